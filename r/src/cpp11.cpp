@@ -36,10 +36,10 @@ extern "C" SEXP _minigpkg_gpkg_cpp_guess_schema(SEXP con_sexp, SEXP sql, SEXP ma
   END_CPP11
 }
 // gpkg.cpp
-int gpkg_cpp_query(cpp11::sexp con_sexp, std::string sql, sexp schema_xptr, sexp array_xptr);
-extern "C" SEXP _minigpkg_gpkg_cpp_query(SEXP con_sexp, SEXP sql, SEXP schema_xptr, SEXP array_xptr) {
+int gpkg_cpp_query(cpp11::sexp con_sexp, std::string sql, double max_guess, sexp schema_xptr, sexp array_xptr);
+extern "C" SEXP _minigpkg_gpkg_cpp_query(SEXP con_sexp, SEXP sql, SEXP max_guess, SEXP schema_xptr, SEXP array_xptr) {
   BEGIN_CPP11
-    return cpp11::as_sexp(gpkg_cpp_query(cpp11::as_cpp<cpp11::decay_t<cpp11::sexp>>(con_sexp), cpp11::as_cpp<cpp11::decay_t<std::string>>(sql), cpp11::as_cpp<cpp11::decay_t<sexp>>(schema_xptr), cpp11::as_cpp<cpp11::decay_t<sexp>>(array_xptr)));
+    return cpp11::as_sexp(gpkg_cpp_query(cpp11::as_cpp<cpp11::decay_t<cpp11::sexp>>(con_sexp), cpp11::as_cpp<cpp11::decay_t<std::string>>(sql), cpp11::as_cpp<cpp11::decay_t<double>>(max_guess), cpp11::as_cpp<cpp11::decay_t<sexp>>(schema_xptr), cpp11::as_cpp<cpp11::decay_t<sexp>>(array_xptr)));
   END_CPP11
 }
 
@@ -49,7 +49,7 @@ static const R_CallMethodDef CallEntries[] = {
     {"_minigpkg_gpkg_cpp_exec",         (DL_FUNC) &_minigpkg_gpkg_cpp_exec,         2},
     {"_minigpkg_gpkg_cpp_guess_schema", (DL_FUNC) &_minigpkg_gpkg_cpp_guess_schema, 4},
     {"_minigpkg_gpkg_cpp_open",         (DL_FUNC) &_minigpkg_gpkg_cpp_open,         1},
-    {"_minigpkg_gpkg_cpp_query",        (DL_FUNC) &_minigpkg_gpkg_cpp_query,        4},
+    {"_minigpkg_gpkg_cpp_query",        (DL_FUNC) &_minigpkg_gpkg_cpp_query,        5},
     {NULL, NULL, 0}
 };
 }
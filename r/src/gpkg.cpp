@@ -85,146 +85,49 @@ int gpkg_cpp_exec(cpp11::sexp con_sexp, std::string sql) {
   return result;
 }
 
-static int sqlite_type2(int current_type, int new_type) {
-  switch (current_type) {
-  case SQLITE_NULL:
-    switch (new_type) {
-      case SQLITE_NULL:
-        return current_type;
-      case SQLITE_INTEGER:
-      case SQLITE_FLOAT:
-      case SQLITE_TEXT:
-      case SQLITE_BLOB:
-        return new_type;
-    }
-  case SQLITE_INTEGER:
-    switch (new_type) {
-      case SQLITE_NULL:
-      case SQLITE_INTEGER:
-        return current_type;
-      case SQLITE_FLOAT:
-      case SQLITE_TEXT:
-      case SQLITE_BLOB:
-        return new_type;
-    }
-  case SQLITE_FLOAT:
-    switch (new_type) {
-      case SQLITE_NULL:
-      case SQLITE_INTEGER:
-      case SQLITE_FLOAT:
-        return current_type;
-      case SQLITE_TEXT:
-      case SQLITE_BLOB:
-        return new_type;
-    }
-  case SQLITE_TEXT:
-    switch (new_type) {
-      case SQLITE_NULL:
-      case SQLITE_INTEGER:
-      case SQLITE_FLOAT:
-      case SQLITE_TEXT:
-        return current_type;
-      case SQLITE_BLOB:
-        return new_type;
-    }
-  case SQLITE_BLOB:
-    switch (new_type) {
-      case SQLITE_NULL:
-      case SQLITE_INTEGER:
-      case SQLITE_FLOAT:
-      case SQLITE_TEXT:
-      case SQLITE_BLOB:
-        return current_type;
-    }
+static void gpkg_set_guess_rows(SQLite3Result& arrow_result, double max_guess) {
+  if (max_guess < 1) {
+    max_guess = 1;
   }
 
-  return current_type;
+  int result = ArrowSQLite3ResultSetGuessRows(arrow_result.get(), max_guess);
+  if (result != 0) {
+    stop("<ArrowSQLite3ResultSetGuessRows> %s\n",
+         ArrowSQLite3ResultError(arrow_result.get()));
+  }
 }
 
 [[cpp11::register]]
 void gpkg_cpp_guess_schema(cpp11::sexp con_sexp, std::string sql, double max_guess,
                            sexp schema_xptr) {
-  if (max_guess == 0) {
-    return;
-  }
-
   external_pointer<GPKGConnection> con(con_sexp);
   auto schema = reinterpret_cast<struct ArrowSchema*>(R_ExternalPtrAddr(schema_xptr));
 
   GPKGStmt stmt;
+  SQLite3Result arrow_result;
+  gpkg_set_guess_rows(arrow_result, max_guess);
+
   const char* tail;
   int result = sqlite3_prepare_v2(con->ptr, sql.data(), sql.size(), &stmt.ptr, &tail);
   if (result != SQLITE_OK) {
     stop("<%s> %s\n", sqlite3_errstr(result), sqlite3_errmsg(con->ptr));
   }
 
-  int64_t row_id = 0;
-  int64_t n_cols;
-  std::vector<std::string> names;
-  std::vector<int> sqlite_types;
-
-  // step once to initialize sqlite_types
-  result = sqlite3_step(stmt.ptr);
-  row_id++;
-  if (result != SQLITE_ROW && result != SQLITE_DONE) {
-    stop("<%s> %s\n", sqlite3_errstr(result), sqlite3_errmsg(con->ptr));
-  }
-
-  n_cols = sqlite3_column_count(stmt.ptr);
-  names.resize(n_cols);
-  sqlite_types.resize(n_cols);
-  for (int64_t i = 0; i < n_cols; i++) {
-    names[i] = sqlite3_column_name(stmt.ptr, i);
-    sqlite_types[i] = sqlite3_column_type(stmt.ptr, i);
-  }
-
-  // step the rest of the times
-  while (row_id < max_guess && result == SQLITE_ROW) {
-    result = sqlite3_step(stmt.ptr);
-    if (result != SQLITE_ROW && result != SQLITE_DONE) {
-      stop("<%s> %s\n", sqlite3_errstr(result), sqlite3_errmsg(con->ptr));
-    }
-
-    for (int64_t i = 0; i < n_cols; i++) {
-      sqlite_types[i] = sqlite_type2(
-        sqlite_types[i],
-        sqlite3_column_type(stmt.ptr, i)
-      );
-    }
-
-    row_id++;
+  // The first step buffers up to max_guess rows and computes the schema
+  result = ArrowSQLite3ResultStep(arrow_result.get(), stmt.ptr);
+  if (result != 0) {
+    stop("<ArrowSQLite3ResultStep> %s\n", ArrowSQLite3ResultError(arrow_result.get()));
   }
 
-  // Calculate the schema
-  ArrowSchemaInit(schema, NANOARROW_TYPE_STRUCT);
-  ArrowSchemaAllocateChildren(schema, n_cols);
-  ArrowSchemaSetName(schema, "");
-
-  for (int64_t i = 0; i < n_cols; i++) {
-    switch (sqlite_types[i]) {
-      case SQLITE_NULL:
-        ArrowSchemaInit(schema->children[i], NANOARROW_TYPE_BOOL);
-        break;
-      case SQLITE_INTEGER:
-        ArrowSchemaInit(schema->children[i], NANOARROW_TYPE_INT64);
-        break;
-      case SQLITE_FLOAT:
-        ArrowSchemaInit(schema->children[i], NANOARROW_TYPE_DOUBLE);
-        break;
-      case SQLITE_TEXT:
-        ArrowSchemaInit(schema->children[i], NANOARROW_TYPE_STRING);
-        break;
-      case SQLITE_BLOB:
-        ArrowSchemaInit(schema->children[i], NANOARROW_TYPE_BINARY);
-        break;
-    }
-
-    ArrowSchemaSetName(schema->children[i], names[i].c_str());
+  result = ArrowSQLite3ResultFinishSchema(arrow_result.get(), schema);
+  if (result != 0) {
+    stop("<ArrowSQLite3ResultFinishSchema> %s\n",
+         ArrowSQLite3ResultError(arrow_result.get()));
   }
 }
 
 [[cpp11::register]]
-int gpkg_cpp_query(cpp11::sexp con_sexp, std::string sql,
+int gpkg_cpp_query(cpp11::sexp con_sexp, std::string sql, double max_guess,
                    sexp schema_xptr, sexp array_xptr) {
   external_pointer<GPKGConnection> con(con_sexp);
   auto schema = reinterpret_cast<struct ArrowSchema*>(R_ExternalPtrAddr(schema_xptr));
@@ -240,6 +143,8 @@ int gpkg_cpp_query(cpp11::sexp con_sexp, std::string sql,
       stop("<ArrowSQLite3ResultSetSchema> %s\n",
            ArrowSQLite3ResultError(arrow_result.get()));
     }
+  } else {
+    gpkg_set_guess_rows(arrow_result, max_guess);
   }
 
   const char* tail;
@@ -249,14 +154,16 @@ int gpkg_cpp_query(cpp11::sexp con_sexp, std::string sql,
   }
 
   int64_t row_id = 0;
+  int64_t rows_appended;
   do {
-    result = ArrowSQLite3ResultStep(arrow_result.get(), stmt.ptr);
+    result = ArrowSQLite3ResultStepN(arrow_result.get(), stmt.ptr, 65536, &rows_appended);
+    row_id += rows_appended;
     if (result != 0) {
       stop("<ArrowSQLite3ResultError on row %ld> %s\n", (long)row_id,
              ArrowSQLite3ResultError(arrow_result.get()));
     }
 
-    row_id++;
+    check_user_interrupt();
   } while (arrow_result.get()->step_return_code == SQLITE_ROW);
 
   result = ArrowSQLite3ResultFinishSchema(arrow_result.get(), schema);
@@ -0,0 +1,5302 @@
+
+#include <ctype.h>
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <sqlite3.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "nanoarrow.h"
+
+#include "nanoarrow_gpkg.h"
+
+static int ArrowGPKGGeometryColumnName(sqlite3* con, const char* table_name,
+                                       char** column_name_out) {
+  *column_name_out = NULL;
+
+  sqlite3_stmt* stmt;
+  int result = sqlite3_prepare_v2(
+      con, "SELECT column_name FROM gpkg_geometry_columns WHERE table_name = ?", -1,
+      &stmt, NULL);
+  if (result != SQLITE_OK) {
+    // Not a GeoPackage (or not one with any geometry columns)
+    return ENOENT;
+  }
+
+  sqlite3_bind_text(stmt, 1, table_name, -1, SQLITE_STATIC);
+  if (sqlite3_step(stmt) == SQLITE_ROW) {
+    *column_name_out = sqlite3_mprintf("%s", sqlite3_column_text(stmt, 0));
+    result = *column_name_out == NULL ? ENOMEM : 0;
+  } else {
+    result = ENOENT;
+  }
+
+  sqlite3_finalize(stmt);
+  return result;
+}
+
+int ArrowGPKGSelectColumnsSQL(sqlite3* con, const char* table_name,
+                              const char** exclude_columns, int64_t n_exclude,
+                              int exclude_geometry, char** sql_out,
+                              struct ArrowSQLite3Error* error) {
+  struct ArrowError* arrow_error = (struct ArrowError*)error;
+
+  char* geometry_column = NULL;
+  if (exclude_geometry) {
+    int result = ArrowGPKGGeometryColumnName(con, table_name, &geometry_column);
+    if (result != 0 && result != ENOENT) {
+      return result;
+    }
+  }
+
+  sqlite3_stmt* stmt;
+  int result =
+      sqlite3_prepare_v2(con, "SELECT name FROM pragma_table_info(?)", -1, &stmt, NULL);
+  if (result != SQLITE_OK) {
+    ArrowErrorSet(arrow_error, "<%s> %s", sqlite3_errstr(result), sqlite3_errmsg(con));
+    sqlite3_free(geometry_column);
+    return EIO;
+  }
+
+  sqlite3_bind_text(stmt, 1, table_name, -1, SQLITE_STATIC);
+
+  sqlite3_str* sql = sqlite3_str_new(con);
+  sqlite3_str_appendall(sql, "SELECT ");
+  int64_t n_table_columns = 0;
+  int64_t n_selected = 0;
+
+  while ((result = sqlite3_step(stmt)) == SQLITE_ROW) {
+    const char* name = (const char*)sqlite3_column_text(stmt, 0);
+    n_table_columns++;
+
+    int skip = geometry_column != NULL && sqlite3_stricmp(name, geometry_column) == 0;
+    for (int64_t i = 0; i < n_exclude && !skip; i++) {
+      skip = sqlite3_stricmp(name, exclude_columns[i]) == 0;
+    }
+
+    if (skip) {
+      continue;
+    }
+
+    sqlite3_str_appendf(sql, "%s\"%w\"", n_selected > 0 ? ", " : "", name);
+    n_selected++;
+  }
+
+  sqlite3_finalize(stmt);
+  sqlite3_free(geometry_column);
+
+  if (result != SQLITE_DONE) {
+    ArrowErrorSet(arrow_error, "<%s> %s", sqlite3_errstr(result), sqlite3_errmsg(con));
+    sqlite3_free(sqlite3_str_finish(sql));
+    return EIO;
+  }
+
+  if (n_table_columns == 0) {
+    ArrowErrorSet(arrow_error, "Table '%s' does not exist", table_name);
+    sqlite3_free(sqlite3_str_finish(sql));
+    return ENOENT;
+  }
+
+  if (n_selected == 0) {
+    ArrowErrorSet(arrow_error, "All columns of table '%s' were excluded", table_name);
+    sqlite3_free(sqlite3_str_finish(sql));
+    return EINVAL;
+  }
+
+  sqlite3_str_appendf(sql, " FROM \"%w\"", table_name);
+  if (sqlite3_str_errcode(sql) != SQLITE_OK) {
+    sqlite3_free(sqlite3_str_finish(sql));
+    return ENOMEM;
+  }
+
+  *sql_out = sqlite3_str_finish(sql);
+  return 0;
+}
+
+static int ArrowGPKGIsLittleEndian(void) {
+  uint16_t one = 1;
+  return *((uint8_t*)&one) == 1;
+}
+
+static void ArrowGPKGReadValue(const uint8_t* data, void* out, int64_t size, int swap) {
+  if (swap) {
+    uint8_t* out_bytes = (uint8_t*)out;
+    for (int64_t i = 0; i < size; i++) {
+      out_bytes[i] = data[size - i - 1];
+    }
+  } else {
+    memcpy(out, data, size);
+  }
+}
+
+int ArrowGPKGParseHeader(const uint8_t* data, int64_t size, struct ArrowGPKGHeader* out,
+                         struct ArrowSQLite3Error* error) {
+  struct ArrowError* arrow_error = (struct ArrowError*)error;
+
+  if (size < 8) {
+    ArrowErrorSet(arrow_error, "Expected geometry blob of at least 8 bytes but got %ld",
+                  (long)size);
+    return EINVAL;
+  }
+
+  if (data[0] != 'G' || data[1] != 'P') {
+    ArrowErrorSet(arrow_error, "Expected geometry blob with magic 'GP'");
+    return EINVAL;
+  }
+
+  if (data[2] != 0) {
+    ArrowErrorSet(arrow_error, "Unsupported geometry blob version %d", (int)data[2]);
+    return EINVAL;
+  }
+
+  uint8_t flags = data[3];
+  int swap = (flags & 0x01) != ArrowGPKGIsLittleEndian();
+  out->envelope_type = (flags >> 1) & 0x07;
+  out->empty = (flags >> 4) & 0x01;
+  ArrowGPKGReadValue(data + 4, &out->srs_id, sizeof(int32_t), swap);
+
+  // The number of doubles in the envelope and where z and m bounds start
+  int n_bounds;
+  int z_offset = -1;
+  int m_offset = -1;
+  switch (out->envelope_type) {
+    case 0:
+      n_bounds = 0;
+      break;
+    case 1:
+      n_bounds = 4;
+      break;
+    case 2:
+      n_bounds = 6;
+      z_offset = 4;
+      break;
+    case 3:
+      n_bounds = 6;
+      m_offset = 4;
+      break;
+    case 4:
+      n_bounds = 8;
+      z_offset = 4;
+      m_offset = 6;
+      break;
+    default:
+      ArrowErrorSet(arrow_error, "Invalid geometry blob envelope indicator %d",
+                    out->envelope_type);
+      return EINVAL;
+  }
+
+  out->header_size = 8 + n_bounds * sizeof(double);
+  if (size < out->header_size) {
+    ArrowErrorSet(arrow_error,
+                  "Expected geometry blob of at least %ld bytes but got %ld",
+                  (long)out->header_size, (long)size);
+    return EINVAL;
+  }
+
+  for (int i = 0; i < 8; i++) {
+    out->envelope[i] = NAN;
+  }
+
+  const uint8_t* bounds = data + 8;
+  for (int i = 0; i < 4 && n_bounds > 0; i++) {
+    ArrowGPKGReadValue(bounds + i * sizeof(double), out->envelope + i, sizeof(double),
+                       swap);
+  }
+
+  for (int i = 0; i < 2; i++) {
+    if (z_offset >= 0) {
+      ArrowGPKGReadValue(bounds + (z_offset + i) * sizeof(double), out->envelope + 4 + i,
+                         sizeof(double), swap);
+    }
+
+    if (m_offset >= 0) {
+      ArrowGPKGReadValue(bounds + (m_offset + i) * sizeof(double), out->envelope + 6 + i,
+                         sizeof(double), swap);
+    }
+  }
+
+  return 0;
+}
+
+struct ArrowGPKGWKBReader {
+  const uint8_t* data;
+  int64_t size;
+  int64_t pos;
+  int swap;
+};
+
+static int ArrowGPKGReadUInt32(struct ArrowGPKGWKBReader* reader, uint32_t* out) {
+  if ((reader->size - reader->pos) < (int64_t)sizeof(uint32_t)) {
+    return EINVAL;
+  }
+
+  ArrowGPKGReadValue(reader->data + reader->pos, out, sizeof(uint32_t), reader->swap);
+  reader->pos += sizeof(uint32_t);
+  return NANOARROW_OK;
+}
+
+// Read the byte order and geometry type at the start of a (nested) WKB geometry
+static int ArrowGPKGReadWKBType(struct ArrowGPKGWKBReader* reader,
+                                uint32_t* geometry_type_out, int* has_z_out,
+                                int* has_m_out) {
+  if (reader->pos >= reader->size || reader->data[reader->pos] > 1) {
+    return EINVAL;
+  }
+
+  reader->swap = reader->data[reader->pos] != ArrowGPKGIsLittleEndian();
+  reader->pos++;
+
+  uint32_t code;
+  NANOARROW_RETURN_NOT_OK(ArrowGPKGReadUInt32(reader, &code));
+
+  // ISO WKB codes (e.g., 1003 for a polygon z) or EWKB flags for z and m
+  int has_z = (code & 0x80000000) != 0;
+  int has_m = (code & 0x40000000) != 0;
+  code &= 0x0000ffff;
+  switch (code / 1000) {
+    case 1:
+      has_z = 1;
+      break;
+    case 2:
+      has_m = 1;
+      break;
+    case 3:
+      has_z = 1;
+      has_m = 1;
+      break;
+    default:
+      break;
+  }
+
+  *geometry_type_out = code % 1000;
+  *has_z_out = has_z;
+  *has_m_out = has_m;
+  return NANOARROW_OK;
+}
+
+// Nested geometry collections deeper than this are considered invalid
+#define ARROW_GPKG_MAX_WKB_DEPTH 32
+
+struct ArrowGPKGEnvelopeBuilder {
+  // Laid out like ArrowGPKGHeader::envelope
+  double bounds[8];
+  int has_z;
+  int has_m;
+};
+
+static int ArrowGPKGEnvelopeCoords(struct ArrowGPKGWKBReader* reader,
+                                   struct ArrowGPKGEnvelopeBuilder* builder, int has_z,
+                                   int has_m, int64_t n_coords) {
+  int n_dims = 2 + has_z + has_m;
+  int64_t n_bytes = n_coords * n_dims * sizeof(double);
+  if (n_coords > (reader->size - reader->pos) || (reader->size - reader->pos) < n_bytes) {
+    return EINVAL;
+  }
+
+  // The index of the minimum bound for each dimension of a coordinate
+  int bound[4] = {0, 2, has_z ? 4 : 6, 6};
+
+  // NaN ordinates (e.g., of an empty point) never update a bound
+  const uint8_t* data = reader->data + reader->pos;
+  double* bounds = builder->bounds;
+  double value;
+  for (int64_t i = 0; i < n_coords; i++) {
+    for (int j = 0; j < n_dims; j++) {
+      ArrowGPKGReadValue(data, &value, sizeof(double), reader->swap);
+      data += sizeof(double);
+      if (value < bounds[bound[j]]) {
+        bounds[bound[j]] = value;
+      }
+
+      if (value > bounds[bound[j] + 1]) {
+        bounds[bound[j] + 1] = value;
+      }
+    }
+  }
+
+  reader->pos += n_bytes;
+  return NANOARROW_OK;
+}
+
+static int ArrowGPKGEnvelopeGeometry(struct ArrowGPKGWKBReader* reader,
+                                     struct ArrowGPKGEnvelopeBuilder* builder,
+                                     int depth) {
+  uint32_t geometry_type;
+  int has_z;
+  int has_m;
+  NANOARROW_RETURN_NOT_OK(ArrowGPKGReadWKBType(reader, &geometry_type, &has_z, &has_m));
+  builder->has_z |= has_z;
+  builder->has_m |= has_m;
+
+  uint32_t n;
+  switch (geometry_type) {
+    case 1:
+      return ArrowGPKGEnvelopeCoords(reader, builder, has_z, has_m, 1);
+    case 2:
+      NANOARROW_RETURN_NOT_OK(ArrowGPKGReadUInt32(reader, &n));
+      return ArrowGPKGEnvelopeCoords(reader, builder, has_z, has_m, n);
+    case 3: {
+      uint32_t n_rings;
+      NANOARROW_RETURN_NOT_OK(ArrowGPKGReadUInt32(reader, &n_rings));
+      for (uint32_t i = 0; i < n_rings; i++) {
+        NANOARROW_RETURN_NOT_OK(ArrowGPKGReadUInt32(reader, &n));
+        NANOARROW_RETURN_NOT_OK(
+            ArrowGPKGEnvelopeCoords(reader, builder, has_z, has_m, n));
+      }
+
+      return NANOARROW_OK;
+    }
+    case 4:
+    case 5:
+    case 6:
+    case 7:
+      // Multi geometries and geometry collections are sequences of geometries
+      if (depth >= ARROW_GPKG_MAX_WKB_DEPTH) {
+        return EINVAL;
+      }
+
+      NANOARROW_RETURN_NOT_OK(ArrowGPKGReadUInt32(reader, &n));
+      for (uint32_t i = 0; i < n; i++) {
+        NANOARROW_RETURN_NOT_OK(ArrowGPKGEnvelopeGeometry(reader, builder, depth + 1));
+      }
+
+      return NANOARROW_OK;
+    default:
+      return EINVAL;
+  }
+}
+
+int ArrowGPKGWKBEnvelope(const uint8_t* data, int64_t size, struct ArrowGPKGHeader* out,
+                         struct ArrowSQLite3Error* error) {
+  struct ArrowError* arrow_error = (struct ArrowError*)error;
+
+  struct ArrowGPKGEnvelopeBuilder builder;
+  for (int i = 0; i < 8; i += 2) {
+    builder.bounds[i] = INFINITY;
+    builder.bounds[i + 1] = -INFINITY;
+  }
+  builder.has_z = 0;
+  builder.has_m = 0;
+
+  struct ArrowGPKGWKBReader reader;
+  reader.data = data;
+  reader.size = size;
+  reader.pos = 0;
+  reader.swap = 0;
+
+  if (ArrowGPKGEnvelopeGeometry(&reader, &builder, 0) != NANOARROW_OK) {
+    ArrowErrorSet(arrow_error, "Invalid WKB geometry at byte %ld", (long)reader.pos);
+    return EINVAL;
+  }
+
+  // Bounds that were never updated (e.g., all NaN) are NaN like the bounds of an
+  // envelope-less header
+  for (int i = 0; i < 8; i += 2) {
+    if (builder.bounds[i] > builder.bounds[i + 1]) {
+      builder.bounds[i] = NAN;
+      builder.bounds[i + 1] = NAN;
+    }
+  }
+
+  memcpy(out->envelope, builder.bounds, sizeof(builder.bounds));
+  out->empty = isnan(builder.bounds[0]);
+  if (out->empty) {
+    out->envelope_type = 0;
+  } else {
+    out->envelope_type = 1 + builder.has_z + 2 * builder.has_m;
+  }
+
+  return NANOARROW_OK;
+}
+
+// Decode the header of a geometry blob, computing the envelope from the WKB if the
+// header doesn't have one
+static int ArrowGPKGBlobEnvelope(const uint8_t* data, int64_t size,
+                                 struct ArrowGPKGHeader* header,
+                                 struct ArrowSQLite3Error* error) {
+  NANOARROW_RETURN_NOT_OK(ArrowGPKGParseHeader(data, size, header, error));
+  if (header->envelope_type != 0 || header->empty) {
+    return NANOARROW_OK;
+  }
+
+  return ArrowGPKGWKBEnvelope(data + header->header_size, size - header->header_size,
+                              header, error);
+}
+
+static const char* kArrowGPKGBoundNames[] = {"xmin", "xmax", "ymin", "ymax",
+                                             "zmin", "zmax", "mmin", "mmax"};
+
+// Initialize the srs_id, empty, and bound fields of a decoded header
+static int ArrowGPKGInitHeaderSchema(struct ArrowSchema** children) {
+  NANOARROW_RETURN_NOT_OK(ArrowSchemaInit(children[0], NANOARROW_TYPE_INT32));
+  NANOARROW_RETURN_NOT_OK(ArrowSchemaSetName(children[0], "srs_id"));
+  NANOARROW_RETURN_NOT_OK(ArrowSchemaInit(children[1], NANOARROW_TYPE_BOOL));
+  NANOARROW_RETURN_NOT_OK(ArrowSchemaSetName(children[1], "empty"));
+
+  for (int i = 0; i < 8; i++) {
+    NANOARROW_RETURN_NOT_OK(ArrowSchemaInit(children[2 + i], NANOARROW_TYPE_DOUBLE));
+    NANOARROW_RETURN_NOT_OK(ArrowSchemaSetName(children[2 + i], kArrowGPKGBoundNames[i]));
+  }
+
+  return NANOARROW_OK;
+}
+
+// Append a decoded header to the arrays initialized by ArrowGPKGInitHeaderSchema()
+static int ArrowGPKGAppendHeader(struct ArrowArray** children,
+                                 const struct ArrowGPKGHeader* header) {
+  NANOARROW_RETURN_NOT_OK(ArrowArrayAppendInt(children[0], header->srs_id));
+  NANOARROW_RETURN_NOT_OK(ArrowArrayAppendUInt(children[1], header->empty));
+
+  for (int j = 0; j < 8; j++) {
+    // Bounds that are not part of the envelope are null (but bounds of an empty
+    // geometry stay NaN)
+    if ((j < 4 && header->envelope_type == 0) ||
+        (j >= 4 && j < 6 && header->envelope_type != 2 && header->envelope_type != 4) ||
+        (j >= 6 && header->envelope_type != 3 && header->envelope_type != 4)) {
+      NANOARROW_RETURN_NOT_OK(ArrowArrayAppendNull(children[2 + j], 1));
+    } else {
+      NANOARROW_RETURN_NOT_OK(
+          ArrowArrayAppendDouble(children[2 + j], header->envelope[j]));
+    }
+  }
+
+  return NANOARROW_OK;
+}
+
+static int ArrowGPKGGeometryInitSchema(struct ArrowSQLite3ColumnHandler* handler,
+                                       const char* name, struct ArrowSchema* schema_out) {
+  NANOARROW_RETURN_NOT_OK(ArrowSchemaInit(schema_out, NANOARROW_TYPE_STRUCT));
+  NANOARROW_RETURN_NOT_OK(ArrowSchemaSetName(schema_out, name));
+  NANOARROW_RETURN_NOT_OK(ArrowSchemaAllocateChildren(schema_out, 11));
+  NANOARROW_RETURN_NOT_OK(ArrowGPKGInitHeaderSchema(schema_out->children));
+  NANOARROW_RETURN_NOT_OK(
+      ArrowSchemaInit(schema_out->children[10], NANOARROW_TYPE_BINARY));
+  NANOARROW_RETURN_NOT_OK(ArrowSchemaSetName(schema_out->children[10], "wkb"));
+  return NANOARROW_OK;
+}
+
+static int ArrowGPKGGeometryAppend(struct ArrowSQLite3ColumnHandler* handler,
+                                   struct ArrowArray* array, sqlite3_stmt* stmt, int i,
+                                   int value_type, int64_t* variable_bytes) {
+  switch (value_type) {
+    case SQLITE_NULL:
+      return ArrowArrayAppendNull(array, 1);
+    case SQLITE_BLOB:
+      break;
+    default:
+      return EINVAL;
+  }
+
+  const uint8_t* data = (const uint8_t*)sqlite3_column_blob(stmt, i);
+  int64_t size = sqlite3_column_bytes(stmt, i);
+
+  struct ArrowGPKGHeader header;
+  NANOARROW_RETURN_NOT_OK(ArrowGPKGBlobEnvelope(data, size, &header, NULL));
+
+  NANOARROW_RETURN_NOT_OK(ArrowGPKGAppendHeader(array->children, &header));
+
+  struct ArrowBufferView wkb;
+  wkb.data.as_uint8 = data + header.header_size;
+  wkb.n_bytes = size - header.header_size;
+  NANOARROW_RETURN_NOT_OK(ArrowArrayAppendBytes(array->children[10], wkb));
+  *variable_bytes += wkb.n_bytes;
+
+  return ArrowArrayFinishElement(array);
+}
+
+static void ArrowGPKGGeometryRelease(struct ArrowSQLite3ColumnHandler* handler) {
+  handler->release = NULL;
+}
+
+int ArrowGPKGGeometryHandlerInit(struct ArrowSQLite3ColumnHandler* handler) {
+  handler->init_schema = &ArrowGPKGGeometryInitSchema;
+  handler->append = &ArrowGPKGGeometryAppend;
+  handler->release = &ArrowGPKGGeometryRelease;
+  handler->private_data = NULL;
+  return 0;
+}
+
+struct ArrowGPKGEnvelopeStreamPrivate {
+  sqlite3* con;
+  sqlite3_stmt* stmt;
+  sqlite3_blob* blob;
+  char* table_name;
+  char* column_name;
+  int64_t batch_rows;
+  int done;
+  struct ArrowBuffer wkb;
+  struct ArrowSchema schema;
+  struct ArrowError error;
+};
+
+// The 8 byte header plus the largest (xyzm) envelope
+#define ARROW_GPKG_MAX_HEADER_SIZE (8 + 8 * sizeof(double))
+
+static int ArrowGPKGEnvelopeStreamGetSchema(struct ArrowArrayStream* stream,
+                                            struct ArrowSchema* out) {
+  struct ArrowGPKGEnvelopeStreamPrivate* private_data =
+      (struct ArrowGPKGEnvelopeStreamPrivate*)stream->private_data;
+  return ArrowSchemaDeepCopy(&private_data->schema, out);
+}
+
+// Read the header of the geometry blob in the given row without touching any
+// overflow pages beyond the ones that contain the header (unless the envelope has to
+// be computed from the WKB)
+static int ArrowGPKGEnvelopeStreamReadHeader(
+    struct ArrowGPKGEnvelopeStreamPrivate* private_data, sqlite3_int64 rowid,
+    struct ArrowGPKGHeader* header) {
+  int result;
+  if (private_data->blob == NULL) {
+    result = sqlite3_blob_open(private_data->con, "main", private_data->table_name,
+                               private_data->column_name, rowid, 0, &private_data->blob);
+  } else {
+    result = sqlite3_blob_reopen(private_data->blob, rowid);
+  }
+
+  if (result != SQLITE_OK) {
+    ArrowErrorSet(&private_data->error, "<%s> %s", sqlite3_errstr(result),
+                  sqlite3_errmsg(private_data->con));
+    return EIO;
+  }
+
+  uint8_t data[ARROW_GPKG_MAX_HEADER_SIZE];
+  int size = sqlite3_blob_bytes(private_data->blob);
+  if (size > (int)sizeof(data)) {
+    size = sizeof(data);
+  }
+
+  result = sqlite3_blob_read(private_data->blob, data, size, 0);
+  if (result != SQLITE_OK) {
+    ArrowErrorSet(&private_data->error, "<%s> %s", sqlite3_errstr(result),
+                  sqlite3_errmsg(private_data->con));
+    return EIO;
+  }
+
+  struct ArrowSQLite3Error* error = (struct ArrowSQLite3Error*)&private_data->error;
+  NANOARROW_RETURN_NOT_OK(ArrowGPKGParseHeader(data, size, header, error));
+  if (header->envelope_type != 0 || header->empty) {
+    return NANOARROW_OK;
+  }
+
+  // Without an envelope in the header we have to read the whole geometry
+  size = sqlite3_blob_bytes(private_data->blob);
+  NANOARROW_RETURN_NOT_OK(ArrowBufferResize(&private_data->wkb, size, 0));
+  result = sqlite3_blob_read(private_data->blob, private_data->wkb.data, size, 0);
+  if (result != SQLITE_OK) {
+    ArrowErrorSet(&private_data->error, "<%s> %s", sqlite3_errstr(result),
+                  sqlite3_errmsg(private_data->con));
+    return EIO;
+  }
+
+  return ArrowGPKGBlobEnvelope(private_data->wkb.data, size, header, error);
+}
+
+static int ArrowGPKGEnvelopeStreamAppendRows(
+    struct ArrowGPKGEnvelopeStreamPrivate* private_data, struct ArrowArray* array) {
+  struct ArrowGPKGHeader header;
+
+  while (array->length < private_data->batch_rows) {
+    int result = sqlite3_step(private_data->stmt);
+    if (result == SQLITE_DONE) {
+      private_data->done = 1;
+      break;
+    } else if (result != SQLITE_ROW) {
+      ArrowErrorSet(&private_data->error, "<%s> %s", sqlite3_errstr(result),
+                    sqlite3_errmsg(private_data->con));
+      return EIO;
+    }
+
+    sqlite3_int64 rowid = sqlite3_column_int64(private_data->stmt, 0);
+    NANOARROW_RETURN_NOT_OK(ArrowArrayAppendInt(array->children[0], rowid));
+
+    // Geometries that are NULL (or not blobs) have an all-null envelope
+    if (sqlite3_column_int(private_data->stmt, 1)) {
+      NANOARROW_RETURN_NOT_OK(
+          ArrowGPKGEnvelopeStreamReadHeader(private_data, rowid, &header));
+      NANOARROW_RETURN_NOT_OK(ArrowGPKGAppendHeader(array->children + 1, &header));
+    } else {
+      for (int64_t i = 1; i < array->n_children; i++) {
+        NANOARROW_RETURN_NOT_OK(ArrowArrayAppendNull(array->children[i], 1));
+      }
+    }
+
+    NANOARROW_RETURN_NOT_OK(ArrowArrayFinishElement(array));
+  }
+
+  return NANOARROW_OK;
+}
+
+static int ArrowGPKGEnvelopeStreamGetNext(struct ArrowArrayStream* stream,
+                                          struct ArrowArray* out) {
+  struct ArrowGPKGEnvelopeStreamPrivate* private_data =
+      (struct ArrowGPKGEnvelopeStreamPrivate*)stream->private_data;
+
+  out->release = NULL;
+  if (private_data->done) {
+    return NANOARROW_OK;
+  }
+
+  struct ArrowArray array;
+  NANOARROW_RETURN_NOT_OK(
+      ArrowArrayInitFromSchema(&array, &private_data->schema, &private_data->error));
+
+  int result = ArrowArrayStartAppending(&array);
+  if (result == NANOARROW_OK) {
+    result = ArrowGPKGEnvelopeStreamAppendRows(private_data, &array);
+  }
+
+  if (result == NANOARROW_OK && array.length > 0) {
+    result = ArrowArrayFinishBuilding(&array, &private_data->error);
+  }
+
+  if (result != NANOARROW_OK || array.length == 0) {
+    array.release(&array);
+    return result;
+  }
+
+  memcpy(out, &array, sizeof(struct ArrowArray));
+  return NANOARROW_OK;
+}
+
+static const char* ArrowGPKGEnvelopeStreamGetLastError(struct ArrowArrayStream* stream) {
+  struct ArrowGPKGEnvelopeStreamPrivate* private_data =
+      (struct ArrowGPKGEnvelopeStreamPrivate*)stream->private_data;
+  return private_data->error.message;
+}
+
+static void ArrowGPKGEnvelopeStreamRelease(struct ArrowArrayStream* stream) {
+  struct ArrowGPKGEnvelopeStreamPrivate* private_data =
+      (struct ArrowGPKGEnvelopeStreamPrivate*)stream->private_data;
+
+  if (private_data->blob != NULL) {
+    sqlite3_blob_close(private_data->blob);
+  }
+
+  sqlite3_finalize(private_data->stmt);
+  sqlite3_free(private_data->table_name);
+  sqlite3_free(private_data->column_name);
+  ArrowBufferReset(&private_data->wkb);
+  if (private_data->schema.release != NULL) {
+    private_data->schema.release(&private_data->schema);
+  }
+
+  ArrowFree(private_data);
+  stream->release = NULL;
+}
+
+static int ArrowGPKGEnvelopeStreamInitSchema(struct ArrowSchema* schema) {
+  NANOARROW_RETURN_NOT_OK(ArrowSchemaInit(schema, NANOARROW_TYPE_STRUCT));
+  NANOARROW_RETURN_NOT_OK(ArrowSchemaAllocateChildren(schema, 11));
+  NANOARROW_RETURN_NOT_OK(ArrowSchemaInit(schema->children[0], NANOARROW_TYPE_INT64));
+  NANOARROW_RETURN_NOT_OK(ArrowSchemaSetName(schema->children[0], "rowid"));
+  return ArrowGPKGInitHeaderSchema(schema->children + 1);
+}
+
+int ArrowGPKGEnvelopeStreamInit(struct ArrowArrayStream* stream, sqlite3* con,
+                                const char* table_name, const char* column_name,
+                                int64_t batch_rows, struct ArrowSQLite3Error* error) {
+  struct ArrowError* arrow_error = (struct ArrowError*)error;
+
+  if (batch_rows <= 0) {
+    ArrowErrorSet(arrow_error, "batch_rows must be greater than zero");
+    return EINVAL;
+  }
+
+  struct ArrowGPKGEnvelopeStreamPrivate* private_data =
+      (struct ArrowGPKGEnvelopeStreamPrivate*)ArrowMalloc(
+          sizeof(struct ArrowGPKGEnvelopeStreamPrivate));
+  if (private_data == NULL) {
+    return ENOMEM;
+  }
+
+  memset(private_data, 0, sizeof(struct ArrowGPKGEnvelopeStreamPrivate));
+  private_data->con = con;
+  private_data->batch_rows = batch_rows;
+  ArrowBufferInit(&private_data->wkb);
+  stream->private_data = private_data;
+  stream->get_schema = &ArrowGPKGEnvelopeStreamGetSchema;
+  stream->get_next = &ArrowGPKGEnvelopeStreamGetNext;
+  stream->get_last_error = &ArrowGPKGEnvelopeStreamGetLastError;
+  stream->release = &ArrowGPKGEnvelopeStreamRelease;
+
+  int result;
+  if (column_name == NULL) {
+    result = ArrowGPKGGeometryColumnName(con, table_name, &private_data->column_name);
+    if (result == ENOENT) {
+      ArrowErrorSet(arrow_error, "Table '%s' has no registered geometry column",
+                    table_name);
+    }
+  } else {
+    private_data->column_name = sqlite3_mprintf("%s", column_name);
+    result = private_data->column_name == NULL ? ENOMEM : 0;
+  }
+
+  private_data->table_name = sqlite3_mprintf("%s", table_name);
+  if (result == 0 && private_data->table_name == NULL) {
+    result = ENOMEM;
+  }
+
+  if (result != 0) {
+    stream->release(stream);
+    return result;
+  }
+
+  // typeof() lets SQLite check the type of the geometry without loading the blob
+  char* sql = sqlite3_mprintf("SELECT rowid, typeof(\"%w\") = 'blob' FROM \"%w\"",
+                              private_data->column_name, table_name);
+  if (sql == NULL) {
+    stream->release(stream);
+    return ENOMEM;
+  }
+
+  result = sqlite3_prepare_v2(con, sql, -1, &private_data->stmt, NULL);
+  sqlite3_free(sql);
+  if (result != SQLITE_OK) {
+    ArrowErrorSet(arrow_error, "<%s> %s", sqlite3_errstr(result), sqlite3_errmsg(con));
+    stream->release(stream);
+    return EIO;
+  }
+
+  result = ArrowGPKGEnvelopeStreamInitSchema(&private_data->schema);
+  if (result != NANOARROW_OK) {
+    stream->release(stream);
+    return result;
+  }
+
+  return NANOARROW_OK;
+}
+
+// Set the extension name of schema (with empty extension metadata)
+static int ArrowGPKGSetExtensionName(struct ArrowSchema* schema,
+                                     const char* extension_name) {
+  struct ArrowBuffer metadata;
+  NANOARROW_RETURN_NOT_OK(ArrowMetadataBuilderInit(&metadata, NULL));
+  int result = ArrowMetadataBuilderAppend(
+      &metadata, ArrowCharView("ARROW:extension:name"), ArrowCharView(extension_name));
+  if (result == NANOARROW_OK) {
+    result = ArrowMetadataBuilderAppend(
+        &metadata, ArrowCharView("ARROW:extension:metadata"), ArrowCharView("{}"));
+  }
+
+  if (result == NANOARROW_OK) {
+    result = ArrowSchemaSetMetadata(schema, (const char*)metadata.data);
+  }
+
+  ArrowBufferReset(&metadata);
+  return result;
+}
+
+static int ArrowGPKGWKBInitSchema(struct ArrowSQLite3ColumnHandler* handler,
+                                  const char* name, struct ArrowSchema* schema_out) {
+  NANOARROW_RETURN_NOT_OK(ArrowSchemaInit(schema_out, NANOARROW_TYPE_BINARY));
+  NANOARROW_RETURN_NOT_OK(ArrowSchemaSetName(schema_out, name));
+  return ArrowGPKGSetExtensionName(schema_out, "geoarrow.wkb");
+}
+
+static int ArrowGPKGWKBAppend(struct ArrowSQLite3ColumnHandler* handler,
+                              struct ArrowArray* array, sqlite3_stmt* stmt, int i,
+                              int value_type, int64_t* variable_bytes) {
+  switch (value_type) {
+    case SQLITE_NULL:
+      return ArrowArrayAppendNull(array, 1);
+    case SQLITE_BLOB:
+      break;
+    default:
+      return EINVAL;
+  }
+
+  struct ArrowBufferView wkb;
+  wkb.data.as_uint8 = (const uint8_t*)sqlite3_column_blob(stmt, i);
+  wkb.n_bytes = sqlite3_column_bytes(stmt, i);
+
+  // Strip the GeoPackage header (if this isn't already WKB)
+  if (wkb.n_bytes > 0 && wkb.data.as_uint8[0] == 'G') {
+    struct ArrowGPKGHeader header;
+    NANOARROW_RETURN_NOT_OK(
+        ArrowGPKGParseHeader(wkb.data.as_uint8, wkb.n_bytes, &header, NULL));
+    wkb.data.as_uint8 += header.header_size;
+    wkb.n_bytes -= header.header_size;
+  }
+
+  NANOARROW_RETURN_NOT_OK(ArrowArrayAppendBytes(array, wkb));
+  *variable_bytes += wkb.n_bytes;
+  return NANOARROW_OK;
+}
+
+int ArrowGPKGWKBHandlerInit(struct ArrowSQLite3ColumnHandler* handler) {
+  handler->init_schema = &ArrowGPKGWKBInitSchema;
+  handler->append = &ArrowGPKGWKBAppend;
+  handler->release = &ArrowGPKGGeometryRelease;
+  handler->private_data = NULL;
+  return 0;
+}
+
+struct ArrowGPKGGeoArrowHandler {
+  enum ArrowGPKGGeometryType geometry_type;
+  enum ArrowGPKGDimensions dimensions;
+  enum ArrowGPKGCoordType coord_type;
+  int n_dims;
+};
+
+static const char* kArrowGPKGGeoArrowNames[] = {
+    NULL,
+    "geoarrow.point",
+    "geoarrow.linestring",
+    "geoarrow.polygon",
+    "geoarrow.multipoint",
+    "geoarrow.multilinestring",
+    "geoarrow.multipolygon"};
+
+static const char* kArrowGPKGDimensionNames[] = {NULL, "xy", "xyz", "xym", "xyzm"};
+
+static int ArrowGPKGInitCoordSchema(struct ArrowGPKGGeoArrowHandler* private_data,
+                                    struct ArrowSchema* schema) {
+  const char* dims = kArrowGPKGDimensionNames[private_data->dimensions];
+
+  if (private_data->coord_type == ARROW_GPKG_COORD_TYPE_INTERLEAVED) {
+    NANOARROW_RETURN_NOT_OK(ArrowSchemaInitFixedSize(
+        schema, NANOARROW_TYPE_FIXED_SIZE_LIST, private_data->n_dims));
+    NANOARROW_RETURN_NOT_OK(ArrowSchemaAllocateChildren(schema, 1));
+    NANOARROW_RETURN_NOT_OK(ArrowSchemaInit(schema->children[0], NANOARROW_TYPE_DOUBLE));
+    NANOARROW_RETURN_NOT_OK(ArrowSchemaSetName(schema->children[0], dims));
+  } else {
+    NANOARROW_RETURN_NOT_OK(ArrowSchemaInit(schema, NANOARROW_TYPE_STRUCT));
+    NANOARROW_RETURN_NOT_OK(ArrowSchemaAllocateChildren(schema, private_data->n_dims));
+    for (int i = 0; i < private_data->n_dims; i++) {
+      char name[2] = {dims[i], '\0'};
+      NANOARROW_RETURN_NOT_OK(
+          ArrowSchemaInit(schema->children[i], NANOARROW_TYPE_DOUBLE));
+      NANOARROW_RETURN_NOT_OK(ArrowSchemaSetName(schema->children[i], name));
+    }
+  }
+
+  return NANOARROW_OK;
+}
+
+static int ArrowGPKGGeoArrowInitSchema(struct ArrowSQLite3ColumnHandler* handler,
+                                       const char* name, struct ArrowSchema* schema_out) {
+  struct ArrowGPKGGeoArrowHandler* private_data =
+      (struct ArrowGPKGGeoArrowHandler*)handler->private_data;
+
+  // The names of the nested lists from the outside in
+  const char* list_names[3];
+  int n_lists;
+  switch (private_data->geometry_type) {
+    case ARROW_GPKG_GEOMETRY_TYPE_POINT:
+      n_lists = 0;
+      break;
+    case ARROW_GPKG_GEOMETRY_TYPE_LINESTRING:
+      n_lists = 1;
+      list_names[0] = "vertices";
+      break;
+    case ARROW_GPKG_GEOMETRY_TYPE_POLYGON:
+      n_lists = 2;
+      list_names[0] = "rings";
+      list_names[1] = "vertices";
+      break;
+    case ARROW_GPKG_GEOMETRY_TYPE_MULTIPOINT:
+      n_lists = 1;
+      list_names[0] = "points";
+      break;
+    case ARROW_GPKG_GEOMETRY_TYPE_MULTILINESTRING:
+      n_lists = 2;
+      list_names[0] = "linestrings";
+      list_names[1] = "vertices";
+      break;
+    case ARROW_GPKG_GEOMETRY_TYPE_MULTIPOLYGON:
+      n_lists = 3;
+      list_names[0] = "polygons";
+      list_names[1] = "rings";
+      list_names[2] = "vertices";
+      break;
+    default:
+      return EINVAL;
+  }
+
+  struct ArrowSchema* schema = schema_out;
+  for (int i = 0; i < n_lists; i++) {
+    NANOARROW_RETURN_NOT_OK(ArrowSchemaInit(schema, NANOARROW_TYPE_LIST));
+    NANOARROW_RETURN_NOT_OK(ArrowSchemaAllocateChildren(schema, 1));
+    schema = schema->children[0];
+  }
+
+  NANOARROW_RETURN_NOT_OK(ArrowGPKGInitCoordSchema(private_data, schema));
+
+  schema = schema_out;
+  for (int i = 0; i < n_lists; i++) {
+    NANOARROW_RETURN_NOT_OK(ArrowSchemaSetName(schema->children[0], list_names[i]));
+    schema = schema->children[0];
+  }
+
+  NANOARROW_RETURN_NOT_OK(ArrowSchemaSetName(schema_out, name));
+  return ArrowGPKGSetExtensionName(schema_out,
+                                   kArrowGPKGGeoArrowNames[private_data->geometry_type]);
+}
+
+// Read the byte order and geometry type at the start of a (nested) WKB geometry,
+// checking that its dimensions match the output
+static int ArrowGPKGReadWKBHeader(struct ArrowGPKGWKBReader* reader,
+                                  struct ArrowGPKGGeoArrowHandler* private_data,
+                                  uint32_t* geometry_type_out) {
+  int has_z;
+  int has_m;
+  NANOARROW_RETURN_NOT_OK(
+      ArrowGPKGReadWKBType(reader, geometry_type_out, &has_z, &has_m));
+  if ((1 + has_z + 2 * has_m) != (int)private_data->dimensions) {
+    return EINVAL;
+  }
+
+  return NANOARROW_OK;
+}
+
+// Mark n values appended directly to the buffers of array as valid
+static inline int ArrowGPKGFinishValues(struct ArrowArray* array, int64_t n) {
+  struct ArrowBitmap* bitmap = ArrowArrayValidityBitmap(array);
+  if (bitmap->buffer.data != NULL) {
+    NANOARROW_RETURN_NOT_OK(ArrowBitmapAppend(bitmap, 1, n));
+  }
+
+  array->length += n;
+  return NANOARROW_OK;
+}
+
+static int ArrowGPKGReadCoords(struct ArrowGPKGWKBReader* reader,
+                               struct ArrowGPKGGeoArrowHandler* private_data,
+                               struct ArrowArray* coords, int64_t n_coords) {
+  int n_dims = private_data->n_dims;
+  int64_t n_bytes = n_coords * n_dims * sizeof(double);
+  if (n_coords > (reader->size - reader->pos) || (reader->size - reader->pos) < n_bytes) {
+    return EINVAL;
+  }
+
+  const uint8_t* data = reader->data + reader->pos;
+  reader->pos += n_bytes;
+
+  if (private_data->coord_type == ARROW_GPKG_COORD_TYPE_INTERLEAVED) {
+    struct ArrowBuffer* buffer = ArrowArrayBuffer(coords->children[0], 1);
+    if (!reader->swap) {
+      // WKB coordinates are already interleaved
+      NANOARROW_RETURN_NOT_OK(ArrowBufferAppend(buffer, data, n_bytes));
+    } else {
+      NANOARROW_RETURN_NOT_OK(ArrowBufferReserve(buffer, n_bytes));
+      double* out = (double*)(buffer->data + buffer->size_bytes);
+      for (int64_t i = 0; i < n_coords * n_dims; i++) {
+        ArrowGPKGReadValue(data + i * sizeof(double), out + i, sizeof(double), 1);
+      }
+
+      buffer->size_bytes += n_bytes;
+    }
+
+    NANOARROW_RETURN_NOT_OK(
+        ArrowGPKGFinishValues(coords->children[0], n_coords * n_dims));
+  } else {
+    for (int j = 0; j < n_dims; j++) {
+      struct ArrowBuffer* buffer = ArrowArrayBuffer(coords->children[j], 1);
+      NANOARROW_RETURN_NOT_OK(ArrowBufferReserve(buffer, n_coords * sizeof(double)));
+      double* out = (double*)(buffer->data + buffer->size_bytes);
+      for (int64_t i = 0; i < n_coords; i++) {
+        ArrowGPKGReadValue(data + (i * n_dims + j) * sizeof(double), out + i,
+                           sizeof(double), reader->swap);
+      }
+
+      buffer->size_bytes += n_coords * sizeof(double);
+      NANOARROW_RETURN_NOT_OK(ArrowGPKGFinishValues(coords->children[j], n_coords));
+    }
+  }
+
+  return ArrowGPKGFinishValues(coords, n_coords);
+}
+
+// Read a sequence of coordinates (the body of a linestring or ring) into an element
+// of vertices
+static int ArrowGPKGReadLinestring(struct ArrowGPKGWKBReader* reader,
+                                   struct ArrowGPKGGeoArrowHandler* private_data,
+                                   struct ArrowArray* vertices) {
+  uint32_t n_coords;
+  NANOARROW_RETURN_NOT_OK(ArrowGPKGReadUInt32(reader, &n_coords));
+  NANOARROW_RETURN_NOT_OK(
+      ArrowGPKGReadCoords(reader, private_data, vertices->children[0], n_coords));
+  return ArrowArrayFinishElement(vertices);
+}
+
+static int ArrowGPKGReadPolygon(struct ArrowGPKGWKBReader* reader,
+                                struct ArrowGPKGGeoArrowHandler* private_data,
+                                struct ArrowArray* rings) {
+  uint32_t n_rings;
+  NANOARROW_RETURN_NOT_OK(ArrowGPKGReadUInt32(reader, &n_rings));
+  for (uint32_t i = 0; i < n_rings; i++) {
+    NANOARROW_RETURN_NOT_OK(
+        ArrowGPKGReadLinestring(reader, private_data, rings->children[0]));
+  }
+
+  return ArrowArrayFinishElement(rings);
+}
+
+// Read the body of a geometry of type geometry_type (whose header has already been
+// read) as one element of array, which has the layout of geometry_type
+static int ArrowGPKGReadGeometry(struct ArrowGPKGWKBReader* reader,
+                                 struct ArrowGPKGGeoArrowHandler* private_data,
+                                 uint32_t geometry_type, struct ArrowArray* array) {
+  switch (geometry_type) {
+    case ARROW_GPKG_GEOMETRY_TYPE_POINT:
+      return ArrowGPKGReadCoords(reader, private_data, array, 1);
+    case ARROW_GPKG_GEOMETRY_TYPE_LINESTRING:
+      return ArrowGPKGReadLinestring(reader, private_data, array);
+    case ARROW_GPKG_GEOMETRY_TYPE_POLYGON:
+      return ArrowGPKGReadPolygon(reader, private_data, array);
+    default:
+      break;
+  }
+
+  // The parts of a multi geometry are geometries (with a header) of the
+  // corresponding single geometry type
+  uint32_t n_parts;
+  NANOARROW_RETURN_NOT_OK(ArrowGPKGReadUInt32(reader, &n_parts));
+  for (uint32_t i = 0; i < n_parts; i++) {
+    uint32_t part_type;
+    NANOARROW_RETURN_NOT_OK(ArrowGPKGReadWKBHeader(reader, private_data, &part_type));
+    if (part_type != (geometry_type - 3)) {
+      return EINVAL;
+    }
+
+    NANOARROW_RETURN_NOT_OK(
+        ArrowGPKGReadGeometry(reader, private_data, part_type, array->children[0]));
+  }
+
+  return ArrowArrayFinishElement(array);
+}
+
+static int ArrowGPKGGeoArrowAppend(struct ArrowSQLite3ColumnHandler* handler,
+                                   struct ArrowArray* array, sqlite3_stmt* stmt, int i,
+                                   int value_type, int64_t* variable_bytes) {
+  struct ArrowGPKGGeoArrowHandler* private_data =
+      (struct ArrowGPKGGeoArrowHandler*)handler->private_data;
+
+  switch (value_type) {
+    case SQLITE_NULL:
+      return ArrowArrayAppendNull(array, 1);
+    case SQLITE_BLOB:
+      break;
+    default:
+      return EINVAL;
+  }
+
+  struct ArrowGPKGWKBReader reader;
+  reader.data = (const uint8_t*)sqlite3_column_blob(stmt, i);
+  reader.size = sqlite3_column_bytes(stmt, i);
+  reader.pos = 0;
+  reader.swap = 0;
+
+  // Skip the GeoPackage header (if this isn't plain WKB)
+  if (reader.size > 0 && reader.data[0] == 'G') {
+    struct ArrowGPKGHeader header;
+    NANOARROW_RETURN_NOT_OK(
+        ArrowGPKGParseHeader(reader.data, reader.size, &header, NULL));
+    reader.pos = header.header_size;
+  }
+
+  uint32_t geometry_type;
+  NANOARROW_RETURN_NOT_OK(ArrowGPKGReadWKBHeader(&reader, private_data, &geometry_type));
+
+  // Promote single geometries to a multi geometry with one part
+  uint32_t output_type = private_data->geometry_type;
+  if (geometry_type == output_type) {
+    NANOARROW_RETURN_NOT_OK(
+        ArrowGPKGReadGeometry(&reader, private_data, geometry_type, array));
+  } else if (output_type > ARROW_GPKG_GEOMETRY_TYPE_POLYGON &&
+             geometry_type == (output_type - 3)) {
+    NANOARROW_RETURN_NOT_OK(
+        ArrowGPKGReadGeometry(&reader, private_data, geometry_type, array->children[0]));
+    NANOARROW_RETURN_NOT_OK(ArrowArrayFinishElement(array));
+  } else {
+    return EINVAL;
+  }
+
+  *variable_bytes += reader.pos;
+  return NANOARROW_OK;
+}
+
+static void ArrowGPKGGeoArrowRelease(struct ArrowSQLite3ColumnHandler* handler) {
+  ArrowFree(handler->private_data);
+  handler->release = NULL;
+}
+
+int ArrowGPKGGeoArrowHandlerInit(struct ArrowSQLite3ColumnHandler* handler,
+                                 enum ArrowGPKGGeometryType geometry_type,
+                                 enum ArrowGPKGDimensions dimensions,
+                                 enum ArrowGPKGCoordType coord_type) {
+  if (geometry_type < ARROW_GPKG_GEOMETRY_TYPE_POINT ||
+      geometry_type > ARROW_GPKG_GEOMETRY_TYPE_MULTIPOLYGON ||
+      dimensions < ARROW_GPKG_DIMENSIONS_XY || dimensions > ARROW_GPKG_DIMENSIONS_XYZM ||
+      (coord_type != ARROW_GPKG_COORD_TYPE_SEPARATE &&
+       coord_type != ARROW_GPKG_COORD_TYPE_INTERLEAVED)) {
+    return EINVAL;
+  }
+
+  struct ArrowGPKGGeoArrowHandler* private_data =
+      (struct ArrowGPKGGeoArrowHandler*)ArrowMalloc(
+          sizeof(struct ArrowGPKGGeoArrowHandler));
+  if (private_data == NULL) {
+    return ENOMEM;
+  }
+
+  private_data->geometry_type = geometry_type;
+  private_data->dimensions = dimensions;
+  private_data->coord_type = coord_type;
+  private_data->n_dims = (int)strlen(kArrowGPKGDimensionNames[dimensions]);
+
+  handler->init_schema = &ArrowGPKGGeoArrowInitSchema;
+  handler->append = &ArrowGPKGGeoArrowAppend;
+  handler->release = &ArrowGPKGGeoArrowRelease;
+  handler->private_data = private_data;
+  return 0;
+}
+
+// A stream that finalizes the statement of an ArrowSQLite3StreamInitFromResult()
+// stream when released
+struct ArrowGPKGStatementStreamPrivate {
+  struct ArrowArrayStream stream;
+  sqlite3_stmt* stmt;
+};
+
+static int ArrowGPKGStatementStreamGetSchema(struct ArrowArrayStream* stream,
+                                             struct ArrowSchema* out) {
+  struct ArrowGPKGStatementStreamPrivate* private_data =
+      (struct ArrowGPKGStatementStreamPrivate*)stream->private_data;
+  return private_data->stream.get_schema(&private_data->stream, out);
+}
+
+static int ArrowGPKGStatementStreamGetNext(struct ArrowArrayStream* stream,
+                                           struct ArrowArray* out) {
+  struct ArrowGPKGStatementStreamPrivate* private_data =
+      (struct ArrowGPKGStatementStreamPrivate*)stream->private_data;
+  return private_data->stream.get_next(&private_data->stream, out);
+}
+
+static const char* ArrowGPKGStatementStreamGetLastError(
+    struct ArrowArrayStream* stream) {
+  struct ArrowGPKGStatementStreamPrivate* private_data =
+      (struct ArrowGPKGStatementStreamPrivate*)stream->private_data;
+  return private_data->stream.get_last_error(&private_data->stream);
+}
+
+static void ArrowGPKGStatementStreamRelease(struct ArrowArrayStream* stream) {
+  struct ArrowGPKGStatementStreamPrivate* private_data =
+      (struct ArrowGPKGStatementStreamPrivate*)stream->private_data;
+  private_data->stream.release(&private_data->stream);
+  sqlite3_finalize(private_data->stmt);
+  ArrowFree(private_data);
+  stream->release = NULL;
+}
+
+// Initialize stream from result (which is moved into the stream) and stmt (whose
+// ownership is transferred to the stream even if this fails)
+static int ArrowGPKGStatementStreamInit(struct ArrowArrayStream* stream,
+                                        struct ArrowSQLite3Result* result,
+                                        sqlite3_stmt* stmt, int64_t batch_rows) {
+  struct ArrowGPKGStatementStreamPrivate* private_data =
+      (struct ArrowGPKGStatementStreamPrivate*)ArrowMalloc(
+          sizeof(struct ArrowGPKGStatementStreamPrivate));
+  if (private_data == NULL) {
+    sqlite3_finalize(stmt);
+    return ENOMEM;
+  }
+
+  int code = ArrowSQLite3StreamInitFromResult(&private_data->stream, result, stmt,
+                                              batch_rows);
+  if (code != NANOARROW_OK) {
+    sqlite3_finalize(stmt);
+    ArrowFree(private_data);
+    return code;
+  }
+
+  private_data->stmt = stmt;
+  stream->get_schema = &ArrowGPKGStatementStreamGetSchema;
+  stream->get_next = &ArrowGPKGStatementStreamGetNext;
+  stream->get_last_error = &ArrowGPKGStatementStreamGetLastError;
+  stream->release = &ArrowGPKGStatementStreamRelease;
+  stream->private_data = private_data;
+  return NANOARROW_OK;
+}
+
+static int ArrowGPKGHasRTree(sqlite3* con, const char* table_name,
+                             const char* column_name) {
+  sqlite3_stmt* stmt;
+  int result = sqlite3_prepare_v2(
+      con,
+      "SELECT 1 FROM gpkg_extensions WHERE lower(table_name) = lower(?) AND "
+      "lower(column_name) = lower(?) AND extension_name = 'gpkg_rtree_index'",
+      -1, &stmt, NULL);
+  if (result != SQLITE_OK) {
+    // No gpkg_extensions table
+    return 0;
+  }
+
+  sqlite3_bind_text(stmt, 1, table_name, -1, SQLITE_STATIC);
+  sqlite3_bind_text(stmt, 2, column_name, -1, SQLITE_STATIC);
+  int has_rtree = sqlite3_step(stmt) == SQLITE_ROW;
+  sqlite3_finalize(stmt);
+  return has_rtree;
+}
+
+// A sequence of xy coordinates of a geometry decoded for testing spatial predicates
+struct ArrowGPKGPath {
+  int64_t offset;
+  int64_t n_coords;
+
+  // The index of the polygon if this is a ring or -1 for points and linestrings
+  int64_t polygon;
+};
+
+// The paths of a geometry (ignoring z and m). The rings of a polygon are consecutive
+// and the first ring of each polygon is its shell.
+struct ArrowGPKGShape {
+  struct ArrowBuffer coords;
+  struct ArrowBuffer paths;
+  int64_t n_polygons;
+
+  // Non-zero if every path is a ring
+  int polygonal;
+};
+
+static void ArrowGPKGShapeInit(struct ArrowGPKGShape* shape) {
+  ArrowBufferInit(&shape->coords);
+  ArrowBufferInit(&shape->paths);
+  shape->n_polygons = 0;
+  shape->polygonal = 1;
+}
+
+static void ArrowGPKGShapeReset(struct ArrowGPKGShape* shape) {
+  ArrowBufferReset(&shape->coords);
+  ArrowBufferReset(&shape->paths);
+}
+
+static inline int64_t ArrowGPKGShapeNumPaths(const struct ArrowGPKGShape* shape) {
+  return shape->paths.size_bytes / sizeof(struct ArrowGPKGPath);
+}
+
+static inline const struct ArrowGPKGPath* ArrowGPKGShapePath(
+    const struct ArrowGPKGShape* shape, int64_t i) {
+  return (const struct ArrowGPKGPath*)shape->paths.data + i;
+}
+
+static inline const double* ArrowGPKGShapeCoord(const struct ArrowGPKGShape* shape,
+                                                const struct ArrowGPKGPath* path,
+                                                int64_t j) {
+  return (const double*)shape->coords.data + 2 * (path->offset + j);
+}
+
+// Rings include the segment from the last to the first coordinate (which has zero
+// length for a closed ring)
+static inline int64_t ArrowGPKGPathNumSegments(const struct ArrowGPKGPath* path) {
+  if (path->n_coords < 2) {
+    return 0;
+  }
+
+  return path->polygon >= 0 ? path->n_coords : path->n_coords - 1;
+}
+
+static int ArrowGPKGShapeAppendPath(struct ArrowGPKGShape* shape,
+                                    struct ArrowGPKGWKBReader* reader, int has_z,
+                                    int has_m, int64_t n_coords, int64_t polygon) {
+  int n_dims = 2 + has_z + has_m;
+  int64_t n_bytes = n_coords * n_dims * sizeof(double);
+  if (n_coords > (reader->size - reader->pos) || (reader->size - reader->pos) < n_bytes) {
+    return EINVAL;
+  }
+
+  const uint8_t* data = reader->data + reader->pos;
+  reader->pos += n_bytes;
+
+  struct ArrowGPKGPath path;
+  path.offset = shape->coords.size_bytes / (2 * sizeof(double));
+  path.n_coords = n_coords;
+  path.polygon = polygon;
+
+  NANOARROW_RETURN_NOT_OK(
+      ArrowBufferReserve(&shape->coords, n_coords * 2 * sizeof(double)));
+  double* out = (double*)(shape->coords.data + shape->coords.size_bytes);
+  for (int64_t i = 0; i < n_coords; i++) {
+    ArrowGPKGReadValue(data, out++, sizeof(double), reader->swap);
+    ArrowGPKGReadValue(data + sizeof(double), out++, sizeof(double), reader->swap);
+    data += n_dims * sizeof(double);
+  }
+
+  // Empty paths and empty points (with NaN coordinates) are not part of the shape
+  if (n_coords == 0 || (n_coords == 1 && isnan(*(out - 2)))) {
+    return NANOARROW_OK;
+  }
+
+  shape->coords.size_bytes += n_coords * 2 * sizeof(double);
+  shape->polygonal = shape->polygonal && polygon >= 0;
+  return ArrowBufferAppend(&shape->paths, &path, sizeof(struct ArrowGPKGPath));
+}
+
+static int ArrowGPKGShapeReadGeometry(struct ArrowGPKGWKBReader* reader,
+                                      struct ArrowGPKGShape* shape, int depth) {
+  uint32_t geometry_type;
+  int has_z;
+  int has_m;
+  NANOARROW_RETURN_NOT_OK(ArrowGPKGReadWKBType(reader, &geometry_type, &has_z, &has_m));
+
+  uint32_t n;
+  switch (geometry_type) {
+    case 1:
+      return ArrowGPKGShapeAppendPath(shape, reader, has_z, has_m, 1, -1);
+    case 2:
+      NANOARROW_RETURN_NOT_OK(ArrowGPKGReadUInt32(reader, &n));
+      return ArrowGPKGShapeAppendPath(shape, reader, has_z, has_m, n, -1);
+    case 3: {
+      uint32_t n_rings;
+      NANOARROW_RETURN_NOT_OK(ArrowGPKGReadUInt32(reader, &n_rings));
+      for (uint32_t i = 0; i < n_rings; i++) {
+        NANOARROW_RETURN_NOT_OK(ArrowGPKGReadUInt32(reader, &n));
+        NANOARROW_RETURN_NOT_OK(ArrowGPKGShapeAppendPath(shape, reader, has_z, has_m, n,
+                                                         shape->n_polygons));
+      }
+
+      shape->n_polygons++;
+      return NANOARROW_OK;
+    }
+    case 4:
+    case 5:
+    case 6:
+    case 7:
+      if (depth >= ARROW_GPKG_MAX_WKB_DEPTH) {
+        return EINVAL;
+      }
+
+      NANOARROW_RETURN_NOT_OK(ArrowGPKGReadUInt32(reader, &n));
+      for (uint32_t i = 0; i < n; i++) {
+        NANOARROW_RETURN_NOT_OK(ArrowGPKGShapeReadGeometry(reader, shape, depth + 1));
+      }
+
+      return NANOARROW_OK;
+    default:
+      return EINVAL;
+  }
+}
+
+static int ArrowGPKGShapeRead(struct ArrowGPKGShape* shape, const uint8_t* data,
+                              int64_t size, struct ArrowSQLite3Error* error) {
+  shape->coords.size_bytes = 0;
+  shape->paths.size_bytes = 0;
+  shape->n_polygons = 0;
+  shape->polygonal = 1;
+
+  struct ArrowGPKGWKBReader reader;
+  reader.data = data;
+  reader.size = size;
+  reader.pos = 0;
+  reader.swap = 0;
+
+  if (ArrowGPKGShapeReadGeometry(&reader, shape, 0) != NANOARROW_OK) {
+    ArrowErrorSet((struct ArrowError*)error, "Invalid WKB geometry at byte %ld",
+                  (long)reader.pos);
+    return EINVAL;
+  }
+
+  return NANOARROW_OK;
+}
+
+// Twice the signed area of the triangle abc (positive if c is left of ab)
+static inline double ArrowGPKGCross(const double* a, const double* b, const double* c) {
+  return (b[0] - a[0]) * (c[1] - a[1]) - (b[1] - a[1]) * (c[0] - a[0]);
+}
+
+static inline int ArrowGPKGOnSegment(const double* p, const double* a, const double* b) {
+  return ArrowGPKGCross(a, b, p) == 0 && p[0] >= fmin(a[0], b[0]) &&
+         p[0] <= fmax(a[0], b[0]) && p[1] >= fmin(a[1], b[1]) &&
+         p[1] <= fmax(a[1], b[1]);
+}
+
+// Returns 2 if ab and cd cross at a point in the interior of both, 1 if they
+// otherwise intersect (i.e., touch or overlap), or 0 if they are disjoint
+static int ArrowGPKGSegmentIntersection(const double* a, const double* b,
+                                        const double* c, const double* d) {
+  double d1 = ArrowGPKGCross(c, d, a);
+  double d2 = ArrowGPKGCross(c, d, b);
+  double d3 = ArrowGPKGCross(a, b, c);
+  double d4 = ArrowGPKGCross(a, b, d);
+  if (((d1 > 0 && d2 < 0) || (d1 < 0 && d2 > 0)) &&
+      ((d3 > 0 && d4 < 0) || (d3 < 0 && d4 > 0))) {
+    return 2;
+  }
+
+  return ArrowGPKGOnSegment(a, c, d) || ArrowGPKGOnSegment(b, c, d) ||
+         ArrowGPKGOnSegment(c, a, b) || ArrowGPKGOnSegment(d, a, b);
+}
+
+// Returns the largest result of ArrowGPKGSegmentIntersection() for ab and any
+// segment of shape (stopping early at min_result)
+static int ArrowGPKGSegmentShapeIntersection(const double* a, const double* b,
+                                             const struct ArrowGPKGShape* shape,
+                                             int min_result) {
+  int result = 0;
+  for (int64_t i = 0; i < ArrowGPKGShapeNumPaths(shape); i++) {
+    const struct ArrowGPKGPath* path = ArrowGPKGShapePath(shape, i);
+    for (int64_t j = 0; j < ArrowGPKGPathNumSegments(path); j++) {
+      int segment_result = ArrowGPKGSegmentIntersection(
+          a, b, ArrowGPKGShapeCoord(shape, path, j),
+          ArrowGPKGShapeCoord(shape, path, (j + 1) % path->n_coords));
+      if (segment_result > result) {
+        result = segment_result;
+      }
+
+      if (result >= min_result) {
+        return result;
+      }
+    }
+  }
+
+  return result;
+}
+
+// Returns 0 if p is outside shape, 1 if it is on the boundary (or on a point or
+// linestring), or 2 if it is in the interior of a polygon
+static int ArrowGPKGLocatePoint(const struct ArrowGPKGShape* shape, const double* p) {
+  int64_t polygon = -1;
+  int inside = 0;
+
+  for (int64_t i = 0; i < ArrowGPKGShapeNumPaths(shape); i++) {
+    const struct ArrowGPKGPath* path = ArrowGPKGShapePath(shape, i);
+
+    // Even-odd crossings over all rings of a polygon (its shell and holes)
+    if (path->polygon != polygon) {
+      if (inside) {
+        return 2;
+      }
+
+      polygon = path->polygon;
+    }
+
+    if (path->n_coords == 1) {
+      const double* q = ArrowGPKGShapeCoord(shape, path, 0);
+      if (p[0] == q[0] && p[1] == q[1]) {
+        return 1;
+      }
+    }
+
+    for (int64_t j = 0; j < ArrowGPKGPathNumSegments(path); j++) {
+      const double* a = ArrowGPKGShapeCoord(shape, path, j);
+      const double* b = ArrowGPKGShapeCoord(shape, path, (j + 1) % path->n_coords);
+      if (ArrowGPKGOnSegment(p, a, b)) {
+        return 1;
+      }
+
+      if (path->polygon >= 0 && ((a[1] > p[1]) != (b[1] > p[1])) &&
+          p[0] < (b[0] - a[0]) * (p[1] - a[1]) / (b[1] - a[1]) + a[0]) {
+        inside = !inside;
+      }
+    }
+  }
+
+  return inside ? 2 : 0;
+}
+
+static int ArrowGPKGShapesIntersect(const struct ArrowGPKGShape* x,
+                                    const struct ArrowGPKGShape* y) {
+  // Either a path of one shape is inside (or on) the other shape or their
+  // boundaries intersect
+  for (int64_t i = 0; i < ArrowGPKGShapeNumPaths(x); i++) {
+    const struct ArrowGPKGPath* path = ArrowGPKGShapePath(x, i);
+    if (ArrowGPKGLocatePoint(y, ArrowGPKGShapeCoord(x, path, 0)) > 0) {
+      return 1;
+    }
+  }
+
+  for (int64_t i = 0; i < ArrowGPKGShapeNumPaths(y); i++) {
+    const struct ArrowGPKGPath* path = ArrowGPKGShapePath(y, i);
+    if (ArrowGPKGLocatePoint(x, ArrowGPKGShapeCoord(y, path, 0)) > 0) {
+      return 1;
+    }
+  }
+
+  for (int64_t i = 0; i < ArrowGPKGShapeNumPaths(x); i++) {
+    const struct ArrowGPKGPath* path = ArrowGPKGShapePath(x, i);
+    for (int64_t j = 0; j < ArrowGPKGPathNumSegments(path); j++) {
+      if (ArrowGPKGSegmentShapeIntersection(
+              ArrowGPKGShapeCoord(x, path, j),
+              ArrowGPKGShapeCoord(x, path, (j + 1) % path->n_coords), y, 1) > 0) {
+        return 1;
+      }
+    }
+  }
+
+  return 0;
+}
+
+// The smallest position t' > t along ab (from 0 at a to 1 at b) at which ab meets
+// the boundary of shape, or 1 if there is none
+static double ArrowGPKGNextIntersection(const double* a, const double* b,
+                                        const struct ArrowGPKGShape* shape, double t) {
+  double dx = b[0] - a[0];
+  double dy = b[1] - a[1];
+  double length2 = dx * dx + dy * dy;
+  double next = 1;
+  if (length2 == 0) {
+    return next;
+  }
+
+  for (int64_t i = 0; i < ArrowGPKGShapeNumPaths(shape); i++) {
+    const struct ArrowGPKGPath* path = ArrowGPKGShapePath(shape, i);
+    for (int64_t j = 0; j < ArrowGPKGPathNumSegments(path); j++) {
+      const double* c = ArrowGPKGShapeCoord(shape, path, j);
+      const double* d = ArrowGPKGShapeCoord(shape, path, (j + 1) % path->n_coords);
+      if (ArrowGPKGSegmentIntersection(a, b, c, d) == 0) {
+        continue;
+      }
+
+      // Segments that intersect meet at a single point unless they are collinear, in
+      // which case they overlap between the ends of cd projected onto ab
+      double u[2];
+      int n_u;
+      double d1 = ArrowGPKGCross(c, d, a);
+      double d2 = ArrowGPKGCross(c, d, b);
+      if (d1 != d2) {
+        u[0] = d1 / (d1 - d2);
+        n_u = 1;
+      } else {
+        u[0] = ((c[0] - a[0]) * dx + (c[1] - a[1]) * dy) / length2;
+        u[1] = ((d[0] - a[0]) * dx + (d[1] - a[1]) * dy) / length2;
+        n_u = 2;
+      }
+
+      for (int k = 0; k < n_u; k++) {
+        if (u[k] > t && u[k] < next) {
+          next = u[k];
+        }
+      }
+    }
+  }
+
+  return next;
+}
+
+// Returns non-zero if ArrowGPKGLocatePoint() returns location for some point of ab.
+// ab is split at every intersection with the boundary of shape: each part is then
+// entirely in the interior, on the boundary, or outside of shape and is located by
+// its midpoint.
+static int ArrowGPKGSegmentHasLocation(const double* a, const double* b,
+                                       const struct ArrowGPKGShape* shape,
+                                       int location) {
+  if (ArrowGPKGLocatePoint(shape, a) == location ||
+      ArrowGPKGLocatePoint(shape, b) == location) {
+    return 1;
+  }
+
+  double t = 0;
+  while (t < 1) {
+    double next = ArrowGPKGNextIntersection(a, b, shape, t);
+    double u = (t + next) / 2;
+    double p[2] = {a[0] + u * (b[0] - a[0]), a[1] + u * (b[1] - a[1])};
+    if (ArrowGPKGLocatePoint(shape, p) == location) {
+      return 1;
+    }
+
+    t = next;
+  }
+
+  return 0;
+}
+
+// Find a point in the interior of the polygon whose rings are the n_paths paths of
+// shape starting at path: the midpoint of the leftmost span inside the polygon on a
+// horizontal line between its lowest vertex and the next lowest one (which passes
+// through no vertex). Returns 0 if the polygon has no area.
+static int ArrowGPKGPolygonInteriorPoint(const struct ArrowGPKGShape* shape,
+                                         int64_t path, int64_t n_paths, double* p) {
+  double y_min = INFINITY;
+  for (int64_t i = path; i < path + n_paths; i++) {
+    const struct ArrowGPKGPath* ring = ArrowGPKGShapePath(shape, i);
+    for (int64_t j = 0; j < ring->n_coords; j++) {
+      y_min = fmin(y_min, ArrowGPKGShapeCoord(shape, ring, j)[1]);
+    }
+  }
+
+  double y_next = INFINITY;
+  for (int64_t i = path; i < path + n_paths; i++) {
+    const struct ArrowGPKGPath* ring = ArrowGPKGShapePath(shape, i);
+    for (int64_t j = 0; j < ring->n_coords; j++) {
+      double y = ArrowGPKGShapeCoord(shape, ring, j)[1];
+      if (y > y_min && y < y_next) {
+        y_next = y;
+      }
+    }
+  }
+
+  if (y_next == INFINITY) {
+    return 0;
+  }
+
+  // The two leftmost crossings of the line
+  double y = (y_min + y_next) / 2;
+  double x[2] = {INFINITY, INFINITY};
+  for (int64_t i = path; i < path + n_paths; i++) {
+    const struct ArrowGPKGPath* ring = ArrowGPKGShapePath(shape, i);
+    for (int64_t j = 0; j < ArrowGPKGPathNumSegments(ring); j++) {
+      const double* a = ArrowGPKGShapeCoord(shape, ring, j);
+      const double* b = ArrowGPKGShapeCoord(shape, ring, (j + 1) % ring->n_coords);
+      if ((a[1] > y) == (b[1] > y)) {
+        continue;
+      }
+
+      double crossing = (b[0] - a[0]) * (y - a[1]) / (b[1] - a[1]) + a[0];
+      if (crossing < x[0]) {
+        x[1] = x[0];
+        x[0] = crossing;
+      } else if (crossing < x[1]) {
+        x[1] = crossing;
+      }
+    }
+  }
+
+  if (x[1] == INFINITY) {
+    return 0;
+  }
+
+  p[0] = (x[0] + x[1]) / 2;
+  p[1] = y;
+  return 1;
+}
+
+// Returns non-zero if every point of x is in or on the polygons of y (up to the
+// rounding of the intersections of their boundaries)
+static int ArrowGPKGShapeCoveredBy(const struct ArrowGPKGShape* x,
+                                   const struct ArrowGPKGShape* y) {
+  if (!y->polygonal || ArrowGPKGShapeNumPaths(x) == 0) {
+    return 0;
+  }
+
+  // No point of x may be outside y
+  for (int64_t i = 0; i < ArrowGPKGShapeNumPaths(x); i++) {
+    const struct ArrowGPKGPath* path = ArrowGPKGShapePath(x, i);
+    for (int64_t j = 0; j < path->n_coords; j++) {
+      if (ArrowGPKGLocatePoint(y, ArrowGPKGShapeCoord(x, path, j)) == 0) {
+        return 0;
+      }
+    }
+
+    for (int64_t j = 0; j < ArrowGPKGPathNumSegments(path); j++) {
+      if (ArrowGPKGSegmentHasLocation(
+              ArrowGPKGShapeCoord(x, path, j),
+              ArrowGPKGShapeCoord(x, path, (j + 1) % path->n_coords), y, 0)) {
+        return 0;
+      }
+    }
+  }
+
+  if (!x->polygonal) {
+    return 1;
+  }
+
+  // The boundary of y (e.g., a hole) can't be in the interior of polygons of x. The
+  // interior of each polygon of x is then entirely in or outside of y, which one
+  // interior point decides (e.g., for a polygon of x that is a hole of y).
+  for (int64_t i = 0; i < ArrowGPKGShapeNumPaths(y); i++) {
+    const struct ArrowGPKGPath* path = ArrowGPKGShapePath(y, i);
+    for (int64_t j = 0; j < ArrowGPKGPathNumSegments(path); j++) {
+      if (ArrowGPKGSegmentHasLocation(
+              ArrowGPKGShapeCoord(y, path, j),
+              ArrowGPKGShapeCoord(y, path, (j + 1) % path->n_coords), x, 2)) {
+        return 0;
+      }
+    }
+  }
+
+  for (int64_t i = 0; i < ArrowGPKGShapeNumPaths(x);) {
+    int64_t polygon = ArrowGPKGShapePath(x, i)->polygon;
+    int64_t n_paths = 1;
+    while (i + n_paths < ArrowGPKGShapeNumPaths(x) &&
+           ArrowGPKGShapePath(x, i + n_paths)->polygon == polygon) {
+      n_paths++;
+    }
+
+    double p[2];
+    if (ArrowGPKGPolygonInteriorPoint(x, i, n_paths, p) &&
+        ArrowGPKGLocatePoint(y, p) == 0) {
+      return 0;
+    }
+
+    i += n_paths;
+  }
+
+  return 1;
+}
+
+struct ArrowGPKGScanFilter {
+  int column;
+  enum ArrowGPKGPredicate predicate;
+
+  // The envelope of the query polygon (xmin, xmax, ymin, ymax)
+  double bounds[4];
+  struct ArrowGPKGShape query;
+
+  // The decoded geometry of the current row
+  struct ArrowGPKGShape shape;
+};
+
+static int ArrowGPKGScanFilterRow(struct ArrowSQLite3RowFilter* filter,
+                                  sqlite3_stmt* stmt, int* keep_out,
+                                  struct ArrowSQLite3Error* error) {
+  struct ArrowGPKGScanFilter* private_data =
+      (struct ArrowGPKGScanFilter*)filter->private_data;
+  const double* bounds = private_data->bounds;
+  *keep_out = 0;
+
+  // NULL geometries never match
+  if (sqlite3_column_type(stmt, private_data->column) != SQLITE_BLOB) {
+    return NANOARROW_OK;
+  }
+
+  const uint8_t* data = (const uint8_t*)sqlite3_column_blob(stmt, private_data->column);
+  int64_t size = sqlite3_column_bytes(stmt, private_data->column);
+  struct ArrowGPKGHeader header;
+  NANOARROW_RETURN_NOT_OK(ArrowGPKGBlobEnvelope(data, size, &header, error));
+
+  // Check the envelopes before decoding any coordinates. Comparisons with the NaN
+  // bounds of an empty geometry are always false.
+  const double* envelope = header.envelope;
+  if (!(envelope[0] <= bounds[1] && envelope[1] >= bounds[0] &&
+        envelope[2] <= bounds[3] && envelope[3] >= bounds[2])) {
+    return NANOARROW_OK;
+  }
+
+  switch (private_data->predicate) {
+    case ARROW_GPKG_PREDICATE_ENVELOPE:
+      *keep_out = 1;
+      return NANOARROW_OK;
+    case ARROW_GPKG_PREDICATE_WITHIN:
+      if (envelope[0] < bounds[0] || envelope[1] > bounds[1] ||
+          envelope[2] < bounds[2] || envelope[3] > bounds[3]) {
+        return NANOARROW_OK;
+      }
+      break;
+    case ARROW_GPKG_PREDICATE_CONTAINS:
+      if (envelope[0] > bounds[0] || envelope[1] < bounds[1] ||
+          envelope[2] > bounds[2] || envelope[3] < bounds[3]) {
+        return NANOARROW_OK;
+      }
+      break;
+    default:
+      break;
+  }
+
+  struct ArrowGPKGShape* shape = &private_data->shape;
+  NANOARROW_RETURN_NOT_OK(ArrowGPKGShapeRead(shape, data + header.header_size,
+                                             size - header.header_size, error));
+
+  switch (private_data->predicate) {
+    case ARROW_GPKG_PREDICATE_INTERSECTS:
+      *keep_out = ArrowGPKGShapesIntersect(shape, &private_data->query);
+      break;
+    case ARROW_GPKG_PREDICATE_WITHIN:
+      *keep_out = ArrowGPKGShapeCoveredBy(shape, &private_data->query);
+      break;
+    case ARROW_GPKG_PREDICATE_CONTAINS:
+      *keep_out = ArrowGPKGShapeCoveredBy(&private_data->query, shape);
+      break;
+    default:
+      break;
+  }
+
+  return NANOARROW_OK;
+}
+
+static void ArrowGPKGScanFilterRelease(struct ArrowSQLite3RowFilter* filter) {
+  struct ArrowGPKGScanFilter* private_data =
+      (struct ArrowGPKGScanFilter*)filter->private_data;
+  ArrowGPKGShapeReset(&private_data->query);
+  ArrowGPKGShapeReset(&private_data->shape);
+  ArrowFree(private_data);
+  filter->release = NULL;
+}
+
+static int ArrowGPKGScanFilterInit(struct ArrowSQLite3RowFilter* filter,
+                                   sqlite3_stmt* stmt, const char* column_name,
+                                   const double* xy, int64_t n_vertices,
+                                   const double* bounds,
+                                   enum ArrowGPKGPredicate predicate) {
+  struct ArrowGPKGScanFilter* private_data =
+      (struct ArrowGPKGScanFilter*)ArrowMalloc(sizeof(struct ArrowGPKGScanFilter));
+  if (private_data == NULL) {
+    return ENOMEM;
+  }
+
+  private_data->column = -1;
+  for (int i = 0; i < sqlite3_column_count(stmt); i++) {
+    if (sqlite3_stricmp(sqlite3_column_name(stmt, i), column_name) == 0) {
+      private_data->column = i;
+      break;
+    }
+  }
+
+  private_data->predicate = predicate;
+  memcpy(private_data->bounds, bounds, sizeof(private_data->bounds));
+  ArrowGPKGShapeInit(&private_data->query);
+  ArrowGPKGShapeInit(&private_data->shape);
+  filter->filter = &ArrowGPKGScanFilterRow;
+  filter->release = &ArrowGPKGScanFilterRelease;
+  filter->private_data = private_data;
+
+  if (private_data->column < 0) {
+    filter->release(filter);
+    return EINVAL;
+  }
+
+  // The query polygon is a single ring
+  struct ArrowGPKGPath path;
+  path.offset = 0;
+  path.n_coords = n_vertices;
+  path.polygon = 0;
+  private_data->query.n_polygons = 1;
+  int code = ArrowBufferAppend(&private_data->query.coords, xy,
+                               n_vertices * 2 * sizeof(double));
+  if (code == NANOARROW_OK) {
+    code = ArrowBufferAppend(&private_data->query.paths, &path,
+                             sizeof(struct ArrowGPKGPath));
+  }
+
+  if (code != NANOARROW_OK) {
+    filter->release(filter);
+    return code;
+  }
+
+  return NANOARROW_OK;
+}
+
+int ArrowGPKGScanPolygon(struct ArrowArrayStream* stream, sqlite3* con,
+                         const char* table_name, const double* xy, int64_t n_vertices,
+                         enum ArrowGPKGPredicate predicate,
+                         struct ArrowSQLite3Result* result, int64_t batch_rows,
+                         struct ArrowSQLite3Error* error) {
+  struct ArrowError* arrow_error = (struct ArrowError*)error;
+
+  if (n_vertices < 3) {
+    ArrowErrorSet(arrow_error, "Expected a query polygon with at least 3 vertices");
+    return EINVAL;
+  }
+
+  if (predicate < ARROW_GPKG_PREDICATE_ENVELOPE ||
+      predicate > ARROW_GPKG_PREDICATE_CONTAINS) {
+    ArrowErrorSet(arrow_error, "Unknown predicate %d", (int)predicate);
+    return EINVAL;
+  }
+
+  double bounds[4] = {INFINITY, -INFINITY, INFINITY, -INFINITY};
+  for (int64_t i = 0; i < n_vertices; i++) {
+    if (isnan(xy[2 * i]) || isnan(xy[2 * i + 1])) {
+      ArrowErrorSet(arrow_error, "Query polygon vertex %ld is NaN", (long)i);
+      return EINVAL;
+    }
+
+    bounds[0] = fmin(bounds[0], xy[2 * i]);
+    bounds[1] = fmax(bounds[1], xy[2 * i]);
+    bounds[2] = fmin(bounds[2], xy[2 * i + 1]);
+    bounds[3] = fmax(bounds[3], xy[2 * i + 1]);
+  }
+
+  char* column_name;
+  int code = ArrowGPKGGeometryColumnName(con, table_name, &column_name);
+  if (code == ENOENT) {
+    ArrowErrorSet(arrow_error, "Table '%s' has no registered geometry column",
+                  table_name);
+  }
+
+  NANOARROW_RETURN_NOT_OK(code);
+
+  // With an rtree, join the candidates from the index to the table (scanning the
+  // index in the outer loop); otherwise, filter the envelope of every row
+  int has_rtree = ArrowGPKGHasRTree(con, table_name, column_name);
+  char* sql;
+  if (has_rtree) {
+    sql = sqlite3_mprintf(
+        "SELECT \"t\".* FROM \"rtree_%w_%w\" AS \"r\" CROSS JOIN \"%w\" AS \"t\" "
+        "ON \"t\".rowid = \"r\".id WHERE \"r\".minx <= ?2 AND \"r\".maxx >= ?1 AND "
+        "\"r\".miny <= ?4 AND \"r\".maxy >= ?3",
+        table_name, column_name, table_name);
+  } else {
+    sql = sqlite3_mprintf("SELECT * FROM \"%w\"", table_name);
+  }
+
+  if (sql == NULL) {
+    sqlite3_free(column_name);
+    return ENOMEM;
+  }
+
+  sqlite3_stmt* stmt;
+  code = sqlite3_prepare_v2(con, sql, -1, &stmt, NULL);
+  sqlite3_free(sql);
+  if (code != SQLITE_OK) {
+    ArrowErrorSet(arrow_error, "<%s> %s", sqlite3_errstr(code), sqlite3_errmsg(con));
+    sqlite3_free(column_name);
+    return EIO;
+  }
+
+  struct ArrowSQLite3Result default_result;
+  if (result == NULL) {
+    code = ArrowSQLite3ResultInit(&default_result);
+    if (code != NANOARROW_OK) {
+      sqlite3_finalize(stmt);
+      sqlite3_free(column_name);
+      return code;
+    }
+
+    result = &default_result;
+  }
+
+  if (has_rtree) {
+    for (int i = 0; i < 4; i++) {
+      sqlite3_bind_double(stmt, i + 1, bounds[i]);
+    }
+  }
+
+  // Candidates from the rtree are refined even for the envelope predicate because
+  // the rtree bounds are rounded outward to float precision
+  struct ArrowSQLite3RowFilter filter;
+  code = ArrowGPKGScanFilterInit(&filter, stmt, column_name, xy, n_vertices, bounds,
+                                 predicate);
+  if (code == NANOARROW_OK) {
+    code = ArrowSQLite3ResultSetRowFilter(result, &filter);
+  } else if (code == EINVAL) {
+    ArrowErrorSet(arrow_error, "Column '%s' not found in table '%s'", column_name,
+                  table_name);
+  }
+
+  sqlite3_free(column_name);
+  if (code == NANOARROW_OK) {
+    code = ArrowGPKGStatementStreamInit(stream, result, stmt, batch_rows);
+  } else {
+    sqlite3_finalize(stmt);
+  }
+
+  if (result == &default_result) {
+    ArrowSQLite3ResultReset(&default_result);
+  }
+
+  return code;
+}
+
+int ArrowGPKGScanBBox(struct ArrowArrayStream* stream, sqlite3* con,
+                      const char* table_name, double xmin, double ymin, double xmax,
+                      double ymax, enum ArrowGPKGPredicate predicate,
+                      struct ArrowSQLite3Result* result, int64_t batch_rows,
+                      struct ArrowSQLite3Error* error) {
+  double xy[8] = {xmin, ymin, xmax, ymin, xmax, ymax, xmin, ymax};
+  return ArrowGPKGScanPolygon(stream, con, table_name, xy, 4, predicate, result,
+                              batch_rows, error);
+}
+
+struct ArrowGPKGCatalogPrivate {
+  sqlite3* con;
+  int loaded;
+
+  // PRAGMA data_version only changes when other connections commit changes, so
+  // changes made using con are detected using sqlite3_total_changes()
+  int64_t data_version;
+  int64_t total_changes;
+
+  struct ArrowGPKGLayerInfo* layers;
+  int64_t n_layers;
+};
+
+static void ArrowGPKGCatalogFreeLayers(struct ArrowGPKGCatalogPrivate* private_data) {
+  for (int64_t i = 0; i < private_data->n_layers; i++) {
+    struct ArrowGPKGLayerInfo* layer = private_data->layers + i;
+    sqlite3_free((char*)layer->table_name);
+    sqlite3_free((char*)layer->data_type);
+    sqlite3_free((char*)layer->column_name);
+    sqlite3_free((char*)layer->geometry_type_name);
+    sqlite3_free((char*)layer->crs);
+  }
+
+  sqlite3_free(private_data->layers);
+  private_data->layers = NULL;
+  private_data->n_layers = 0;
+  private_data->loaded = 0;
+}
+
+int ArrowGPKGCatalogInit(struct ArrowGPKGCatalog* catalog, sqlite3* con) {
+  struct ArrowGPKGCatalogPrivate* private_data =
+      (struct ArrowGPKGCatalogPrivate*)ArrowMalloc(
+          sizeof(struct ArrowGPKGCatalogPrivate));
+  if (private_data == NULL) {
+    return ENOMEM;
+  }
+
+  private_data->con = con;
+  private_data->loaded = 0;
+  private_data->data_version = 0;
+  private_data->total_changes = 0;
+  private_data->layers = NULL;
+  private_data->n_layers = 0;
+  catalog->private_data = private_data;
+  return 0;
+}
+
+void ArrowGPKGCatalogReset(struct ArrowGPKGCatalog* catalog) {
+  if (catalog->private_data == NULL) {
+    return;
+  }
+
+  struct ArrowGPKGCatalogPrivate* private_data =
+      (struct ArrowGPKGCatalogPrivate*)catalog->private_data;
+  ArrowGPKGCatalogFreeLayers(private_data);
+  ArrowFree(private_data);
+  catalog->private_data = NULL;
+}
+
+static char* ArrowGPKGColumnText(sqlite3_stmt* stmt, int i) {
+  if (sqlite3_column_type(stmt, i) == SQLITE_NULL) {
+    return NULL;
+  }
+
+  return sqlite3_mprintf("%s", sqlite3_column_text(stmt, i));
+}
+
+// Use the WKT2 definition from the CRS WKT extension, the WKT definition, or the
+// organization's code (in that order) for the crs of a layer
+static int ArrowGPKGCatalogSetCRS(struct ArrowGPKGLayerInfo* layer, sqlite3_stmt* stmt) {
+  const char* wkt2 = (const char*)sqlite3_column_text(stmt, 10);
+  const char* wkt = (const char*)sqlite3_column_text(stmt, 9);
+  const char* organization = (const char*)sqlite3_column_text(stmt, 7);
+
+  if (wkt2 != NULL && sqlite3_stricmp(wkt2, "undefined") != 0) {
+    layer->crs = sqlite3_mprintf("%s", wkt2);
+    layer->crs_type = "wkt2:2019";
+  } else if (wkt != NULL && sqlite3_stricmp(wkt, "undefined") != 0) {
+    layer->crs = sqlite3_mprintf("%s", wkt);
+  } else if (organization != NULL && sqlite3_stricmp(organization, "NONE") != 0) {
+    layer->crs =
+        sqlite3_mprintf("%s:%d", organization, sqlite3_column_int(stmt, 8));
+    layer->crs_type = "authority_code";
+  } else {
+    return NANOARROW_OK;
+  }
+
+  return layer->crs == NULL ? ENOMEM : NANOARROW_OK;
+}
+
+static int ArrowGPKGCatalogLoad(struct ArrowGPKGCatalogPrivate* private_data,
+                                struct ArrowError* error) {
+  sqlite3* con = private_data->con;
+  ArrowGPKGCatalogFreeLayers(private_data);
+
+  // One query for all three tables. definition_12_063 only exists if the CRS WKT
+  // extension is used.
+  static const char* kSQL =
+      "SELECT c.table_name, c.data_type, g.column_name, g.geometry_type_name, "
+      "coalesce(g.srs_id, c.srs_id), g.z, g.m, s.organization, "
+      "s.organization_coordsys_id, s.definition, %s FROM gpkg_contents AS c "
+      "LEFT JOIN gpkg_geometry_columns AS g ON lower(g.table_name) = "
+      "lower(c.table_name) LEFT JOIN gpkg_spatial_ref_sys AS s ON s.srs_id = "
+      "coalesce(g.srs_id, c.srs_id) ORDER BY c.table_name";
+
+  sqlite3_stmt* stmt = NULL;
+  char* sql = sqlite3_mprintf(kSQL, "s.definition_12_063");
+  int result = sql == NULL ? SQLITE_NOMEM : sqlite3_prepare_v2(con, sql, -1, &stmt, NULL);
+  sqlite3_free(sql);
+  if (result != SQLITE_OK && result != SQLITE_NOMEM) {
+    sql = sqlite3_mprintf(kSQL, "NULL");
+    result = sql == NULL ? SQLITE_NOMEM : sqlite3_prepare_v2(con, sql, -1, &stmt, NULL);
+    sqlite3_free(sql);
+  }
+
+  if (result == SQLITE_NOMEM) {
+    return ENOMEM;
+  } else if (result != SQLITE_OK) {
+    // Not a GeoPackage: the catalog is empty
+    private_data->loaded = 1;
+    return NANOARROW_OK;
+  }
+
+  int code = NANOARROW_OK;
+  while ((result = sqlite3_step(stmt)) == SQLITE_ROW) {
+    struct ArrowGPKGLayerInfo* layers = (struct ArrowGPKGLayerInfo*)sqlite3_realloc64(
+        private_data->layers,
+        (private_data->n_layers + 1) * sizeof(struct ArrowGPKGLayerInfo));
+    if (layers == NULL) {
+      code = ENOMEM;
+      break;
+    }
+
+    private_data->layers = layers;
+    struct ArrowGPKGLayerInfo* layer = layers + private_data->n_layers;
+    memset(layer, 0, sizeof(struct ArrowGPKGLayerInfo));
+    private_data->n_layers++;
+
+    layer->table_name = ArrowGPKGColumnText(stmt, 0);
+    layer->data_type = ArrowGPKGColumnText(stmt, 1);
+    layer->column_name = ArrowGPKGColumnText(stmt, 2);
+    layer->geometry_type_name = ArrowGPKGColumnText(stmt, 3);
+    layer->srs_id = sqlite3_column_int(stmt, 4);
+    layer->z = sqlite3_column_int(stmt, 5);
+    layer->m = sqlite3_column_int(stmt, 6);
+    code = ArrowGPKGCatalogSetCRS(layer, stmt);
+    if (code != NANOARROW_OK || layer->table_name == NULL ||
+        (sqlite3_column_type(stmt, 1) != SQLITE_NULL && layer->data_type == NULL) ||
+        (sqlite3_column_type(stmt, 2) != SQLITE_NULL && layer->column_name == NULL) ||
+        (sqlite3_column_type(stmt, 3) != SQLITE_NULL &&
+         layer->geometry_type_name == NULL)) {
+      code = ENOMEM;
+      break;
+    }
+  }
+
+  if (code == NANOARROW_OK && result != SQLITE_DONE) {
+    ArrowErrorSet(error, "<%s> %s", sqlite3_errstr(result), sqlite3_errmsg(con));
+    code = EIO;
+  }
+
+  sqlite3_finalize(stmt);
+  if (code != NANOARROW_OK) {
+    ArrowGPKGCatalogFreeLayers(private_data);
+    return code;
+  }
+
+  private_data->loaded = 1;
+  return NANOARROW_OK;
+}
+
+// Load the catalog if it was never loaded or if the database changed since
+static int ArrowGPKGCatalogRefresh(struct ArrowGPKGCatalogPrivate* private_data,
+                                   struct ArrowError* error) {
+  sqlite3_stmt* stmt;
+  int result = sqlite3_prepare_v2(private_data->con, "PRAGMA data_version", -1, &stmt,
+                                  NULL);
+  if (result == SQLITE_OK) {
+    result = sqlite3_step(stmt);
+  }
+
+  if (result != SQLITE_ROW) {
+    ArrowErrorSet(error, "<%s> %s", sqlite3_errstr(result),
+                  sqlite3_errmsg(private_data->con));
+    sqlite3_finalize(stmt);
+    return EIO;
+  }
+
+  int64_t data_version = sqlite3_column_int64(stmt, 0);
+  int64_t total_changes = sqlite3_total_changes(private_data->con);
+  sqlite3_finalize(stmt);
+
+  if (private_data->loaded && data_version == private_data->data_version &&
+      total_changes == private_data->total_changes) {
+    return NANOARROW_OK;
+  }
+
+  NANOARROW_RETURN_NOT_OK(ArrowGPKGCatalogLoad(private_data, error));
+  private_data->data_version = data_version;
+  private_data->total_changes = total_changes;
+  return NANOARROW_OK;
+}
+
+int ArrowGPKGCatalogLayers(struct ArrowGPKGCatalog* catalog,
+                           const struct ArrowGPKGLayerInfo** layers_out,
+                           int64_t* n_layers_out, struct ArrowSQLite3Error* error) {
+  struct ArrowGPKGCatalogPrivate* private_data =
+      (struct ArrowGPKGCatalogPrivate*)catalog->private_data;
+  NANOARROW_RETURN_NOT_OK(
+      ArrowGPKGCatalogRefresh(private_data, (struct ArrowError*)error));
+  *layers_out = private_data->layers;
+  *n_layers_out = private_data->n_layers;
+  return NANOARROW_OK;
+}
+
+int ArrowGPKGCatalogFindLayer(struct ArrowGPKGCatalog* catalog, const char* table_name,
+                              const struct ArrowGPKGLayerInfo** layer_out,
+                              struct ArrowSQLite3Error* error) {
+  const struct ArrowGPKGLayerInfo* layers;
+  int64_t n_layers;
+  NANOARROW_RETURN_NOT_OK(ArrowGPKGCatalogLayers(catalog, &layers, &n_layers, error));
+
+  for (int64_t i = 0; i < n_layers; i++) {
+    if (sqlite3_stricmp(layers[i].table_name, table_name) == 0) {
+      *layer_out = layers + i;
+      return NANOARROW_OK;
+    }
+  }
+
+  ArrowErrorSet((struct ArrowError*)error, "Table '%s' is not in gpkg_contents",
+                table_name);
+  return ENOENT;
+}
+
+static void ArrowGPKGAppendJSONString(sqlite3_str* out, const char* value) {
+  sqlite3_str_appendchar(out, 1, '"');
+  for (const char* c = value; *c != '\0'; c++) {
+    switch (*c) {
+      case '"':
+        sqlite3_str_appendall(out, "\\\"");
+        break;
+      case '\\':
+        sqlite3_str_appendall(out, "\\\\");
+        break;
+      case '\n':
+        sqlite3_str_appendall(out, "\\n");
+        break;
+      case '\t':
+        sqlite3_str_appendall(out, "\\t");
+        break;
+      default:
+        if ((unsigned char)*c < 0x20) {
+          sqlite3_str_appendf(out, "\\u%04x", (int)*c);
+        } else {
+          sqlite3_str_appendchar(out, 1, *c);
+        }
+        break;
+    }
+  }
+
+  sqlite3_str_appendchar(out, 1, '"');
+}
+
+static int ArrowGPKGAnnotateField(struct ArrowSchema* schema,
+                                  const struct ArrowGPKGLayerInfo* layer) {
+  sqlite3_str* extension_metadata = sqlite3_str_new(NULL);
+  sqlite3_str_appendall(extension_metadata, "{");
+  if (layer->crs != NULL) {
+    sqlite3_str_appendall(extension_metadata, "\"crs\":");
+    ArrowGPKGAppendJSONString(extension_metadata, layer->crs);
+    if (layer->crs_type != NULL) {
+      sqlite3_str_appendall(extension_metadata, ",\"crs_type\":");
+      ArrowGPKGAppendJSONString(extension_metadata, layer->crs_type);
+    }
+  }
+  sqlite3_str_appendall(extension_metadata, "}");
+
+  char srs_id[16];
+  snprintf(srs_id, sizeof(srs_id), "%d", (int)layer->srs_id);
+
+  char* extension_metadata_chars = sqlite3_str_finish(extension_metadata);
+  if (extension_metadata_chars == NULL) {
+    return ENOMEM;
+  }
+
+  struct ArrowBuffer metadata;
+  int result = ArrowMetadataBuilderInit(&metadata, schema->metadata);
+
+  // Only GeoArrow extension types (e.g., from a GeoArrow or WKB column handler) get
+  // a crs: the raw geometry blob isn't WKB
+  struct ArrowStringView extension_name = {NULL, 0};
+  if (result == NANOARROW_OK) {
+    result = ArrowMetadataGetValue(
+        schema->metadata, ArrowCharView("ARROW:extension:name"), &extension_name);
+  }
+
+  if (result == NANOARROW_OK && extension_name.n_bytes > 9 &&
+      strncmp(extension_name.data, "geoarrow.", 9) == 0) {
+    result = ArrowMetadataBuilderSet(&metadata, ArrowCharView("ARROW:extension:metadata"),
+                                     ArrowCharView(extension_metadata_chars));
+  }
+
+  if (result == NANOARROW_OK && layer->geometry_type_name != NULL) {
+    result = ArrowMetadataBuilderSet(&metadata, ArrowCharView("gpkg:geometry_type_name"),
+                                     ArrowCharView(layer->geometry_type_name));
+  }
+
+  if (result == NANOARROW_OK) {
+    result = ArrowMetadataBuilderSet(&metadata, ArrowCharView("gpkg:srs_id"),
+                                     ArrowCharView(srs_id));
+  }
+
+  if (result == NANOARROW_OK) {
+    result = ArrowSchemaSetMetadata(schema, (const char*)metadata.data);
+  }
+
+  ArrowBufferReset(&metadata);
+  sqlite3_free(extension_metadata_chars);
+  return result;
+}
+
+int ArrowGPKGCatalogAnnotateSchema(struct ArrowGPKGCatalog* catalog,
+                                   const char* table_name, struct ArrowSchema* schema,
+                                   struct ArrowSQLite3Error* error) {
+  const struct ArrowGPKGLayerInfo* layer;
+  int result = ArrowGPKGCatalogFindLayer(catalog, table_name, &layer, error);
+  if (result == ENOENT) {
+    return NANOARROW_OK;
+  }
+
+  NANOARROW_RETURN_NOT_OK(result);
+  if (layer->column_name == NULL) {
+    return NANOARROW_OK;
+  }
+
+  for (int64_t i = 0; i < schema->n_children; i++) {
+    struct ArrowSchema* child = schema->children[i];
+    if (child->name != NULL && sqlite3_stricmp(child->name, layer->column_name) == 0) {
+      NANOARROW_RETURN_NOT_OK(ArrowGPKGAnnotateField(child, layer));
+    }
+  }
+
+  return NANOARROW_OK;
+}
+
+struct ArrowGPKGAnnotatedStreamPrivate {
+  struct ArrowArrayStream stream;
+  struct ArrowGPKGCatalog* catalog;
+  char* table_name;
+  struct ArrowError error;
+};
+
+static int ArrowGPKGAnnotatedStreamGetSchema(struct ArrowArrayStream* stream,
+                                             struct ArrowSchema* out) {
+  struct ArrowGPKGAnnotatedStreamPrivate* private_data =
+      (struct ArrowGPKGAnnotatedStreamPrivate*)stream->private_data;
+  private_data->error.message[0] = '\0';
+
+  NANOARROW_RETURN_NOT_OK(private_data->stream.get_schema(&private_data->stream, out));
+  int result = ArrowGPKGCatalogAnnotateSchema(
+      private_data->catalog, private_data->table_name, out,
+      (struct ArrowSQLite3Error*)&private_data->error);
+  if (result != NANOARROW_OK) {
+    out->release(out);
+  }
+
+  return result;
+}
+
+static int ArrowGPKGAnnotatedStreamGetNext(struct ArrowArrayStream* stream,
+                                           struct ArrowArray* out) {
+  struct ArrowGPKGAnnotatedStreamPrivate* private_data =
+      (struct ArrowGPKGAnnotatedStreamPrivate*)stream->private_data;
+  private_data->error.message[0] = '\0';
+  return private_data->stream.get_next(&private_data->stream, out);
+}
+
+static const char* ArrowGPKGAnnotatedStreamGetLastError(
+    struct ArrowArrayStream* stream) {
+  struct ArrowGPKGAnnotatedStreamPrivate* private_data =
+      (struct ArrowGPKGAnnotatedStreamPrivate*)stream->private_data;
+  if (private_data->error.message[0] != '\0') {
+    return private_data->error.message;
+  }
+
+  return private_data->stream.get_last_error(&private_data->stream);
+}
+
+static void ArrowGPKGAnnotatedStreamRelease(struct ArrowArrayStream* stream) {
+  struct ArrowGPKGAnnotatedStreamPrivate* private_data =
+      (struct ArrowGPKGAnnotatedStreamPrivate*)stream->private_data;
+  private_data->stream.release(&private_data->stream);
+  sqlite3_free(private_data->table_name);
+  ArrowFree(private_data);
+  stream->release = NULL;
+}
+
+int ArrowGPKGCatalogAnnotateStream(struct ArrowGPKGCatalog* catalog,
+                                   const char* table_name,
+                                   struct ArrowArrayStream* stream) {
+  struct ArrowGPKGAnnotatedStreamPrivate* private_data =
+      (struct ArrowGPKGAnnotatedStreamPrivate*)ArrowMalloc(
+          sizeof(struct ArrowGPKGAnnotatedStreamPrivate));
+  if (private_data == NULL) {
+    return ENOMEM;
+  }
+
+  private_data->table_name = sqlite3_mprintf("%s", table_name);
+  if (private_data->table_name == NULL) {
+    ArrowFree(private_data);
+    return ENOMEM;
+  }
+
+  memcpy(&private_data->stream, stream, sizeof(struct ArrowArrayStream));
+  private_data->catalog = catalog;
+  private_data->error.message[0] = '\0';
+
+  stream->get_schema = &ArrowGPKGAnnotatedStreamGetSchema;
+  stream->get_next = &ArrowGPKGAnnotatedStreamGetNext;
+  stream->get_last_error = &ArrowGPKGAnnotatedStreamGetLastError;
+  stream->release = &ArrowGPKGAnnotatedStreamRelease;
+  stream->private_data = private_data;
+  return NANOARROW_OK;
+}
+
+// Read the extent of all entries of an rtree from the cells of its root node (node
+// 1 of the _node shadow table). Nodes are a big-endian 2 byte depth and 2 byte cell
+// count followed by cells of a 64-bit id and minx, maxx, miny, maxy as 32-bit floats.
+static int ArrowGPKGRTreeExtent(sqlite3* con, const char* table_name,
+                                const char* column_name, double* extent,
+                                struct ArrowError* error) {
+  char* sql = sqlite3_mprintf("SELECT data FROM \"rtree_%w_%w_node\" WHERE nodeno = 1",
+                              table_name, column_name);
+  if (sql == NULL) {
+    return ENOMEM;
+  }
+
+  sqlite3_stmt* stmt;
+  int result = sqlite3_prepare_v2(con, sql, -1, &stmt, NULL);
+  sqlite3_free(sql);
+  if (result != SQLITE_OK) {
+    return ENOENT;
+  }
+
+  result = sqlite3_step(stmt);
+  if (result != SQLITE_ROW) {
+    sqlite3_finalize(stmt);
+    if (result == SQLITE_DONE) {
+      return ENOENT;
+    }
+
+    ArrowErrorSet(error, "<%s> %s", sqlite3_errstr(result), sqlite3_errmsg(con));
+    return EIO;
+  }
+
+  const uint8_t* data = (const uint8_t*)sqlite3_column_blob(stmt, 0);
+  int64_t size = sqlite3_column_bytes(stmt, 0);
+  int64_t n_cells = size >= 4 ? (data[2] << 8) | data[3] : 0;
+  int64_t cell_size = sizeof(int64_t) + 4 * sizeof(float);
+  if (size < 4 || size < 4 + n_cells * cell_size) {
+    sqlite3_finalize(stmt);
+    ArrowErrorSet(error, "Invalid root node of the rtree of '%s'", table_name);
+    return EINVAL;
+  }
+
+  // minx, maxx, miny, maxy of all cells
+  double bounds[4] = {INFINITY, -INFINITY, INFINITY, -INFINITY};
+  int swap = ArrowGPKGIsLittleEndian();
+  for (int64_t i = 0; i < n_cells; i++) {
+    const uint8_t* cell = data + 4 + i * cell_size + sizeof(int64_t);
+    for (int j = 0; j < 4; j++) {
+      float value;
+      ArrowGPKGReadValue(cell + j * sizeof(float), &value, sizeof(float), swap);
+      bounds[j] = (j % 2 == 0) ? fmin(bounds[j], value) : fmax(bounds[j], value);
+    }
+  }
+
+  sqlite3_finalize(stmt);
+
+  // An empty rtree has an empty extent
+  if (n_cells == 0) {
+    return NANOARROW_OK;
+  }
+
+  extent[0] = bounds[0];
+  extent[1] = bounds[2];
+  extent[2] = bounds[1];
+  extent[3] = bounds[3];
+  return NANOARROW_OK;
+}
+
+int ArrowGPKGSummarizeLayer(sqlite3* con, const char* table_name,
+                            struct ArrowGPKGLayerSummary* out,
+                            struct ArrowSQLite3Error* error) {
+  struct ArrowError* arrow_error = (struct ArrowError*)error;
+  out->feature_count = -1;
+  out->feature_count_source = ARROW_GPKG_SOURCE_NONE;
+  out->feature_count_exact = 0;
+  for (int i = 0; i < 4; i++) {
+    out->extent[i] = NAN;
+  }
+  out->extent_source = ARROW_GPKG_SOURCE_NONE;
+  out->extent_exact = 0;
+  out->extent_conservative = 0;
+
+  // The feature count maintained by GDAL's triggers is exact. sqlite_stat1 is only
+  // as recent as the last ANALYZE and max(rowid) is an upper bound if rows were
+  // deleted (or rowids were assigned explicitly). A table whose feature count can't
+  // be estimated (e.g., a WITHOUT ROWID table) has no feature count source.
+  enum ArrowSQLite3RowCountSource source;
+  if (ArrowSQLite3EstimateRowCountSource(con, table_name, &out->feature_count,
+                                         &source) == NANOARROW_OK) {
+    out->feature_count_source = (enum ArrowGPKGSource)source;
+    out->feature_count_exact = source == ARROW_SQLITE3_ROW_COUNT_OGR_CONTENTS;
+  } else {
+    out->feature_count = -1;
+  }
+
+  // The rtree is kept up to date by triggers (but its bounds are rounded outward to
+  // float precision); the gpkg_contents extent is informative only
+  char* column_name = NULL;
+  int code = ArrowGPKGGeometryColumnName(con, table_name, &column_name);
+  if (code == NANOARROW_OK && ArrowGPKGHasRTree(con, table_name, column_name)) {
+    code = ArrowGPKGRTreeExtent(con, table_name, column_name, out->extent, arrow_error);
+    if (code == NANOARROW_OK) {
+      out->extent_source = ARROW_GPKG_SOURCE_RTREE;
+      out->extent_conservative = 1;
+    }
+  } else if (code == NANOARROW_OK) {
+    code = ENOENT;
+  }
+
+  sqlite3_free(column_name);
+  if (code == ENOENT) {
+    code = ArrowSQLite3QueryValue(
+        con,
+        "SELECT min_x, min_y, max_x, max_y FROM gpkg_contents WHERE lower(table_name) = "
+        "lower(?)",
+        table_name, NULL, out->extent, error);
+    if (code == NANOARROW_OK) {
+      out->extent_source = ARROW_GPKG_SOURCE_CONTENTS;
+    }
+  }
+
+  if (code != NANOARROW_OK && code != ENOENT) {
+    return code;
+  }
+
+  return NANOARROW_OK;
+}
+
+// Record the WKB geometry type and dimensions of the geometry blob of a row, reading
+// only the blob header and the start of the WKB
+static int ArrowGPKGDetectRow(sqlite3* con, sqlite3_blob* blob,
+                              struct ArrowGPKGGeometryTypes* out,
+                              struct ArrowError* error) {
+  uint8_t data[ARROW_GPKG_MAX_HEADER_SIZE + 5];
+  int size = sqlite3_blob_bytes(blob);
+  if (size > (int)sizeof(data)) {
+    size = sizeof(data);
+  }
+
+  int result = sqlite3_blob_read(blob, data, size, 0);
+  if (result != SQLITE_OK) {
+    ArrowErrorSet(error, "<%s> %s", sqlite3_errstr(result), sqlite3_errmsg(con));
+    return EIO;
+  }
+
+  // Plain WKB doesn't have a header
+  struct ArrowGPKGHeader header;
+  header.header_size = 0;
+  if (size > 0 && data[0] == 'G') {
+    NANOARROW_RETURN_NOT_OK(
+        ArrowGPKGParseHeader(data, size, &header, (struct ArrowSQLite3Error*)error));
+  }
+
+  struct ArrowGPKGWKBReader reader;
+  reader.data = data;
+  reader.size = size;
+  reader.pos = header.header_size;
+  reader.swap = 0;
+
+  uint32_t geometry_type;
+  int has_z;
+  int has_m;
+  if (ArrowGPKGReadWKBType(&reader, &geometry_type, &has_z, &has_m) != NANOARROW_OK) {
+    ArrowErrorSet(error, "Invalid WKB geometry at byte %ld", (long)reader.pos);
+    return EINVAL;
+  }
+
+  // Unknown geometry types (e.g., curves) are recorded as type 0
+  out->geometry_types |= 1u << (geometry_type <= 7 ? geometry_type : 0);
+  out->dimensions |= 1u << (1 + has_z + 2 * has_m);
+  return NANOARROW_OK;
+}
+
+int ArrowGPKGDetectGeometryTypes(sqlite3* con, const char* table_name,
+                                 const char* column_name, int64_t max_rows,
+                                 struct ArrowGPKGGeometryTypes* out,
+                                 struct ArrowSQLite3Error* error) {
+  struct ArrowError* arrow_error = (struct ArrowError*)error;
+  out->geometry_types = 0;
+  out->dimensions = 0;
+  out->n_rows = 0;
+  out->n_null = 0;
+  out->complete = 0;
+
+  char* registered_column_name = NULL;
+  if (column_name == NULL) {
+    int code = ArrowGPKGGeometryColumnName(con, table_name, &registered_column_name);
+    if (code == ENOENT) {
+      ArrowErrorSet(arrow_error, "Table '%s' has no registered geometry column",
+                    table_name);
+    }
+
+    NANOARROW_RETURN_NOT_OK(code);
+    column_name = registered_column_name;
+  }
+
+  // Sample the first max_rows rows (plus one to know if there are more). typeof()
+  // lets SQLite check the type of the geometry without loading the blob.
+  char* sql;
+  if (max_rows > 0) {
+    sql = sqlite3_mprintf("SELECT rowid, typeof(\"%w\") = 'blob' FROM \"%w\" LIMIT %lld",
+                          column_name, table_name, (long long)max_rows + 1);
+  } else {
+    sql = sqlite3_mprintf("SELECT rowid, typeof(\"%w\") = 'blob' FROM \"%w\"",
+                          column_name, table_name);
+  }
+
+  sqlite3_stmt* stmt = NULL;
+  int result = sql == NULL ? SQLITE_NOMEM : sqlite3_prepare_v2(con, sql, -1, &stmt, NULL);
+  sqlite3_free(sql);
+  if (result != SQLITE_OK) {
+    ArrowErrorSet(arrow_error, "<%s> %s", sqlite3_errstr(result), sqlite3_errmsg(con));
+    sqlite3_free(registered_column_name);
+    return result == SQLITE_NOMEM ? ENOMEM : EIO;
+  }
+
+  sqlite3_blob* blob = NULL;
+  int code = NANOARROW_OK;
+  while ((result = sqlite3_step(stmt)) == SQLITE_ROW) {
+    if (max_rows > 0 && out->n_rows == max_rows) {
+      break;
+    }
+
+    out->n_rows++;
+    if (!sqlite3_column_int(stmt, 1)) {
+      out->n_null++;
+      continue;
+    }
+
+    sqlite3_int64 rowid = sqlite3_column_int64(stmt, 0);
+    if (blob == NULL) {
+      result = sqlite3_blob_open(con, "main", table_name, column_name, rowid, 0, &blob);
+    } else {
+      result = sqlite3_blob_reopen(blob, rowid);
+    }
+
+    if (result != SQLITE_OK) {
+      ArrowErrorSet(arrow_error, "<%s> %s", sqlite3_errstr(result), sqlite3_errmsg(con));
+      code = EIO;
+      break;
+    }
+
+    code = ArrowGPKGDetectRow(con, blob, out, arrow_error);
+    if (code != NANOARROW_OK) {
+      break;
+    }
+  }
+
+  if (code == NANOARROW_OK && result == SQLITE_DONE) {
+    out->complete = 1;
+  } else if (code == NANOARROW_OK && result != SQLITE_ROW) {
+    ArrowErrorSet(arrow_error, "<%s> %s", sqlite3_errstr(result), sqlite3_errmsg(con));
+    code = EIO;
+  }
+
+  sqlite3_blob_close(blob);
+  sqlite3_finalize(stmt);
+  sqlite3_free(registered_column_name);
+  return code;
+}
+
+int ArrowGPKGChooseGeoArrowLayout(const struct ArrowGPKGGeometryTypes* types,
+                                  enum ArrowGPKGGeometryType* geometry_type_out,
+                                  enum ArrowGPKGDimensions* dimensions_out) {
+  // All geometries must have the same dimensions
+  int dimensions = 0;
+  for (int i = ARROW_GPKG_DIMENSIONS_XY; i <= ARROW_GPKG_DIMENSIONS_XYZM; i++) {
+    if (types->dimensions == (1u << i)) {
+      dimensions = i;
+    }
+  }
+
+  if (dimensions == 0) {
+    return ENOTSUP;
+  }
+
+  // Either one single geometry type or a mix of a single geometry type and its multi
+  // geometry type (which are promoted)
+  uint32_t geometry_types = types->geometry_types;
+  for (int single_type = ARROW_GPKG_GEOMETRY_TYPE_POINT;
+       single_type <= ARROW_GPKG_GEOMETRY_TYPE_POLYGON; single_type++) {
+    uint32_t single_bit = 1u << single_type;
+    uint32_t multi_bit = 1u << (single_type + 3);
+    if (geometry_types == single_bit) {
+      *geometry_type_out = (enum ArrowGPKGGeometryType)single_type;
+    } else if ((geometry_types & multi_bit) &&
+               (geometry_types & ~(single_bit | multi_bit)) == 0) {
+      *geometry_type_out = (enum ArrowGPKGGeometryType)(single_type + 3);
+    } else {
+      continue;
+    }
+
+    *dimensions_out = (enum ArrowGPKGDimensions)dimensions;
+    return NANOARROW_OK;
+  }
+
+  return ENOTSUP;
+}
+
+int ArrowGPKGDetectedHandlerInit(struct ArrowSQLite3ColumnHandler* handler,
+                                 const struct ArrowGPKGGeometryTypes* types,
+                                 enum ArrowGPKGCoordType coord_type) {
+  enum ArrowGPKGGeometryType geometry_type;
+  enum ArrowGPKGDimensions dimensions;
+  if (ArrowGPKGChooseGeoArrowLayout(types, &geometry_type, &dimensions) == NANOARROW_OK) {
+    return ArrowGPKGGeoArrowHandlerInit(handler, geometry_type, dimensions, coord_type);
+  }
+
+  return ArrowGPKGWKBHandlerInit(handler);
+}
+
+struct ArrowGPKGTileStreamPrivate {
+  sqlite3* con;
+  sqlite3_stmt* stmt;
+  sqlite3_blob* blob;
+  char* table_name;
+  int64_t zoom_level;
+  int64_t batch_rows;
+  int done;
+  struct ArrowBuffer tile_data;
+  struct ArrowSchema schema;
+  struct ArrowError error;
+};
+
+static int ArrowGPKGTileStreamGetSchema(struct ArrowArrayStream* stream,
+                                        struct ArrowSchema* out) {
+  struct ArrowGPKGTileStreamPrivate* private_data =
+      (struct ArrowGPKGTileStreamPrivate*)stream->private_data;
+  return ArrowSchemaDeepCopy(&private_data->schema, out);
+}
+
+// Read the tile_data of the given row into private_data->tile_data
+static int ArrowGPKGTileStreamReadTile(struct ArrowGPKGTileStreamPrivate* private_data,
+                                       sqlite3_int64 rowid) {
+  int result;
+  if (private_data->blob == NULL) {
+    result = sqlite3_blob_open(private_data->con, "main", private_data->table_name,
+                               "tile_data", rowid, 0, &private_data->blob);
+  } else {
+    result = sqlite3_blob_reopen(private_data->blob, rowid);
+  }
+
+  if (result == SQLITE_OK) {
+    int size = sqlite3_blob_bytes(private_data->blob);
+    NANOARROW_RETURN_NOT_OK(ArrowBufferResize(&private_data->tile_data, size, 0));
+    result = sqlite3_blob_read(private_data->blob, private_data->tile_data.data, size, 0);
+    private_data->tile_data.size_bytes = size;
+  }
+
+  if (result != SQLITE_OK) {
+    ArrowErrorSet(&private_data->error, "<%s> %s", sqlite3_errstr(result),
+                  sqlite3_errmsg(private_data->con));
+    return EIO;
+  }
+
+  return NANOARROW_OK;
+}
+
+static int ArrowGPKGTileStreamAppendRows(struct ArrowGPKGTileStreamPrivate* private_data,
+                                         struct ArrowArray* array) {
+  struct ArrowBufferView tile_data;
+
+  while (array->length < private_data->batch_rows) {
+    int result = sqlite3_step(private_data->stmt);
+    if (result == SQLITE_DONE) {
+      private_data->done = 1;
+      break;
+    } else if (result != SQLITE_ROW) {
+      ArrowErrorSet(&private_data->error, "<%s> %s", sqlite3_errstr(result),
+                    sqlite3_errmsg(private_data->con));
+      return EIO;
+    }
+
+    sqlite3_int64 rowid = sqlite3_column_int64(private_data->stmt, 0);
+    NANOARROW_RETURN_NOT_OK(ArrowGPKGTileStreamReadTile(private_data, rowid));
+    tile_data.data.data = private_data->tile_data.data;
+    tile_data.n_bytes = private_data->tile_data.size_bytes;
+
+    NANOARROW_RETURN_NOT_OK(
+        ArrowArrayAppendInt(array->children[0], private_data->zoom_level));
+    NANOARROW_RETURN_NOT_OK(ArrowArrayAppendInt(
+        array->children[1], sqlite3_column_int64(private_data->stmt, 1)));
+    NANOARROW_RETURN_NOT_OK(ArrowArrayAppendInt(
+        array->children[2], sqlite3_column_int64(private_data->stmt, 2)));
+    NANOARROW_RETURN_NOT_OK(ArrowArrayAppendBytes(array->children[3], tile_data));
+    NANOARROW_RETURN_NOT_OK(ArrowArrayFinishElement(array));
+  }
+
+  return NANOARROW_OK;
+}
+
+static int ArrowGPKGTileStreamGetNext(struct ArrowArrayStream* stream,
+                                      struct ArrowArray* out) {
+  struct ArrowGPKGTileStreamPrivate* private_data =
+      (struct ArrowGPKGTileStreamPrivate*)stream->private_data;
+
+  out->release = NULL;
+  if (private_data->done) {
+    return NANOARROW_OK;
+  }
+
+  struct ArrowArray array;
+  NANOARROW_RETURN_NOT_OK(
+      ArrowArrayInitFromSchema(&array, &private_data->schema, &private_data->error));
+
+  int result = ArrowArrayStartAppending(&array);
+  if (result == NANOARROW_OK) {
+    result = ArrowGPKGTileStreamAppendRows(private_data, &array);
+  }
+
+  if (result == NANOARROW_OK && array.length > 0) {
+    result = ArrowArrayFinishBuilding(&array, &private_data->error);
+  }
+
+  if (result != NANOARROW_OK || array.length == 0) {
+    array.release(&array);
+    return result;
+  }
+
+  memcpy(out, &array, sizeof(struct ArrowArray));
+  return NANOARROW_OK;
+}
+
+static const char* ArrowGPKGTileStreamGetLastError(struct ArrowArrayStream* stream) {
+  struct ArrowGPKGTileStreamPrivate* private_data =
+      (struct ArrowGPKGTileStreamPrivate*)stream->private_data;
+  return private_data->error.message;
+}
+
+static void ArrowGPKGTileStreamRelease(struct ArrowArrayStream* stream) {
+  struct ArrowGPKGTileStreamPrivate* private_data =
+      (struct ArrowGPKGTileStreamPrivate*)stream->private_data;
+
+  if (private_data->blob != NULL) {
+    sqlite3_blob_close(private_data->blob);
+  }
+
+  sqlite3_finalize(private_data->stmt);
+  sqlite3_free(private_data->table_name);
+  ArrowBufferReset(&private_data->tile_data);
+  if (private_data->schema.release != NULL) {
+    private_data->schema.release(&private_data->schema);
+  }
+
+  ArrowFree(private_data);
+  stream->release = NULL;
+}
+
+static int ArrowGPKGTileStreamInitSchema(struct ArrowSchema* schema) {
+  const char* names[] = {"zoom_level", "tile_column", "tile_row"};
+
+  NANOARROW_RETURN_NOT_OK(ArrowSchemaInit(schema, NANOARROW_TYPE_STRUCT));
+  NANOARROW_RETURN_NOT_OK(ArrowSchemaAllocateChildren(schema, 4));
+  for (int i = 0; i < 3; i++) {
+    NANOARROW_RETURN_NOT_OK(ArrowSchemaInit(schema->children[i], NANOARROW_TYPE_INT64));
+    NANOARROW_RETURN_NOT_OK(ArrowSchemaSetName(schema->children[i], names[i]));
+  }
+
+  NANOARROW_RETURN_NOT_OK(ArrowSchemaInit(schema->children[3], NANOARROW_TYPE_BINARY));
+  NANOARROW_RETURN_NOT_OK(ArrowSchemaSetName(schema->children[3], "tile_data"));
+  return NANOARROW_OK;
+}
+
+// Check that table_name is a tile pyramid with a tile matrix at zoom_level and clip
+// the tile range to the size of the tile matrix
+static int ArrowGPKGTileMatrixClip(sqlite3* con, const char* table_name,
+                                   int64_t zoom_level, int64_t* tile_range,
+                                   struct ArrowError* error) {
+  int64_t count;
+  int result = ArrowSQLite3QueryValue(
+      con, "SELECT count(*) FROM gpkg_tile_matrix_set WHERE table_name = ?1",
+      table_name, &count, NULL, (struct ArrowSQLite3Error*)error);
+  if (result == NANOARROW_OK && count == 0) {
+    result = ENOENT;
+  }
+
+  if (result == ENOENT) {
+    ArrowErrorSet(error, "Table '%s' is not in gpkg_tile_matrix_set", table_name);
+  }
+
+  NANOARROW_RETURN_NOT_OK(result);
+
+  char* sql = sqlite3_mprintf(
+      "SELECT matrix_width, matrix_height FROM gpkg_tile_matrix WHERE table_name = ?1 "
+      "AND zoom_level = %lld",
+      (long long)zoom_level);
+  if (sql == NULL) {
+    return ENOMEM;
+  }
+
+  double matrix_size[2];
+  result = ArrowSQLite3QueryValue(con, sql, table_name, NULL, matrix_size,
+                                  (struct ArrowSQLite3Error*)error);
+  sqlite3_free(sql);
+  if (result == ENOENT) {
+    ArrowErrorSet(error, "Table '%s' has no tile matrix at zoom level %lld", table_name,
+                  (long long)zoom_level);
+  }
+
+  NANOARROW_RETURN_NOT_OK(result);
+
+  // tile_range is min_column, min_row, max_column, max_row. Only the minimums are
+  // raised and the maximums lowered, such that a window outside of the matrix stays
+  // empty (with a minimum greater than its maximum).
+  for (int i = 0; i < 2; i++) {
+    int64_t max_value = (int64_t)matrix_size[i] - 1;
+    if (tile_range[i] < 0) {
+      tile_range[i] = 0;
+    }
+
+    if (tile_range[2 + i] > max_value) {
+      tile_range[2 + i] = max_value;
+    }
+  }
+
+  return NANOARROW_OK;
+}
+
+int ArrowGPKGTileStreamInit(struct ArrowArrayStream* stream, sqlite3* con,
+                            const char* table_name, int64_t zoom_level,
+                            int64_t min_column, int64_t min_row, int64_t max_column,
+                            int64_t max_row, int64_t batch_rows,
+                            struct ArrowSQLite3Error* error) {
+  struct ArrowError* arrow_error = (struct ArrowError*)error;
+
+  if (batch_rows <= 0) {
+    ArrowErrorSet(arrow_error, "batch_rows must be greater than zero");
+    return EINVAL;
+  }
+
+  int64_t tile_range[] = {min_column, min_row, max_column, max_row};
+  NANOARROW_RETURN_NOT_OK(
+      ArrowGPKGTileMatrixClip(con, table_name, zoom_level, tile_range, arrow_error));
+
+  struct ArrowGPKGTileStreamPrivate* private_data =
+      (struct ArrowGPKGTileStreamPrivate*)ArrowMalloc(
+          sizeof(struct ArrowGPKGTileStreamPrivate));
+  if (private_data == NULL) {
+    return ENOMEM;
+  }
+
+  memset(private_data, 0, sizeof(struct ArrowGPKGTileStreamPrivate));
+  private_data->con = con;
+  private_data->zoom_level = zoom_level;
+  private_data->batch_rows = batch_rows;
+  ArrowBufferInit(&private_data->tile_data);
+  stream->private_data = private_data;
+  stream->get_schema = &ArrowGPKGTileStreamGetSchema;
+  stream->get_next = &ArrowGPKGTileStreamGetNext;
+  stream->get_last_error = &ArrowGPKGTileStreamGetLastError;
+  stream->release = &ArrowGPKGTileStreamRelease;
+
+  private_data->table_name = sqlite3_mprintf("%s", table_name);
+  if (private_data->table_name == NULL) {
+    stream->release(stream);
+    return ENOMEM;
+  }
+
+  // The unique (zoom_level, tile_column, tile_row) index covers this query, so the
+  // window is found without touching the tiles. Sorting by rowid (the primary key)
+  // makes the reads of tile_data sequential.
+  char* sql = sqlite3_mprintf(
+      "SELECT rowid, tile_column, tile_row FROM \"%w\" WHERE zoom_level = ?1 AND "
+      "tile_column BETWEEN ?2 AND ?3 AND tile_row BETWEEN ?4 AND ?5 ORDER BY rowid",
+      table_name);
+  if (sql == NULL) {
+    stream->release(stream);
+    return ENOMEM;
+  }
+
+  int result = sqlite3_prepare_v2(con, sql, -1, &private_data->stmt, NULL);
+  sqlite3_free(sql);
+  if (result != SQLITE_OK) {
+    ArrowErrorSet(arrow_error, "<%s> %s", sqlite3_errstr(result), sqlite3_errmsg(con));
+    stream->release(stream);
+    return EIO;
+  }
+
+  sqlite3_bind_int64(private_data->stmt, 1, zoom_level);
+  sqlite3_bind_int64(private_data->stmt, 2, tile_range[0]);
+  sqlite3_bind_int64(private_data->stmt, 3, tile_range[2]);
+  sqlite3_bind_int64(private_data->stmt, 4, tile_range[1]);
+  sqlite3_bind_int64(private_data->stmt, 5, tile_range[3]);
+
+  result = ArrowGPKGTileStreamInitSchema(&private_data->schema);
+  if (result != NANOARROW_OK) {
+    stream->release(stream);
+    return result;
+  }
+
+  return NANOARROW_OK;
+}
+
+// Get the geometry type (0 for geoarrow.wkb) and dimensions (0 if unknown) of a
+// GeoArrow field. Returns ENOENT if schema isn't a supported GeoArrow field.
+static int ArrowGPKGGeoArrowFieldType(struct ArrowSchema* schema, int* geometry_type_out,
+                                      int* dimensions_out) {
+  struct ArrowStringView extension_name = {NULL, 0};
+  NANOARROW_RETURN_NOT_OK(ArrowMetadataGetValue(
+      schema->metadata, ArrowCharView("ARROW:extension:name"), &extension_name));
+
+  *geometry_type_out = -1;
+  *dimensions_out = 0;
+  if (extension_name.n_bytes == 12 &&
+      strncmp(extension_name.data, "geoarrow.wkb", 12) == 0) {
+    *geometry_type_out = 0;
+    return NANOARROW_OK;
+  }
+
+  for (int i = ARROW_GPKG_GEOMETRY_TYPE_POINT; i <= ARROW_GPKG_GEOMETRY_TYPE_MULTIPOLYGON;
+       i++) {
+    const char* name = kArrowGPKGGeoArrowNames[i];
+    if ((int64_t)strlen(name) == extension_name.n_bytes &&
+        strncmp(extension_name.data, name, extension_name.n_bytes) == 0) {
+      *geometry_type_out = i;
+    }
+  }
+
+  if (*geometry_type_out == -1) {
+    return ENOENT;
+  }
+
+  // The coordinates are a fixed-size list named after its dimensions or a struct
+  // with one child per dimension inside zero or more lists
+  struct ArrowSchema* coords = schema;
+  while (coords->n_children == 1 && (strcmp(coords->format, "+l") == 0 ||
+                                     strcmp(coords->format, "+L") == 0)) {
+    coords = coords->children[0];
+  }
+
+  char dims[5] = {'\0'};
+  if (strncmp(coords->format, "+w:", 3) == 0 && coords->n_children == 1 &&
+      coords->children[0]->name != NULL) {
+    snprintf(dims, sizeof(dims), "%s", coords->children[0]->name);
+  } else if (strcmp(coords->format, "+s") == 0 && coords->n_children <= 4) {
+    for (int64_t i = 0; i < coords->n_children; i++) {
+      const char* name = coords->children[i]->name;
+      dims[i] = name != NULL && strlen(name) == 1 ? name[0] : '?';
+    }
+  }
+
+  for (int i = ARROW_GPKG_DIMENSIONS_XY; i <= ARROW_GPKG_DIMENSIONS_XYZM; i++) {
+    if (strcmp(dims, kArrowGPKGDimensionNames[i]) == 0) {
+      *dimensions_out = i;
+    }
+  }
+
+  return NANOARROW_OK;
+}
+
+// Parse the JSON string starting at *pos in json (after the opening quote) into out
+// (if not NULL), leaving *pos after the closing quote
+static int ArrowGPKGParseJSONString(struct ArrowStringView json, int64_t* pos,
+                                    sqlite3_str* out) {
+  while (*pos < json.n_bytes) {
+    char c = json.data[(*pos)++];
+    if (c == '"') {
+      return NANOARROW_OK;
+    } else if (c != '\\') {
+      if (out != NULL) {
+        sqlite3_str_appendchar(out, 1, c);
+      }
+
+      continue;
+    }
+
+    if (*pos >= json.n_bytes) {
+      return EINVAL;
+    }
+
+    c = json.data[(*pos)++];
+    switch (c) {
+      case 'n':
+        c = '\n';
+        break;
+      case 't':
+        c = '\t';
+        break;
+      case 'r':
+        c = '\r';
+        break;
+      case 'b':
+        c = '\b';
+        break;
+      case 'f':
+        c = '\f';
+        break;
+      case 'u': {
+        // Only escaped ASCII characters (e.g., control characters) are supported
+        unsigned int code;
+        if (json.n_bytes - *pos < 4 || sscanf(json.data + *pos, "%4x", &code) != 1 ||
+            code > 0x7f) {
+          return ENOTSUP;
+        }
+
+        *pos += 4;
+        c = (char)code;
+        break;
+      }
+      default:
+        break;
+    }
+
+    if (out != NULL) {
+      sqlite3_str_appendchar(out, 1, c);
+    }
+  }
+
+  return EINVAL;
+}
+
+// Skip the JSON value starting at *pos in json, leaving *pos after it
+static int ArrowGPKGSkipJSONValue(struct ArrowStringView json, int64_t* pos) {
+  int depth = 0;
+  while (*pos < json.n_bytes) {
+    char c = json.data[*pos];
+    if (depth == 0 && strchr(",}] \t\r\n", c) != NULL) {
+      return NANOARROW_OK;
+    }
+
+    (*pos)++;
+    if (c == '"') {
+      NANOARROW_RETURN_NOT_OK(ArrowGPKGParseJSONString(json, pos, NULL));
+    } else if (c == '{' || c == '[') {
+      depth++;
+    } else if (c == '}' || c == ']') {
+      depth--;
+    }
+
+    if (depth == 0 && strchr("\"}]", c) != NULL) {
+      return NANOARROW_OK;
+    }
+  }
+
+  return depth == 0 ? NANOARROW_OK : EINVAL;
+}
+
+// Get the (unparsed) value of key in the JSON object json. Returns ENOENT if json has
+// no such key.
+static int ArrowGPKGJSONValue(struct ArrowStringView json, const char* key,
+                              struct ArrowStringView* value_out) {
+  int64_t pos = 0;
+  int depth = 0;
+  int expect_key = 0;
+  int64_t key_size = strlen(key);
+
+  while (pos < json.n_bytes) {
+    char c = json.data[pos++];
+    if (c == '{') {
+      depth++;
+      expect_key = depth == 1;
+    } else if (c == '[') {
+      depth++;
+    } else if (c == '}' || c == ']') {
+      depth--;
+    } else if (c == ',' && depth == 1) {
+      expect_key = 1;
+    } else if (c == '"') {
+      int64_t start = pos;
+      NANOARROW_RETURN_NOT_OK(ArrowGPKGParseJSONString(json, &pos, NULL));
+      if (!expect_key) {
+        continue;
+      }
+
+      expect_key = 0;
+      int matches = (pos - start - 1) == key_size &&
+                    strncmp(json.data + start, key, key_size) == 0;
+      while (pos < json.n_bytes && strchr(" \t\r\n:", json.data[pos]) != NULL) {
+        pos++;
+      }
+
+      if (!matches) {
+        continue;
+      }
+
+      start = pos;
+      NANOARROW_RETURN_NOT_OK(ArrowGPKGSkipJSONValue(json, &pos));
+      if (pos == start) {
+        return EINVAL;
+      }
+
+      value_out->data = json.data + start;
+      value_out->n_bytes = pos - start;
+      return NANOARROW_OK;
+    }
+  }
+
+  return ENOENT;
+}
+
+// Get the value of key in the JSON object json if it is a string. Returns ENOENT if
+// json has no such key and ENOTSUP if its value isn't a string.
+static int ArrowGPKGJSONStringValue(struct ArrowStringView json, const char* key,
+                                    char** value_out) {
+  struct ArrowStringView value;
+  NANOARROW_RETURN_NOT_OK(ArrowGPKGJSONValue(json, key, &value));
+  if (value.data[0] != '"') {
+    return ENOTSUP;
+  }
+
+  int64_t pos = 1;
+  sqlite3_str* out = sqlite3_str_new(NULL);
+  int result = ArrowGPKGParseJSONString(value, &pos, out);
+  *value_out = sqlite3_str_finish(out);
+  if (result != NANOARROW_OK) {
+    sqlite3_free(*value_out);
+    *value_out = NULL;
+    return result;
+  }
+
+  return *value_out == NULL ? ENOMEM : NANOARROW_OK;
+}
+
+static int ArrowGPKGExec(sqlite3* con, const char* sql, struct ArrowError* error) {
+  int result = sqlite3_exec(con, sql, NULL, NULL, NULL);
+  if (result != SQLITE_OK) {
+    ArrowErrorSet(error, "<%s> %s", sqlite3_errstr(result), sqlite3_errmsg(con));
+    return EIO;
+  }
+
+  return NANOARROW_OK;
+}
+
+// Create the tables required in every GeoPackage (with the required rows of
+// gpkg_spatial_ref_sys) if they don't exist yet
+static int ArrowGPKGEnsureCoreTables(sqlite3* con, struct ArrowError* error) {
+  int64_t application_id = 0;
+  NANOARROW_RETURN_NOT_OK(
+      ArrowSQLite3QueryValue(con, "PRAGMA application_id", NULL, &application_id, NULL,
+                             (struct ArrowSQLite3Error*)error));
+  if (application_id == 0) {
+    // 'GPKG' and version 1.4.0
+    NANOARROW_RETURN_NOT_OK(ArrowGPKGExec(
+        con, "PRAGMA application_id = 1196444487; PRAGMA user_version = 10400", error));
+  }
+
+  NANOARROW_RETURN_NOT_OK(ArrowGPKGExec(
+      con,
+      "CREATE TABLE IF NOT EXISTS gpkg_spatial_ref_sys (srs_name TEXT NOT NULL, "
+      "srs_id INTEGER PRIMARY KEY, organization TEXT NOT NULL, "
+      "organization_coordsys_id INTEGER NOT NULL, definition  TEXT NOT NULL, "
+      "description TEXT)",
+      error));
+  NANOARROW_RETURN_NOT_OK(ArrowGPKGExec(
+      con,
+      "INSERT OR IGNORE INTO gpkg_spatial_ref_sys VALUES "
+      "('Undefined cartesian SRS', -1, 'NONE', -1, 'undefined', "
+      "'undefined cartesian coordinate reference system'), "
+      "('Undefined geographic SRS', 0, 'NONE', 0, 'undefined', "
+      "'undefined geographic coordinate reference system'), "
+      "('WGS 84 geodetic', 4326, 'EPSG', 4326, 'GEOGCS[\"WGS 84\",DATUM[\"WGS_1984\","
+      "SPHEROID[\"WGS 84\",6378137,298.257223563,AUTHORITY[\"EPSG\",\"7030\"]],"
+      "AUTHORITY[\"EPSG\",\"6326\"]],"
+      "PRIMEM[\"Greenwich\",0,AUTHORITY[\"EPSG\",\"8901\"]],"
+      "UNIT[\"degree\",0.0174532925199433,AUTHORITY[\"EPSG\",\"9122\"]],"
+      "AXIS[\"Latitude\",NORTH],AXIS[\"Longitude\",EAST],AUTHORITY[\"EPSG\",\"4326\"]]', "
+      "'longitude/latitude coordinates in decimal degrees on the WGS 84 spheroid')",
+      error));
+  NANOARROW_RETURN_NOT_OK(ArrowGPKGExec(
+      con,
+      "CREATE TABLE IF NOT EXISTS gpkg_contents (table_name TEXT NOT NULL PRIMARY KEY, "
+      "data_type TEXT NOT NULL, identifier TEXT UNIQUE, description TEXT DEFAULT '', "
+      "last_change DATETIME NOT NULL DEFAULT (strftime('%Y-%m-%dT%H:%M:%fZ','now')), "
+      "min_x DOUBLE, min_y DOUBLE, max_x DOUBLE, max_y DOUBLE, srs_id INTEGER, "
+      "CONSTRAINT fk_gc_r_srs_id FOREIGN KEY (srs_id) REFERENCES "
+      "gpkg_spatial_ref_sys(srs_id))",
+      error));
+  return ArrowGPKGExec(
+      con,
+      "CREATE TABLE IF NOT EXISTS gpkg_geometry_columns (table_name TEXT NOT NULL, "
+      "column_name TEXT NOT NULL, geometry_type_name TEXT NOT NULL, srs_id INTEGER NOT "
+      "NULL, z TINYINT NOT NULL, m TINYINT NOT NULL, CONSTRAINT pk_geom_cols PRIMARY "
+      "KEY (table_name, column_name), CONSTRAINT uk_gc_table_name UNIQUE (table_name), "
+      "CONSTRAINT fk_gc_tn FOREIGN KEY (table_name) REFERENCES "
+      "gpkg_contents(table_name), CONSTRAINT fk_gc_srs FOREIGN KEY (srs_id) REFERENCES "
+      "gpkg_spatial_ref_sys (srs_id))",
+      error);
+}
+
+// Non-zero if crs looks like a WKT definition (a keyword followed by a bracket, e.g.,
+// PROJCS[...] or GEOGCRS[...])
+static int ArrowGPKGIsWKT(const char* crs) {
+  size_t n = strspn(crs, "ABCDEFGHIJKLMNOPQRSTUVWXYZ_");
+  return n > 0 && (crs[n] == '[' || crs[n] == '(');
+}
+
+// Find the srs_id of a crs in gpkg_spatial_ref_sys. Authority codes (e.g., EPSG:32631)
+// are matched by organization and code and must have been registered (with their WKT
+// definition) before. WKT definitions are matched by definition or added as a custom
+// srs. Other crs values are not supported because the definition must be WKT.
+static int ArrowGPKGResolveSRS(sqlite3* con, const char* crs, int32_t* srs_id_out,
+                               struct ArrowError* error) {
+  // GeoPackage geometries are always stored as x/y (i.e., lon/lat for 4326)
+  if (sqlite3_stricmp(crs, "OGC:CRS84") == 0) {
+    crs = "EPSG:4326";
+  }
+
+  char organization[32];
+  int code;
+  char end;
+  int is_authority_code =
+      sscanf(crs, "%31[A-Za-z]:%d%c", organization, &code, &end) == 2;
+  if (!is_authority_code && !ArrowGPKGIsWKT(crs)) {
+    ArrowErrorSet(error, "crs '%s' is neither an authority code nor a WKT definition",
+                  crs);
+    return ENOTSUP;
+  }
+
+  char* sql;
+  if (is_authority_code) {
+    sql = sqlite3_mprintf(
+        "SELECT srs_id FROM gpkg_spatial_ref_sys WHERE organization = '%q' COLLATE "
+        "NOCASE AND organization_coordsys_id = %d",
+        organization, code);
+  } else {
+    sql = sqlite3_mprintf("SELECT srs_id FROM gpkg_spatial_ref_sys WHERE definition = ?");
+  }
+
+  if (sql == NULL) {
+    return ENOMEM;
+  }
+
+  int64_t srs_id;
+  int result = ArrowSQLite3QueryValue(con, sql, is_authority_code ? NULL : crs, &srs_id,
+                                      NULL, (struct ArrowSQLite3Error*)error);
+  sqlite3_free(sql);
+  if (result != ENOENT) {
+    *srs_id_out = (int32_t)srs_id;
+    return result;
+  }
+
+  if (is_authority_code) {
+    ArrowErrorSet(error,
+                  "crs '%s' is not in gpkg_spatial_ref_sys (its WKT definition must be "
+                  "registered first)",
+                  crs);
+    return ENOTSUP;
+  }
+
+  // Custom definitions are numbered from 100000 (like GDAL does)
+  NANOARROW_RETURN_NOT_OK(ArrowSQLite3QueryValue(
+      con,
+      "SELECT max(coalesce(max(srs_id) + 1, 0), 100000) FROM gpkg_spatial_ref_sys",
+      NULL, &srs_id, NULL, (struct ArrowSQLite3Error*)error));
+  sql = sqlite3_mprintf(
+      "INSERT INTO gpkg_spatial_ref_sys VALUES ('Unknown', %lld, 'NONE', %lld, '%q', "
+      "NULL)",
+      (long long)srs_id, (long long)srs_id, crs);
+  if (sql == NULL) {
+    return ENOMEM;
+  }
+
+  result = ArrowGPKGExec(con, sql, error);
+  sqlite3_free(sql);
+  *srs_id_out = (int32_t)srs_id;
+  return result;
+}
+
+// The crs to resolve for a PROJJSON crs value: the authority code from its id (e.g.,
+// {..., "id": {"authority": "EPSG", "code": 32631}}). Returns ENOTSUP if it has no
+// id, as PROJJSON can't be stored as a gpkg_spatial_ref_sys definition.
+static int ArrowGPKGPROJJSONCrs(struct ArrowStringView projjson, char** crs_out) {
+  struct ArrowStringView id;
+  int result = ArrowGPKGJSONValue(projjson, "id", &id);
+  if (result == ENOENT) {
+    return ENOTSUP;
+  }
+
+  NANOARROW_RETURN_NOT_OK(result);
+  struct ArrowStringView code;
+  char* authority;
+  if (ArrowGPKGJSONValue(id, "code", &code) != NANOARROW_OK ||
+      ArrowGPKGJSONStringValue(id, "authority", &authority) != NANOARROW_OK) {
+    return EINVAL;
+  }
+
+  if (code.data[0] == '"') {
+    code.data++;
+    code.n_bytes -= 2;
+  }
+
+  *crs_out = sqlite3_mprintf("%s:%.*s", authority, (int)code.n_bytes, code.data);
+  sqlite3_free(authority);
+  return *crs_out == NULL ? ENOMEM : NANOARROW_OK;
+}
+
+// Get the srs_id of a geometry field from the crs in its extension metadata or its
+// gpkg:srs_id metadata (e.g., from ArrowGPKGCatalogAnnotateSchema())
+static int ArrowGPKGFieldSRS(sqlite3* con, struct ArrowSchema* schema,
+                             int32_t* srs_id_out, struct ArrowError* error) {
+  struct ArrowStringView value = {NULL, 0};
+  NANOARROW_RETURN_NOT_OK(ArrowMetadataGetValue(
+      schema->metadata, ArrowCharView("ARROW:extension:metadata"), &value));
+
+  char* crs = NULL;
+  int result = value.data == NULL ? ENOENT : ArrowGPKGJSONStringValue(value, "crs", &crs);
+  if (result == ENOTSUP) {
+    struct ArrowStringView projjson;
+    result = ArrowGPKGJSONValue(value, "crs", &projjson);
+    if (result == NANOARROW_OK && projjson.data[0] == '{') {
+      result = ArrowGPKGPROJJSONCrs(projjson, &crs);
+    } else if (result == NANOARROW_OK && projjson.n_bytes == 4 &&
+               strncmp(projjson.data, "null", 4) == 0) {
+      result = ENOENT;
+    } else if (result == NANOARROW_OK) {
+      result = EINVAL;
+    }
+  }
+
+  if (result == NANOARROW_OK) {
+    result = ArrowGPKGResolveSRS(con, crs, srs_id_out, error);
+    sqlite3_free(crs);
+    return result;
+  } else if (result == ENOTSUP) {
+    ArrowErrorSet(error, "PROJJSON crs of column '%s' has no id", schema->name);
+    return result;
+  } else if (result != ENOENT) {
+    ArrowErrorSet(error, "Invalid ARROW:extension:metadata for column '%s'",
+                  schema->name);
+    return result;
+  }
+
+  // Without a crs, the srs_id has to exist already (or the srs is undefined)
+  *srs_id_out = -1;
+  value.data = NULL;
+  NANOARROW_RETURN_NOT_OK(
+      ArrowMetadataGetValue(schema->metadata, ArrowCharView("gpkg:srs_id"), &value));
+  if (value.data == NULL) {
+    return NANOARROW_OK;
+  }
+
+  char srs_id[16];
+  snprintf(srs_id, sizeof(srs_id), "%.*s", (int)value.n_bytes, value.data);
+  int64_t count;
+  NANOARROW_RETURN_NOT_OK(ArrowSQLite3QueryValue(
+      con, "SELECT count(*) FROM gpkg_spatial_ref_sys WHERE srs_id = CAST(?1 AS INTEGER)",
+      srs_id, &count, NULL, (struct ArrowSQLite3Error*)error));
+  if (count == 0) {
+    ArrowErrorSet(error, "srs_id %s of column '%s' is not in gpkg_spatial_ref_sys",
+                  srs_id, schema->name);
+    return ENOENT;
+  }
+
+  *srs_id_out = atoi(srs_id);
+  return NANOARROW_OK;
+}
+
+// The GeoPackage data type for a column such that reading it with declared types
+// gives the same type (or the narrowest type that can hold its values). Declared
+// types from nanoarrow_sqlite3.decltype metadata are kept as is.
+static const char* ArrowGPKGDeclaredType(struct ArrowSchema* schema, char* buf,
+                                         size_t buf_size) {
+  struct ArrowStringView decltype = {NULL, 0};
+  if (ArrowMetadataGetValue(schema->metadata, ArrowCharView("nanoarrow_sqlite3.decltype"),
+                            &decltype) == NANOARROW_OK &&
+      decltype.data != NULL && decltype.n_bytes > 0 &&
+      decltype.n_bytes < (int64_t)buf_size) {
+    // Only keep declared types that can be pasted into a CREATE TABLE statement
+    int valid = 1;
+    for (int64_t i = 0; i < decltype.n_bytes; i++) {
+      char c = decltype.data[i];
+      valid = valid && (isalnum((unsigned char)c) || strchr("_ (),", c) != NULL);
+    }
+
+    if (valid) {
+      snprintf(buf, buf_size, "%.*s", (int)decltype.n_bytes, decltype.data);
+      return buf;
+    }
+  }
+
+  const char* format = schema->format;
+  if (strcmp(format, "b") == 0) {
+    return "BOOLEAN";
+  } else if (strcmp(format, "c") == 0) {
+    return "TINYINT";
+  } else if (strcmp(format, "C") == 0 || strcmp(format, "s") == 0) {
+    return "SMALLINT";
+  } else if (strcmp(format, "S") == 0 || strcmp(format, "i") == 0) {
+    return "MEDIUMINT";
+  } else if (strcmp(format, "I") == 0 || strcmp(format, "l") == 0 ||
+             strcmp(format, "L") == 0) {
+    return "INTEGER";
+  } else if (strcmp(format, "f") == 0) {
+    return "FLOAT";
+  } else if (strcmp(format, "g") == 0) {
+    return "DOUBLE";
+  } else if (strcmp(format, "u") == 0 || strcmp(format, "U") == 0) {
+    return "TEXT";
+  } else if (strcmp(format, "z") == 0 || strcmp(format, "Z") == 0 ||
+             strncmp(format, "w:", 2) == 0) {
+    return "BLOB";
+  } else {
+    return NULL;
+  }
+}
+
+static const char* kArrowGPKGGeometryTypeNames[] = {
+    "GEOMETRY",   "POINT",           "LINESTRING",  "POLYGON",
+    "MULTIPOINT", "MULTILINESTRING", "MULTIPOLYGON"};
+
+static int ArrowGPKGIsGeometryField(struct ArrowSchema* schema) {
+  int geometry_type;
+  int dimensions;
+  return ArrowGPKGGeoArrowFieldType(schema, &geometry_type, &dimensions) ==
+         NANOARROW_OK;
+}
+
+// Append the CREATE TABLE statement for the columns of schema to sql. geometry_type
+// is the GeoPackage geometry type name of the geometry column (if any).
+static int ArrowGPKGCreateTableSQL(sqlite3_str* sql, const char* table_name,
+                                   struct ArrowSchema* schema, const char* geometry_type,
+                                   struct ArrowError* error) {
+  // GeoPackage tables need an INTEGER PRIMARY KEY: use an integer fid column of the
+  // schema or add one
+  int64_t fid_column = -1;
+  for (int64_t i = 0; i < schema->n_children; i++) {
+    const char* name = schema->children[i]->name;
+    const char* format = schema->children[i]->format;
+    if (name != NULL && sqlite3_stricmp(name, "fid") == 0 &&
+        strchr("cCsSiIlL", format[0]) != NULL && format[1] == '\0') {
+      fid_column = i;
+    }
+  }
+
+  sqlite3_str_appendf(sql, "CREATE TABLE \"%w\" (", table_name);
+  if (fid_column == -1) {
+    sqlite3_str_appendall(sql, "fid INTEGER PRIMARY KEY AUTOINCREMENT NOT NULL");
+  }
+
+  char buf[64];
+  for (int64_t i = 0; i < schema->n_children; i++) {
+    struct ArrowSchema* child = schema->children[i];
+    const char* name = child->name == NULL ? "" : child->name;
+    const char* declared_type;
+    if (i == fid_column) {
+      declared_type = "INTEGER PRIMARY KEY AUTOINCREMENT";
+    } else if (ArrowGPKGIsGeometryField(child)) {
+      declared_type = geometry_type;
+    } else {
+      declared_type = ArrowGPKGDeclaredType(child, buf, sizeof(buf));
+    }
+
+    if (declared_type == NULL) {
+      ArrowErrorSet(error, "Can't create column '%s' with format '%s'", name,
+                    child->format);
+      return ENOTSUP;
+    }
+
+    int not_null = i == fid_column || !(child->flags & ARROW_FLAG_NULLABLE);
+    sqlite3_str_appendf(sql, "%s\"%w\" %s%s", (i == 0 && fid_column != -1) ? "" : ", ",
+                        name, declared_type, not_null ? " NOT NULL" : "");
+  }
+
+  sqlite3_str_appendall(sql, ")");
+  return sqlite3_str_errcode(sql) == SQLITE_OK ? NANOARROW_OK : ENOMEM;
+}
+
+static int ArrowGPKGCreateTableInternal(sqlite3* con, const char* table_name,
+                                        struct ArrowSchema* schema,
+                                        struct ArrowError* error) {
+  // A feature table has exactly one geometry column
+  int64_t geometry_column = -1;
+  for (int64_t i = 0; i < schema->n_children; i++) {
+    if (!ArrowGPKGIsGeometryField(schema->children[i])) {
+      continue;
+    } else if (geometry_column != -1) {
+      ArrowErrorSet(error, "Can't create a table with more than one geometry column");
+      return ENOTSUP;
+    }
+
+    geometry_column = i;
+  }
+
+  int geometry_type = 0;
+  int dimensions = 0;
+  int32_t srs_id = -1;
+  struct ArrowSchema* geometry = NULL;
+  if (geometry_column != -1) {
+    geometry = schema->children[geometry_column];
+    NANOARROW_RETURN_NOT_OK(ArrowGPKGGeoArrowFieldType(geometry, &geometry_type,
+                                                       &dimensions));
+  }
+
+  NANOARROW_RETURN_NOT_OK(ArrowGPKGEnsureCoreTables(con, error));
+  if (geometry != NULL) {
+    NANOARROW_RETURN_NOT_OK(ArrowGPKGFieldSRS(con, geometry, &srs_id, error));
+  }
+
+  // Keep the geometry type of WKB columns read from a GeoPackage
+  char geometry_type_name[32];
+  snprintf(geometry_type_name, sizeof(geometry_type_name), "%s",
+           kArrowGPKGGeometryTypeNames[geometry_type]);
+  struct ArrowStringView value = {NULL, 0};
+  if (geometry != NULL && geometry_type == 0 &&
+      ArrowMetadataGetValue(geometry->metadata, ArrowCharView("gpkg:geometry_type_name"),
+                            &value) == NANOARROW_OK &&
+      value.data != NULL && value.n_bytes < (int64_t)sizeof(geometry_type_name)) {
+    for (int64_t i = 0; i < value.n_bytes; i++) {
+      geometry_type_name[i] = (char)toupper((unsigned char)value.data[i]);
+      geometry_type_name[i] = isalpha((unsigned char)geometry_type_name[i])
+                                  ? geometry_type_name[i]
+                                  : '_';
+    }
+
+    geometry_type_name[value.n_bytes] = '\0';
+  }
+
+  sqlite3_str* sql = sqlite3_str_new(con);
+  int result =
+      ArrowGPKGCreateTableSQL(sql, table_name, schema, geometry_type_name, error);
+  char* sql_chars = sqlite3_str_finish(sql);
+  if (result == NANOARROW_OK && sql_chars == NULL) {
+    result = ENOMEM;
+  }
+
+  if (result == NANOARROW_OK) {
+    result = ArrowGPKGExec(con, sql_chars, error);
+  }
+
+  sqlite3_free(sql_chars);
+  NANOARROW_RETURN_NOT_OK(result);
+
+  if (geometry == NULL) {
+    sql_chars = sqlite3_mprintf(
+        "INSERT INTO gpkg_contents (table_name, data_type, identifier) VALUES ('%q', "
+        "'attributes', '%q')",
+        table_name, table_name);
+  } else {
+    sql_chars = sqlite3_mprintf(
+        "INSERT INTO gpkg_contents (table_name, data_type, identifier, srs_id) VALUES "
+        "('%q', 'features', '%q', %d)",
+        table_name, table_name, srs_id);
+  }
+
+  result = sql_chars == NULL ? ENOMEM : ArrowGPKGExec(con, sql_chars, error);
+  sqlite3_free(sql_chars);
+  NANOARROW_RETURN_NOT_OK(result);
+
+  if (geometry == NULL) {
+    return NANOARROW_OK;
+  }
+
+  // z and m are prohibited (0), mandatory (1), or optional (2)
+  int z = 2;
+  int m = 2;
+  if (dimensions != 0) {
+    z = dimensions == ARROW_GPKG_DIMENSIONS_XYZ ||
+        dimensions == ARROW_GPKG_DIMENSIONS_XYZM;
+    m = dimensions == ARROW_GPKG_DIMENSIONS_XYM ||
+        dimensions == ARROW_GPKG_DIMENSIONS_XYZM;
+  }
+
+  sql_chars = sqlite3_mprintf(
+      "INSERT INTO gpkg_geometry_columns VALUES ('%q', '%q', '%s', %d, %d, %d)",
+      table_name, geometry->name == NULL ? "" : geometry->name, geometry_type_name,
+      srs_id, z, m);
+  result = sql_chars == NULL ? ENOMEM : ArrowGPKGExec(con, sql_chars, error);
+  sqlite3_free(sql_chars);
+  return result;
+}
+
+int ArrowGPKGCreateTable(sqlite3* con, const char* table_name,
+                         struct ArrowSchema* schema, struct ArrowSQLite3Error* error) {
+  struct ArrowError* arrow_error = (struct ArrowError*)error;
+  if (strcmp(schema->format, "+s") != 0) {
+    ArrowErrorSet(arrow_error, "Expected a struct schema");
+    return EINVAL;
+  }
+
+  // A savepoint works both in and outside of a transaction
+  NANOARROW_RETURN_NOT_OK(ArrowGPKGExec(con, "SAVEPOINT arrow_gpkg_create", arrow_error));
+  int result = ArrowGPKGCreateTableInternal(con, table_name, schema, arrow_error);
+  if (result != NANOARROW_OK) {
+    sqlite3_exec(con, "ROLLBACK TO arrow_gpkg_create", NULL, NULL, NULL);
+  }
+
+  sqlite3_exec(con, "RELEASE arrow_gpkg_create", NULL, NULL, NULL);
+  return result;
+}
+
+// The coordinates of a batch of a native GeoArrow array: dimension d of coordinate j
+// is values[d][j * stride] (interleaved coordinates have stride n_dims)
+struct ArrowGPKGCoordValues {
+  const double* values[4];
+  int64_t stride;
+  int n_dims;
+};
+
+struct ArrowGPKGEncoderPrivate {
+  int32_t srs_id;
+  // 0 for geoarrow.wkb
+  int geometry_type;
+  int n_dims;
+  uint32_t wkb_dimensions_code;
+  struct ArrowArrayView array_view;
+  // The views of the nested lists (from the outside in) and of the coordinates
+  int n_lists;
+  struct ArrowArrayView* lists[3];
+  struct ArrowArrayView* coords;
+  struct ArrowGPKGCoordValues coord_values;
+  // Used to reserve the data buffer of the next output array
+  int64_t avg_blob_bytes;
+};
+
+void ArrowGPKGEncoderReset(struct ArrowGPKGEncoder* encoder) {
+  struct ArrowGPKGEncoderPrivate* private_data =
+      (struct ArrowGPKGEncoderPrivate*)encoder->private_data;
+  if (private_data == NULL) {
+    return;
+  }
+
+  ArrowArrayViewReset(&private_data->array_view);
+  ArrowFree(private_data);
+  encoder->private_data = NULL;
+}
+
+// Find the views of the nested lists and coordinates of a native GeoArrow array
+static int ArrowGPKGEncoderInitViews(struct ArrowGPKGEncoderPrivate* private_data) {
+  static const int kListLevels[] = {0, 0, 1, 2, 1, 2, 3};
+  private_data->n_lists = kListLevels[private_data->geometry_type];
+
+  struct ArrowArrayView* view = &private_data->array_view;
+  for (int i = 0; i < private_data->n_lists; i++) {
+    if ((view->storage_type != NANOARROW_TYPE_LIST &&
+         view->storage_type != NANOARROW_TYPE_LARGE_LIST) ||
+        view->n_children != 1) {
+      return EINVAL;
+    }
+
+    private_data->lists[i] = view;
+    view = view->children[0];
+  }
+
+  private_data->coords = view;
+  if (view->storage_type == NANOARROW_TYPE_FIXED_SIZE_LIST) {
+    return view->n_children == 1 &&
+                   view->children[0]->storage_type == NANOARROW_TYPE_DOUBLE &&
+                   view->layout.child_size_elements == private_data->n_dims
+               ? NANOARROW_OK
+               : EINVAL;
+  } else if (view->storage_type == NANOARROW_TYPE_STRUCT &&
+             view->n_children == private_data->n_dims) {
+    for (int64_t i = 0; i < view->n_children; i++) {
+      if (view->children[i]->storage_type != NANOARROW_TYPE_DOUBLE) {
+        return EINVAL;
+      }
+    }
+
+    return NANOARROW_OK;
+  }
+
+  return EINVAL;
+}
+
+int ArrowGPKGEncoderInit(struct ArrowGPKGEncoder* encoder, struct ArrowSchema* schema,
+                         int32_t srs_id, struct ArrowSQLite3Error* error) {
+  struct ArrowError* arrow_error = (struct ArrowError*)error;
+  const char* name = schema->name == NULL ? "" : schema->name;
+
+  int geometry_type;
+  int dimensions;
+  if (ArrowGPKGGeoArrowFieldType(schema, &geometry_type, &dimensions) != NANOARROW_OK) {
+    ArrowErrorSet(arrow_error, "Column '%s' is not a GeoArrow column", name);
+    return EINVAL;
+  } else if (geometry_type != 0 && dimensions == 0) {
+    ArrowErrorSet(arrow_error, "Can't determine the dimensions of column '%s'", name);
+    return EINVAL;
+  }
+
+  struct ArrowGPKGEncoderPrivate* private_data =
+      (struct ArrowGPKGEncoderPrivate*)ArrowMalloc(
+          sizeof(struct ArrowGPKGEncoderPrivate));
+  if (private_data == NULL) {
+    return ENOMEM;
+  }
+
+  memset(private_data, 0, sizeof(struct ArrowGPKGEncoderPrivate));
+  private_data->srs_id = srs_id;
+  private_data->geometry_type = geometry_type;
+  if (geometry_type != 0) {
+    private_data->n_dims = (int)strlen(kArrowGPKGDimensionNames[dimensions]);
+    private_data->wkb_dimensions_code = (dimensions - 1) * 1000;
+  }
+
+  ArrowArrayViewInit(&private_data->array_view, NANOARROW_TYPE_UNINITIALIZED);
+  encoder->private_data = private_data;
+
+  int result =
+      ArrowArrayViewInitFromSchema(&private_data->array_view, schema, arrow_error);
+  if (result == NANOARROW_OK && geometry_type == 0) {
+    enum ArrowType storage_type = private_data->array_view.storage_type;
+    result = storage_type == NANOARROW_TYPE_BINARY ||
+                     storage_type == NANOARROW_TYPE_LARGE_BINARY
+                 ? NANOARROW_OK
+                 : EINVAL;
+  } else if (result == NANOARROW_OK) {
+    result = ArrowGPKGEncoderInitViews(private_data);
+  }
+
+  if (result != NANOARROW_OK) {
+    ArrowErrorSet(arrow_error, "Unexpected storage type '%s' for GeoArrow column '%s'",
+                  schema->format, name);
+    ArrowGPKGEncoderReset(encoder);
+  }
+
+  return result;
+}
+
+static int64_t ArrowGPKGListOffset(struct ArrowArrayView* view, int64_t i) {
+  i += view->array->offset;
+  if (view->storage_type == NANOARROW_TYPE_LIST) {
+    return view->buffer_views[1].data.as_int32[i];
+  } else {
+    return view->buffer_views[1].data.as_int64[i];
+  }
+}
+
+static void ArrowGPKGInitCoordValues(struct ArrowGPKGEncoderPrivate* private_data) {
+  struct ArrowArrayView* coords = private_data->coords;
+  struct ArrowGPKGCoordValues* out = &private_data->coord_values;
+  int n_dims = private_data->n_dims;
+  out->n_dims = n_dims;
+
+  if (coords->storage_type == NANOARROW_TYPE_FIXED_SIZE_LIST) {
+    struct ArrowArrayView* child = coords->children[0];
+    const double* values = child->buffer_views[1].data.as_double + child->array->offset +
+                           coords->array->offset * n_dims;
+    for (int i = 0; i < n_dims; i++) {
+      out->values[i] = values + i;
+    }
+
+    out->stride = n_dims;
+  } else {
+    for (int i = 0; i < n_dims; i++) {
+      struct ArrowArrayView* child = coords->children[i];
+      out->values[i] = child->buffer_views[1].data.as_double + child->array->offset +
+                       coords->array->offset;
+    }
+
+    out->stride = 1;
+  }
+}
+
+// Compute xmin, xmax, ymin, ymax of coordinates start to end. NaN coordinates (e.g.,
+// of empty points) are skipped because comparisons with NaN are false.
+static void ArrowGPKGCoordBounds(const struct ArrowGPKGCoordValues* coords,
+                                 int64_t start, int64_t end, double* bounds) {
+  for (int i = 0; i < 2; i++) {
+    const double* values = coords->values[i];
+    int64_t stride = coords->stride;
+    double min_value = INFINITY;
+    double max_value = -INFINITY;
+    for (int64_t j = start; j < end; j++) {
+      double value = values[j * stride];
+      min_value = value < min_value ? value : min_value;
+      max_value = value > max_value ? value : max_value;
+    }
+
+    bounds[2 * i] = min_value;
+    bounds[2 * i + 1] = max_value;
+  }
+}
+
+static uint8_t* ArrowGPKGWriteUInt32(uint8_t* out, uint32_t value) {
+  memcpy(out, &value, sizeof(uint32_t));
+  return out + sizeof(uint32_t);
+}
+
+// WKB is written in the byte order of the host
+static uint8_t* ArrowGPKGWriteWKBType(uint8_t* out, uint32_t geometry_type) {
+  *out++ = (uint8_t)ArrowGPKGIsLittleEndian();
+  return ArrowGPKGWriteUInt32(out, geometry_type);
+}
+
+static uint8_t* ArrowGPKGWriteCoords(uint8_t* out,
+                                     const struct ArrowGPKGCoordValues* coords,
+                                     int64_t start, int64_t end) {
+  int n_dims = coords->n_dims;
+  if (coords->stride == n_dims) {
+    int64_t n_bytes = (end - start) * n_dims * sizeof(double);
+    memcpy(out, coords->values[0] + start * n_dims, n_bytes);
+    return out + n_bytes;
+  }
+
+  for (int64_t j = start; j < end; j++) {
+    for (int i = 0; i < n_dims; i++) {
+      memcpy(out, coords->values[i] + j, sizeof(double));
+      out += sizeof(double);
+    }
+  }
+
+  return out;
+}
+
+// Write a GeoPackage geometry blob header with an xy envelope (or none if bounds is
+// NULL, in which case the geometry is flagged as empty)
+static uint8_t* ArrowGPKGWriteHeader(uint8_t* out, int32_t srs_id, const double* bounds) {
+  *out++ = 'G';
+  *out++ = 'P';
+  *out++ = 0;
+  *out++ = (uint8_t)(ArrowGPKGIsLittleEndian() | (bounds == NULL ? 0x10 : 0x02));
+  memcpy(out, &srs_id, sizeof(int32_t));
+  out += sizeof(int32_t);
+  if (bounds != NULL) {
+    memcpy(out, bounds, 4 * sizeof(double));
+    out += 4 * sizeof(double);
+  }
+
+  return out;
+}
+
+// Append the current element (the bytes appended to the data buffer since the last
+// one) to a binary array
+static int ArrowGPKGFinishBlob(struct ArrowArray* out, struct ArrowSQLite3Error* error) {
+  struct ArrowBuffer* data = ArrowArrayBuffer(out, 2);
+  if (data->size_bytes > INT32_MAX) {
+    ArrowErrorSet((struct ArrowError*)error,
+                  "Encoded geometries of a batch exceed the %d bytes of a binary array",
+                  INT32_MAX);
+    return EINVAL;
+  }
+
+  int32_t offset = (int32_t)data->size_bytes;
+  NANOARROW_RETURN_NOT_OK(ArrowBufferAppend(ArrowArrayBuffer(out, 1), &offset,
+                                            sizeof(int32_t)));
+  struct ArrowBitmap* validity = ArrowArrayValidityBitmap(out);
+  if (validity->buffer.data != NULL) {
+    NANOARROW_RETURN_NOT_OK(ArrowBitmapAppend(validity, 1, 1));
+  }
+
+  out->length++;
+  return NANOARROW_OK;
+}
+
+static int ArrowGPKGEncodeWKB(struct ArrowGPKGEncoderPrivate* private_data, int64_t i,
+                              struct ArrowArray* out, struct ArrowSQLite3Error* error) {
+  struct ArrowBufferView wkb = ArrowArrayViewGetBytesUnsafe(&private_data->array_view, i);
+  struct ArrowGPKGHeader header;
+  NANOARROW_RETURN_NOT_OK(ArrowGPKGWKBEnvelope(wkb.data.as_uint8, wkb.n_bytes, &header,
+                                               error));
+
+  struct ArrowBuffer* data = ArrowArrayBuffer(out, 2);
+  NANOARROW_RETURN_NOT_OK(ArrowBufferReserve(data, 40 + wkb.n_bytes));
+  uint8_t* start = data->data + data->size_bytes;
+  uint8_t* end = ArrowGPKGWriteHeader(start, private_data->srs_id,
+                                      header.empty ? NULL : header.envelope);
+  memcpy(end, wkb.data.data, wkb.n_bytes);
+  data->size_bytes += (end - start) + wkb.n_bytes;
+  return ArrowGPKGFinishBlob(out, error);
+}
+
+static int ArrowGPKGEncodeNative(struct ArrowGPKGEncoderPrivate* private_data, int64_t i,
+                                 struct ArrowArray* out,
+                                 struct ArrowSQLite3Error* error) {
+  const struct ArrowGPKGCoordValues* coords = &private_data->coord_values;
+  struct ArrowArrayView** lists = private_data->lists;
+  int geometry_type = private_data->geometry_type;
+  uint32_t dims_code = private_data->wkb_dimensions_code;
+  int64_t coord_bytes = private_data->n_dims * sizeof(double);
+
+  // Resolve the range of each level of nesting. The coordinates of a geometry are
+  // contiguous, which makes its envelope a min/max over coordinates start to end.
+  int64_t start = i;
+  int64_t end = i + 1;
+  int64_t counts[3] = {0, 0, 0};
+  for (int k = 0; k < private_data->n_lists; k++) {
+    start = ArrowGPKGListOffset(lists[k], start);
+    end = ArrowGPKGListOffset(lists[k], end);
+    counts[k] = end - start;
+  }
+
+  int64_t n_coords = end - start;
+  int64_t wkb_size;
+  switch (geometry_type) {
+    case ARROW_GPKG_GEOMETRY_TYPE_POINT:
+      wkb_size = 5 + coord_bytes;
+      break;
+    case ARROW_GPKG_GEOMETRY_TYPE_LINESTRING:
+      wkb_size = 9 + n_coords * coord_bytes;
+      break;
+    case ARROW_GPKG_GEOMETRY_TYPE_POLYGON:
+      wkb_size = 9 + 4 * counts[0] + n_coords * coord_bytes;
+      break;
+    case ARROW_GPKG_GEOMETRY_TYPE_MULTIPOINT:
+      wkb_size = 9 + n_coords * (5 + coord_bytes);
+      break;
+    case ARROW_GPKG_GEOMETRY_TYPE_MULTILINESTRING:
+      wkb_size = 9 + 9 * counts[0] + n_coords * coord_bytes;
+      break;
+    default:
+      wkb_size = 9 + 9 * counts[0] + 4 * counts[1] + n_coords * coord_bytes;
+      break;
+  }
+
+  double bounds[4];
+  ArrowGPKGCoordBounds(coords, start, end, bounds);
+  int empty = !(bounds[0] <= bounds[1]);
+
+  struct ArrowBuffer* data = ArrowArrayBuffer(out, 2);
+  NANOARROW_RETURN_NOT_OK(ArrowBufferReserve(data, 40 + wkb_size));
+  uint8_t* p_start = data->data + data->size_bytes;
+  uint8_t* p = ArrowGPKGWriteHeader(p_start, private_data->srs_id, empty ? NULL : bounds);
+  p = ArrowGPKGWriteWKBType(p, geometry_type + dims_code);
+
+  int64_t part_start = 0;
+  int64_t part_end = 0;
+  if (private_data->n_lists > 0) {
+    part_start = ArrowGPKGListOffset(lists[0], i);
+    part_end = ArrowGPKGListOffset(lists[0], i + 1);
+  }
+
+  switch (geometry_type) {
+    case ARROW_GPKG_GEOMETRY_TYPE_POINT:
+      p = ArrowGPKGWriteCoords(p, coords, i, i + 1);
+      break;
+    case ARROW_GPKG_GEOMETRY_TYPE_LINESTRING:
+      p = ArrowGPKGWriteUInt32(p, (uint32_t)n_coords);
+      p = ArrowGPKGWriteCoords(p, coords, start, end);
+      break;
+    case ARROW_GPKG_GEOMETRY_TYPE_MULTIPOINT:
+      p = ArrowGPKGWriteUInt32(p, (uint32_t)n_coords);
+      for (int64_t j = start; j < end; j++) {
+        p = ArrowGPKGWriteWKBType(p, ARROW_GPKG_GEOMETRY_TYPE_POINT + dims_code);
+        p = ArrowGPKGWriteCoords(p, coords, j, j + 1);
+      }
+      break;
+    case ARROW_GPKG_GEOMETRY_TYPE_POLYGON:
+    case ARROW_GPKG_GEOMETRY_TYPE_MULTILINESTRING:
+      // Rings of a polygon and linestrings of a multilinestring
+      p = ArrowGPKGWriteUInt32(p, (uint32_t)counts[0]);
+      for (int64_t j = part_start; j < part_end; j++) {
+        if (geometry_type == ARROW_GPKG_GEOMETRY_TYPE_MULTILINESTRING) {
+          p = ArrowGPKGWriteWKBType(p, ARROW_GPKG_GEOMETRY_TYPE_LINESTRING + dims_code);
+        }
+
+        int64_t coord_start = ArrowGPKGListOffset(lists[1], j);
+        int64_t coord_end = ArrowGPKGListOffset(lists[1], j + 1);
+        p = ArrowGPKGWriteUInt32(p, (uint32_t)(coord_end - coord_start));
+        p = ArrowGPKGWriteCoords(p, coords, coord_start, coord_end);
+      }
+      break;
+    default:
+      p = ArrowGPKGWriteUInt32(p, (uint32_t)counts[0]);
+      for (int64_t j = part_start; j < part_end; j++) {
+        p = ArrowGPKGWriteWKBType(p, ARROW_GPKG_GEOMETRY_TYPE_POLYGON + dims_code);
+        int64_t ring_start = ArrowGPKGListOffset(lists[1], j);
+        int64_t ring_end = ArrowGPKGListOffset(lists[1], j + 1);
+        p = ArrowGPKGWriteUInt32(p, (uint32_t)(ring_end - ring_start));
+        for (int64_t k = ring_start; k < ring_end; k++) {
+          int64_t coord_start = ArrowGPKGListOffset(lists[2], k);
+          int64_t coord_end = ArrowGPKGListOffset(lists[2], k + 1);
+          p = ArrowGPKGWriteUInt32(p, (uint32_t)(coord_end - coord_start));
+          p = ArrowGPKGWriteCoords(p, coords, coord_start, coord_end);
+        }
+      }
+      break;
+  }
+
+  data->size_bytes += p - p_start;
+  return ArrowGPKGFinishBlob(out, error);
+}
+
+static int ArrowGPKGEncoderEncodeInternal(struct ArrowGPKGEncoderPrivate* private_data,
+                                          struct ArrowArray* array,
+                                          struct ArrowArray* out,
+                                          struct ArrowSQLite3Error* error) {
+  struct ArrowArrayView* array_view = &private_data->array_view;
+  NANOARROW_RETURN_NOT_OK(
+      ArrowArrayViewSetArray(array_view, array, (struct ArrowError*)error));
+  NANOARROW_RETURN_NOT_OK(ArrowArrayStartAppending(out));
+  NANOARROW_RETURN_NOT_OK(ArrowBufferReserve(ArrowArrayBuffer(out, 1),
+                                             (array->length + 1) * sizeof(int32_t)));
+  NANOARROW_RETURN_NOT_OK(ArrowBufferReserve(
+      ArrowArrayBuffer(out, 2), private_data->avg_blob_bytes * array->length));
+  if (private_data->geometry_type != 0) {
+    ArrowGPKGInitCoordValues(private_data);
+  }
+
+  for (int64_t i = 0; i < array->length; i++) {
+    if (ArrowArrayViewIsNull(array_view, i)) {
+      NANOARROW_RETURN_NOT_OK(ArrowArrayAppendNull(out, 1));
+    } else if (private_data->geometry_type == 0) {
+      NANOARROW_RETURN_NOT_OK(ArrowGPKGEncodeWKB(private_data, i, out, error));
+    } else {
+      NANOARROW_RETURN_NOT_OK(ArrowGPKGEncodeNative(private_data, i, out, error));
+    }
+  }
+
+  if (array->length > 0) {
+    private_data->avg_blob_bytes = ArrowArrayBuffer(out, 2)->size_bytes / array->length;
+  }
+
+  return ArrowArrayFinishBuilding(out, (struct ArrowError*)error);
+}
+
+int ArrowGPKGEncoderEncode(struct ArrowGPKGEncoder* encoder, struct ArrowArray* array,
+                           struct ArrowArray* out, struct ArrowSQLite3Error* error) {
+  if (error != NULL) {
+    error->message[0] = '\0';
+  }
+
+  int result = ArrowArrayInit(out, NANOARROW_TYPE_BINARY);
+  if (result == NANOARROW_OK) {
+    result = ArrowGPKGEncoderEncodeInternal(
+        (struct ArrowGPKGEncoderPrivate*)encoder->private_data, array, out, error);
+    if (result != NANOARROW_OK) {
+      out->release(out);
+    }
+  }
+
+  // Allocation failures don't set a message
+  if (result != NANOARROW_OK && error != NULL && error->message[0] == '\0') {
+    ArrowErrorSet((struct ArrowError*)error, "Failed to encode geometries: %s",
+                  strerror(result));
+  }
+
+  return result;
+}
+
+// The state shared by get_next() and the threads of an encoded stream with more than
+// one thread. Each thread reserves a slot (waiting while all max_batches slots are
+// reserved), pulls the next batch from the source stream (one thread at a time, which
+// numbers the batches in order), encodes it, and puts it in slot n % max_batches for
+// get_next(), which returns batches in order and frees their slot.
+struct ArrowGPKGEncodePipeline {
+  pthread_mutex_t mutex;
+  // Signaled when a slot is freed, when all threads were started, and when the pipeline
+  // stops
+  pthread_cond_t slot_free;
+  // Signaled when a batch is encoded and when the pipeline stops
+  pthread_cond_t batch_ready;
+  struct ArrowArray* slots;
+  int64_t max_batches;
+  int64_t n_reserved;
+  int64_t n_consumed;
+  // The number of the end of the source stream (or -1 if it hasn't been reached)
+  int64_t end_batch;
+  int stop;
+  int code;
+  struct ArrowError error;
+
+  // Guards the source stream and the numbering of its batches
+  pthread_mutex_t source_mutex;
+  int64_t n_pulled;
+  int source_done;
+
+  // The threads that were created and the number that have claimed a set of encoders.
+  // Threads don't pull from the source stream until all of them were created, such
+  // that the source is untouched if one can't be.
+  pthread_t* threads;
+  int n_created;
+  int n_running;
+  int started;
+  struct ArrowGPKGEncodedStreamPrivate* private_data;
+};
+
+struct ArrowGPKGEncodedStreamPrivate {
+  struct ArrowArrayStream stream;
+  struct ArrowSchema schema;
+  int64_t n_columns;
+  // An encoder per column (whose private_data is NULL for non-GeoArrow columns) for each
+  // of n_threads threads
+  int n_threads;
+  struct ArrowGPKGEncoder* encoders;
+  struct ArrowError error;
+  // NULL unless batches are encoded by threads
+  struct ArrowGPKGEncodePipeline* pipeline;
+};
+
+static int ArrowGPKGEncodedStreamGetSchema(struct ArrowArrayStream* stream,
+                                           struct ArrowSchema* out) {
+  struct ArrowGPKGEncodedStreamPrivate* private_data =
+      (struct ArrowGPKGEncodedStreamPrivate*)stream->private_data;
+  return ArrowSchemaDeepCopy(&private_data->schema, out);
+}
+
+// Replace the GeoArrow children of array with their encoded version (using an encoder
+// per column), releasing array on error
+static int ArrowGPKGEncodeBatch(struct ArrowGPKGEncoder* encoders, int64_t n_columns,
+                                struct ArrowArray* array, struct ArrowError* error) {
+  if (array->n_children != n_columns) {
+    ArrowErrorSet(error, "Expected array with %ld children but got %ld", (long)n_columns,
+                  (long)array->n_children);
+    array->release(array);
+    return EINVAL;
+  }
+
+  // Move the original child out of the array to release it
+  for (int64_t i = 0; i < n_columns; i++) {
+    if (encoders[i].private_data == NULL) {
+      continue;
+    }
+
+    struct ArrowArray encoded;
+    int result = ArrowGPKGEncoderEncode(encoders + i, array->children[i], &encoded,
+                                        (struct ArrowSQLite3Error*)error);
+    if (result != NANOARROW_OK) {
+      array->release(array);
+      return result;
+    }
+
+    struct ArrowArray child;
+    memcpy(&child, array->children[i], sizeof(struct ArrowArray));
+    child.release(&child);
+    memcpy(array->children[i], &encoded, sizeof(struct ArrowArray));
+  }
+
+  return NANOARROW_OK;
+}
+
+static int ArrowGPKGEncodePipelineGetNext(struct ArrowGPKGEncodePipeline* pipeline,
+                                          struct ArrowArray* out,
+                                          struct ArrowError* error) {
+  int result = NANOARROW_OK;
+  pthread_mutex_lock(&pipeline->mutex);
+  while (1) {
+    struct ArrowArray* slot =
+        pipeline->slots + pipeline->n_consumed % pipeline->max_batches;
+    if (pipeline->code != NANOARROW_OK) {
+      memcpy(error, &pipeline->error, sizeof(struct ArrowError));
+      result = pipeline->code;
+      break;
+    } else if (slot->release != NULL) {
+      memcpy(out, slot, sizeof(struct ArrowArray));
+      slot->release = NULL;
+      pipeline->n_consumed++;
+      pipeline->n_reserved--;
+      pthread_cond_signal(&pipeline->slot_free);
+      break;
+    } else if (pipeline->n_consumed == pipeline->end_batch) {
+      out->release = NULL;
+      break;
+    }
+
+    pthread_cond_wait(&pipeline->batch_ready, &pipeline->mutex);
+  }
+
+  pthread_mutex_unlock(&pipeline->mutex);
+  return result;
+}
+
+static int ArrowGPKGEncodedStreamGetNext(struct ArrowArrayStream* stream,
+                                         struct ArrowArray* out) {
+  struct ArrowGPKGEncodedStreamPrivate* private_data =
+      (struct ArrowGPKGEncodedStreamPrivate*)stream->private_data;
+  private_data->error.message[0] = '\0';
+
+  if (private_data->pipeline != NULL) {
+    return ArrowGPKGEncodePipelineGetNext(private_data->pipeline, out,
+                                          &private_data->error);
+  }
+
+  NANOARROW_RETURN_NOT_OK(private_data->stream.get_next(&private_data->stream, out));
+  if (out->release == NULL) {
+    return NANOARROW_OK;
+  }
+
+  return ArrowGPKGEncodeBatch(private_data->encoders, private_data->n_columns, out,
+                              &private_data->error);
+}
+
+static const char* ArrowGPKGEncodedStreamGetLastError(struct ArrowArrayStream* stream) {
+  struct ArrowGPKGEncodedStreamPrivate* private_data =
+      (struct ArrowGPKGEncodedStreamPrivate*)stream->private_data;
+  if (private_data->error.message[0] != '\0' || private_data->pipeline != NULL) {
+    return private_data->error.message;
+  }
+
+  return private_data->stream.get_last_error(&private_data->stream);
+}
+
+// Pull, encode, and queue batches until the source stream ends, the pipeline stops, or
+// an error occurs
+static void* ArrowGPKGEncodePipelineRun(void* arg) {
+  struct ArrowGPKGEncodePipeline* pipeline = (struct ArrowGPKGEncodePipeline*)arg;
+  struct ArrowGPKGEncodedStreamPrivate* private_data = pipeline->private_data;
+  struct ArrowArrayStream* source = &private_data->stream;
+
+  // Each thread has its own set of encoders
+  pthread_mutex_lock(&pipeline->mutex);
+  struct ArrowGPKGEncoder* encoders =
+      private_data->encoders + pipeline->n_running * private_data->n_columns;
+  pipeline->n_running++;
+
+  while (1) {
+    while (!pipeline->stop && pipeline->code == NANOARROW_OK &&
+           pipeline->end_batch == -1 &&
+           (!pipeline->started || pipeline->n_reserved >= pipeline->max_batches)) {
+      pthread_cond_wait(&pipeline->slot_free, &pipeline->mutex);
+    }
+
+    if (pipeline->stop || pipeline->code != NANOARROW_OK || pipeline->end_batch != -1) {
+      break;
+    }
+
+    pipeline->n_reserved++;
+    pthread_mutex_unlock(&pipeline->mutex);
+
+    struct ArrowArray array;
+    array.release = NULL;
+    struct ArrowError error;
+    error.message[0] = '\0';
+    int64_t batch = -1;
+    int result = NANOARROW_OK;
+
+    pthread_mutex_lock(&pipeline->source_mutex);
+    if (!pipeline->source_done) {
+      batch = pipeline->n_pulled++;
+      result = source->get_next(source, &array);
+      if (result != NANOARROW_OK) {
+        ArrowErrorSet(&error, "%s", ArrowSQLite3StreamError(source, result));
+      }
+
+      pipeline->source_done = result != NANOARROW_OK || array.release == NULL;
+    }
+    pthread_mutex_unlock(&pipeline->source_mutex);
+
+    if (array.release != NULL) {
+      result = ArrowGPKGEncodeBatch(encoders, private_data->n_columns, &array, &error);
+    }
+
+    pthread_mutex_lock(&pipeline->mutex);
+    if (result != NANOARROW_OK) {
+      if (pipeline->code == NANOARROW_OK) {
+        pipeline->code = result;
+        memcpy(&pipeline->error, &error, sizeof(struct ArrowError));
+      }
+    } else if (array.release != NULL) {
+      memcpy(pipeline->slots + batch % pipeline->max_batches, &array,
+             sizeof(struct ArrowArray));
+    } else {
+      // The end of the stream (or another thread reached it first)
+      pipeline->n_reserved--;
+      if (batch != -1) {
+        pipeline->end_batch = batch;
+      }
+    }
+
+    pthread_cond_broadcast(&pipeline->batch_ready);
+    if (result != NANOARROW_OK || array.release == NULL) {
+      pthread_cond_broadcast(&pipeline->slot_free);
+    }
+  }
+
+  pthread_mutex_unlock(&pipeline->mutex);
+  return NULL;
+}
+
+static void ArrowGPKGEncodePipelineFree(struct ArrowGPKGEncodePipeline* pipeline) {
+  pthread_mutex_lock(&pipeline->mutex);
+  pipeline->stop = 1;
+  pthread_cond_broadcast(&pipeline->slot_free);
+  pthread_mutex_unlock(&pipeline->mutex);
+
+  for (int i = 0; i < pipeline->n_created; i++) {
+    pthread_join(pipeline->threads[i], NULL);
+  }
+
+  for (int64_t i = 0; i < pipeline->max_batches; i++) {
+    if (pipeline->slots[i].release != NULL) {
+      pipeline->slots[i].release(pipeline->slots + i);
+    }
+  }
+
+  pthread_cond_destroy(&pipeline->batch_ready);
+  pthread_cond_destroy(&pipeline->slot_free);
+  pthread_mutex_destroy(&pipeline->source_mutex);
+  pthread_mutex_destroy(&pipeline->mutex);
+  ArrowFree(pipeline->threads);
+  ArrowFree(pipeline->slots);
+  ArrowFree(pipeline);
+}
+
+static int ArrowGPKGEncodePipelineStart(
+    struct ArrowGPKGEncodedStreamPrivate* private_data, int64_t max_batches) {
+  struct ArrowGPKGEncodePipeline* pipeline = (struct ArrowGPKGEncodePipeline*)ArrowMalloc(
+      sizeof(struct ArrowGPKGEncodePipeline));
+  if (pipeline == NULL) {
+    return ENOMEM;
+  }
+
+  memset(pipeline, 0, sizeof(struct ArrowGPKGEncodePipeline));
+  pipeline->max_batches = max_batches;
+  pipeline->end_batch = -1;
+  pipeline->private_data = private_data;
+  pipeline->slots =
+      (struct ArrowArray*)ArrowMalloc(max_batches * sizeof(struct ArrowArray));
+  pipeline->threads =
+      (pthread_t*)ArrowMalloc(private_data->n_threads * sizeof(pthread_t));
+  if (pipeline->slots == NULL || pipeline->threads == NULL) {
+    ArrowFree(pipeline->slots);
+    ArrowFree(pipeline->threads);
+    ArrowFree(pipeline);
+    return ENOMEM;
+  }
+
+  memset(pipeline->slots, 0, max_batches * sizeof(struct ArrowArray));
+  pthread_mutex_init(&pipeline->mutex, NULL);
+  pthread_mutex_init(&pipeline->source_mutex, NULL);
+  pthread_cond_init(&pipeline->slot_free, NULL);
+  pthread_cond_init(&pipeline->batch_ready, NULL);
+  private_data->pipeline = pipeline;
+
+  for (int i = 0; i < private_data->n_threads; i++) {
+    if (pthread_create(pipeline->threads + i, NULL, &ArrowGPKGEncodePipelineRun,
+                       pipeline) != 0) {
+      return EAGAIN;
+    }
+
+    pipeline->n_created++;
+  }
+
+  pthread_mutex_lock(&pipeline->mutex);
+  pipeline->started = 1;
+  pthread_cond_broadcast(&pipeline->slot_free);
+  pthread_mutex_unlock(&pipeline->mutex);
+  return NANOARROW_OK;
+}
+
+static void ArrowGPKGEncodedStreamFree(
+    struct ArrowGPKGEncodedStreamPrivate* private_data) {
+  if (private_data->pipeline != NULL) {
+    ArrowGPKGEncodePipelineFree(private_data->pipeline);
+  }
+
+  for (int64_t i = 0; private_data->encoders != NULL &&
+                      i < private_data->n_threads * private_data->n_columns;
+       i++) {
+    ArrowGPKGEncoderReset(private_data->encoders + i);
+  }
+
+  ArrowFree(private_data->encoders);
+  if (private_data->schema.release != NULL) {
+    private_data->schema.release(&private_data->schema);
+  }
+
+  ArrowFree(private_data);
+}
+
+static void ArrowGPKGEncodedStreamRelease(struct ArrowArrayStream* stream) {
+  struct ArrowGPKGEncodedStreamPrivate* private_data =
+      (struct ArrowGPKGEncodedStreamPrivate*)stream->private_data;
+
+  // Stop the threads before releasing the stream they pull from
+  if (private_data->pipeline != NULL) {
+    ArrowGPKGEncodePipelineFree(private_data->pipeline);
+    private_data->pipeline = NULL;
+  }
+
+  private_data->stream.release(&private_data->stream);
+  ArrowGPKGEncodedStreamFree(private_data);
+  stream->release = NULL;
+}
+
+// Initialize n_threads encoders for each GeoArrow column of the schema of stream and
+// replace these columns by binary columns in private_data->schema
+static int ArrowGPKGEncodedStreamInit(struct ArrowGPKGEncodedStreamPrivate* private_data,
+                                      struct ArrowArrayStream* stream, int32_t srs_id,
+                                      int n_threads, struct ArrowSQLite3Error* error) {
+  struct ArrowError* arrow_error = (struct ArrowError*)error;
+  int result = stream->get_schema(stream, &private_data->schema);
+  if (result != NANOARROW_OK) {
+    ArrowErrorSet(arrow_error, "get_schema() failed: %s",
+                  ArrowSQLite3StreamError(stream, result));
+    return result;
+  }
+
+  struct ArrowSchema* schema = &private_data->schema;
+  if (strcmp(schema->format, "+s") != 0) {
+    ArrowErrorSet(arrow_error, "Expected a stream of struct arrays");
+    return EINVAL;
+  }
+
+  int64_t n_encoders = n_threads * schema->n_children;
+  private_data->n_columns = schema->n_children;
+  private_data->n_threads = n_threads;
+  private_data->encoders =
+      (struct ArrowGPKGEncoder*)ArrowMalloc(n_encoders * sizeof(struct ArrowGPKGEncoder));
+  if (private_data->encoders == NULL) {
+    return ENOMEM;
+  }
+
+  memset(private_data->encoders, 0, n_encoders * sizeof(struct ArrowGPKGEncoder));
+  for (int64_t i = 0; i < schema->n_children; i++) {
+    struct ArrowSchema* child = schema->children[i];
+    if (!ArrowGPKGIsGeometryField(child)) {
+      continue;
+    }
+
+    for (int j = 0; j < n_threads; j++) {
+      NANOARROW_RETURN_NOT_OK(ArrowGPKGEncoderInit(
+          private_data->encoders + j * schema->n_children + i, child, srs_id, error));
+    }
+
+    struct ArrowSchema encoded;
+    NANOARROW_RETURN_NOT_OK(ArrowSchemaInit(&encoded, NANOARROW_TYPE_BINARY));
+    result = ArrowSchemaSetName(&encoded, child->name);
+    if (result != NANOARROW_OK) {
+      encoded.release(&encoded);
+      return result;
+    }
+
+    child->release(child);
+    memcpy(child, &encoded, sizeof(struct ArrowSchema));
+  }
+
+  return NANOARROW_OK;
+}
+
+static int ArrowGPKGEncodeStreamInternal(struct ArrowArrayStream* stream, int32_t srs_id,
+                                         int n_threads, int64_t max_batches,
+                                         struct ArrowSQLite3Error* error) {
+  struct ArrowGPKGEncodedStreamPrivate* private_data =
+      (struct ArrowGPKGEncodedStreamPrivate*)ArrowMalloc(
+          sizeof(struct ArrowGPKGEncodedStreamPrivate));
+  if (private_data == NULL) {
+    return ENOMEM;
+  }
+
+  memset(private_data, 0, sizeof(struct ArrowGPKGEncodedStreamPrivate));
+  int result =
+      ArrowGPKGEncodedStreamInit(private_data, stream, srs_id, n_threads, error);
+  if (result != NANOARROW_OK) {
+    ArrowGPKGEncodedStreamFree(private_data);
+    return result;
+  }
+
+  memcpy(&private_data->stream, stream, sizeof(struct ArrowArrayStream));
+  stream->get_schema = &ArrowGPKGEncodedStreamGetSchema;
+  stream->get_next = &ArrowGPKGEncodedStreamGetNext;
+  stream->get_last_error = &ArrowGPKGEncodedStreamGetLastError;
+  stream->release = &ArrowGPKGEncodedStreamRelease;
+  stream->private_data = private_data;
+
+  if (max_batches > 0) {
+    result = ArrowGPKGEncodePipelineStart(private_data, max_batches);
+    if (result != NANOARROW_OK) {
+      ArrowErrorSet((struct ArrowError*)error, "Failed to start encoding threads");
+      // Leave the source stream in place of the wrapper
+      if (private_data->pipeline != NULL) {
+        ArrowGPKGEncodePipelineFree(private_data->pipeline);
+        private_data->pipeline = NULL;
+      }
+
+      memcpy(stream, &private_data->stream, sizeof(struct ArrowArrayStream));
+      ArrowGPKGEncodedStreamFree(private_data);
+      return result;
+    }
+  }
+
+  return NANOARROW_OK;
+}
+
+int ArrowGPKGEncodeStream(struct ArrowArrayStream* stream, int32_t srs_id,
+                          struct ArrowSQLite3Error* error) {
+  return ArrowGPKGEncodeStreamInternal(stream, srs_id, 1, 0, error);
+}
+
+int ArrowGPKGEncodeStreamParallel(struct ArrowArrayStream* stream, int32_t srs_id,
+                                  int n_threads, int64_t max_batches,
+                                  struct ArrowSQLite3Error* error) {
+  if (n_threads <= 0 || max_batches <= 0) {
+    ArrowErrorSet((struct ArrowError*)error,
+                  "n_threads and max_batches must be greater than zero");
+    return EINVAL;
+  }
+
+  return ArrowGPKGEncodeStreamInternal(stream, srs_id, n_threads, max_batches, error);
+}
+
+// An entry of an rtree: the id of a row (or of a child node) and its xy envelope
+struct ArrowGPKGRTreeEntry {
+  int64_t id;
+  double bounds[4];
+};
+
+static int ArrowGPKGCompareEntryX(const void* a, const void* b) {
+  const struct ArrowGPKGRTreeEntry* x = (const struct ArrowGPKGRTreeEntry*)a;
+  const struct ArrowGPKGRTreeEntry* y = (const struct ArrowGPKGRTreeEntry*)b;
+  double x_center = x->bounds[0] + x->bounds[1];
+  double y_center = y->bounds[0] + y->bounds[1];
+  return (x_center > y_center) - (x_center < y_center);
+}
+
+static int ArrowGPKGCompareEntryY(const void* a, const void* b) {
+  const struct ArrowGPKGRTreeEntry* x = (const struct ArrowGPKGRTreeEntry*)a;
+  const struct ArrowGPKGRTreeEntry* y = (const struct ArrowGPKGRTreeEntry*)b;
+  double x_center = x->bounds[2] + x->bounds[3];
+  double y_center = y->bounds[2] + y->bounds[3];
+  return (x_center > y_center) - (x_center < y_center);
+}
+
+// Sort entries into Sort-Tile-Recursive order: sorted by x into about sqrt(n_nodes)
+// vertical slices of whole nodes, each of which is sorted by y, such that each run of
+// n_cells entries is a tile of neighbouring envelopes
+static void ArrowGPKGSortTileRecursive(struct ArrowGPKGRTreeEntry* entries,
+                                       int64_t n_entries, int64_t n_cells) {
+  qsort(entries, n_entries, sizeof(struct ArrowGPKGRTreeEntry), &ArrowGPKGCompareEntryX);
+
+  int64_t n_nodes = (n_entries + n_cells - 1) / n_cells;
+  int64_t n_slices = 1;
+  while (n_slices * n_slices < n_nodes) {
+    n_slices++;
+  }
+
+  int64_t slice_entries = (n_nodes + n_slices - 1) / n_slices * n_cells;
+  for (int64_t start = 0; start < n_entries; start += slice_entries) {
+    int64_t n = n_entries - start < slice_entries ? n_entries - start : slice_entries;
+    qsort(entries + start, n, sizeof(struct ArrowGPKGRTreeEntry),
+          &ArrowGPKGCompareEntryY);
+  }
+}
+
+// Append the id and xy envelope of each non-null, non-empty geometry of column_name
+// to entries (reading only the geometry headers where possible)
+static int ArrowGPKGCollectEnvelopes(sqlite3* con, const char* table_name,
+                                     const char* column_name, struct ArrowBuffer* entries,
+                                     struct ArrowError* error) {
+  struct ArrowArrayStream stream;
+  NANOARROW_RETURN_NOT_OK(ArrowGPKGEnvelopeStreamInit(
+      &stream, con, table_name, column_name, 65536, (struct ArrowSQLite3Error*)error));
+
+  struct ArrowSchema schema;
+  int result = stream.get_schema(&stream, &schema);
+  if (result != NANOARROW_OK) {
+    stream.release(&stream);
+    return result;
+  }
+
+  struct ArrowArrayView view;
+  result = ArrowArrayViewInitFromSchema(&view, &schema, error);
+  schema.release(&schema);
+  if (result != NANOARROW_OK) {
+    stream.release(&stream);
+    return result;
+  }
+
+  struct ArrowArray array;
+  struct ArrowGPKGRTreeEntry entry;
+  while (result == NANOARROW_OK) {
+    result = stream.get_next(&stream, &array);
+    if (result != NANOARROW_OK) {
+      ArrowErrorSet(error, "%s", ArrowSQLite3StreamError(&stream, result));
+      break;
+    }
+
+    if (array.release == NULL) {
+      break;
+    }
+
+    result = ArrowArrayViewSetArray(&view, &array, error);
+    for (int64_t i = 0; result == NANOARROW_OK && i < array.length; i++) {
+      // Null and empty geometries are not indexed
+      if (ArrowArrayViewIsNull(view.children[3], i) ||
+          ArrowArrayViewGetUIntUnsafe(view.children[2], i)) {
+        continue;
+      }
+
+      entry.id = ArrowArrayViewGetIntUnsafe(view.children[0], i);
+      int valid = 1;
+      for (int j = 0; j < 4; j++) {
+        entry.bounds[j] = ArrowArrayViewGetDoubleUnsafe(view.children[3 + j], i);
+        valid = valid && !isnan(entry.bounds[j]);
+      }
+
+      if (valid) {
+        result = ArrowBufferAppend(entries, &entry, sizeof(struct ArrowGPKGRTreeEntry));
+      }
+    }
+
+    array.release(&array);
+  }
+
+  ArrowArrayViewReset(&view);
+  stream.release(&stream);
+  return result;
+}
+
+// Round bounds outwards to the nearest float as the SQLite rtree module does when it
+// stores them (see rtreeValueDown() and rtreeValueUp() in rtree.c)
+static void ArrowGPKGRTreeRoundBounds(double* bounds) {
+  const double towards_zero = 1.0 - 1.0 / 8388608.0;
+  const double away_from_zero = 1.0 + 1.0 / 8388608.0;
+  for (int j = 0; j < 4; j++) {
+    double value = bounds[j];
+    float rounded = (float)value;
+    if (j % 2 == 0 && rounded > value) {
+      rounded = (float)(value * (value < 0 ? away_from_zero : towards_zero));
+    } else if (j % 2 == 1 && rounded < value) {
+      rounded = (float)(value * (value < 0 ? towards_zero : away_from_zero));
+    }
+
+    bounds[j] = rounded;
+  }
+}
+
+static void ArrowGPKGWriteBigEndian(uint8_t* data, uint64_t value, int n_bytes) {
+  for (int i = n_bytes - 1; i >= 0; i--) {
+    data[i] = (uint8_t)value;
+    value >>= 8;
+  }
+}
+
+// The statements that write the shadow tables of an rtree and the nodes of the level
+// of the tree being written
+struct ArrowGPKGRTreeWriter {
+  sqlite3* con;
+  sqlite3_stmt* insert_node;
+  // Maps the rowid of an entry to its leaf or a child node to its parent
+  sqlite3_stmt* insert_parent[2];
+  int64_t node_size;
+  int64_t n_cells;
+  uint8_t* node;
+};
+
+// Write the entries of one level of the tree (in Sort-Tile-Recursive order) as runs of
+// n_cells cells of nodes numbered from first_node_id, replacing each entry by the
+// entry of its node for the level above. Nodes are a big-endian 2 byte depth (only set
+// for the root) and 2 byte cell count followed by cells of a 64-bit id and minx, maxx,
+// miny, maxy as 32-bit floats.
+static int ArrowGPKGRTreeWriteLevel(struct ArrowGPKGRTreeWriter* writer,
+                                    struct ArrowGPKGRTreeEntry* entries,
+                                    int64_t n_entries, int64_t first_node_id,
+                                    int is_leaf, int depth,
+                                    struct ArrowError* error) {
+  sqlite3_stmt* insert_parent = writer->insert_parent[is_leaf ? 0 : 1];
+  int result = SQLITE_OK;
+  for (int64_t start = 0; result == SQLITE_OK && start < n_entries;
+       start += writer->n_cells) {
+    int64_t node_id = first_node_id + start / writer->n_cells;
+    int64_t n = n_entries - start < writer->n_cells ? n_entries - start : writer->n_cells;
+
+    struct ArrowGPKGRTreeEntry node_entry = {node_id, {INFINITY, -INFINITY, INFINITY,
+                                                       -INFINITY}};
+    memset(writer->node, 0, writer->node_size);
+    ArrowGPKGWriteBigEndian(writer->node, depth, 2);
+    ArrowGPKGWriteBigEndian(writer->node + 2, n, 2);
+    for (int64_t i = 0; result == SQLITE_OK && i < n; i++) {
+      const struct ArrowGPKGRTreeEntry* entry = entries + start + i;
+      uint8_t* cell = writer->node + 4 + i * 24;
+      ArrowGPKGWriteBigEndian(cell, (uint64_t)entry->id, 8);
+      for (int j = 0; j < 4; j++) {
+        float value = (float)entry->bounds[j];
+        uint32_t bits;
+        memcpy(&bits, &value, sizeof(uint32_t));
+        ArrowGPKGWriteBigEndian(cell + 8 + j * 4, bits, 4);
+      }
+
+      node_entry.bounds[0] = fmin(node_entry.bounds[0], entry->bounds[0]);
+      node_entry.bounds[1] = fmax(node_entry.bounds[1], entry->bounds[1]);
+      node_entry.bounds[2] = fmin(node_entry.bounds[2], entry->bounds[2]);
+      node_entry.bounds[3] = fmax(node_entry.bounds[3], entry->bounds[3]);
+
+      sqlite3_bind_int64(insert_parent, 1, entry->id);
+      sqlite3_bind_int64(insert_parent, 2, node_id);
+      result = sqlite3_step(insert_parent);
+      if (result == SQLITE_DONE) {
+        result = sqlite3_reset(insert_parent);
+      }
+    }
+
+    if (result == SQLITE_OK) {
+      sqlite3_bind_int64(writer->insert_node, 1, node_id);
+      sqlite3_bind_blob(writer->insert_node, 2, writer->node, (int)writer->node_size,
+                        SQLITE_STATIC);
+      result = sqlite3_step(writer->insert_node);
+      if (result == SQLITE_DONE) {
+        result = sqlite3_reset(writer->insert_node);
+      }
+    }
+
+    // Entries before start have already been written, so the node entries of this
+    // level can take their place
+    entries[start / writer->n_cells] = node_entry;
+  }
+
+  if (result != SQLITE_OK) {
+    ArrowErrorSet(error, "<%s> %s", sqlite3_errstr(result), sqlite3_errmsg(writer->con));
+    return EIO;
+  }
+
+  return NANOARROW_OK;
+}
+
+// Write the (empty) rtree of table_name and column_name bottom up from entries:
+// each level is sorted into Sort-Tile-Recursive order and packed into full nodes,
+// whose envelopes are the entries of the level above. Node ids are assigned from the
+// top such that the root is node 1.
+static int ArrowGPKGRTreeWrite(struct ArrowGPKGRTreeWriter* writer,
+                               const char* table_name, const char* column_name,
+                               struct ArrowGPKGRTreeEntry* entries, int64_t n_entries,
+                               struct ArrowError* error) {
+  char* sql = sqlite3_mprintf("SELECT length(data) FROM \"rtree_%w_%w_node\" "
+                              "WHERE nodeno = 1",
+                              table_name, column_name);
+  if (sql == NULL) {
+    return ENOMEM;
+  }
+
+  int result = ArrowSQLite3QueryValue(writer->con, sql, NULL, &writer->node_size, NULL,
+                                      (struct ArrowSQLite3Error*)error);
+  sqlite3_free(sql);
+  if (result == ENOENT || (result == NANOARROW_OK && writer->node_size < 4 + 2 * 24)) {
+    ArrowErrorSet(error, "Invalid root node of the rtree of '%s'", table_name);
+    return EINVAL;
+  }
+  NANOARROW_RETURN_NOT_OK(result);
+
+  writer->n_cells = (writer->node_size - 4) / 24;
+  writer->node = (uint8_t*)ArrowMalloc(writer->node_size);
+  if (writer->node == NULL) {
+    return ENOMEM;
+  }
+
+  const char* insert_sql[] = {
+      "INSERT OR REPLACE INTO \"rtree_%w_%w_node\" (nodeno, data) VALUES (?, ?)",
+      "INSERT INTO \"rtree_%w_%w_rowid\" (rowid, nodeno) VALUES (?, ?)",
+      "INSERT INTO \"rtree_%w_%w_parent\" (nodeno, parentnode) VALUES (?, ?)"};
+  sqlite3_stmt** stmts[] = {&writer->insert_node, &writer->insert_parent[0],
+                            &writer->insert_parent[1]};
+  for (int i = 0; i < 3; i++) {
+    sql = sqlite3_mprintf(insert_sql[i], table_name, column_name);
+    if (sql == NULL) {
+      return ENOMEM;
+    }
+
+    int sqlite_result = sqlite3_prepare_v2(writer->con, sql, -1, stmts[i], NULL);
+    sqlite3_free(sql);
+    if (sqlite_result != SQLITE_OK) {
+      ArrowErrorSet(error, "<%s> %s", sqlite3_errstr(sqlite_result),
+                    sqlite3_errmsg(writer->con));
+      return EIO;
+    }
+  }
+
+  // The number of nodes of each level, from the leaves up to the root
+  int64_t n_level_nodes[32];
+  int n_levels = 0;
+  int64_t n = n_entries;
+  do {
+    n = (n + writer->n_cells - 1) / writer->n_cells;
+    n_level_nodes[n_levels++] = n;
+  } while (n > 1);
+
+  int64_t first_node_id = 1;
+  for (int level = 1; level < n_levels; level++) {
+    first_node_id += n_level_nodes[level];
+  }
+
+  n = n_entries;
+  for (int level = 0; level < n_levels; level++) {
+    ArrowGPKGSortTileRecursive(entries, n, writer->n_cells);
+    int depth = level == n_levels - 1 ? level : 0;
+    NANOARROW_RETURN_NOT_OK(ArrowGPKGRTreeWriteLevel(writer, entries, n, first_node_id,
+                                                     level == 0, depth, error));
+    n = n_level_nodes[level];
+    if (level + 1 < n_levels) {
+      first_node_id -= n_level_nodes[level + 1];
+    }
+  }
+
+  return NANOARROW_OK;
+}
+
+static int ArrowGPKGBuildRTreeInternal(sqlite3* con, const char* table_name,
+                                       const char* column_name,
+                                       struct ArrowError* error) {
+  struct ArrowBuffer entries;
+  ArrowBufferInit(&entries);
+  int result = ArrowGPKGCollectEnvelopes(con, table_name, column_name, &entries, error);
+  if (result != NANOARROW_OK) {
+    ArrowBufferReset(&entries);
+    return result;
+  }
+
+  // Dropping and recreating the rtree is much faster than deleting its entries
+  char* sql = sqlite3_mprintf(
+      "DROP TABLE IF EXISTS \"rtree_%w_%w\"; CREATE VIRTUAL TABLE \"rtree_%w_%w\" USING "
+      "rtree(id, minx, maxx, miny, maxy); CREATE TABLE IF NOT EXISTS gpkg_extensions "
+      "(table_name TEXT, column_name TEXT, extension_name TEXT NOT NULL, definition "
+      "TEXT NOT NULL, scope TEXT NOT NULL, CONSTRAINT ge_tce UNIQUE (table_name, "
+      "column_name, extension_name)); INSERT OR IGNORE INTO gpkg_extensions VALUES "
+      "('%q', '%q', 'gpkg_rtree_index', "
+      "'http://www.geopackage.org/spec120/#extension_rtree', 'write-only')",
+      table_name, column_name, table_name, column_name, table_name, column_name);
+  if (sql == NULL) {
+    ArrowBufferReset(&entries);
+    return ENOMEM;
+  }
+
+  result = ArrowGPKGExec(con, sql, error);
+  sqlite3_free(sql);
+
+  // An empty rtree is a root node without cells (which creating it has written)
+  int64_t n_entries = entries.size_bytes / sizeof(struct ArrowGPKGRTreeEntry);
+  if (result == NANOARROW_OK && n_entries > 0) {
+    struct ArrowGPKGRTreeEntry* entry = (struct ArrowGPKGRTreeEntry*)entries.data;
+    for (int64_t i = 0; i < n_entries; i++) {
+      ArrowGPKGRTreeRoundBounds(entry[i].bounds);
+    }
+
+    struct ArrowGPKGRTreeWriter writer;
+    memset(&writer, 0, sizeof(struct ArrowGPKGRTreeWriter));
+    writer.con = con;
+    result = ArrowGPKGRTreeWrite(&writer, table_name, column_name, entry, n_entries,
+                                 error);
+    sqlite3_finalize(writer.insert_node);
+    sqlite3_finalize(writer.insert_parent[0]);
+    sqlite3_finalize(writer.insert_parent[1]);
+    ArrowFree(writer.node);
+  }
+
+  ArrowBufferReset(&entries);
+  return result;
+}
+
+// ST_IsEmpty() (if the user data is -1) or ST_MinX(), ST_MaxX(), ST_MinY(), and
+// ST_MaxY() (if it is the index of the bound in the envelope) of a geometry blob
+static void ArrowGPKGEnvelopeFunction(sqlite3_context* context, int argc,
+                                      sqlite3_value** argv) {
+  if (argc != 1 || sqlite3_value_type(argv[0]) != SQLITE_BLOB) {
+    sqlite3_result_null(context);
+    return;
+  }
+
+  struct ArrowGPKGHeader header;
+  struct ArrowSQLite3Error error;
+  error.message[0] = '\0';
+  if (ArrowGPKGBlobEnvelope((const uint8_t*)sqlite3_value_blob(argv[0]),
+                            sqlite3_value_bytes(argv[0]), &header,
+                            &error) != NANOARROW_OK) {
+    sqlite3_result_error(context, error.message, -1);
+    return;
+  }
+
+  int bound = (int)(intptr_t)sqlite3_user_data(context);
+  int empty = header.empty || isnan(header.envelope[0]);
+  if (bound == -1) {
+    sqlite3_result_int(context, empty);
+  } else if (empty) {
+    sqlite3_result_null(context);
+  } else {
+    sqlite3_result_double(context, header.envelope[bound]);
+  }
+}
+
+int ArrowGPKGRegisterFunctions(sqlite3* con, struct ArrowSQLite3Error* error) {
+  const char* names[] = {"ST_IsEmpty", "ST_MinX", "ST_MaxX", "ST_MinY", "ST_MaxY"};
+  for (int i = 0; i < 5; i++) {
+    int result = sqlite3_create_function_v2(
+        con, names[i], 1, SQLITE_UTF8 | SQLITE_DETERMINISTIC, (void*)(intptr_t)(i - 1),
+        &ArrowGPKGEnvelopeFunction, NULL, NULL, NULL);
+    if (result != SQLITE_OK) {
+      ArrowErrorSet((struct ArrowError*)error, "<%s> %s", sqlite3_errstr(result),
+                    sqlite3_errmsg(con));
+      return EIO;
+    }
+  }
+
+  return NANOARROW_OK;
+}
+
+// Create the triggers of the GeoPackage R-tree extension that maintain the rtree of
+// column_name of table_name (using the rowid, which is the primary key of a feature
+// table) unless the table already has rtree_<table>_<column>_* triggers
+static int ArrowGPKGCreateRTreeTriggers(sqlite3* con, const char* table_name,
+                                        const char* column_name,
+                                        struct ArrowError* error) {
+  char* sql = sqlite3_mprintf(
+      "SELECT count(*) FROM sqlite_master WHERE type = 'trigger' AND lower(tbl_name) = "
+      "lower('%q') AND lower(substr(name, 1, length('rtree_%q_%q_'))) = "
+      "lower('rtree_%q_%q_')",
+      table_name, table_name, column_name, table_name, column_name);
+  if (sql == NULL) {
+    return ENOMEM;
+  }
+
+  int64_t n_triggers = 0;
+  int result = ArrowSQLite3QueryValue(con, sql, NULL, &n_triggers, NULL,
+                                      (struct ArrowSQLite3Error*)error);
+  sqlite3_free(sql);
+  if (result != NANOARROW_OK || n_triggers > 0) {
+    return result;
+  }
+
+  // Identifiers are escaped to be pasted between double quotes
+  char* table = sqlite3_mprintf("%w", table_name);
+  char* rtree = sqlite3_mprintf("rtree_%w_%w", table_name, column_name);
+  char* geom = sqlite3_mprintf("%w", column_name);
+  char* values = geom == NULL
+                     ? NULL
+                     : sqlite3_mprintf(
+                           "NEW.rowid, ST_MinX(NEW.\"%s\"), ST_MaxX(NEW.\"%s\"), "
+                           "ST_MinY(NEW.\"%s\"), ST_MaxY(NEW.\"%s\")",
+                           geom, geom, geom, geom);
+  char* not_empty =
+      geom == NULL
+          ? NULL
+          : sqlite3_mprintf("NEW.\"%s\" NOT NULL AND NOT ST_IsEmpty(NEW.\"%s\")", geom,
+                            geom);
+  sql = NULL;
+  if (table != NULL && rtree != NULL && values != NULL && not_empty != NULL) {
+    sql = sqlite3_mprintf(
+        "CREATE TRIGGER \"%s_insert\" AFTER INSERT ON \"%s\" WHEN (%s) BEGIN INSERT "
+        "OR REPLACE INTO \"%s\" VALUES (%s); END; "
+        "CREATE TRIGGER \"%s_update1\" AFTER UPDATE OF \"%s\" ON \"%s\" WHEN "
+        "OLD.rowid = NEW.rowid AND (%s) BEGIN INSERT OR REPLACE INTO \"%s\" VALUES "
+        "(%s); END; "
+        "CREATE TRIGGER \"%s_update2\" AFTER UPDATE OF \"%s\" ON \"%s\" WHEN "
+        "OLD.rowid = NEW.rowid AND NOT (%s) BEGIN DELETE FROM \"%s\" WHERE id = "
+        "OLD.rowid; END; "
+        "CREATE TRIGGER \"%s_update3\" AFTER UPDATE ON \"%s\" WHEN OLD.rowid != "
+        "NEW.rowid AND (%s) BEGIN DELETE FROM \"%s\" WHERE id = OLD.rowid; INSERT OR "
+        "REPLACE INTO \"%s\" VALUES (%s); END; "
+        "CREATE TRIGGER \"%s_update4\" AFTER UPDATE ON \"%s\" WHEN OLD.rowid != "
+        "NEW.rowid AND NOT (%s) BEGIN DELETE FROM \"%s\" WHERE id IN (OLD.rowid, "
+        "NEW.rowid); END; "
+        "CREATE TRIGGER \"%s_delete\" AFTER DELETE ON \"%s\" WHEN OLD.\"%s\" NOT NULL "
+        "BEGIN DELETE FROM \"%s\" WHERE id = OLD.rowid; END",
+        rtree, table, not_empty, rtree, values, rtree, geom, table, not_empty, rtree,
+        values, rtree, geom, table, not_empty, rtree, rtree, table, not_empty, rtree,
+        rtree, values, rtree, table, not_empty, rtree, rtree, table, geom, rtree);
+  }
+
+  result = sql == NULL ? ENOMEM : ArrowGPKGExec(con, sql, error);
+  sqlite3_free(sql);
+  sqlite3_free(not_empty);
+  sqlite3_free(values);
+  sqlite3_free(geom);
+  sqlite3_free(rtree);
+  sqlite3_free(table);
+  return result;
+}
+
+// Build the rtree of column_name of table_name in a savepoint and, if create_triggers
+// is non-zero, create the triggers that maintain it
+static int ArrowGPKGBuildRTreeSavepoint(sqlite3* con, const char* table_name,
+                                        const char* column_name, int create_triggers,
+                                        struct ArrowError* error) {
+  // A savepoint works both in and outside of a transaction
+  int result = ArrowGPKGExec(con, "SAVEPOINT arrow_gpkg_rtree", error);
+  if (result == NANOARROW_OK) {
+    result = ArrowGPKGBuildRTreeInternal(con, table_name, column_name, error);
+    if (result == NANOARROW_OK && create_triggers) {
+      result = ArrowGPKGCreateRTreeTriggers(con, table_name, column_name, error);
+    }
+
+    if (result != NANOARROW_OK) {
+      sqlite3_exec(con, "ROLLBACK TO arrow_gpkg_rtree", NULL, NULL, NULL);
+    }
+
+    sqlite3_exec(con, "RELEASE arrow_gpkg_rtree", NULL, NULL, NULL);
+  }
+
+  return result;
+}
+
+int ArrowGPKGBuildRTree(sqlite3* con, const char* table_name, const char* column_name,
+                        struct ArrowSQLite3Error* error) {
+  struct ArrowError* arrow_error = (struct ArrowError*)error;
+
+  // The triggers need the ST_ functions on this connection
+  NANOARROW_RETURN_NOT_OK(ArrowGPKGRegisterFunctions(con, error));
+
+  char* registered_column_name = NULL;
+  if (column_name == NULL) {
+    int result = ArrowGPKGGeometryColumnName(con, table_name, &registered_column_name);
+    if (result == ENOENT) {
+      ArrowErrorSet(arrow_error, "Table '%s' has no registered geometry column",
+                    table_name);
+    }
+
+    NANOARROW_RETURN_NOT_OK(result);
+    column_name = registered_column_name;
+  }
+
+  int result =
+      ArrowGPKGBuildRTreeSavepoint(con, table_name, column_name, 1, arrow_error);
+  sqlite3_free(registered_column_name);
+  return result;
+}
+
+// Drop the triggers that maintain the rtree of column_name of table_name, keeping
+// their SQL in triggers_sql (an array of *n_triggers strings to be freed using
+// sqlite3_free()) to recreate them
+static int ArrowGPKGDropRTreeTriggers(sqlite3* con, const char* table_name,
+                                      const char* column_name, char*** triggers_sql,
+                                      int64_t* n_triggers, struct ArrowError* error) {
+  *triggers_sql = NULL;
+  *n_triggers = 0;
+
+  char* prefix = sqlite3_mprintf("rtree_%s_%s_", table_name, column_name);
+  if (prefix == NULL) {
+    return ENOMEM;
+  }
+
+  sqlite3_stmt* stmt;
+  int result = sqlite3_prepare_v2(
+      con,
+      "SELECT name, sql FROM sqlite_master WHERE type = 'trigger' AND "
+      "lower(tbl_name) = lower(?1) AND lower(substr(name, 1, length(?2))) = lower(?2)",
+      -1, &stmt, NULL);
+  if (result != SQLITE_OK) {
+    sqlite3_free(prefix);
+    ArrowErrorSet(error, "<%s> %s", sqlite3_errstr(result), sqlite3_errmsg(con));
+    return EIO;
+  }
+
+  sqlite3_bind_text(stmt, 1, table_name, -1, SQLITE_STATIC);
+  sqlite3_bind_text(stmt, 2, prefix, -1, SQLITE_STATIC);
+
+  struct ArrowBuffer names;
+  struct ArrowBuffer sqls;
+  ArrowBufferInit(&names);
+  ArrowBufferInit(&sqls);
+  int code = NANOARROW_OK;
+  while (code == NANOARROW_OK && (result = sqlite3_step(stmt)) == SQLITE_ROW) {
+    char* name = sqlite3_mprintf("%s", sqlite3_column_text(stmt, 0));
+    char* sql = sqlite3_mprintf("%s", sqlite3_column_text(stmt, 1));
+    code = name == NULL || sql == NULL ? ENOMEM : NANOARROW_OK;
+    if (code == NANOARROW_OK) {
+      code = ArrowBufferAppend(&names, &name, sizeof(char*));
+    }
+    if (code == NANOARROW_OK) {
+      code = ArrowBufferAppend(&sqls, &sql, sizeof(char*));
+    }
+    if (code != NANOARROW_OK) {
+      sqlite3_free(name);
+      sqlite3_free(sql);
+    }
+  }
+
+  if (code == NANOARROW_OK && result != SQLITE_DONE) {
+    ArrowErrorSet(error, "<%s> %s", sqlite3_errstr(result), sqlite3_errmsg(con));
+    code = EIO;
+  }
+
+  sqlite3_finalize(stmt);
+  sqlite3_free(prefix);
+
+  // Triggers can't be dropped while the statement that lists them is active
+  int64_t n = names.size_bytes / sizeof(char*);
+  char** name = (char**)names.data;
+  for (int64_t i = 0; code == NANOARROW_OK && i < n; i++) {
+    char* sql = sqlite3_mprintf("DROP TRIGGER \"%w\"", name[i]);
+    code = sql == NULL ? ENOMEM : ArrowGPKGExec(con, sql, error);
+    sqlite3_free(sql);
+  }
+
+  for (int64_t i = 0; i < n; i++) {
+    sqlite3_free(name[i]);
+  }
+  ArrowBufferReset(&names);
+
+  if (code != NANOARROW_OK) {
+    for (int64_t i = 0; i < n; i++) {
+      sqlite3_free(((char**)sqls.data)[i]);
+    }
+    ArrowBufferReset(&sqls);
+    return code;
+  }
+
+  *triggers_sql = (char**)sqls.data;
+  *n_triggers = n;
+  return NANOARROW_OK;
+}
+
+// Whether the rtree of column_name of table_name exists and has no entries
+static int ArrowGPKGRTreeIsEmpty(sqlite3* con, const char* table_name,
+                                 const char* column_name) {
+  char* sql = sqlite3_mprintf("SELECT NOT EXISTS (SELECT 1 FROM \"rtree_%w_%w\")",
+                              table_name, column_name);
+  int64_t is_empty = 0;
+  if (sql != NULL) {
+    ArrowSQLite3QueryValue(con, sql, NULL, &is_empty, NULL, NULL);
+  }
+
+  sqlite3_free(sql);
+  return is_empty != 0;
+}
+
+// Insert stream into table_name with the rtree triggers of column_name dropped, then
+// rebuild the index and recreate the triggers
+static int ArrowGPKGIngestWithoutTriggers(sqlite3* con, const char* table_name,
+                                          const char* column_name,
+                                          struct ArrowArrayStream* stream,
+                                          const struct ArrowSQLite3IngestOptions* options,
+                                          int64_t* rows_inserted,
+                                          struct ArrowSQLite3Error* error) {
+  char** triggers_sql;
+  int64_t n_triggers;
+  NANOARROW_RETURN_NOT_OK(ArrowGPKGDropRTreeTriggers(con, table_name, column_name,
+                                                     &triggers_sql, &n_triggers,
+                                                     (struct ArrowError*)error));
+
+  // Rows that were committed before an error are indexed too, so the index and
+  // its triggers are restored whether or not the ingest succeeds. Every trigger is
+  // recreated even if the rebuild or another trigger fails.
+  int ingest_result =
+      ArrowSQLite3Ingest(con, table_name, stream, options, rows_inserted, error);
+  struct ArrowSQLite3Error restore_error;
+  // A table without triggers gets the standard ones, such that the index doesn't go
+  // stale when rows are added later
+  int result =
+      n_triggers == 0
+          ? ArrowGPKGBuildRTree(con, table_name, column_name, &restore_error)
+          : ArrowGPKGBuildRTreeSavepoint(con, table_name, column_name, 0,
+                                         (struct ArrowError*)&restore_error);
+  for (int64_t i = 0; i < n_triggers; i++) {
+    struct ArrowSQLite3Error trigger_error;
+    int trigger_result =
+        ArrowGPKGExec(con, triggers_sql[i], (struct ArrowError*)&trigger_error);
+    if (result == NANOARROW_OK && trigger_result != NANOARROW_OK) {
+      result = trigger_result;
+      memcpy(&restore_error, &trigger_error, sizeof(struct ArrowSQLite3Error));
+    }
+
+    sqlite3_free(triggers_sql[i]);
+  }
+
+  ArrowFree(triggers_sql);
+  if (ingest_result != NANOARROW_OK) {
+    return ingest_result;
+  }
+
+  if (result != NANOARROW_OK) {
+    memcpy(error, &restore_error, sizeof(struct ArrowSQLite3Error));
+  }
+
+  return result;
+}
+
+int ArrowGPKGIngest(sqlite3* con, const char* table_name,
+                    struct ArrowArrayStream* stream,
+                    const struct ArrowSQLite3IngestOptions* options,
+                    int64_t* rows_inserted, struct ArrowSQLite3Error* error) {
+  struct ArrowError* arrow_error = (struct ArrowError*)error;
+  struct ArrowSQLite3IngestOptions default_options;
+  if (options == NULL) {
+    ArrowSQLite3IngestOptionsInit(&default_options);
+    options = &default_options;
+  }
+
+  // The index is only rebuilt if it was empty (i.e., this is the initial load) such
+  // that loading a few rows into a large table doesn't rebuild its whole index
+  char* column_name = NULL;
+  int result = ArrowGPKGGeometryColumnName(con, table_name, &column_name);
+  if (result != NANOARROW_OK || !ArrowGPKGHasRTree(con, table_name, column_name) ||
+      !ArrowGPKGRTreeIsEmpty(con, table_name, column_name)) {
+    sqlite3_free(column_name);
+    if (result != NANOARROW_OK && result != ENOENT) {
+      return result;
+    }
+
+    return ArrowSQLite3Ingest(con, table_name, stream, options, rows_inserted, error);
+  }
+
+  // If everything happens in one transaction (the caller's or the single one of the
+  // ingest), it happens in a savepoint that is rolled back (with the dropped
+  // triggers) if there is an error
+  int in_savepoint = options->rows_per_transaction == 0 || !sqlite3_get_autocommit(con);
+  if (in_savepoint) {
+    result = ArrowGPKGExec(con, "SAVEPOINT arrow_gpkg_ingest", arrow_error);
+  }
+
+  int64_t rows_inserted_local = 0;
+  if (rows_inserted == NULL) {
+    rows_inserted = &rows_inserted_local;
+  }
+
+  if (result == NANOARROW_OK) {
+    result = ArrowGPKGIngestWithoutTriggers(con, table_name, column_name, stream,
+                                            options, rows_inserted, error);
+  }
+
+  if (in_savepoint && result == NANOARROW_OK) {
+    result = ArrowGPKGExec(con, "RELEASE arrow_gpkg_ingest", arrow_error);
+  }
+
+  if (in_savepoint && result != NANOARROW_OK) {
+    sqlite3_exec(con, "ROLLBACK TO arrow_gpkg_ingest", NULL, NULL, NULL);
+    sqlite3_exec(con, "RELEASE arrow_gpkg_ingest", NULL, NULL, NULL);
+    *rows_inserted = 0;
+  }
+
+  sqlite3_free(column_name);
+  return result;
+}
@@ -0,0 +1,390 @@
+
+#ifndef NANOARROW_GPKG_H_INCLUDED
+#define NANOARROW_GPKG_H_INCLUDED
+
+#include <stdint.h>
+
+#include <sqlite3.h>
+
+#include "nanoarrow_sqlite3.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Write the SQL for SELECT * FROM table_name with the * expanded to the columns
+// of table_name except exclude_columns and, if exclude_geometry is non-zero, the
+// geometry column registered in gpkg_geometry_columns. Columns that are not
+// selected are never read by SQLite (including any overflow pages they occupy).
+// sql_out must be freed using sqlite3_free().
+int ArrowGPKGSelectColumnsSQL(sqlite3* con, const char* table_name,
+                              const char** exclude_columns, int64_t n_exclude,
+                              int exclude_geometry, char** sql_out,
+                              struct ArrowSQLite3Error* error);
+
+// The header of a GeoPackage geometry blob
+struct ArrowGPKGHeader {
+  int32_t srs_id;
+
+  // Non-zero if the geometry is empty
+  int empty;
+
+  // 0 for no envelope, 1 for xy, 2 for xyz, 3 for xym, or 4 for xyzm
+  int envelope_type;
+
+  // xmin, xmax, ymin, ymax, zmin, zmax, mmin, mmax (in the order of the GeoPackage
+  // envelope). Bounds that are not part of the envelope are NaN.
+  double envelope[8];
+
+  // The number of bytes before the WKB
+  int64_t header_size;
+};
+
+// Decode the header of the GeoPackage geometry blob data (of size bytes). Returns
+// EINVAL if data is not a valid geometry blob.
+int ArrowGPKGParseHeader(const uint8_t* data, int64_t size, struct ArrowGPKGHeader* out,
+                         struct ArrowSQLite3Error* error);
+
+// Compute the envelope of the WKB geometry data (of size bytes) by walking its
+// coordinates in either byte order, setting the envelope, envelope_type, and empty
+// fields of out as if they had been decoded from a header with an envelope. NaN
+// ordinates (e.g., of an empty point) are ignored; a geometry without any other
+// ordinates is empty. Returns EINVAL if data is not valid WKB.
+int ArrowGPKGWKBEnvelope(const uint8_t* data, int64_t size, struct ArrowGPKGHeader* out,
+                         struct ArrowSQLite3Error* error);
+
+// Initialize a column handler for ArrowSQLite3ResultSetColumnHandler() that decodes
+// geometry blobs into a struct with children srs_id (int32), empty (bool), xmin,
+// xmax, ymin, ymax, zmin, zmax, mmin, mmax (double, null if not part of the
+// envelope), and wkb (binary). The envelope of geometries whose header doesn't have
+// one is computed from the WKB.
+int ArrowGPKGGeometryHandlerInit(struct ArrowSQLite3ColumnHandler* handler);
+
+// Initialize an ArrowArrayStream whose get_next() returns batches of up to batch_rows
+// envelopes of the geometry column column_name of table_name (or, if column_name is
+// NULL, the column registered in gpkg_geometry_columns). Each batch is a struct with
+// children rowid (int64) and the srs_id, empty, and bound children of
+// ArrowGPKGGeometryHandlerInit(); bounds are null for NULL geometries. Only the
+// header of each blob is read (using sqlite3_blob_read()), which avoids reading the
+// overflow pages occupied by large geometries, unless the header has no envelope. The
+// table must be a rowid table and con must outlive the stream.
+int ArrowGPKGEnvelopeStreamInit(struct ArrowArrayStream* stream, sqlite3* con,
+                                const char* table_name, const char* column_name,
+                                int64_t batch_rows, struct ArrowSQLite3Error* error);
+
+enum ArrowGPKGPredicate {
+  // The envelope of the geometry intersects the envelope of the query polygon
+  ARROW_GPKG_PREDICATE_ENVELOPE = 0,
+  // The geometry intersects the query polygon
+  ARROW_GPKG_PREDICATE_INTERSECTS = 1,
+  // The geometry is in or on the query polygon
+  ARROW_GPKG_PREDICATE_WITHIN = 2,
+  // The query polygon is in or on the (polygonal) geometry
+  ARROW_GPKG_PREDICATE_CONTAINS = 3
+};
+
+// Initialize an ArrowArrayStream of the rows of table_name whose geometry (in the
+// column registered in gpkg_geometry_columns) matches predicate for the query
+// polygon whose n_vertices vertices are the x, y pairs in xy (a single ring that may
+// or may not be closed). If the GeoPackage R-tree extension is registered for the
+// column in gpkg_extensions, candidates are looked up in the rtree_<table>_<column>
+// index (in index order), whose bounds are rounded outward to float precision;
+// otherwise, every row is a candidate. The envelope in the geometry header of each
+// candidate is checked and, for predicates other than ARROW_GPKG_PREDICATE_ENVELOPE,
+// candidates are refined by testing their xy coordinates against the query polygon
+// before they are appended.
+// Rows are read as in ArrowSQLite3StreamInitFromResult(): options can be set on
+// result (which is moved into the stream) or result can be NULL.
+int ArrowGPKGScanPolygon(struct ArrowArrayStream* stream, sqlite3* con,
+                         const char* table_name, const double* xy, int64_t n_vertices,
+                         enum ArrowGPKGPredicate predicate,
+                         struct ArrowSQLite3Result* result, int64_t batch_rows,
+                         struct ArrowSQLite3Error* error);
+
+// ArrowGPKGScanPolygon() with the query rectangle xmin, ymin, xmax, ymax
+int ArrowGPKGScanBBox(struct ArrowArrayStream* stream, sqlite3* con,
+                      const char* table_name, double xmin, double ymin, double xmax,
+                      double ymax, enum ArrowGPKGPredicate predicate,
+                      struct ArrowSQLite3Result* result, int64_t batch_rows,
+                      struct ArrowSQLite3Error* error);
+
+// Initialize a column handler for ArrowSQLite3ResultSetColumnHandler() that strips
+// the header of geometry blobs into a geoarrow.wkb column (WKB is copied as is).
+int ArrowGPKGWKBHandlerInit(struct ArrowSQLite3ColumnHandler* handler);
+
+enum ArrowGPKGGeometryType {
+  ARROW_GPKG_GEOMETRY_TYPE_POINT = 1,
+  ARROW_GPKG_GEOMETRY_TYPE_LINESTRING = 2,
+  ARROW_GPKG_GEOMETRY_TYPE_POLYGON = 3,
+  ARROW_GPKG_GEOMETRY_TYPE_MULTIPOINT = 4,
+  ARROW_GPKG_GEOMETRY_TYPE_MULTILINESTRING = 5,
+  ARROW_GPKG_GEOMETRY_TYPE_MULTIPOLYGON = 6
+};
+
+enum ArrowGPKGDimensions {
+  ARROW_GPKG_DIMENSIONS_XY = 1,
+  ARROW_GPKG_DIMENSIONS_XYZ = 2,
+  ARROW_GPKG_DIMENSIONS_XYM = 3,
+  ARROW_GPKG_DIMENSIONS_XYZM = 4
+};
+
+enum ArrowGPKGCoordType {
+  // A struct with one double child per dimension (x, y, z, m)
+  ARROW_GPKG_COORD_TYPE_SEPARATE = 1,
+  // A fixed-size list of doubles (xy, xyz, xym, or xyzm)
+  ARROW_GPKG_COORD_TYPE_INTERLEAVED = 2
+};
+
+// Initialize a column handler for ArrowSQLite3ResultSetColumnHandler() that decodes
+// geometry blobs (or WKB) directly into the GeoArrow native layout for
+// geometry_type: nested lists of parts, rings, and vertices whose coordinates are
+// stored according to coord_type. The field has GeoArrow extension metadata (e.g.,
+// geoarrow.multipolygon). Single geometries are accepted for the corresponding
+// multi geometry type; other geometry types or dimensions are an error.
+int ArrowGPKGGeoArrowHandlerInit(struct ArrowSQLite3ColumnHandler* handler,
+                                 enum ArrowGPKGGeometryType geometry_type,
+                                 enum ArrowGPKGDimensions dimensions,
+                                 enum ArrowGPKGCoordType coord_type);
+
+// A layer (i.e., a row of gpkg_contents) and its geometry column
+struct ArrowGPKGLayerInfo {
+  const char* table_name;
+
+  // features, attributes, tiles, or an extension data type
+  const char* data_type;
+
+  // The geometry column (or NULL for layers without one) and its type (e.g.,
+  // MULTIPOLYGON). z and m are 0 if prohibited, 1 if mandatory, or 2 if optional.
+  const char* column_name;
+  const char* geometry_type_name;
+  int z;
+  int m;
+
+  // The SRS of the geometry column (or of the layer) and its definition as WKT (or
+  // an authority code if there is no definition) with the GeoArrow crs_type (NULL
+  // for WKT1 or unknown). crs is NULL if the SRS is undefined.
+  int32_t srs_id;
+  const char* crs;
+  const char* crs_type;
+};
+
+// The layers of a GeoPackage, read from gpkg_contents, gpkg_geometry_columns, and
+// gpkg_spatial_ref_sys in one query when first needed and cached until the database
+// changes (checked using PRAGMA data_version and sqlite3_total_changes()).
+struct ArrowGPKGCatalog {
+  void* private_data;
+};
+
+// Initialize a catalog for con, which must outlive the catalog
+int ArrowGPKGCatalogInit(struct ArrowGPKGCatalog* catalog, sqlite3* con);
+
+void ArrowGPKGCatalogReset(struct ArrowGPKGCatalog* catalog);
+
+// Get all layers (none if con is not a GeoPackage). The layers are valid until the
+// next call that uses the catalog.
+int ArrowGPKGCatalogLayers(struct ArrowGPKGCatalog* catalog,
+                           const struct ArrowGPKGLayerInfo** layers_out,
+                           int64_t* n_layers_out, struct ArrowSQLite3Error* error);
+
+// Find the layer of table_name. Returns ENOENT if it is not in gpkg_contents.
+int ArrowGPKGCatalogFindLayer(struct ArrowGPKGCatalog* catalog, const char* table_name,
+                              const struct ArrowGPKGLayerInfo** layer_out,
+                              struct ArrowSQLite3Error* error);
+
+// Add metadata to the child of schema that is the geometry column of table_name: the
+// gpkg:geometry_type_name and gpkg:srs_id keys and, for GeoArrow extension types
+// (e.g., from ArrowGPKGWKBHandlerInit()), extension metadata with the crs. Schemas
+// of other tables are unchanged.
+int ArrowGPKGCatalogAnnotateSchema(struct ArrowGPKGCatalog* catalog,
+                                   const char* table_name, struct ArrowSchema* schema,
+                                   struct ArrowSQLite3Error* error);
+
+// Wrap stream (e.g., from ArrowGPKGScanBBox()) such that its schema is annotated
+// using ArrowGPKGCatalogAnnotateSchema(). The catalog must outlive the stream.
+int ArrowGPKGCatalogAnnotateStream(struct ArrowGPKGCatalog* catalog,
+                                   const char* table_name,
+                                   struct ArrowArrayStream* stream);
+
+// The first four sources have the values of enum ArrowSQLite3RowCountSource
+enum ArrowGPKGSource {
+  ARROW_GPKG_SOURCE_NONE = 0,
+  // gpkg_ogr_contents.feature_count
+  ARROW_GPKG_SOURCE_OGR_CONTENTS = 1,
+  // The row count in sqlite_stat1 (from the last ANALYZE)
+  ARROW_GPKG_SOURCE_SQLITE_STAT1 = 2,
+  // The largest rowid of the table
+  ARROW_GPKG_SOURCE_MAX_ROWID = 3,
+  // The root node of the rtree_<table>_<column> index
+  ARROW_GPKG_SOURCE_RTREE = 4,
+  // The min_x, min_y, max_x, and max_y columns of gpkg_contents
+  ARROW_GPKG_SOURCE_CONTENTS = 5
+};
+
+struct ArrowGPKGLayerSummary {
+  // -1 if unknown
+  int64_t feature_count;
+  enum ArrowGPKGSource feature_count_source;
+  int feature_count_exact;
+
+  // xmin, ymin, xmax, ymax (NaN if unknown or if the layer is empty)
+  double extent[4];
+  enum ArrowGPKGSource extent_source;
+  // Non-zero if the extent is exactly the bounds of the features
+  int extent_exact;
+  // Non-zero if the extent is known to contain every feature (but may be larger)
+  int extent_conservative;
+};
+
+// Get the feature count and extent of table_name from the cheapest trustworthy
+// source without scanning the table. The feature count is read from (in order)
+// gpkg_ogr_contents (exact), sqlite_stat1, or max(rowid) (an upper bound after
+// deletes); the extent from the root node of the R-tree index (conservative, as its
+// bounds are rounded outward to float precision) or gpkg_contents (informative
+// only). Sources that are not available are reported as ARROW_GPKG_SOURCE_NONE.
+int ArrowGPKGSummarizeLayer(sqlite3* con, const char* table_name,
+                            struct ArrowGPKGLayerSummary* out,
+                            struct ArrowSQLite3Error* error);
+
+// The geometry types and dimensions observed in a geometry column
+struct ArrowGPKGGeometryTypes {
+  // Bit (1 << t) is set for each WKB geometry type t observed (1 for point to 7 for
+  // geometry collection). Bit 0 is set for other geometry types (e.g., curves).
+  uint32_t geometry_types;
+
+  // Bit (1 << d) is set for each enum ArrowGPKGDimensions d observed
+  uint32_t dimensions;
+
+  // The number of rows examined and how many of them had NULL geometries
+  int64_t n_rows;
+  int64_t n_null;
+
+  // Non-zero if every row of the table was examined
+  int complete;
+};
+
+// Record the geometry types and dimensions of the first max_rows rows (or all rows
+// if max_rows is 0) of the geometry column column_name of table_name (or, if
+// column_name is NULL, the column registered in gpkg_geometry_columns). Only the
+// header of each blob and the type of its WKB are read (using sqlite3_blob_read()).
+int ArrowGPKGDetectGeometryTypes(sqlite3* con, const char* table_name,
+                                 const char* column_name, int64_t max_rows,
+                                 struct ArrowGPKGGeometryTypes* out,
+                                 struct ArrowSQLite3Error* error);
+
+// Choose the most compact GeoArrow layout for the observed types: a single geometry
+// type if only that type was observed or the corresponding multi geometry type if
+// it was mixed with its single geometry type. Returns ENOTSUP if there is no such
+// layout (e.g., mixed dimensions, geometry collections, or no geometries).
+int ArrowGPKGChooseGeoArrowLayout(const struct ArrowGPKGGeometryTypes* types,
+                                  enum ArrowGPKGGeometryType* geometry_type_out,
+                                  enum ArrowGPKGDimensions* dimensions_out);
+
+// Initialize a GeoArrow column handler with the layout chosen by
+// ArrowGPKGChooseGeoArrowLayout() or a WKB column handler if there is none. The
+// layout is fixed by the schema of the first batch; if types is from a sample,
+// later geometries that don't fit the layout fail to append.
+int ArrowGPKGDetectedHandlerInit(struct ArrowSQLite3ColumnHandler* handler,
+                                 const struct ArrowGPKGGeometryTypes* types,
+                                 enum ArrowGPKGCoordType coord_type);
+
+// Initialize a stream of the tiles of the tile pyramid table_name (registered in
+// gpkg_tile_matrix_set) at zoom_level whose tile_column and tile_row are within the
+// (inclusive) window, which is clipped to the size of the tile matrix. Batches of up
+// to batch_rows rows have zoom_level, tile_column, tile_row (int64) and tile_data
+// (binary) columns in the order of the primary key of the table. The stream reads
+// tile_data using sqlite3_blob_read() and must be released before con is closed.
+int ArrowGPKGTileStreamInit(struct ArrowArrayStream* stream, sqlite3* con,
+                            const char* table_name, int64_t zoom_level,
+                            int64_t min_column, int64_t min_row, int64_t max_column,
+                            int64_t max_row, int64_t batch_rows,
+                            struct ArrowSQLite3Error* error);
+
+// Create table_name from the columns of schema with the gpkg_contents and (if schema
+// has a geometry column) gpkg_geometry_columns rows that register it, creating the
+// GeoPackage core tables if needed. Columns are created with the GeoPackage data type
+// that reads back as their Arrow type (or their nanoarrow_sqlite3.decltype metadata).
+// A geoarrow.* column becomes the geometry column: its crs (from
+// ARROW:extension:metadata) is found in gpkg_spatial_ref_sys and its geometry type
+// and dimensions are registered. Authority codes (and PROJJSON crs values, by their
+// id) must already be registered; WKT crs values are added as a custom definition if
+// needed. Other crs values fail with ENOTSUP, as definitions must be WKT. An integer
+// column named fid is used as the primary key (otherwise one is added). Everything
+// is created in a single savepoint and nothing is created if there is an error.
+int ArrowGPKGCreateTable(sqlite3* con, const char* table_name,
+                         struct ArrowSchema* schema, struct ArrowSQLite3Error* error);
+
+// Encodes native GeoArrow or geoarrow.wkb arrays as binary arrays of GeoPackage
+// geometry blobs (with an xy envelope computed from the coordinates or WKB)
+struct ArrowGPKGEncoder {
+  void* private_data;
+};
+
+// Initialize an encoder for arrays of the GeoArrow field schema. Geometries are
+// written with srs_id (e.g., the one registered for the table in
+// gpkg_geometry_columns).
+int ArrowGPKGEncoderInit(struct ArrowGPKGEncoder* encoder, struct ArrowSchema* schema,
+                         int32_t srs_id, struct ArrowSQLite3Error* error);
+
+// Encode array into out (a new binary array) in a single pass. Null geometries are
+// null in out and geometries without coordinates are flagged as empty. The data
+// buffer of out is reserved from the size of the previous output.
+int ArrowGPKGEncoderEncode(struct ArrowGPKGEncoder* encoder, struct ArrowArray* array,
+                           struct ArrowArray* out, struct ArrowSQLite3Error* error);
+
+void ArrowGPKGEncoderReset(struct ArrowGPKGEncoder* encoder);
+
+// Wrap stream such that its GeoArrow columns are encoded as binary columns of
+// GeoPackage geometry blobs (e.g., to insert them using ArrowSQLite3Ingest()).
+int ArrowGPKGEncodeStream(struct ArrowArrayStream* stream, int32_t srs_id,
+                          struct ArrowSQLite3Error* error);
+
+// Wrap stream as in ArrowGPKGEncodeStream() but encode batches on n_threads threads.
+// Batches are pulled from stream (by one thread at a time) and encoded in parallel
+// while get_next() returns them in their original order, such that the consumer (e.g.,
+// the single writer of ArrowSQLite3Ingest()) doesn't wait on the encoding. At most
+// max_batches batches are pulled but not yet returned by get_next(), which bounds the
+// memory used when the consumer is slower. stream must support calls from threads
+// other than the one that created it.
+int ArrowGPKGEncodeStreamParallel(struct ArrowArrayStream* stream, int32_t srs_id,
+                                  int n_threads, int64_t max_batches,
+                                  struct ArrowSQLite3Error* error);
+
+// Build the GeoPackage R-tree index rtree_<table_name>_<column_name> of the geometry
+// column column_name of table_name (or, if column_name is NULL, the column registered
+// in gpkg_geometry_columns), replacing any existing index, and register it in
+// gpkg_extensions. The xy envelopes of non-empty geometries are read from their
+// headers and packed bottom up into full nodes in Sort-Tile-Recursive order, which
+// are written directly to the shadow tables of the rtree. If the table has no
+// rtree_<table_name>_<column_name>_* triggers, the triggers of the specification that
+// maintain the index are created (existing ones are kept). They require the ST_
+// functions, which are registered on con using ArrowGPKGRegisterFunctions() (other
+// connections that write to the table must register them too).
+int ArrowGPKGBuildRTree(sqlite3* con, const char* table_name, const char* column_name,
+                        struct ArrowSQLite3Error* error);
+
+// Register the ST_IsEmpty(), ST_MinX(), ST_MaxX(), ST_MinY(), and ST_MaxY() SQL
+// functions of the GeoPackage R-tree extension on con. They read the envelope of a
+// geometry blob from its header (or its WKB if the header has none).
+int ArrowGPKGRegisterFunctions(sqlite3* con, struct ArrowSQLite3Error* error);
+
+// Insert the batches of stream into table_name as in ArrowSQLite3Ingest(). If the
+// geometry column of table_name has an empty R-tree index (e.g., a new table), the
+// triggers that maintain it are dropped for the duration of the load, after which the
+// index is rebuilt using ArrowGPKGBuildRTree() and the triggers are recreated (which
+// is faster than updating the index once per row and results in a better packed
+// index). A table without triggers gets the ones created by ArrowGPKGBuildRTree(). A
+// non-empty index is updated by its triggers. If con is in a transaction or
+// options->rows_per_transaction is 0, the load is done in a savepoint and nothing is
+// inserted if there is an error. Otherwise, rows are committed during the load and a
+// crash before it ends leaves the table without the index triggers and with an
+// incomplete index (which ArrowGPKGBuildRTree() repairs).
+int ArrowGPKGIngest(sqlite3* con, const char* table_name,
+                    struct ArrowArrayStream* stream,
+                    const struct ArrowSQLite3IngestOptions* options,
+                    int64_t* rows_inserted, struct ArrowSQLite3Error* error);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,1940 @@
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <arrow/array.h>
+#include <arrow/builder.h>
+#include <arrow/c/bridge.h>
+#include <arrow/record_batch.h>
+#include <arrow/util/key_value_metadata.h>
+#include <gtest/gtest.h>
+#include <sqlite3.h>
+
+#include "nanoarrow_gpkg.h"
+
+using namespace arrow;
+
+// Append the bytes of value to out in little or big endian order
+template <typename T>
+void append_value(std::string* out, T value, bool little_endian) {
+  char bytes[sizeof(T)];
+  std::memcpy(bytes, &value, sizeof(T));
+  uint16_t one = 1;
+  bool host_little_endian = *reinterpret_cast<uint8_t*>(&one) == 1;
+  if (little_endian != host_little_endian) {
+    for (size_t i = 0; i < sizeof(T) / 2; i++) {
+      std::swap(bytes[i], bytes[sizeof(T) - i - 1]);
+    }
+  }
+
+  out->append(bytes, sizeof(T));
+}
+
+// A GeoPackage geometry blob with envelope_type and an xy point (as little-endian WKB)
+std::string gpkg_point(int32_t srs_id, double x, double y, int envelope_type = 1,
+                       bool little_endian = true, const std::vector<double>& zm = {}) {
+  std::string out("GP");
+  out.push_back(0);
+  out.push_back(static_cast<char>(little_endian | (envelope_type << 1)));
+  append_value(&out, srs_id, little_endian);
+
+  if (envelope_type > 0) {
+    for (double bound : {x, x, y, y}) {
+      append_value(&out, bound, little_endian);
+    }
+
+    for (double bound : zm) {
+      append_value(&out, bound, little_endian);
+    }
+  }
+
+  out.push_back(1);
+  append_value<uint32_t>(&out, 1, true);
+  append_value(&out, x, true);
+  append_value(&out, y, true);
+  return out;
+}
+
+std::string wkb_header(uint32_t geometry_type, bool little_endian = true) {
+  std::string out;
+  out.push_back(little_endian);
+  append_value(&out, geometry_type, little_endian);
+  return out;
+}
+
+std::string wkb_coords(const std::vector<double>& coords, bool little_endian = true) {
+  std::string out;
+  for (double coord : coords) {
+    append_value(&out, coord, little_endian);
+  }
+
+  return out;
+}
+
+std::string wkb_count(uint32_t count, bool little_endian = true) {
+  std::string out;
+  append_value(&out, count, little_endian);
+  return out;
+}
+
+// A GeoPackage geometry blob without an envelope
+std::string gpkg_blob(const std::string& wkb) {
+  std::string out("GP");
+  out.push_back(0);
+  out.push_back(1);
+  append_value<int32_t>(&out, 4326, true);
+  return out + wkb;
+}
+
+class ConnectionHolder {
+ public:
+  sqlite3* ptr;
+  ConnectionHolder() : ptr(nullptr) {}
+
+  int open_memory() {
+    int result = sqlite3_open(":memory:", &ptr);
+    if (result != SQLITE_OK) {
+      throw std::runtime_error(sqlite3_errstr(result));
+    }
+
+    return result;
+  }
+
+  int exec(const std::string& sql) {
+    char* error_message = nullptr;
+    int result = sqlite3_exec(ptr, sql.c_str(), nullptr, nullptr, &error_message);
+    if (error_message != nullptr) {
+      std::string error_message_str(error_message);
+      sqlite3_free(error_message);
+      throw std::runtime_error(error_message_str);
+    }
+
+    return result;
+  }
+
+  void add_gpkg_tables() {
+    exec(
+        "CREATE TABLE gpkg_spatial_ref_sys (srs_name TEXT NOT NULL, srs_id INTEGER "
+        "PRIMARY KEY, organization TEXT NOT NULL, organization_coordsys_id INTEGER NOT "
+        "NULL, definition TEXT NOT NULL, description TEXT)");
+    exec(
+        "INSERT INTO gpkg_spatial_ref_sys VALUES ('Undefined cartesian SRS', -1, 'NONE', "
+        "-1, 'undefined', NULL), ('Undefined geographic SRS', 0, 'NONE', 0, "
+        "'undefined', NULL)");
+    exec(
+        "CREATE TABLE gpkg_contents (table_name TEXT NOT NULL PRIMARY KEY, data_type "
+        "TEXT NOT NULL, identifier TEXT UNIQUE, description TEXT DEFAULT '', "
+        "last_change DATETIME NOT NULL DEFAULT "
+        "(strftime('%Y-%m-%dT%H:%M:%fZ','now')), min_x DOUBLE, min_y DOUBLE, max_x "
+        "DOUBLE, max_y DOUBLE, srs_id INTEGER)");
+    exec(
+        "CREATE TABLE gpkg_geometry_columns (table_name TEXT NOT NULL, column_name TEXT "
+        "NOT NULL, geometry_type_name TEXT NOT NULL, srs_id INTEGER NOT NULL, z TINYINT "
+        "NOT NULL, m TINYINT NOT NULL, CONSTRAINT pk_geom_cols PRIMARY KEY (table_name, "
+        "column_name))");
+  }
+
+  void add_features_table() {
+    exec(
+        "CREATE TABLE features (fid INTEGER PRIMARY KEY AUTOINCREMENT, name TEXT, geom "
+        "POINT)");
+    exec(
+        "INSERT INTO gpkg_contents (table_name, data_type, srs_id) VALUES ('features', "
+        "'features', 0)");
+    exec(
+        "INSERT INTO gpkg_geometry_columns VALUES ('features', 'geom', 'POINT', 0, 0, "
+        "0)");
+    exec("INSERT INTO features (name, geom) VALUES ('one', X'00'), ('two', NULL)");
+  }
+
+  void insert_blob(const std::string& sql, const std::string& blob) {
+    sqlite3_stmt* stmt;
+    int result = sqlite3_prepare_v2(ptr, sql.c_str(), -1, &stmt, nullptr);
+    if (result != SQLITE_OK) {
+      throw std::runtime_error(sqlite3_errmsg(ptr));
+    }
+
+    sqlite3_bind_blob(stmt, 1, blob.data(), blob.size(), SQLITE_STATIC);
+    result = sqlite3_step(stmt);
+    sqlite3_finalize(stmt);
+    if (result != SQLITE_DONE) {
+      throw std::runtime_error(sqlite3_errmsg(ptr));
+    }
+  }
+
+  ~ConnectionHolder() {
+    if (ptr != nullptr) {
+      sqlite3_close(ptr);
+    }
+  }
+};
+
+void ASSERT_ARROW_OK(Status status) {
+  if (!status.ok()) {
+    throw std::runtime_error(status.message());
+  }
+}
+
+TEST(GPKGTest, GPKGSelectColumnsSQL) {
+  ConnectionHolder con;
+  con.open_memory();
+  con.add_gpkg_tables();
+  con.add_features_table();
+
+  struct ArrowSQLite3Error error;
+  char* sql = nullptr;
+
+  ASSERT_EQ(ArrowGPKGSelectColumnsSQL(con.ptr, "features", nullptr, 0, 0, &sql, &error),
+            0);
+  EXPECT_STREQ(sql, "SELECT \"fid\", \"name\", \"geom\" FROM \"features\"");
+  sqlite3_free(sql);
+
+  ASSERT_EQ(ArrowGPKGSelectColumnsSQL(con.ptr, "features", nullptr, 0, 1, &sql, &error),
+            0);
+  EXPECT_STREQ(sql, "SELECT \"fid\", \"name\" FROM \"features\"");
+  sqlite3_free(sql);
+
+  const char* exclude[] = {"FID"};
+  ASSERT_EQ(ArrowGPKGSelectColumnsSQL(con.ptr, "features", exclude, 1, 1, &sql, &error),
+            0);
+  EXPECT_STREQ(sql, "SELECT \"name\" FROM \"features\"");
+  sqlite3_free(sql);
+
+  const char* exclude_all[] = {"fid", "name"};
+  EXPECT_EQ(
+      ArrowGPKGSelectColumnsSQL(con.ptr, "features", exclude_all, 2, 1, &sql, &error),
+      EINVAL);
+  EXPECT_STREQ(error.message, "All columns of table 'features' were excluded");
+
+  EXPECT_EQ(
+      ArrowGPKGSelectColumnsSQL(con.ptr, "not_a_table", nullptr, 0, 0, &sql, &error),
+      ENOENT);
+  EXPECT_STREQ(error.message, "Table 'not_a_table' does not exist");
+}
+
+TEST(GPKGTest, GPKGParseHeader) {
+  struct ArrowGPKGHeader header;
+  struct ArrowSQLite3Error error;
+
+  std::string blob = gpkg_point(4326, 1, 2);
+  ASSERT_EQ(ArrowGPKGParseHeader(reinterpret_cast<const uint8_t*>(blob.data()),
+                                 blob.size(), &header, &error),
+            0);
+  EXPECT_EQ(header.srs_id, 4326);
+  EXPECT_EQ(header.empty, 0);
+  EXPECT_EQ(header.envelope_type, 1);
+  EXPECT_EQ(header.header_size, 40);
+  EXPECT_EQ(header.envelope[0], 1);
+  EXPECT_EQ(header.envelope[1], 1);
+  EXPECT_EQ(header.envelope[2], 2);
+  EXPECT_EQ(header.envelope[3], 2);
+  EXPECT_TRUE(std::isnan(header.envelope[4]));
+  EXPECT_TRUE(std::isnan(header.envelope[7]));
+
+  blob = gpkg_point(3857, 1, 2, 3, false, {5, 6});
+  ASSERT_EQ(ArrowGPKGParseHeader(reinterpret_cast<const uint8_t*>(blob.data()),
+                                 blob.size(), &header, &error),
+            0);
+  EXPECT_EQ(header.srs_id, 3857);
+  EXPECT_EQ(header.envelope_type, 3);
+  EXPECT_EQ(header.header_size, 56);
+  EXPECT_EQ(header.envelope[2], 2);
+  EXPECT_TRUE(std::isnan(header.envelope[4]));
+  EXPECT_EQ(header.envelope[6], 5);
+  EXPECT_EQ(header.envelope[7], 6);
+
+  blob = gpkg_point(0, 1, 2, 0);
+  ASSERT_EQ(ArrowGPKGParseHeader(reinterpret_cast<const uint8_t*>(blob.data()),
+                                 blob.size(), &header, &error),
+            0);
+  EXPECT_EQ(header.header_size, 8);
+  EXPECT_TRUE(std::isnan(header.envelope[0]));
+
+  blob[0] = 'X';
+  EXPECT_EQ(ArrowGPKGParseHeader(reinterpret_cast<const uint8_t*>(blob.data()),
+                                 blob.size(), &header, &error),
+            EINVAL);
+  EXPECT_STREQ(error.message, "Expected geometry blob with magic 'GP'");
+
+  blob = gpkg_point(0, 1, 2, 4).substr(0, 40);
+  EXPECT_EQ(ArrowGPKGParseHeader(reinterpret_cast<const uint8_t*>(blob.data()),
+                                 blob.size(), &header, &error),
+            EINVAL);
+  EXPECT_STREQ(error.message, "Expected geometry blob of at least 72 bytes but got 40");
+}
+
+TEST(GPKGTest, GPKGWKBEnvelope) {
+  struct ArrowGPKGHeader header;
+  struct ArrowSQLite3Error error;
+
+  // Big-endian linestring z
+  std::string wkb = wkb_header(1002, false) + wkb_count(2, false) +
+                    wkb_coords({1, 2, 3, -4, 5, 6}, false);
+  ASSERT_EQ(ArrowGPKGWKBEnvelope(reinterpret_cast<const uint8_t*>(wkb.data()),
+                                 wkb.size(), &header, &error),
+            0)
+      << error.message;
+  EXPECT_EQ(header.envelope_type, 2);
+  EXPECT_FALSE(header.empty);
+  EXPECT_EQ(header.envelope[0], -4);
+  EXPECT_EQ(header.envelope[1], 1);
+  EXPECT_EQ(header.envelope[2], 2);
+  EXPECT_EQ(header.envelope[3], 5);
+  EXPECT_EQ(header.envelope[4], 3);
+  EXPECT_EQ(header.envelope[5], 6);
+  EXPECT_TRUE(std::isnan(header.envelope[6]));
+
+  // Geometry collection of an EWKB point m and a polygon m
+  wkb = wkb_header(7) + wkb_count(2) + wkb_header(0x40000001) + wkb_coords({0, 0, 10}) +
+        wkb_header(2003) + wkb_count(1) + wkb_count(3) +
+        wkb_coords({1, 1, 1, 2, 3, 4, 1, 1, 1});
+  ASSERT_EQ(ArrowGPKGWKBEnvelope(reinterpret_cast<const uint8_t*>(wkb.data()),
+                                 wkb.size(), &header, &error),
+            0)
+      << error.message;
+  EXPECT_EQ(header.envelope_type, 3);
+  EXPECT_EQ(header.envelope[1], 2);
+  EXPECT_EQ(header.envelope[3], 3);
+  EXPECT_TRUE(std::isnan(header.envelope[4]));
+  EXPECT_EQ(header.envelope[6], 1);
+  EXPECT_EQ(header.envelope[7], 10);
+
+  // Empty point
+  wkb = wkb_header(1) + wkb_coords({NAN, NAN});
+  ASSERT_EQ(ArrowGPKGWKBEnvelope(reinterpret_cast<const uint8_t*>(wkb.data()),
+                                 wkb.size(), &header, &error),
+            0);
+  EXPECT_TRUE(header.empty);
+  EXPECT_EQ(header.envelope_type, 0);
+
+  // Truncated coordinates
+  wkb = wkb_header(2) + wkb_count(2) + wkb_coords({1, 2, 3});
+  EXPECT_EQ(ArrowGPKGWKBEnvelope(reinterpret_cast<const uint8_t*>(wkb.data()),
+                                 wkb.size(), &header, &error),
+            EINVAL);
+  EXPECT_STREQ(error.message, "Invalid WKB geometry at byte 9");
+
+  // The geometry handler and the envelope stream fill in missing envelopes
+  ConnectionHolder con;
+  con.open_memory();
+  con.exec("CREATE TABLE features (geom GEOMETRY)");
+  con.insert_blob("INSERT INTO features VALUES (?)",
+                  gpkg_blob(wkb_header(2) + wkb_count(2) + wkb_coords({1, 2, 3, 4})));
+
+  struct ArrowArrayStream stream;
+  ASSERT_EQ(ArrowGPKGEnvelopeStreamInit(&stream, con.ptr, "features", "geom", 10, &error),
+            0);
+  auto batch = ImportRecordBatchReader(&stream).ValueOrDie()->Next().ValueOrDie();
+  auto ymax = std::dynamic_pointer_cast<DoubleArray>(batch->column(6));
+  EXPECT_EQ(ymax->Value(0), 4);
+  EXPECT_TRUE(batch->column(7)->IsNull(0));
+
+  sqlite3_stmt* stmt;
+  ASSERT_EQ(sqlite3_prepare_v2(con.ptr, "SELECT geom FROM features", -1, &stmt, nullptr),
+            SQLITE_OK);
+  struct ArrowSQLite3Result result;
+  ASSERT_EQ(ArrowSQLite3ResultInit(&result), 0);
+  struct ArrowSQLite3ColumnHandler handler;
+  ASSERT_EQ(ArrowGPKGGeometryHandlerInit(&handler), 0);
+  ASSERT_EQ(ArrowSQLite3ResultSetColumnHandler(&result, "geom", &handler), 0);
+  ASSERT_EQ(ArrowSQLite3ResultStep(&result, stmt), 0) << ArrowSQLite3ResultError(&result);
+  sqlite3_finalize(stmt);
+
+  struct ArrowArray array;
+  struct ArrowSchema schema;
+  ASSERT_EQ(ArrowSQLite3ResultFinishArray(&result, &array), 0);
+  ASSERT_EQ(ArrowSQLite3ResultFinishSchema(&result, &schema), 0);
+  ArrowSQLite3ResultReset(&result);
+
+  auto geom = std::dynamic_pointer_cast<StructArray>(
+      ImportRecordBatch(&array, &schema).ValueOrDie()->column(0));
+  auto xmin = std::dynamic_pointer_cast<DoubleArray>(geom->field(2));
+  EXPECT_EQ(xmin->Value(0), 1);
+}
+
+TEST(GPKGTest, GPKGGeometryHandler) {
+  ConnectionHolder con;
+  con.open_memory();
+  con.exec("CREATE TABLE features (fid INTEGER PRIMARY KEY, geom POINT)");
+  con.insert_blob("INSERT INTO features (geom) VALUES (?)", gpkg_point(4326, 1, 2));
+  con.exec("INSERT INTO features (geom) VALUES (NULL)");
+  con.insert_blob("INSERT INTO features (geom) VALUES (?)",
+                  gpkg_point(3857, 3, 4, 2, false, {5, 6}));
+
+  sqlite3_stmt* stmt;
+  ASSERT_EQ(sqlite3_prepare_v2(con.ptr, "SELECT fid, geom FROM features", -1, &stmt,
+                               nullptr),
+            SQLITE_OK);
+
+  struct ArrowSQLite3Result result;
+  ASSERT_EQ(ArrowSQLite3ResultInit(&result), 0);
+
+  struct ArrowSQLite3ColumnHandler handler;
+  ASSERT_EQ(ArrowGPKGGeometryHandlerInit(&handler), 0);
+  ASSERT_EQ(ArrowSQLite3ResultSetColumnHandler(&result, "geom", &handler), 0);
+
+  int64_t rows_appended;
+  ASSERT_EQ(ArrowSQLite3ResultStepN(&result, stmt, 1024, &rows_appended), 0)
+      << ArrowSQLite3ResultError(&result);
+  EXPECT_EQ(rows_appended, 3);
+  sqlite3_finalize(stmt);
+
+  struct ArrowArray array;
+  struct ArrowSchema schema;
+  ASSERT_EQ(ArrowSQLite3ResultFinishArray(&result, &array), 0);
+  ASSERT_EQ(ArrowSQLite3ResultFinishSchema(&result, &schema), 0);
+  ArrowSQLite3ResultReset(&result);
+
+  auto maybe_array = ImportArray(&array, &schema);
+  ASSERT_ARROW_OK(maybe_array.status());
+  auto arr = std::dynamic_pointer_cast<StructArray>(maybe_array.ValueUnsafe());
+  ASSERT_ARROW_OK(arr->ValidateFull());
+
+  auto geom_type = struct_(
+      {field("srs_id", int32()), field("empty", boolean()), field("xmin", float64()),
+       field("xmax", float64()), field("ymin", float64()), field("ymax", float64()),
+       field("zmin", float64()), field("zmax", float64()), field("mmin", float64()),
+       field("mmax", float64()), field("wkb", binary())});
+  EXPECT_TRUE(
+      arr->type()->Equals(struct_({field("fid", int64()), field("geom", geom_type)})));
+
+  auto geom = std::dynamic_pointer_cast<StructArray>(arr->field(1));
+  EXPECT_TRUE(geom->IsNull(1));
+
+  auto srs_id = std::dynamic_pointer_cast<Int32Array>(geom->field(0));
+  EXPECT_EQ(srs_id->Value(0), 4326);
+  EXPECT_EQ(srs_id->Value(2), 3857);
+
+  auto ymin = std::dynamic_pointer_cast<DoubleArray>(geom->field(4));
+  EXPECT_EQ(ymin->Value(0), 2);
+  EXPECT_EQ(ymin->Value(2), 4);
+
+  auto zmax = std::dynamic_pointer_cast<DoubleArray>(geom->field(7));
+  EXPECT_TRUE(zmax->IsNull(0));
+  EXPECT_EQ(zmax->Value(2), 6);
+  EXPECT_TRUE(geom->field(8)->IsNull(2));
+
+  auto wkb = std::dynamic_pointer_cast<BinaryArray>(geom->field(10));
+  EXPECT_EQ(wkb->GetView(0), gpkg_point(4326, 1, 2).substr(40));
+  EXPECT_EQ(wkb->GetView(2).size(), 21);
+}
+
+TEST(GPKGTest, GPKGEnvelopeStream) {
+  ConnectionHolder con;
+  con.open_memory();
+  con.add_gpkg_tables();
+  con.exec("CREATE TABLE features (fid INTEGER PRIMARY KEY, geom POLYGON)");
+  con.exec(
+      "INSERT INTO gpkg_geometry_columns VALUES ('features', 'geom', 'POLYGON', 0, 0, "
+      "0)");
+
+  // Geometries much larger than a page are mostly stored in overflow pages
+  std::string large = gpkg_point(4326, 1, 2) + std::string(100000, '\0');
+  con.insert_blob("INSERT INTO features (geom) VALUES (?)", large);
+  con.exec("INSERT INTO features (geom) VALUES (NULL)");
+  con.insert_blob("INSERT INTO features (geom) VALUES (?)",
+                  gpkg_point(3857, 3, 4, 3, false, {5, 6}));
+
+  struct ArrowArrayStream stream;
+  struct ArrowSQLite3Error error;
+  ASSERT_EQ(ArrowGPKGEnvelopeStreamInit(&stream, con.ptr, "features", nullptr, 2, &error),
+            0)
+      << error.message;
+
+  auto maybe_reader = ImportRecordBatchReader(&stream);
+  ASSERT_ARROW_OK(maybe_reader.status());
+  auto maybe_batches = maybe_reader.ValueUnsafe()->ToRecordBatches();
+  ASSERT_ARROW_OK(maybe_batches.status());
+  auto batches = maybe_batches.ValueUnsafe();
+  ASSERT_EQ(batches.size(), 2);
+  EXPECT_EQ(batches[0]->num_rows(), 2);
+  EXPECT_EQ(batches[1]->num_rows(), 1);
+
+  auto schema = batches[0]->schema();
+  EXPECT_EQ(schema->num_fields(), 11);
+  EXPECT_EQ(schema->field(0)->name(), "rowid");
+  EXPECT_TRUE(schema->field(3)->type()->Equals(float64()));
+
+  auto rowid = std::dynamic_pointer_cast<Int64Array>(batches[0]->column(0));
+  EXPECT_EQ(rowid->Value(0), 1);
+  EXPECT_EQ(rowid->Value(1), 2);
+
+  auto srs_id = std::dynamic_pointer_cast<Int32Array>(batches[0]->column(1));
+  EXPECT_EQ(srs_id->Value(0), 4326);
+  EXPECT_TRUE(srs_id->IsNull(1));
+
+  auto xmax = std::dynamic_pointer_cast<DoubleArray>(batches[0]->column(4));
+  EXPECT_EQ(xmax->Value(0), 1);
+  EXPECT_TRUE(xmax->IsNull(1));
+
+  auto mmax = std::dynamic_pointer_cast<DoubleArray>(batches[1]->column(10));
+  EXPECT_EQ(mmax->Value(0), 6);
+  EXPECT_TRUE(batches[1]->column(7)->IsNull(0));
+
+  // Tables without a registered geometry column need an explicit column_name
+  con.exec("CREATE TABLE other (geom BLOB)");
+  EXPECT_EQ(ArrowGPKGEnvelopeStreamInit(&stream, con.ptr, "other", nullptr, 2, &error),
+            ENOENT);
+  EXPECT_STREQ(error.message, "Table 'other' has no registered geometry column");
+
+  con.exec("INSERT INTO other VALUES (X'00')");
+  ASSERT_EQ(ArrowGPKGEnvelopeStreamInit(&stream, con.ptr, "other", "geom", 2, &error),
+            0);
+  struct ArrowArray array;
+  EXPECT_EQ(stream.get_next(&stream, &array), EINVAL);
+  EXPECT_STREQ(stream.get_last_error(&stream),
+               "Expected geometry blob of at least 8 bytes but got 1");
+  stream.release(&stream);
+}
+
+TEST(GPKGTest, GPKGScanBBox) {
+  ConnectionHolder con;
+  con.open_memory();
+  con.add_gpkg_tables();
+  con.exec("CREATE TABLE features (fid INTEGER PRIMARY KEY, geom POINT)");
+  con.exec(
+      "INSERT INTO gpkg_geometry_columns VALUES ('features', 'geom', 'POINT', 0, 0, 0)");
+  for (int i = 0; i < 10; i++) {
+    con.insert_blob("INSERT INTO features (geom) VALUES (?)", gpkg_point(0, i, i));
+  }
+  con.exec("INSERT INTO features (geom) VALUES (NULL)");
+
+  // Read the fids of the rows of a bbox scan
+  auto scan = [&](double xmin, double ymin, double xmax, double ymax) {
+    struct ArrowArrayStream stream;
+    struct ArrowSQLite3Error error;
+    int code = ArrowGPKGScanBBox(&stream, con.ptr, "features", xmin, ymin, xmax, ymax,
+                                 ARROW_GPKG_PREDICATE_ENVELOPE, nullptr, 3, &error);
+    if (code != 0) {
+      throw std::runtime_error(error.message);
+    }
+
+    auto batches =
+        ImportRecordBatchReader(&stream).ValueOrDie()->ToRecordBatches().ValueOrDie();
+    std::vector<int64_t> fids;
+    for (const auto& batch : batches) {
+      auto fid = std::dynamic_pointer_cast<Int64Array>(batch->column(0));
+      for (int64_t i = 0; i < fid->length(); i++) {
+        fids.push_back(fid->Value(i));
+      }
+    }
+
+    std::sort(fids.begin(), fids.end());
+    return fids;
+  };
+
+  // Without an rtree every envelope is checked
+  EXPECT_EQ(scan(2.5, 1, 5, 4.5), std::vector<int64_t>({4, 5}));
+  EXPECT_EQ(scan(100, 100, 200, 200), std::vector<int64_t>());
+
+  // With an rtree, candidates are looked up in the index and their envelopes checked
+  con.exec(
+      "CREATE TABLE gpkg_extensions (table_name TEXT, column_name TEXT, extension_name "
+      "TEXT NOT NULL, definition TEXT NOT NULL, scope TEXT NOT NULL)");
+  con.exec(
+      "INSERT INTO gpkg_extensions VALUES ('features', 'geom', 'gpkg_rtree_index', "
+      "'http://www.geopackage.org/spec120/#extension_rtree', 'write-only')");
+  con.exec(
+      "CREATE VIRTUAL TABLE rtree_features_geom USING rtree(id, minx, maxx, miny, maxy)");
+  con.exec(
+      "INSERT INTO rtree_features_geom SELECT fid, fid - 1, fid - 1, fid - 1, fid - 1 "
+      "FROM features WHERE geom IS NOT NULL");
+  EXPECT_EQ(scan(2.5, 1, 5, 4.5), std::vector<int64_t>({4, 5}));
+  con.exec("UPDATE rtree_features_geom SET minx = 100, maxx = 100 WHERE id = 4");
+  EXPECT_EQ(scan(2.5, 1, 5, 4.5), std::vector<int64_t>({5}));
+
+  // Candidates whose geometry is outside the query (e.g., because the float bounds of
+  // the index were rounded outward) are dropped
+  con.insert_blob("INSERT INTO features (fid, geom) VALUES (20, ?)",
+                  gpkg_point(0, 0.1, 0.1));
+  con.exec("INSERT INTO rtree_features_geom VALUES (20, 0.1, 0.1, 0.1, 0.1)");
+  EXPECT_EQ(scan(-1, -1, 0.1, 0.1), std::vector<int64_t>({1, 20}));
+  EXPECT_EQ(scan(-1, -1, 0.0999999999, 0.0999999999), std::vector<int64_t>({1}));
+
+  struct ArrowArrayStream stream;
+  struct ArrowSQLite3Error error;
+  EXPECT_EQ(ArrowGPKGScanBBox(&stream, con.ptr, "gpkg_contents", 0, 0, 1, 1,
+                              ARROW_GPKG_PREDICATE_ENVELOPE, nullptr, 3, &error),
+            ENOENT);
+  EXPECT_STREQ(error.message, "Table 'gpkg_contents' has no registered geometry column");
+}
+
+std::string wkb_polygon(const std::vector<std::vector<double>>& rings) {
+  std::string out = wkb_header(3) + wkb_count(rings.size());
+  for (const auto& ring : rings) {
+    out += wkb_count(ring.size() / 2) + wkb_coords(ring);
+  }
+
+  return out;
+}
+
+TEST(GPKGTest, GPKGScanPredicate) {
+  ConnectionHolder con;
+  con.open_memory();
+  con.add_gpkg_tables();
+  con.exec("CREATE TABLE features (fid INTEGER PRIMARY KEY, geom GEOMETRY)");
+  con.exec(
+      "INSERT INTO gpkg_geometry_columns VALUES ('features', 'geom', 'GEOMETRY', 0, 0, "
+      "0)");
+
+  std::vector<std::string> geometries = {
+      // 1: A long diagonal line whose envelope covers the query
+      wkb_header(2) + wkb_count(2) + wkb_coords({0, 10, 10, 0}),
+      // 2: A polygon inside the query
+      wkb_polygon({{1, 1, 2, 1, 2, 2, 1, 2, 1, 1}}),
+      // 3: A polygon around the query
+      wkb_polygon({{-10, -10, 10, -10, 10, 10, -10, 10, -10, -10}}),
+      // 4: A polygon with a hole around the query
+      wkb_polygon({{-10, -10, 10, -10, 10, 10, -10, 10, -10, -10},
+                   {-5, -5, 5, -5, 5, 5, -5, 5, -5, -5}}),
+      // 5: A point inside the query
+      wkb_header(1) + wkb_coords({2.5, 2.5}),
+      // 6: A multipolygon with one part crossing the query boundary
+      wkb_header(6) + wkb_count(2) + wkb_polygon({{2, 2, 4, 2, 4, 4, 2, 4, 2, 2}}) +
+          wkb_polygon({{20, 20, 21, 20, 21, 21, 20, 20}}),
+      // 7: A line crossing the query
+      wkb_header(2) + wkb_count(2) + wkb_coords({-1, 1, 4, 1}),
+      // 8: A point on the boundary of the query
+      wkb_header(1) + wkb_coords({3, 0}),
+      // 9: A line along the top of the notched query (and across its notch)
+      wkb_header(2) + wkb_count(2) + wkb_coords({0, 10, 8, 10})};
+  for (const auto& wkb : geometries) {
+    con.insert_blob("INSERT INTO features (geom) VALUES (?)", gpkg_blob(wkb));
+  }
+
+  auto scan = [&](const std::vector<double>& xy, enum ArrowGPKGPredicate predicate) {
+    struct ArrowArrayStream stream;
+    struct ArrowSQLite3Error error;
+    int code = ArrowGPKGScanPolygon(&stream, con.ptr, "features", xy.data(),
+                                    xy.size() / 2, predicate, nullptr, 1024, &error);
+    if (code != 0) {
+      throw std::runtime_error(error.message);
+    }
+
+    std::vector<int64_t> fids;
+    auto reader = ImportRecordBatchReader(&stream).ValueOrDie();
+    for (const auto& batch : reader->ToRecordBatches().ValueOrDie()) {
+      auto fid = std::dynamic_pointer_cast<Int64Array>(batch->column(0));
+      for (int64_t i = 0; i < fid->length(); i++) {
+        fids.push_back(fid->Value(i));
+      }
+    }
+
+    return fids;
+  };
+
+  std::vector<double> rect = {0, 0, 3, 0, 3, 3, 0, 3};
+  EXPECT_EQ(scan(rect, ARROW_GPKG_PREDICATE_ENVELOPE),
+            std::vector<int64_t>({1, 2, 3, 4, 5, 6, 7, 8}));
+  EXPECT_EQ(scan(rect, ARROW_GPKG_PREDICATE_INTERSECTS),
+            std::vector<int64_t>({2, 3, 5, 6, 7, 8}));
+  EXPECT_EQ(scan(rect, ARROW_GPKG_PREDICATE_WITHIN), std::vector<int64_t>({2, 5, 8}));
+  EXPECT_EQ(scan(rect, ARROW_GPKG_PREDICATE_CONTAINS), std::vector<int64_t>({3}));
+
+  // A concave (L-shaped) query that only touches polygon 2
+  std::vector<double> ell = {0, 0, 4, 0, 4, 1, 1, 1, 1, 4, 0, 4, 0, 0};
+  EXPECT_EQ(scan(ell, ARROW_GPKG_PREDICATE_INTERSECTS),
+            std::vector<int64_t>({2, 3, 7, 8}));
+  EXPECT_EQ(scan(ell, ARROW_GPKG_PREDICATE_WITHIN), std::vector<int64_t>({8}));
+
+  // A query with a notch that line 9 only touches at its corners and line 1 crosses
+  std::vector<double> notched = {0, 0, 10, 0, 10, 10, 6, 10, 6, 5, 4, 5, 4, 10, 0, 10};
+  EXPECT_EQ(scan(notched, ARROW_GPKG_PREDICATE_WITHIN),
+            std::vector<int64_t>({2, 5, 8}));
+
+  // The hole of polygon 4 is on its boundary but not in it
+  std::vector<double> hole = {-5, -5, 5, -5, 5, 5, -5, 5};
+  EXPECT_EQ(scan(hole, ARROW_GPKG_PREDICATE_CONTAINS), std::vector<int64_t>({3}));
+
+  struct ArrowArrayStream stream;
+  struct ArrowSQLite3Error error;
+  EXPECT_EQ(ArrowGPKGScanPolygon(&stream, con.ptr, "features", rect.data(), 2,
+                                 ARROW_GPKG_PREDICATE_INTERSECTS, nullptr, 1024, &error),
+            EINVAL);
+  EXPECT_STREQ(error.message, "Expected a query polygon with at least 3 vertices");
+}
+
+TEST(GPKGTest, GPKGCatalog) {
+  ConnectionHolder con;
+  con.open_memory();
+
+  struct ArrowGPKGCatalog catalog;
+  struct ArrowSQLite3Error error;
+  ASSERT_EQ(ArrowGPKGCatalogInit(&catalog, con.ptr), 0);
+
+  // Not a GeoPackage
+  const struct ArrowGPKGLayerInfo* layers;
+  int64_t n_layers;
+  ASSERT_EQ(ArrowGPKGCatalogLayers(&catalog, &layers, &n_layers, &error), 0);
+  EXPECT_EQ(n_layers, 0);
+
+  con.add_gpkg_tables();
+  con.add_features_table();
+  con.exec(
+      "INSERT INTO gpkg_spatial_ref_sys VALUES ('WGS 84', 4326, 'EPSG', 4326, "
+      "'GEOGCS[\"WGS 84\"]', NULL)");
+  con.exec("UPDATE gpkg_geometry_columns SET srs_id = 4326");
+  ASSERT_EQ(ArrowGPKGCatalogLayers(&catalog, &layers, &n_layers, &error), 0)
+      << error.message;
+  ASSERT_EQ(n_layers, 1);
+  EXPECT_STREQ(layers[0].table_name, "features");
+  EXPECT_STREQ(layers[0].data_type, "features");
+  EXPECT_STREQ(layers[0].column_name, "geom");
+  EXPECT_STREQ(layers[0].geometry_type_name, "POINT");
+  EXPECT_EQ(layers[0].srs_id, 4326);
+  EXPECT_STREQ(layers[0].crs, "GEOGCS[\"WGS 84\"]");
+  EXPECT_EQ(layers[0].crs_type, nullptr);
+
+  // Annotate a stream of the layer read with the WKB handler
+  con.exec("UPDATE features SET geom = NULL");
+  sqlite3_stmt* stmt;
+  ASSERT_EQ(sqlite3_prepare_v2(con.ptr, "SELECT * FROM features", -1, &stmt, nullptr),
+            SQLITE_OK);
+  struct ArrowSQLite3Result result;
+  ASSERT_EQ(ArrowSQLite3ResultInit(&result), 0);
+  ASSERT_EQ(ArrowSQLite3ResultSetDeclaredTypes(&result, 1), 0);
+  struct ArrowSQLite3ColumnHandler handler;
+  ASSERT_EQ(ArrowGPKGWKBHandlerInit(&handler), 0);
+  ASSERT_EQ(ArrowSQLite3ResultSetColumnHandler(&result, "geom", &handler), 0);
+
+  struct ArrowArrayStream stream;
+  ASSERT_EQ(ArrowSQLite3StreamInitFromResult(&stream, &result, stmt, 1024), 0);
+  ArrowSQLite3ResultReset(&result);
+  ASSERT_EQ(ArrowGPKGCatalogAnnotateStream(&catalog, "features", &stream), 0);
+
+  auto reader = ImportRecordBatchReader(&stream).ValueOrDie();
+  auto geom_field = reader->schema()->GetFieldByName("geom");
+  ASSERT_NE(geom_field, nullptr);
+  auto metadata = geom_field->metadata();
+  ASSERT_NE(metadata, nullptr);
+  EXPECT_EQ(metadata->Get("ARROW:extension:name").ValueOrDie(), "geoarrow.wkb");
+  EXPECT_EQ(metadata->Get("ARROW:extension:metadata").ValueOrDie(),
+            "{\"crs\":\"GEOGCS[\\\"WGS 84\\\"]\"}");
+  EXPECT_EQ(metadata->Get("gpkg:geometry_type_name").ValueOrDie(), "POINT");
+  EXPECT_EQ(metadata->Get("gpkg:srs_id").ValueOrDie(), "4326");
+  auto name_metadata = reader->schema()->GetFieldByName("name")->metadata();
+  EXPECT_FALSE(name_metadata != nullptr && name_metadata->Contains("gpkg:srs_id"));
+  ASSERT_ARROW_OK(reader->ToRecordBatches().status());
+  reader.reset();
+  sqlite3_finalize(stmt);
+
+  // Changes are picked up (including the WKT2 definition and authority codes)
+  con.exec("ALTER TABLE gpkg_spatial_ref_sys ADD COLUMN definition_12_063 TEXT");
+  con.exec("UPDATE gpkg_spatial_ref_sys SET definition_12_063 = 'GEOGCRS[]'");
+  con.exec(
+      "INSERT INTO gpkg_spatial_ref_sys VALUES ('Web Mercator', 3857, 'EPSG', 3857, "
+      "'undefined', NULL, 'undefined')");
+  con.exec(
+      "INSERT INTO gpkg_contents (table_name, data_type, srs_id) VALUES ('other', "
+      "'attributes', 3857)");
+  ASSERT_EQ(ArrowGPKGCatalogLayers(&catalog, &layers, &n_layers, &error), 0);
+  ASSERT_EQ(n_layers, 2);
+  EXPECT_STREQ(layers[0].crs, "GEOGCRS[]");
+  EXPECT_STREQ(layers[0].crs_type, "wkt2:2019");
+  EXPECT_STREQ(layers[1].table_name, "other");
+  EXPECT_EQ(layers[1].column_name, nullptr);
+  EXPECT_STREQ(layers[1].crs, "EPSG:3857");
+  EXPECT_STREQ(layers[1].crs_type, "authority_code");
+
+  const struct ArrowGPKGLayerInfo* layer;
+  EXPECT_EQ(ArrowGPKGCatalogFindLayer(&catalog, "OTHER", &layer, &error), 0);
+  EXPECT_EQ(layer, layers + 1);
+  EXPECT_EQ(ArrowGPKGCatalogFindLayer(&catalog, "missing", &layer, &error), ENOENT);
+  EXPECT_STREQ(error.message, "Table 'missing' is not in gpkg_contents");
+
+  ArrowGPKGCatalogReset(&catalog);
+}
+
+TEST(GPKGTest, GPKGSummarizeLayer) {
+  ConnectionHolder con;
+  con.open_memory();
+  con.add_gpkg_tables();
+  con.add_features_table();
+
+  struct ArrowGPKGLayerSummary summary;
+  struct ArrowSQLite3Error error;
+
+  // Only max(rowid) is available
+  ASSERT_EQ(ArrowGPKGSummarizeLayer(con.ptr, "features", &summary, &error), 0)
+      << error.message;
+  EXPECT_EQ(summary.feature_count, 2);
+  EXPECT_EQ(summary.feature_count_source, ARROW_GPKG_SOURCE_MAX_ROWID);
+  EXPECT_FALSE(summary.feature_count_exact);
+  EXPECT_EQ(summary.extent_source, ARROW_GPKG_SOURCE_NONE);
+  EXPECT_TRUE(std::isnan(summary.extent[0]));
+
+  con.exec("ANALYZE");
+  con.exec("UPDATE gpkg_contents SET min_x = -1, min_y = -2, max_x = 3, max_y = 4");
+  ASSERT_EQ(ArrowGPKGSummarizeLayer(con.ptr, "features", &summary, &error), 0);
+  EXPECT_EQ(summary.feature_count_source, ARROW_GPKG_SOURCE_SQLITE_STAT1);
+  EXPECT_EQ(summary.feature_count, 2);
+  EXPECT_EQ(summary.extent_source, ARROW_GPKG_SOURCE_CONTENTS);
+  EXPECT_FALSE(summary.extent_exact);
+  EXPECT_FALSE(summary.extent_conservative);
+  EXPECT_EQ(summary.extent[1], -2);
+  EXPECT_EQ(summary.extent[2], 3);
+
+  con.exec("CREATE TABLE gpkg_ogr_contents (table_name TEXT, feature_count INTEGER)");
+  con.exec("INSERT INTO gpkg_ogr_contents VALUES ('features', 5)");
+  con.exec(
+      "CREATE TABLE gpkg_extensions (table_name TEXT, column_name TEXT, extension_name "
+      "TEXT NOT NULL, definition TEXT NOT NULL, scope TEXT NOT NULL)");
+  con.exec(
+      "INSERT INTO gpkg_extensions VALUES ('features', 'geom', 'gpkg_rtree_index', "
+      "'http://www.geopackage.org/spec120/#extension_rtree', 'write-only')");
+  con.exec(
+      "CREATE VIRTUAL TABLE rtree_features_geom USING rtree(id, minx, maxx, miny, maxy)");
+
+  // An empty rtree has an empty extent
+  ASSERT_EQ(ArrowGPKGSummarizeLayer(con.ptr, "features", &summary, &error), 0);
+  EXPECT_EQ(summary.feature_count, 5);
+  EXPECT_EQ(summary.feature_count_source, ARROW_GPKG_SOURCE_OGR_CONTENTS);
+  EXPECT_TRUE(summary.feature_count_exact);
+  EXPECT_EQ(summary.extent_source, ARROW_GPKG_SOURCE_RTREE);
+  EXPECT_TRUE(std::isnan(summary.extent[0]));
+
+  // Enough entries that the root node isn't a leaf
+  con.exec(
+      "WITH RECURSIVE i(x) AS (SELECT 1 UNION ALL SELECT x + 1 FROM i WHERE x < 1000) "
+      "INSERT INTO rtree_features_geom SELECT x, x, x + 0.5, -x, -x + 0.25 FROM i");
+  ASSERT_EQ(ArrowGPKGSummarizeLayer(con.ptr, "features", &summary, &error), 0);
+  EXPECT_EQ(summary.extent_source, ARROW_GPKG_SOURCE_RTREE);
+  EXPECT_FALSE(summary.extent_exact);
+  EXPECT_TRUE(summary.extent_conservative);
+  EXPECT_EQ(summary.extent[0], 1);
+  EXPECT_EQ(summary.extent[1], -1000);
+  EXPECT_EQ(summary.extent[2], 1000.5);
+  EXPECT_EQ(summary.extent[3], -0.75);
+}
+
+class GeoArrowTest {
+ public:
+  ConnectionHolder con;
+
+  GeoArrowTest() {
+    con.open_memory();
+    con.exec("CREATE TABLE features (geom GEOMETRY)");
+  }
+
+  void insert(const std::string& blob) {
+    con.insert_blob("INSERT INTO features VALUES (?)", blob);
+  }
+
+  void insert_null() { con.exec("INSERT INTO features VALUES (NULL)"); }
+
+  int read(enum ArrowGPKGGeometryType geometry_type, enum ArrowGPKGDimensions dimensions,
+           enum ArrowGPKGCoordType coord_type, std::shared_ptr<Field>* field_out,
+           std::shared_ptr<Array>* array_out) {
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(con.ptr, "SELECT geom FROM features", -1, &stmt, nullptr) !=
+        SQLITE_OK) {
+      throw std::runtime_error(sqlite3_errmsg(con.ptr));
+    }
+
+    struct ArrowSQLite3Result result;
+    ArrowSQLite3ResultInit(&result);
+
+    struct ArrowSQLite3ColumnHandler handler;
+    int code = ArrowGPKGGeoArrowHandlerInit(&handler, geometry_type, dimensions,
+                                            coord_type);
+    if (code == 0) {
+      code = ArrowSQLite3ResultSetColumnHandler(&result, "geom", &handler);
+    }
+
+    int64_t rows_appended;
+    if (code == 0) {
+      code = ArrowSQLite3ResultStepN(&result, stmt, 1024, &rows_appended);
+    }
+
+    sqlite3_finalize(stmt);
+
+    struct ArrowArray array;
+    struct ArrowSchema schema;
+    if (code == 0) {
+      code = ArrowSQLite3ResultFinishArray(&result, &array);
+    }
+
+    if (code == 0) {
+      code = ArrowSQLite3ResultFinishSchema(&result, &schema);
+    }
+
+    ArrowSQLite3ResultReset(&result);
+    if (code != 0) {
+      return code;
+    }
+
+    auto batch = ImportRecordBatch(&array, &schema).ValueOrDie();
+    ASSERT_ARROW_OK(batch->ValidateFull());
+    *field_out = batch->schema()->field(0);
+    *array_out = batch->column(0);
+    return 0;
+  }
+};
+
+TEST(GPKGTest, GPKGGeoArrowLinestring) {
+  GeoArrowTest test;
+  test.insert(gpkg_blob(wkb_header(2) + wkb_count(2) + wkb_coords({0, 1, 2, 3})));
+  test.insert_null();
+  test.insert(wkb_header(2, false) + wkb_count(1, false) + wkb_coords({4, 5}, false));
+
+  std::shared_ptr<Field> geom_field;
+  std::shared_ptr<Array> array;
+  ASSERT_EQ(test.read(ARROW_GPKG_GEOMETRY_TYPE_LINESTRING, ARROW_GPKG_DIMENSIONS_XY,
+                      ARROW_GPKG_COORD_TYPE_INTERLEAVED, &geom_field, &array),
+            0);
+
+  EXPECT_TRUE(geom_field->type()->Equals(
+      list(field("vertices", fixed_size_list(field("xy", float64()), 2)))));
+  EXPECT_EQ(geom_field->metadata()->Get("ARROW:extension:name").ValueOr(""),
+            "geoarrow.linestring");
+  EXPECT_EQ(geom_field->metadata()->Get("ARROW:extension:metadata").ValueOr(""), "{}");
+
+  auto linestrings = std::dynamic_pointer_cast<ListArray>(array);
+  EXPECT_EQ(linestrings->value_offset(1), 2);
+  EXPECT_TRUE(linestrings->IsNull(1));
+  EXPECT_EQ(linestrings->value_offset(3), 3);
+
+  auto vertices = std::dynamic_pointer_cast<FixedSizeListArray>(linestrings->values());
+  auto xy = std::dynamic_pointer_cast<DoubleArray>(vertices->values());
+  ASSERT_EQ(xy->length(), 6);
+  for (int64_t i = 0; i < 6; i++) {
+    EXPECT_EQ(xy->Value(i), i);
+  }
+}
+
+TEST(GPKGTest, GPKGGeoArrowMultipolygon) {
+  GeoArrowTest test;
+  std::string ring = wkb_count(4) + wkb_coords({0, 0, 1, 1, 0, 2, 0, 1, 3, 0, 0, 4});
+  test.insert(gpkg_blob(wkb_header(1006) + wkb_count(1) + wkb_header(1003) +
+                        wkb_count(1) + ring));
+  test.insert(gpkg_blob(wkb_header(1003) + wkb_count(1) + ring));
+
+  std::shared_ptr<Field> geom_field;
+  std::shared_ptr<Array> array;
+  ASSERT_EQ(test.read(ARROW_GPKG_GEOMETRY_TYPE_MULTIPOLYGON, ARROW_GPKG_DIMENSIONS_XYZ,
+                      ARROW_GPKG_COORD_TYPE_SEPARATE, &geom_field, &array),
+            0);
+
+  auto coords_type =
+      struct_({field("x", float64()), field("y", float64()), field("z", float64())});
+  EXPECT_TRUE(geom_field->type()->Equals(list(field(
+      "polygons", list(field("rings", list(field("vertices", coords_type))))))));
+  EXPECT_EQ(geom_field->metadata()->Get("ARROW:extension:name").ValueOr(""),
+            "geoarrow.multipolygon");
+
+  auto polygons = std::dynamic_pointer_cast<ListArray>(array);
+  EXPECT_EQ(polygons->length(), 2);
+  EXPECT_EQ(polygons->value_length(1), 1);
+  auto rings = std::dynamic_pointer_cast<ListArray>(polygons->values());
+  EXPECT_EQ(rings->length(), 2);
+  auto vertices = std::dynamic_pointer_cast<ListArray>(rings->values());
+  EXPECT_EQ(vertices->length(), 2);
+  auto coords = std::dynamic_pointer_cast<StructArray>(vertices->values());
+  EXPECT_EQ(coords->length(), 8);
+  auto z = std::dynamic_pointer_cast<DoubleArray>(coords->field(2));
+  EXPECT_EQ(z->Value(3), 4);
+  EXPECT_EQ(z->Value(7), 4);
+}
+
+TEST(GPKGTest, GPKGGeoArrowPoint) {
+  GeoArrowTest test;
+  test.insert(gpkg_blob(wkb_header(1) + wkb_coords({1, 2})));
+  test.insert_null();
+  test.insert(gpkg_blob(wkb_header(1, false) + wkb_coords({3, 4}, false)));
+
+  std::shared_ptr<Field> geom_field;
+  std::shared_ptr<Array> array;
+  ASSERT_EQ(test.read(ARROW_GPKG_GEOMETRY_TYPE_POINT, ARROW_GPKG_DIMENSIONS_XY,
+                      ARROW_GPKG_COORD_TYPE_SEPARATE, &geom_field, &array),
+            0);
+
+  auto points = std::dynamic_pointer_cast<StructArray>(array);
+  EXPECT_TRUE(points->IsNull(1));
+  auto y = std::dynamic_pointer_cast<DoubleArray>(points->field(1));
+  EXPECT_EQ(y->Value(0), 2);
+  EXPECT_EQ(y->Value(2), 4);
+
+  // Wrong geometry type or dimensions
+  EXPECT_EQ(test.read(ARROW_GPKG_GEOMETRY_TYPE_LINESTRING, ARROW_GPKG_DIMENSIONS_XY,
+                      ARROW_GPKG_COORD_TYPE_SEPARATE, &geom_field, &array),
+            EINVAL);
+  EXPECT_EQ(test.read(ARROW_GPKG_GEOMETRY_TYPE_POINT, ARROW_GPKG_DIMENSIONS_XYZ,
+                      ARROW_GPKG_COORD_TYPE_SEPARATE, &geom_field, &array),
+            EINVAL);
+
+  // Truncated coordinates
+  test.insert(gpkg_blob(wkb_header(1) + wkb_coords({1})));
+  EXPECT_EQ(test.read(ARROW_GPKG_GEOMETRY_TYPE_POINT, ARROW_GPKG_DIMENSIONS_XY,
+                      ARROW_GPKG_COORD_TYPE_SEPARATE, &geom_field, &array),
+            EINVAL);
+}
+
+TEST(GPKGTest, GPKGDetectGeometryTypes) {
+  GeoArrowTest test;
+  test.insert(gpkg_blob(wkb_header(2) + wkb_count(2) + wkb_coords({0, 1, 2, 3})));
+  test.insert_null();
+  test.insert(wkb_header(2, false) + wkb_count(1, false) + wkb_coords({4, 5}, false));
+
+  struct ArrowGPKGGeometryTypes types;
+  struct ArrowSQLite3Error error;
+  ASSERT_EQ(ArrowGPKGDetectGeometryTypes(test.con.ptr, "features", "geom", 0, &types,
+                                         &error),
+            0)
+      << error.message;
+  EXPECT_EQ(types.geometry_types, 1u << 2);
+  EXPECT_EQ(types.dimensions, 1u << ARROW_GPKG_DIMENSIONS_XY);
+  EXPECT_EQ(types.n_rows, 3);
+  EXPECT_EQ(types.n_null, 1);
+  EXPECT_TRUE(types.complete);
+
+  enum ArrowGPKGGeometryType geometry_type;
+  enum ArrowGPKGDimensions dimensions;
+  ASSERT_EQ(ArrowGPKGChooseGeoArrowLayout(&types, &geometry_type, &dimensions), 0);
+  EXPECT_EQ(geometry_type, ARROW_GPKG_GEOMETRY_TYPE_LINESTRING);
+  EXPECT_EQ(dimensions, ARROW_GPKG_DIMENSIONS_XY);
+
+  // Mixed single and multi geometries are promoted to the multi geometry type
+  test.insert(gpkg_blob(wkb_header(5) + wkb_count(1) + wkb_header(2) + wkb_count(1) +
+                        wkb_coords({6, 7})));
+  ASSERT_EQ(ArrowGPKGDetectGeometryTypes(test.con.ptr, "features", "geom", 3, &types,
+                                         &error),
+            0);
+  EXPECT_EQ(types.n_rows, 3);
+  EXPECT_FALSE(types.complete);
+
+  ASSERT_EQ(ArrowGPKGDetectGeometryTypes(test.con.ptr, "features", "geom", 4, &types,
+                                         &error),
+            0);
+  EXPECT_TRUE(types.complete);
+  ASSERT_EQ(ArrowGPKGChooseGeoArrowLayout(&types, &geometry_type, &dimensions), 0);
+  EXPECT_EQ(geometry_type, ARROW_GPKG_GEOMETRY_TYPE_MULTILINESTRING);
+
+  std::shared_ptr<Field> geom_field;
+  std::shared_ptr<Array> array;
+  ASSERT_EQ(test.read(geometry_type, dimensions, ARROW_GPKG_COORD_TYPE_INTERLEAVED,
+                      &geom_field, &array),
+            0);
+  EXPECT_EQ(array->length(), 4);
+
+  struct ArrowSQLite3ColumnHandler handler;
+  struct ArrowSchema schema;
+  ASSERT_EQ(ArrowGPKGDetectedHandlerInit(&handler, &types,
+                                         ARROW_GPKG_COORD_TYPE_INTERLEAVED),
+            0);
+  ASSERT_EQ(handler.init_schema(&handler, "geom", &schema), 0);
+  handler.release(&handler);
+  auto field = ImportField(&schema).ValueOrDie();
+  EXPECT_EQ(field->metadata()->Get("ARROW:extension:name").ValueOr(""),
+            "geoarrow.multilinestring");
+
+  // Mixed dimensions (or geometry collections) fall back to WKB
+  test.insert(gpkg_blob(wkb_header(1001) + wkb_coords({0, 1, 2})));
+  ASSERT_EQ(ArrowGPKGDetectGeometryTypes(test.con.ptr, "features", "geom", 0, &types,
+                                         &error),
+            0);
+  EXPECT_EQ(types.geometry_types, (1u << 1) | (1u << 2) | (1u << 5));
+  EXPECT_EQ(types.dimensions,
+            (1u << ARROW_GPKG_DIMENSIONS_XY) | (1u << ARROW_GPKG_DIMENSIONS_XYZ));
+  EXPECT_EQ(ArrowGPKGChooseGeoArrowLayout(&types, &geometry_type, &dimensions), ENOTSUP);
+
+  ASSERT_EQ(ArrowGPKGDetectedHandlerInit(&handler, &types,
+                                         ARROW_GPKG_COORD_TYPE_INTERLEAVED),
+            0);
+  ASSERT_EQ(handler.init_schema(&handler, "geom", &schema), 0);
+  handler.release(&handler);
+  field = ImportField(&schema).ValueOrDie();
+  EXPECT_EQ(field->metadata()->Get("ARROW:extension:name").ValueOr(""), "geoarrow.wkb");
+
+  test.con.exec("INSERT INTO features VALUES (X'00')");
+  EXPECT_EQ(ArrowGPKGDetectGeometryTypes(test.con.ptr, "features", "geom", 0, &types,
+                                         &error),
+            EINVAL);
+  EXPECT_STREQ(error.message, "Invalid WKB geometry at byte 1");
+}
+
+TEST(GPKGTest, GPKGTileStream) {
+  ConnectionHolder con;
+  con.open_memory();
+  con.add_gpkg_tables();
+  con.exec(
+      "CREATE TABLE gpkg_tile_matrix_set (table_name TEXT NOT NULL PRIMARY KEY, srs_id "
+      "INTEGER NOT NULL, min_x DOUBLE NOT NULL, min_y DOUBLE NOT NULL, max_x DOUBLE NOT "
+      "NULL, max_y DOUBLE NOT NULL)");
+  con.exec(
+      "CREATE TABLE gpkg_tile_matrix (table_name TEXT NOT NULL, zoom_level INTEGER NOT "
+      "NULL, matrix_width INTEGER NOT NULL, matrix_height INTEGER NOT NULL, tile_width "
+      "INTEGER NOT NULL, tile_height INTEGER NOT NULL, pixel_x_size DOUBLE NOT NULL, "
+      "pixel_y_size DOUBLE NOT NULL, CONSTRAINT pk_ttm PRIMARY KEY (table_name, "
+      "zoom_level))");
+  con.exec(
+      "CREATE TABLE tiles (id INTEGER PRIMARY KEY AUTOINCREMENT, zoom_level INTEGER NOT "
+      "NULL, tile_column INTEGER NOT NULL, tile_row INTEGER NOT NULL, tile_data BLOB NOT "
+      "NULL, UNIQUE (zoom_level, tile_column, tile_row))");
+  con.exec("INSERT INTO gpkg_tile_matrix_set VALUES ('tiles', 0, 0, 0, 4, 4)");
+  con.exec(
+      "INSERT INTO gpkg_tile_matrix VALUES ('tiles', 0, 1, 1, 256, 256, 1, 1), "
+      "('tiles', 1, 2, 2, 256, 256, 0.5, 0.5)");
+
+  // Insert tiles out of column/row order so that the order of the output (rowid)
+  // differs from the order of the index
+  con.exec("INSERT INTO tiles (zoom_level, tile_column, tile_row, tile_data) VALUES "
+           "(0, 0, 0, X'00'), (1, 1, 1, X'1111'), (1, 0, 1, X'1001'), "
+           "(1, 1, 0, X'0110'), (1, 0, 0, X'0000')");
+
+  struct ArrowArrayStream stream;
+  struct ArrowSQLite3Error error;
+  ASSERT_EQ(ArrowGPKGTileStreamInit(&stream, con.ptr, "tiles", 1, 0, 0, 100, 100, 3,
+                                    &error),
+            0)
+      << error.message;
+
+  auto maybe_reader = ImportRecordBatchReader(&stream);
+  ASSERT_ARROW_OK(maybe_reader.status());
+  auto maybe_batches = maybe_reader.ValueUnsafe()->ToRecordBatches();
+  ASSERT_ARROW_OK(maybe_batches.status());
+  auto batches = maybe_batches.ValueUnsafe();
+  ASSERT_EQ(batches.size(), 2);
+  EXPECT_EQ(batches[0]->num_rows(), 3);
+  EXPECT_EQ(batches[1]->num_rows(), 1);
+
+  auto schema = batches[0]->schema();
+  ASSERT_EQ(schema->num_fields(), 4);
+  EXPECT_EQ(schema->field(1)->name(), "tile_column");
+  EXPECT_TRUE(schema->field(3)->type()->Equals(binary()));
+
+  auto zoom_level = std::dynamic_pointer_cast<Int64Array>(batches[0]->column(0));
+  auto tile_column = std::dynamic_pointer_cast<Int64Array>(batches[0]->column(1));
+  auto tile_row = std::dynamic_pointer_cast<Int64Array>(batches[0]->column(2));
+  auto tile_data = std::dynamic_pointer_cast<BinaryArray>(batches[0]->column(3));
+  EXPECT_EQ(zoom_level->Value(0), 1);
+  EXPECT_EQ(tile_column->Value(0), 1);
+  EXPECT_EQ(tile_row->Value(0), 1);
+  EXPECT_EQ(tile_data->GetString(0), std::string("\x11\x11", 2));
+  EXPECT_EQ(tile_column->Value(1), 0);
+  EXPECT_EQ(tile_row->Value(1), 1);
+  EXPECT_EQ(tile_data->GetString(2), std::string("\x01\x10", 2));
+
+  // A window of one column
+  ASSERT_EQ(ArrowGPKGTileStreamInit(&stream, con.ptr, "tiles", 1, 0, -5, 0, 5, 100,
+                                    &error),
+            0);
+  maybe_reader = ImportRecordBatchReader(&stream);
+  ASSERT_ARROW_OK(maybe_reader.status());
+  batches = maybe_reader.ValueUnsafe()->ToRecordBatches().ValueOrDie();
+  ASSERT_EQ(batches.size(), 1);
+  EXPECT_EQ(batches[0]->num_rows(), 2);
+
+  // Windows outside of the matrix have no tiles
+  for (auto window : std::vector<std::vector<int64_t>>{{5, 0, 10, 1}, {-3, -3, -1, -1},
+                                                       {0, 2, 1, 10}}) {
+    ASSERT_EQ(ArrowGPKGTileStreamInit(&stream, con.ptr, "tiles", 1, window[0],
+                                      window[1], window[2], window[3], 100, &error),
+              0);
+    maybe_reader = ImportRecordBatchReader(&stream);
+    ASSERT_ARROW_OK(maybe_reader.status());
+    batches = maybe_reader.ValueUnsafe()->ToRecordBatches().ValueOrDie();
+    int64_t n_rows = 0;
+    for (const auto& batch : batches) {
+      n_rows += batch->num_rows();
+    }
+    EXPECT_EQ(n_rows, 0);
+  }
+
+  EXPECT_EQ(ArrowGPKGTileStreamInit(&stream, con.ptr, "tiles", 2, 0, 0, 1, 1, 100,
+                                    &error),
+            ENOENT);
+  EXPECT_STREQ(error.message, "Table 'tiles' has no tile matrix at zoom level 2");
+
+  EXPECT_EQ(ArrowGPKGTileStreamInit(&stream, con.ptr, "features", 0, 0, 0, 1, 1, 100,
+                                    &error),
+            ENOENT);
+  EXPECT_STREQ(error.message, "Table 'features' is not in gpkg_tile_matrix_set");
+}
+
+std::string query_text(sqlite3* con, const std::string& sql) {
+  sqlite3_stmt* stmt;
+  if (sqlite3_prepare_v2(con, sql.c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
+    throw std::runtime_error(sqlite3_errmsg(con));
+  }
+
+  std::string out;
+  while (sqlite3_step(stmt) == SQLITE_ROW) {
+    for (int i = 0; i < sqlite3_column_count(stmt); i++) {
+      const unsigned char* value = sqlite3_column_text(stmt, i);
+      out += i > 0 ? "|" : (out.empty() ? "" : "\n");
+      out += value == nullptr ? "NULL" : reinterpret_cast<const char*>(value);
+    }
+  }
+
+  sqlite3_finalize(stmt);
+  return out;
+}
+
+TEST(GPKGTest, GPKGCreateTable) {
+  ConnectionHolder con;
+  con.open_memory();
+
+  auto wkb_metadata = key_value_metadata(
+      {"ARROW:extension:name", "ARROW:extension:metadata"},
+      {"geoarrow.wkb", R"({"crs":"EPSG:32631","crs_type":"authority_code"})"});
+  auto schema = arrow::schema(
+      {field("name", utf8(), false), field("small", int16()), field("flag", boolean()),
+       field("ratio", float32()), field("count", uint32()),
+       field("day", utf8(), true, key_value_metadata({"nanoarrow_sqlite3.decltype"},
+                                                      {"DATE"})),
+       field("geom", binary(), true, wkb_metadata)});
+
+  // Authority codes must be registered with their definition before
+  struct ArrowSchema c_schema;
+  struct ArrowSQLite3Error error;
+  ASSERT_ARROW_OK(ExportSchema(*schema, &c_schema));
+  ASSERT_EQ(ArrowGPKGCreateTable(con.ptr, "features", &c_schema, &error), ENOTSUP);
+  EXPECT_STREQ(error.message,
+               "crs 'EPSG:32631' is not in gpkg_spatial_ref_sys (its WKT definition must "
+               "be registered first)");
+  EXPECT_EQ(query_text(con.ptr, "SELECT count(*) FROM sqlite_master"), "0");
+
+  con.add_gpkg_tables();
+  con.exec(
+      "INSERT INTO gpkg_spatial_ref_sys VALUES ('WGS 84 / UTM zone 31N', 32631, 'EPSG', "
+      "32631, 'PROJCS[\"WGS 84 / UTM zone 31N\"]', NULL)");
+  ASSERT_EQ(ArrowGPKGCreateTable(con.ptr, "features", &c_schema, &error), 0)
+      << error.message;
+  c_schema.release(&c_schema);
+
+  EXPECT_EQ(query_text(con.ptr, "PRAGMA application_id"), "1196444487");
+  EXPECT_EQ(query_text(con.ptr, "SELECT sql FROM sqlite_master WHERE name = 'features'"),
+            "CREATE TABLE \"features\" (fid INTEGER PRIMARY KEY AUTOINCREMENT NOT NULL, "
+            "\"name\" TEXT NOT NULL, \"small\" SMALLINT, \"flag\" BOOLEAN, \"ratio\" "
+            "FLOAT, \"count\" INTEGER, \"day\" DATE, \"geom\" GEOMETRY)");
+  EXPECT_EQ(query_text(con.ptr,
+                       "SELECT data_type, identifier, srs_id FROM gpkg_contents"),
+            "features|features|32631");
+  EXPECT_EQ(query_text(con.ptr, "SELECT * FROM gpkg_geometry_columns"),
+            "features|geom|GEOMETRY|32631|2|2");
+  EXPECT_EQ(query_text(con.ptr,
+                       "SELECT srs_name, organization, organization_coordsys_id FROM "
+                       "gpkg_spatial_ref_sys WHERE srs_id = 32631"),
+            "WGS 84 / UTM zone 31N|EPSG|32631");
+
+  // Declared types read back as the narrow types
+  con.exec("INSERT INTO features (name, small, flag, ratio) VALUES ('one', 1, 1, 0.5)");
+  sqlite3_stmt* stmt;
+  ASSERT_EQ(sqlite3_prepare_v2(con.ptr, "SELECT small, flag, ratio FROM features", -1,
+                               &stmt, nullptr),
+            SQLITE_OK);
+  struct ArrowSQLite3Result result;
+  ArrowSQLite3ResultInit(&result);
+  ASSERT_EQ(ArrowSQLite3ResultSetDeclaredTypes(&result, 1), 0);
+  ASSERT_EQ(ArrowSQLite3ResultStep(&result, stmt), 0);
+  sqlite3_finalize(stmt);
+  ASSERT_EQ(ArrowSQLite3ResultFinishSchema(&result, &c_schema), 0);
+  ArrowSQLite3ResultReset(&result);
+  auto read_schema = ImportSchema(&c_schema).ValueOrDie();
+  EXPECT_TRUE(read_schema->field(0)->type()->Equals(int16()));
+  EXPECT_TRUE(read_schema->field(1)->type()->Equals(boolean()));
+  EXPECT_TRUE(read_schema->field(2)->type()->Equals(float32()));
+
+  // Native GeoArrow types register their geometry type and dimensions, an existing
+  // fid column is used as the primary key, and WKT crs values are matched by
+  // definition or added
+  auto point_metadata = key_value_metadata(
+      {"ARROW:extension:name", "ARROW:extension:metadata"},
+      {"geoarrow.point", R"({"crs":"PROJCRS[\"My \\\"CRS\\\"\"]"})"});
+  schema = arrow::schema(
+      {field("fid", int64()),
+       field("geom", fixed_size_list(field("xyz", float64()), 3), true,
+             point_metadata)});
+  ASSERT_ARROW_OK(ExportSchema(*schema, &c_schema));
+  ASSERT_EQ(ArrowGPKGCreateTable(con.ptr, "points", &c_schema, &error), 0)
+      << error.message;
+  ASSERT_EQ(ArrowGPKGCreateTable(con.ptr, "points2", &c_schema, &error), 0)
+      << error.message;
+  c_schema.release(&c_schema);
+
+  EXPECT_EQ(query_text(con.ptr, "SELECT sql FROM sqlite_master WHERE name = 'points'"),
+            "CREATE TABLE \"points\" (\"fid\" INTEGER PRIMARY KEY AUTOINCREMENT NOT "
+            "NULL, \"geom\" POINT)");
+  EXPECT_EQ(query_text(con.ptr,
+                       "SELECT * FROM gpkg_geometry_columns WHERE table_name LIKE "
+                       "'points%'"),
+            "points|geom|POINT|100000|1|0\npoints2|geom|POINT|100000|1|0");
+  EXPECT_EQ(query_text(con.ptr,
+                       "SELECT definition FROM gpkg_spatial_ref_sys WHERE srs_id = "
+                       "100000"),
+            R"(PROJCRS["My \"CRS\""])");
+
+  // PROJJSON crs values are found by their id (the top-level one) and can't be added
+  // without one, as definitions must be WKT
+  auto projjson_metadata = key_value_metadata(
+      {"ARROW:extension:name", "ARROW:extension:metadata"},
+      {"geoarrow.wkb",
+       R"({"crs": {"type": "ProjectedCRS", "name": "WGS 84 / UTM zone 31N", )"
+       R"("base_crs": {"name": "WGS 84", "id": {"authority": "EPSG", "code": 4326}}, )"
+       R"("id": {"authority": "EPSG", "code": 32631}}, "crs_type": "projjson"})"});
+  schema = arrow::schema({field("geom", binary(), true, projjson_metadata)});
+  ASSERT_ARROW_OK(ExportSchema(*schema, &c_schema));
+  ASSERT_EQ(ArrowGPKGCreateTable(con.ptr, "projjson", &c_schema, &error), 0)
+      << error.message;
+  c_schema.release(&c_schema);
+
+  projjson_metadata = key_value_metadata(
+      {"ARROW:extension:name", "ARROW:extension:metadata"},
+      {"geoarrow.wkb", R"({"crs":{"type":"EngineeringCRS","name":"Local"}})"});
+  schema = arrow::schema({field("geom", binary(), true, projjson_metadata)});
+  ASSERT_ARROW_OK(ExportSchema(*schema, &c_schema));
+  EXPECT_EQ(ArrowGPKGCreateTable(con.ptr, "projjson_custom", &c_schema, &error),
+            ENOTSUP);
+  EXPECT_STREQ(error.message, "PROJJSON crs of column 'geom' has no id");
+  c_schema.release(&c_schema);
+
+  auto proj_metadata =
+      key_value_metadata({"ARROW:extension:name", "ARROW:extension:metadata"},
+                         {"geoarrow.wkb", R"({"crs":"+proj=longlat"})"});
+  schema = arrow::schema({field("geom", binary(), true, proj_metadata)});
+  ASSERT_ARROW_OK(ExportSchema(*schema, &c_schema));
+  EXPECT_EQ(ArrowGPKGCreateTable(con.ptr, "proj", &c_schema, &error), ENOTSUP);
+  EXPECT_STREQ(error.message,
+               "crs '+proj=longlat' is neither an authority code nor a WKT definition");
+  c_schema.release(&c_schema);
+
+  EXPECT_EQ(query_text(con.ptr,
+                       "SELECT table_name, srs_id FROM gpkg_geometry_columns WHERE "
+                       "table_name LIKE 'proj%' ORDER BY table_name"),
+            "projjson|32631");
+  EXPECT_EQ(query_text(con.ptr,
+                       "SELECT count(*) FROM gpkg_spatial_ref_sys WHERE definition NOT "
+                       "LIKE '%[%' AND srs_id > 0"),
+            "0");
+
+  // Tables without a geometry column are attribute tables
+  schema = arrow::schema({field("value", float64())});
+  ASSERT_ARROW_OK(ExportSchema(*schema, &c_schema));
+  ASSERT_EQ(ArrowGPKGCreateTable(con.ptr, "attributes", &c_schema, &error), 0);
+  c_schema.release(&c_schema);
+  EXPECT_EQ(query_text(con.ptr,
+                       "SELECT data_type, srs_id FROM gpkg_contents WHERE table_name = "
+                       "'attributes'"),
+            "attributes|NULL");
+
+  // Errors leave nothing behind
+  schema = arrow::schema({field("value", float64()), field("nested", list(int32()))});
+  ASSERT_ARROW_OK(ExportSchema(*schema, &c_schema));
+  EXPECT_EQ(ArrowGPKGCreateTable(con.ptr, "nested", &c_schema, &error), ENOTSUP);
+  c_schema.release(&c_schema);
+  EXPECT_STREQ(error.message, "Can't create column 'nested' with format '+l'");
+  EXPECT_EQ(query_text(con.ptr, "SELECT count(*) FROM sqlite_master WHERE name = "
+                                "'nested'"),
+            "0");
+  EXPECT_TRUE(sqlite3_get_autocommit(con.ptr));
+
+  // Existing tables can't be created again
+  schema = arrow::schema({field("value", float64())});
+  ASSERT_ARROW_OK(ExportSchema(*schema, &c_schema));
+  EXPECT_EQ(ArrowGPKGCreateTable(con.ptr, "attributes", &c_schema, &error), EIO);
+  c_schema.release(&c_schema);
+  EXPECT_EQ(query_text(con.ptr, "SELECT count(*) FROM gpkg_contents"), "5");
+}
+
+// Encode a GeoArrow array as geometry blobs and insert them into test
+void encode_into(const std::shared_ptr<Field>& field, const std::shared_ptr<Array>& array,
+                 GeoArrowTest* test, std::shared_ptr<BinaryArray>* blobs_out = nullptr) {
+  struct ArrowSchema schema;
+  struct ArrowArray c_array;
+  struct ArrowSQLite3Error error;
+  ASSERT_ARROW_OK(ExportField(*field, &schema));
+  ASSERT_ARROW_OK(ExportArray(*array, &c_array));
+
+  struct ArrowGPKGEncoder encoder;
+  struct ArrowArray encoded;
+  int result = ArrowGPKGEncoderInit(&encoder, &schema, 4326, &error);
+  schema.release(&schema);
+  if (result != 0) {
+    c_array.release(&c_array);
+    throw std::runtime_error(error.message);
+  }
+
+  result = ArrowGPKGEncoderEncode(&encoder, &c_array, &encoded, &error);
+  ArrowGPKGEncoderReset(&encoder);
+  c_array.release(&c_array);
+  if (result != 0) {
+    throw std::runtime_error(error.message);
+  }
+
+  auto blobs = std::dynamic_pointer_cast<BinaryArray>(
+      ImportArray(&encoded, binary()).ValueOrDie());
+  ASSERT_ARROW_OK(blobs->ValidateFull());
+  for (int64_t i = 0; i < blobs->length(); i++) {
+    if (blobs->IsNull(i)) {
+      test->insert_null();
+    } else {
+      test->insert(blobs->GetString(i));
+    }
+  }
+
+  if (blobs_out != nullptr) {
+    *blobs_out = blobs;
+  }
+}
+
+TEST(GPKGTest, GPKGEncoder) {
+  // Read GeoArrow arrays, encode them, and read the encoded blobs again
+  GeoArrowTest test;
+  std::string ring = wkb_count(4) + wkb_coords({0, 0, 1, 1, 0, 2, 0, 1, 3, 0, 0, 4});
+  test.insert(gpkg_blob(wkb_header(1006) + wkb_count(2) + wkb_header(1003) +
+                        wkb_count(1) + ring + wkb_header(1003) + wkb_count(2) + ring +
+                        ring));
+  test.insert_null();
+  test.insert(gpkg_blob(wkb_header(1006) + wkb_count(0)));
+  test.insert(gpkg_blob(wkb_header(1003) + wkb_count(1) + ring));
+
+  for (auto coord_type :
+       {ARROW_GPKG_COORD_TYPE_SEPARATE, ARROW_GPKG_COORD_TYPE_INTERLEAVED}) {
+    std::shared_ptr<Field> field;
+    std::shared_ptr<Array> array;
+    ASSERT_EQ(test.read(ARROW_GPKG_GEOMETRY_TYPE_MULTIPOLYGON, ARROW_GPKG_DIMENSIONS_XYZ,
+                        coord_type, &field, &array),
+              0);
+
+    GeoArrowTest encoded_test;
+    std::shared_ptr<BinaryArray> blobs;
+    encode_into(field, array->Slice(1), &encoded_test, &blobs);
+    std::shared_ptr<Field> encoded_field;
+    std::shared_ptr<Array> encoded_array;
+    ASSERT_EQ(encoded_test.read(ARROW_GPKG_GEOMETRY_TYPE_MULTIPOLYGON,
+                                ARROW_GPKG_DIMENSIONS_XYZ, coord_type, &encoded_field,
+                                &encoded_array),
+              0);
+    EXPECT_TRUE(encoded_array->Equals(array->Slice(1)));
+
+    // The empty multipolygon has no envelope and the polygon has an xy envelope
+    struct ArrowGPKGHeader header;
+    struct ArrowSQLite3Error error;
+    std::string blob = blobs->GetString(1);
+    ASSERT_EQ(ArrowGPKGParseHeader(reinterpret_cast<const uint8_t*>(blob.data()),
+                                   blob.size(), &header, &error),
+              0);
+    EXPECT_TRUE(header.empty);
+    EXPECT_EQ(header.envelope_type, 0);
+    EXPECT_EQ(header.srs_id, 4326);
+
+    blob = blobs->GetString(2);
+    ASSERT_EQ(ArrowGPKGParseHeader(reinterpret_cast<const uint8_t*>(blob.data()),
+                                   blob.size(), &header, &error),
+              0);
+    EXPECT_FALSE(header.empty);
+    EXPECT_EQ(header.envelope_type, 1);
+    EXPECT_EQ(header.envelope[0], 0);
+    EXPECT_EQ(header.envelope[1], 1);
+    EXPECT_EQ(header.envelope[2], 0);
+    EXPECT_EQ(header.envelope[3], 1);
+  }
+
+  // Each geometry type
+  std::vector<std::pair<enum ArrowGPKGGeometryType, std::string>> geometries = {
+      {ARROW_GPKG_GEOMETRY_TYPE_POINT, wkb_header(1) + wkb_coords({1, 2})},
+      {ARROW_GPKG_GEOMETRY_TYPE_LINESTRING,
+       wkb_header(2) + wkb_count(2) + wkb_coords({1, 2, 3, 4})},
+      {ARROW_GPKG_GEOMETRY_TYPE_POLYGON,
+       wkb_header(3) + wkb_count(1) + wkb_count(3) + wkb_coords({0, 0, 1, 0, 0, 0})},
+      {ARROW_GPKG_GEOMETRY_TYPE_MULTIPOINT,
+       wkb_header(4) + wkb_count(2) + wkb_header(1) + wkb_coords({1, 2}) +
+           wkb_header(1) + wkb_coords({3, 4})},
+      {ARROW_GPKG_GEOMETRY_TYPE_MULTILINESTRING,
+       wkb_header(5) + wkb_count(1) + wkb_header(2) + wkb_count(2) +
+           wkb_coords({1, 2, 3, 4})}};
+  for (const auto& geometry : geometries) {
+    GeoArrowTest single_test;
+    single_test.insert(gpkg_blob(geometry.second));
+    std::shared_ptr<Field> field;
+    std::shared_ptr<Array> array;
+    ASSERT_EQ(single_test.read(geometry.first, ARROW_GPKG_DIMENSIONS_XY,
+                               ARROW_GPKG_COORD_TYPE_INTERLEAVED, &field, &array),
+              0);
+
+    GeoArrowTest encoded_test;
+    std::shared_ptr<BinaryArray> blobs;
+    encode_into(field, array, &encoded_test, &blobs);
+
+    // WKB is written in the byte order of the host (little endian in these tests)
+    EXPECT_EQ(blobs->GetString(0).substr(40), geometry.second);
+  }
+
+  // WKB arrays
+  auto wkb_field = field("geom", binary(), true,
+                         key_value_metadata({"ARROW:extension:name"}, {"geoarrow.wkb"}));
+  BinaryBuilder builder;
+  ASSERT_ARROW_OK(builder.Append(geometries[1].second));
+  ASSERT_ARROW_OK(builder.Append(wkb_header(2) + wkb_count(0)));
+  GeoArrowTest wkb_test;
+  std::shared_ptr<BinaryArray> blobs;
+  encode_into(wkb_field, builder.Finish().ValueOrDie(), &wkb_test, &blobs);
+  EXPECT_EQ(blobs->GetString(0).substr(40), geometries[1].second);
+  EXPECT_EQ(blobs->GetString(1).substr(8), wkb_header(2) + wkb_count(0));
+  EXPECT_EQ(blobs->GetString(1)[3], 0x11);
+
+  struct ArrowSchema schema;
+  struct ArrowGPKGEncoder encoder;
+  struct ArrowSQLite3Error error;
+  ASSERT_ARROW_OK(ExportField(*field("geom", binary()), &schema));
+  EXPECT_EQ(ArrowGPKGEncoderInit(&encoder, &schema, 0, &error), EINVAL);
+  schema.release(&schema);
+  EXPECT_STREQ(error.message, "Column 'geom' is not a GeoArrow column");
+}
+
+TEST(GPKGTest, GPKGEncodeStream) {
+  ConnectionHolder con;
+  con.open_memory();
+
+  // Create a table from a schema, then insert a stream with encoded geometries
+  auto point_metadata = key_value_metadata(
+      {"ARROW:extension:name", "ARROW:extension:metadata"},
+      {"geoarrow.point", R"({"crs":"OGC:CRS84"})"});
+  auto point_type = struct_({field("x", float64()), field("y", float64())});
+  auto schema = arrow::schema(
+      {field("name", utf8()), field("geom", point_type, true, point_metadata)});
+
+  struct ArrowSchema c_schema;
+  struct ArrowSQLite3Error error;
+  ASSERT_ARROW_OK(ExportSchema(*schema, &c_schema));
+  ASSERT_EQ(ArrowGPKGCreateTable(con.ptr, "points", &c_schema, &error), 0)
+      << error.message;
+  c_schema.release(&c_schema);
+
+  DoubleBuilder x_builder;
+  DoubleBuilder y_builder;
+  ASSERT_ARROW_OK(x_builder.AppendValues({1, 2, NAN}));
+  ASSERT_ARROW_OK(y_builder.AppendValues({3, 4, NAN}));
+  auto points = StructArray::Make({x_builder.Finish().ValueOrDie(),
+                                   y_builder.Finish().ValueOrDie()},
+                                  point_type->fields())
+                    .ValueOrDie();
+  StringBuilder name_builder;
+  ASSERT_ARROW_OK(name_builder.AppendValues({"one", "two", "empty"}));
+  auto batch = RecordBatch::Make(schema, 3, {name_builder.Finish().ValueOrDie(), points});
+
+  auto reader = RecordBatchReader::Make({batch, batch->Slice(1)}).ValueOrDie();
+  struct ArrowArrayStream stream;
+  ASSERT_ARROW_OK(ExportRecordBatchReader(reader, &stream));
+  ASSERT_EQ(ArrowGPKGEncodeStream(&stream, 4326, &error), 0) << error.message;
+
+  ASSERT_EQ(stream.get_schema(&stream, &c_schema), 0);
+  auto encoded_schema = ImportSchema(&c_schema).ValueOrDie();
+  EXPECT_TRUE(encoded_schema->field(1)->type()->Equals(binary()));
+  EXPECT_EQ(encoded_schema->field(1)->name(), "geom");
+
+  int64_t rows_inserted;
+  ASSERT_EQ(ArrowSQLite3Ingest(con.ptr, "points", &stream, nullptr, &rows_inserted,
+                               &error),
+            0)
+      << error.message;
+  stream.release(&stream);
+  EXPECT_EQ(rows_inserted, 5);
+
+  struct ArrowGPKGLayerSummary summary;
+  ASSERT_EQ(ArrowGPKGSummarizeLayer(con.ptr, "points", &summary, &error), 0);
+  EXPECT_EQ(summary.feature_count, 5);
+
+  struct ArrowGPKGHeader header;
+  sqlite3_stmt* stmt;
+  ASSERT_EQ(sqlite3_prepare_v2(con.ptr, "SELECT geom FROM points WHERE fid = 2", -1,
+                               &stmt, nullptr),
+            SQLITE_OK);
+  ASSERT_EQ(sqlite3_step(stmt), SQLITE_ROW);
+  ASSERT_EQ(ArrowGPKGParseHeader(
+                reinterpret_cast<const uint8_t*>(sqlite3_column_blob(stmt, 0)),
+                sqlite3_column_bytes(stmt, 0), &header, &error),
+            0);
+  sqlite3_finalize(stmt);
+  EXPECT_EQ(header.srs_id, 4326);
+  EXPECT_EQ(header.envelope[0], 2);
+  EXPECT_EQ(header.envelope[3], 4);
+
+  EXPECT_EQ(query_text(con.ptr, "SELECT srs_id FROM gpkg_geometry_columns"), "4326");
+  EXPECT_EQ(query_text(con.ptr,
+                       "SELECT count(*) FROM points WHERE substr(geom, 4, 1) = X'11'"),
+            "2");
+}
+
+// A reader of some batches followed by an error
+class FailingReader : public RecordBatchReader {
+ public:
+  FailingReader(std::vector<std::shared_ptr<RecordBatch>> batches)
+      : batches_(batches), i_(0) {}
+
+  std::shared_ptr<Schema> schema() const override { return batches_[0]->schema(); }
+
+  Status ReadNext(std::shared_ptr<RecordBatch>* batch) override {
+    if (i_ == batches_.size()) {
+      return Status::IOError("Reader failed");
+    }
+
+    *batch = batches_[i_++];
+    return Status::OK();
+  }
+
+ private:
+  std::vector<std::shared_ptr<RecordBatch>> batches_;
+  size_t i_;
+};
+
+// A reader of batches that runs sql on con before returning the first one
+class ExecReader : public RecordBatchReader {
+ public:
+  ExecReader(std::vector<std::shared_ptr<RecordBatch>> batches, sqlite3* con,
+             std::string sql)
+      : batches_(batches), con_(con), sql_(sql), i_(0) {}
+
+  std::shared_ptr<Schema> schema() const override { return batches_[0]->schema(); }
+
+  Status ReadNext(std::shared_ptr<RecordBatch>* batch) override {
+    if (i_ == 0 && sqlite3_exec(con_, sql_.c_str(), nullptr, nullptr, nullptr) != 0) {
+      return Status::IOError(sqlite3_errmsg(con_));
+    }
+
+    *batch = i_ == batches_.size() ? nullptr : batches_[i_++];
+    return Status::OK();
+  }
+
+ private:
+  std::vector<std::shared_ptr<RecordBatch>> batches_;
+  sqlite3* con_;
+  std::string sql_;
+  size_t i_;
+};
+
+TEST(GPKGTest, GPKGBuildRTree) {
+  ConnectionHolder con;
+  con.open_memory();
+  struct ArrowSQLite3Error error;
+
+  auto point_type = struct_({field("x", float64()), field("y", float64())});
+  auto schema = arrow::schema(
+      {field("geom", point_type, true,
+             key_value_metadata({"ARROW:extension:name"}, {"geoarrow.point"}))});
+  struct ArrowSchema c_schema;
+  ASSERT_ARROW_OK(ExportSchema(*schema, &c_schema));
+  ASSERT_EQ(ArrowGPKGCreateTable(con.ptr, "points", &c_schema, &error), 0)
+      << error.message;
+  c_schema.release(&c_schema);
+
+  // An empty table has an empty index
+  ASSERT_EQ(ArrowGPKGBuildRTree(con.ptr, "points", nullptr, &error), 0) << error.message;
+  EXPECT_EQ(query_text(con.ptr, "SELECT rtreecheck('rtree_points_geom')"), "ok");
+  EXPECT_EQ(query_text(con.ptr, "SELECT count(*) FROM rtree_points_geom"), "0");
+  EXPECT_EQ(query_text(con.ptr, "SELECT table_name, column_name, scope FROM "
+                                "gpkg_extensions WHERE extension_name = "
+                                "'gpkg_rtree_index'"),
+            "points|geom|write-only");
+  EXPECT_EQ(query_text(con.ptr, "SELECT name FROM sqlite_master WHERE type = 'trigger' "
+                                "ORDER BY name"),
+            "rtree_points_geom_delete\nrtree_points_geom_insert\n"
+            "rtree_points_geom_update1\nrtree_points_geom_update2\n"
+            "rtree_points_geom_update3\nrtree_points_geom_update4");
+
+  // A trigger that maintains the index (with dummy envelopes, to tell whether it ran)
+  // is not run during the ingest but is restored
+  for (const char* suffix : {"insert", "update1", "update2", "update3", "update4",
+                             "delete"}) {
+    con.exec(std::string("DROP TRIGGER rtree_points_geom_") + suffix);
+  }
+  con.exec(
+      "CREATE TRIGGER rtree_points_geom_insert AFTER INSERT ON points BEGIN "
+      "INSERT OR REPLACE INTO rtree_points_geom VALUES (NEW.fid, -1, -1, -1, -1); END");
+
+  // A 100 x 50 grid of points and an empty point
+  DoubleBuilder x_builder;
+  DoubleBuilder y_builder;
+  for (int i = 0; i < 5000; i++) {
+    ASSERT_ARROW_OK(x_builder.Append(i % 100));
+    ASSERT_ARROW_OK(y_builder.Append(i / 100));
+  }
+  ASSERT_ARROW_OK(x_builder.Append(NAN));
+  ASSERT_ARROW_OK(y_builder.Append(NAN));
+  auto points = StructArray::Make({x_builder.Finish().ValueOrDie(),
+                                   y_builder.Finish().ValueOrDie()},
+                                  point_type->fields())
+                    .ValueOrDie();
+  auto batch = RecordBatch::Make(schema, points->length(), {points});
+
+  auto reader =
+      RecordBatchReader::Make({batch->Slice(0, 3000), batch->Slice(3000)}).ValueOrDie();
+  struct ArrowArrayStream stream;
+  ASSERT_ARROW_OK(ExportRecordBatchReader(reader, &stream));
+  ASSERT_EQ(ArrowGPKGEncodeStream(&stream, 0, &error), 0) << error.message;
+
+  int64_t rows_inserted;
+  ASSERT_EQ(ArrowGPKGIngest(con.ptr, "points", &stream, nullptr, &rows_inserted, &error),
+            0)
+      << error.message;
+  stream.release(&stream);
+  EXPECT_EQ(rows_inserted, 5001);
+
+  EXPECT_EQ(query_text(con.ptr, "SELECT rtreecheck('rtree_points_geom')"), "ok");
+  EXPECT_EQ(query_text(con.ptr, "SELECT count(*) FROM rtree_points_geom"), "5000");
+  EXPECT_EQ(query_text(con.ptr, "SELECT count(*) FROM rtree_points_geom WHERE minx < 0"),
+            "0");
+  EXPECT_EQ(query_text(con.ptr, "SELECT id FROM rtree_points_geom WHERE minx >= 10 AND "
+                                "maxx <= 11 AND miny >= 20 AND maxy <= 20 ORDER BY id"),
+            "2011\n2012");
+
+  // Every node is full: 99 leaves, 2 internal nodes, and the root
+  EXPECT_EQ(query_text(con.ptr, "SELECT count(*) FROM rtree_points_geom_node"), "102");
+  EXPECT_EQ(query_text(con.ptr, "SELECT hex(substr(data, 1, 4)) FROM "
+                                "rtree_points_geom_node WHERE nodeno = 1"),
+            "00020002");
+
+  // The extent of the layer is read from the root of the index
+  struct ArrowGPKGLayerSummary summary;
+  ASSERT_EQ(ArrowGPKGSummarizeLayer(con.ptr, "points", &summary, &error), 0);
+  EXPECT_EQ(summary.extent_source, ARROW_GPKG_SOURCE_RTREE);
+  EXPECT_EQ(summary.extent[0], 0);
+  EXPECT_EQ(summary.extent[1], 0);
+  EXPECT_EQ(summary.extent[2], 99);
+  EXPECT_EQ(summary.extent[3], 49);
+
+  // The trigger was recreated
+  con.exec("INSERT INTO points (geom) VALUES (NULL)");
+  EXPECT_EQ(query_text(con.ptr, "SELECT id FROM rtree_points_geom WHERE minx < 0"),
+            "5002");
+
+  // Rebuilding the index keeps the trigger (and doesn't index the NULL geometry)
+  ASSERT_EQ(ArrowGPKGBuildRTree(con.ptr, "points", "geom", &error), 0) << error.message;
+  EXPECT_EQ(query_text(con.ptr, "SELECT rtreecheck('rtree_points_geom')"), "ok");
+  EXPECT_EQ(query_text(con.ptr, "SELECT count(*) FROM rtree_points_geom"), "5000");
+  EXPECT_EQ(query_text(con.ptr, "SELECT name FROM sqlite_master WHERE type = 'trigger'"),
+            "rtree_points_geom_insert");
+
+  // A non-empty index is updated by its triggers
+  reader = RecordBatchReader::Make({batch->Slice(0, 2)}).ValueOrDie();
+  ASSERT_ARROW_OK(ExportRecordBatchReader(reader, &stream));
+  ASSERT_EQ(ArrowGPKGEncodeStream(&stream, 0, &error), 0) << error.message;
+  ASSERT_EQ(ArrowGPKGIngest(con.ptr, "points", &stream, nullptr, &rows_inserted, &error),
+            0)
+      << error.message;
+  stream.release(&stream);
+  EXPECT_EQ(query_text(con.ptr, "SELECT id FROM rtree_points_geom WHERE minx < 0"),
+            "5003\n5004");
+
+  // Loads in a single transaction are rolled back with the dropped triggers (which
+  // exist before the index, such that building it doesn't add the standard ones)
+  ASSERT_ARROW_OK(ExportSchema(*schema, &c_schema));
+  ASSERT_EQ(ArrowGPKGCreateTable(con.ptr, "points2", &c_schema, &error), 0)
+      << error.message;
+  c_schema.release(&c_schema);
+  con.exec(
+      "CREATE TRIGGER rtree_points2_geom_insert AFTER INSERT ON points2 BEGIN "
+      "INSERT OR REPLACE INTO rtree_points2_geom VALUES (NEW.fid, -1, -1, -1, -1); END; "
+      "CREATE TRIGGER rtree_points2_geom_delete AFTER DELETE ON points2 BEGIN "
+      "DELETE FROM rtree_points2_geom WHERE id = OLD.fid; END");
+  ASSERT_EQ(ArrowGPKGBuildRTree(con.ptr, "points2", nullptr, &error), 0) << error.message;
+
+  struct ArrowSQLite3IngestOptions options;
+  ArrowSQLite3IngestOptionsInit(&options);
+  options.rows_per_transaction = 0;
+  ASSERT_ARROW_OK(ExportRecordBatchReader(
+      std::make_shared<FailingReader>(
+          std::vector<std::shared_ptr<RecordBatch>>{batch->Slice(0, 10)}),
+      &stream));
+  ASSERT_EQ(ArrowGPKGEncodeStream(&stream, 0, &error), 0) << error.message;
+  EXPECT_EQ(ArrowGPKGIngest(con.ptr, "points2", &stream, &options, &rows_inserted,
+                            &error),
+            EIO);
+  stream.release(&stream);
+  EXPECT_EQ(rows_inserted, 0);
+  EXPECT_TRUE(sqlite3_get_autocommit(con.ptr));
+  EXPECT_EQ(query_text(con.ptr, "SELECT count(*) FROM points2"), "0");
+  EXPECT_EQ(query_text(con.ptr, "SELECT name FROM sqlite_master WHERE type = 'trigger' "
+                                "AND tbl_name = 'points2' ORDER BY name"),
+            "rtree_points2_geom_delete\nrtree_points2_geom_insert");
+
+  // Every trigger is recreated even if one of them can't be
+  ASSERT_ARROW_OK(ExportRecordBatchReader(
+      std::make_shared<ExecReader>(
+          std::vector<std::shared_ptr<RecordBatch>>{batch->Slice(0, 10)}, con.ptr,
+          "CREATE TRIGGER rtree_points2_geom_delete AFTER DELETE ON points2 BEGIN "
+          "SELECT 1; END"),
+      &stream));
+  ASSERT_EQ(ArrowGPKGEncodeStream(&stream, 0, &error), 0) << error.message;
+  EXPECT_EQ(ArrowGPKGIngest(con.ptr, "points2", &stream, nullptr, &rows_inserted,
+                            &error),
+            EIO);
+  stream.release(&stream);
+  EXPECT_STREQ(error.message,
+               "<SQL logic error> trigger rtree_points2_geom_delete already exists");
+  EXPECT_EQ(rows_inserted, 10);
+  EXPECT_EQ(query_text(con.ptr, "SELECT count(*) FROM rtree_points2_geom"), "10");
+  con.exec("INSERT INTO points2 (geom) VALUES (NULL)");
+  EXPECT_EQ(query_text(con.ptr, "SELECT id FROM rtree_points2_geom WHERE minx < 0"),
+            "11");
+
+  // The standard triggers keep an index built for existing rows up to date, such
+  // that scans using it find rows that are added, moved, or deleted later
+  ASSERT_ARROW_OK(ExportSchema(*schema, &c_schema));
+  ASSERT_EQ(ArrowGPKGCreateTable(con.ptr, "points3", &c_schema, &error), 0)
+      << error.message;
+  c_schema.release(&c_schema);
+  con.insert_blob("INSERT INTO points3 (geom) VALUES (?)", gpkg_point(0, 1, 1));
+  con.insert_blob("INSERT INTO points3 (geom) VALUES (?)", gpkg_point(0, 2, 2));
+  ASSERT_EQ(ArrowGPKGBuildRTree(con.ptr, "points3", nullptr, &error), 0) << error.message;
+
+  auto scan_count = [&](double xmin, double ymin, double xmax, double ymax) {
+    struct ArrowArrayStream stream;
+    if (ArrowGPKGScanBBox(&stream, con.ptr, "points3", xmin, ymin, xmax, ymax,
+                          ARROW_GPKG_PREDICATE_ENVELOPE, nullptr, 1024, &error) != 0) {
+      throw std::runtime_error(error.message);
+    }
+
+    int64_t n_rows = 0;
+    for (const auto& batch :
+         ImportRecordBatchReader(&stream).ValueOrDie()->ToRecordBatches().ValueOrDie()) {
+      n_rows += batch->num_rows();
+    }
+
+    return n_rows;
+  };
+
+  // An envelope is computed from the WKB if the header has none
+  con.insert_blob("INSERT INTO points3 (geom) VALUES (?)", gpkg_point(0, 5, 5));
+  con.insert_blob("INSERT INTO points3 (geom) VALUES (?)", gpkg_point(0, 6, 6, 0));
+  EXPECT_EQ(scan_count(4, 4, 7, 7), 2);
+  EXPECT_EQ(scan_count(0, 0, 7, 7), 4);
+
+  con.insert_blob("UPDATE points3 SET geom = ? WHERE fid = 1", gpkg_point(0, 10, 10));
+  EXPECT_EQ(scan_count(9, 9, 11, 11), 1);
+  con.exec("UPDATE points3 SET fid = 10 WHERE fid = 2");
+  con.exec("UPDATE points3 SET geom = NULL WHERE fid = 3");
+  con.exec("DELETE FROM points3 WHERE fid = 4");
+  EXPECT_EQ(scan_count(0, 0, 20, 20), 2);
+  EXPECT_EQ(query_text(con.ptr, "SELECT id FROM rtree_points3_geom ORDER BY id"),
+            "1\n10");
+  EXPECT_EQ(query_text(con.ptr, "SELECT rtreecheck('rtree_points3_geom')"), "ok");
+
+  EXPECT_EQ(ArrowGPKGBuildRTree(con.ptr, "not_a_table", nullptr, &error), ENOENT);
+  EXPECT_STREQ(error.message, "Table 'not_a_table' has no registered geometry column");
+}
+
+TEST(GPKGTest, GPKGEncodeStreamParallel) {
+  auto point_type = struct_({field("x", float64()), field("y", float64())});
+  auto schema = arrow::schema(
+      {field("geom", point_type, true,
+             key_value_metadata({"ARROW:extension:name"}, {"geoarrow.point"})),
+       field("i", int64())});
+
+  // Batches of different sizes such that they take a different time to encode
+  std::vector<std::shared_ptr<RecordBatch>> batches;
+  int64_t n_rows = 0;
+  for (int i = 0; i < 200; i++) {
+    DoubleBuilder x_builder;
+    DoubleBuilder y_builder;
+    Int64Builder i_builder;
+    for (int j = 0; j < (i * 37) % 101; j++, n_rows++) {
+      ASSERT_ARROW_OK(x_builder.Append(n_rows));
+      ASSERT_ARROW_OK(y_builder.Append(-n_rows));
+      ASSERT_ARROW_OK(i_builder.Append(n_rows));
+    }
+
+    auto points = StructArray::Make({x_builder.Finish().ValueOrDie(),
+                                     y_builder.Finish().ValueOrDie()},
+                                    point_type->fields())
+                      .ValueOrDie();
+    batches.push_back(RecordBatch::Make(schema, points->length(),
+                                        {points, i_builder.Finish().ValueOrDie()}));
+  }
+
+  struct ArrowSQLite3Error error;
+  auto encode = [&](int n_threads, int64_t max_batches) {
+    struct ArrowArrayStream stream;
+    auto reader = RecordBatchReader::Make(batches).ValueOrDie();
+    ASSERT_ARROW_OK(ExportRecordBatchReader(reader, &stream));
+    int result = n_threads == 0
+                     ? ArrowGPKGEncodeStream(&stream, 0, &error)
+                     : ArrowGPKGEncodeStreamParallel(&stream, 0, n_threads, max_batches,
+                                                     &error);
+    EXPECT_EQ(result, 0) << error.message;
+    return ImportRecordBatchReader(&stream).ValueOrDie();
+  };
+
+  // Batches are encoded as by a single thread and returned in order
+  auto expected = encode(0, 0)->ToRecordBatches().ValueOrDie();
+  ASSERT_EQ(expected.size(), batches.size());
+  for (int n_threads : {1, 4}) {
+    auto actual = encode(n_threads, 3)->ToRecordBatches().ValueOrDie();
+    ASSERT_EQ(actual.size(), expected.size());
+    for (size_t i = 0; i < actual.size(); i++) {
+      EXPECT_TRUE(actual[i]->Equals(*expected[i])) << "batch " << i;
+    }
+  }
+
+  // Releasing the stream stops the threads (that are waiting for free slots)
+  auto reader = encode(4, 2);
+  std::shared_ptr<RecordBatch> batch;
+  ASSERT_ARROW_OK(reader->ReadNext(&batch));
+  EXPECT_TRUE(batch->Equals(*expected[0]));
+  ASSERT_ARROW_OK(reader->Close());
+  reader.reset();
+
+  // Encoded batches are ingested by a single writer
+  ConnectionHolder con;
+  con.open_memory();
+  struct ArrowSchema c_schema;
+  ASSERT_ARROW_OK(ExportSchema(*schema, &c_schema));
+  ASSERT_EQ(ArrowGPKGCreateTable(con.ptr, "points", &c_schema, &error), 0)
+      << error.message;
+  c_schema.release(&c_schema);
+
+  struct ArrowArrayStream stream;
+  ASSERT_ARROW_OK(
+      ExportRecordBatchReader(RecordBatchReader::Make(batches).ValueOrDie(), &stream));
+  ASSERT_EQ(ArrowGPKGEncodeStreamParallel(&stream, 0, 4, 8, &error), 0) << error.message;
+  int64_t rows_inserted;
+  ASSERT_EQ(ArrowGPKGIngest(con.ptr, "points", &stream, nullptr, &rows_inserted, &error),
+            0)
+      << error.message;
+  stream.release(&stream);
+  EXPECT_EQ(rows_inserted, n_rows);
+  EXPECT_EQ(query_text(con.ptr, "SELECT count(*) FROM points WHERE fid != i + 1"), "0");
+
+  // Errors of the source stream are returned by get_next() after the batches before it
+  auto failing = std::make_shared<FailingReader>(
+      std::vector<std::shared_ptr<RecordBatch>>{batches[1], batches[2]});
+  ASSERT_ARROW_OK(ExportRecordBatchReader(failing, &stream));
+  ASSERT_EQ(ArrowGPKGEncodeStreamParallel(&stream, 0, 2, 4, &error), 0) << error.message;
+  struct ArrowArray array;
+  int result = 0;
+  for (int i = 0; i < 3 && result == 0; i++) {
+    result = stream.get_next(&stream, &array);
+    if (result == 0) {
+      ASSERT_NE(array.release, nullptr);
+      array.release(&array);
+    }
+  }
+  EXPECT_EQ(result, EIO);
+  EXPECT_STREQ(stream.get_last_error(&stream), "IOError: Reader failed");
+  stream.release(&stream);
+
+  // Streams without an error message
+  struct ArrowArrayStream no_message;
+  no_message.get_schema = [](struct ArrowArrayStream*, struct ArrowSchema* out) {
+    return ExportSchema(*arrow::schema({field("i", int64())}), out).ok() ? 0 : EINVAL;
+  };
+  no_message.get_next = [](struct ArrowArrayStream*, struct ArrowArray*) { return EIO; };
+  no_message.get_last_error = [](struct ArrowArrayStream*) -> const char* {
+    return nullptr;
+  };
+  no_message.release = [](struct ArrowArrayStream* stream) { stream->release = nullptr; };
+  ASSERT_EQ(ArrowGPKGEncodeStreamParallel(&no_message, 0, 2, 2, &error), 0);
+  EXPECT_EQ(no_message.get_next(&no_message, &array), EIO);
+  EXPECT_STREQ(no_message.get_last_error(&no_message), strerror(EIO));
+  no_message.release(&no_message);
+
+  ASSERT_ARROW_OK(
+      ExportRecordBatchReader(RecordBatchReader::Make(batches).ValueOrDie(), &stream));
+  EXPECT_EQ(ArrowGPKGEncodeStreamParallel(&stream, 0, 0, 1, &error), EINVAL);
+  EXPECT_STREQ(error.message, "n_threads and max_batches must be greater than zero");
+  stream.release(&stream);
+}
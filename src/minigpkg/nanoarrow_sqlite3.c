@@ -1,16 +1,120 @@
 
+#include <ctype.h>
 #include <errno.h>
+#include <math.h>
 #include <sqlite3.h>
+#include <stdio.h>
 #include <string.h>
 
 #include "nanoarrow.h"
 
 #include "nanoarrow_sqlite3.h"
 
+struct ArrowSQLite3ResultPrivate;
+struct ArrowSQLite3Column;
+
+// Appenders resolved once per column from the storage type of the output column.
+// Each appender receives the sqlite3 storage class of the value (i.e., the result of
+// sqlite3_column_type()) so that it only has to be queried once per value.
+typedef int (*ArrowSQLite3AppendFunc)(struct ArrowSQLite3ResultPrivate* private_data,
+                                      struct ArrowSQLite3Column* column,
+                                      struct ArrowArray* array, sqlite3_stmt* stmt,
+                                      int i, int value_type);
+
+struct ArrowSQLite3Column {
+  ArrowSQLite3AppendFunc append;
+
+  // For variable-length columns, the average number of bytes per value in the
+  // last array that was finished, used to reserve the data buffer of the next one
+  int64_t avg_value_bytes;
+
+  // The handler that appends values of this column or NULL
+  struct ArrowSQLite3ColumnHandler* handler;
+};
+
+struct ArrowSQLite3NamedHandler {
+  char* column_name;
+  struct ArrowSQLite3ColumnHandler handler;
+};
+
+// Rows that were stepped while guessing the schema and that still need to be appended.
+// These are appended by binding them to replay_stmt (SELECT ?1, ?2, ...) such that
+// the same appenders can be used for buffered rows and rows from the statement.
+struct ArrowSQLite3BufferedRows {
+  struct ArrowBuffer values;
+  int64_t n_rows;
+  int64_t next_row;
+  int step_return_code;
+  sqlite3_stmt* replay_stmt;
+};
+
 struct ArrowSQLite3ResultPrivate {
   struct ArrowError error;
+  int64_t max_batch_bytes;
+  int64_t fixed_row_bits;
+  int64_t variable_bytes;
+  int64_t row_count_hint;
+  int64_t guess_rows;
+  int use_declared_types;
+  int widen_types;
+  int union_mixed_types;
+  int schema_exported;
+
+  // Non-zero if the schema was guessed from several rows, such that a string or
+  // binary column may have been chosen to also hold numbers
+  int guessed_from_rows;
+  struct ArrowSQLite3BufferedRows buffered;
+
+  // The statement column used for each output column. This is resolved from
+  // column_names (or all columns of the statement) on the first step if NULL.
+  int* column_index;
+  int64_t n_columns;
+  char** column_names;
+  int64_t n_column_names;
+  int exclude_column_names;
+
+  struct ArrowSQLite3Column* columns;
+
+  struct ArrowSQLite3NamedHandler* handlers;
+  int64_t n_handlers;
+
+  // filter.filter is NULL if all rows are appended
+  struct ArrowSQLite3RowFilter filter;
 };
 
+static void ArrowSQLite3FreeColumnNames(struct ArrowSQLite3ResultPrivate* private_data) {
+  if (private_data->column_names == NULL) {
+    return;
+  }
+
+  for (int64_t i = 0; i < private_data->n_column_names; i++) {
+    if (private_data->column_names[i] != NULL) {
+      ArrowFree(private_data->column_names[i]);
+    }
+  }
+
+  ArrowFree(private_data->column_names);
+  private_data->column_names = NULL;
+  private_data->n_column_names = 0;
+}
+
+static void ArrowSQLite3FreeBufferedRows(struct ArrowSQLite3BufferedRows* buffered) {
+  sqlite3_value** values = (sqlite3_value**)buffered->values.data;
+  int64_t n_values = buffered->values.size_bytes / sizeof(sqlite3_value*);
+  for (int64_t i = 0; i < n_values; i++) {
+    sqlite3_value_free(values[i]);
+  }
+
+  ArrowBufferReset(&buffered->values);
+  buffered->n_rows = 0;
+  buffered->next_row = 0;
+
+  if (buffered->replay_stmt != NULL) {
+    sqlite3_finalize(buffered->replay_stmt);
+    buffered->replay_stmt = NULL;
+  }
+}
+
 int ArrowSQLite3ResultInit(struct ArrowSQLite3Result* result) {
   result->step_return_code = SQLITE_OK;
   result->array.release = NULL;
@@ -24,6 +128,32 @@ int ArrowSQLite3ResultInit(struct ArrowSQLite3Result* result) {
   struct ArrowSQLite3ResultPrivate* private_data =
       (struct ArrowSQLite3ResultPrivate*)result->private_data;
   private_data->error.message[0] = '\0';
+  private_data->max_batch_bytes = 0;
+  private_data->fixed_row_bits = 0;
+  private_data->variable_bytes = 0;
+  private_data->row_count_hint = 0;
+  private_data->guess_rows = 1;
+  private_data->use_declared_types = 0;
+  private_data->widen_types = 0;
+  private_data->union_mixed_types = 0;
+  private_data->schema_exported = 0;
+  private_data->guessed_from_rows = 0;
+  ArrowBufferInit(&private_data->buffered.values);
+  private_data->buffered.n_rows = 0;
+  private_data->buffered.next_row = 0;
+  private_data->buffered.step_return_code = SQLITE_OK;
+  private_data->buffered.replay_stmt = NULL;
+  private_data->column_index = NULL;
+  private_data->n_columns = 0;
+  private_data->column_names = NULL;
+  private_data->n_column_names = 0;
+  private_data->exclude_column_names = 0;
+  private_data->columns = NULL;
+  private_data->handlers = NULL;
+  private_data->n_handlers = 0;
+  private_data->filter.filter = NULL;
+  private_data->filter.release = NULL;
+  private_data->filter.private_data = NULL;
 
   return 0;
 }
@@ -38,6 +168,34 @@ void ArrowSQLite3ResultReset(struct ArrowSQLite3Result* result) {
   }
 
   if (result->private_data != NULL) {
+    struct ArrowSQLite3ResultPrivate* private_data =
+        (struct ArrowSQLite3ResultPrivate*)result->private_data;
+    if (private_data->columns != NULL) {
+      ArrowFree(private_data->columns);
+    }
+
+    if (private_data->column_index != NULL) {
+      ArrowFree(private_data->column_index);
+    }
+
+    ArrowSQLite3FreeColumnNames(private_data);
+    ArrowSQLite3FreeBufferedRows(&private_data->buffered);
+
+    for (int64_t i = 0; i < private_data->n_handlers; i++) {
+      ArrowFree(private_data->handlers[i].column_name);
+      if (private_data->handlers[i].handler.release != NULL) {
+        private_data->handlers[i].handler.release(&private_data->handlers[i].handler);
+      }
+    }
+
+    if (private_data->handlers != NULL) {
+      ArrowFree(private_data->handlers);
+    }
+
+    if (private_data->filter.release != NULL) {
+      private_data->filter.release(&private_data->filter);
+    }
+
     ArrowFree(result->private_data);
   }
 }
@@ -69,6 +227,216 @@ int ArrowSQLite3ResultSetSchema(struct ArrowSQLite3Result* result,
   return 0;
 }
 
+int ArrowSQLite3ResultSetMaxBatchBytes(struct ArrowSQLite3Result* result,
+                                       int64_t max_batch_bytes) {
+  struct ArrowSQLite3ResultPrivate* private_data =
+      (struct ArrowSQLite3ResultPrivate*)result->private_data;
+
+  if (max_batch_bytes < 0) {
+    ArrowErrorSet(&private_data->error, "max_batch_bytes must be >= 0");
+    return EINVAL;
+  }
+
+  private_data->max_batch_bytes = max_batch_bytes;
+  return 0;
+}
+
+int64_t ArrowSQLite3ResultBatchBytes(struct ArrowSQLite3Result* result) {
+  if (result->array.release == NULL) {
+    return 0;
+  }
+
+  struct ArrowSQLite3ResultPrivate* private_data =
+      (struct ArrowSQLite3ResultPrivate*)result->private_data;
+  return (private_data->fixed_row_bits * result->array.length + 7) / 8 +
+         private_data->variable_bytes;
+}
+
+int ArrowSQLite3ResultBatchFull(struct ArrowSQLite3Result* result) {
+  struct ArrowSQLite3ResultPrivate* private_data =
+      (struct ArrowSQLite3ResultPrivate*)result->private_data;
+  return private_data->max_batch_bytes > 0 &&
+         ArrowSQLite3ResultBatchBytes(result) >= private_data->max_batch_bytes;
+}
+
+int ArrowSQLite3ResultSetRowCountHint(struct ArrowSQLite3Result* result,
+                                      int64_t row_count_hint) {
+  struct ArrowSQLite3ResultPrivate* private_data =
+      (struct ArrowSQLite3ResultPrivate*)result->private_data;
+
+  if (row_count_hint < 0) {
+    ArrowErrorSet(&private_data->error, "row_count_hint must be >= 0");
+    return EINVAL;
+  }
+
+  private_data->row_count_hint = row_count_hint;
+  return 0;
+}
+
+int ArrowSQLite3ResultSetGuessRows(struct ArrowSQLite3Result* result,
+                                   int64_t guess_rows) {
+  struct ArrowSQLite3ResultPrivate* private_data =
+      (struct ArrowSQLite3ResultPrivate*)result->private_data;
+
+  if (guess_rows < 1) {
+    ArrowErrorSet(&private_data->error, "guess_rows must be >= 1");
+    return EINVAL;
+  }
+
+  private_data->guess_rows = guess_rows;
+  return 0;
+}
+
+int ArrowSQLite3ResultSetDeclaredTypes(struct ArrowSQLite3Result* result,
+                                       int use_declared_types) {
+  struct ArrowSQLite3ResultPrivate* private_data =
+      (struct ArrowSQLite3ResultPrivate*)result->private_data;
+  private_data->use_declared_types = use_declared_types != 0;
+  return 0;
+}
+
+int ArrowSQLite3ResultSetWidenTypes(struct ArrowSQLite3Result* result,
+                                    int widen_types) {
+  struct ArrowSQLite3ResultPrivate* private_data =
+      (struct ArrowSQLite3ResultPrivate*)result->private_data;
+  private_data->widen_types = widen_types != 0;
+  return 0;
+}
+
+int ArrowSQLite3ResultSetUnionMixedTypes(struct ArrowSQLite3Result* result,
+                                          int union_mixed_types) {
+  struct ArrowSQLite3ResultPrivate* private_data =
+      (struct ArrowSQLite3ResultPrivate*)result->private_data;
+  private_data->union_mixed_types = union_mixed_types != 0;
+  return 0;
+}
+
+int ArrowSQLite3ResultSetColumns(struct ArrowSQLite3Result* result,
+                                 const int* column_index, int64_t n_columns) {
+  struct ArrowSQLite3ResultPrivate* private_data =
+      (struct ArrowSQLite3ResultPrivate*)result->private_data;
+
+  if (private_data->columns != NULL || private_data->column_index != NULL ||
+      private_data->column_names != NULL) {
+    ArrowErrorSet(&private_data->error, "columns have already been set or resolved");
+    return EINVAL;
+  }
+
+  for (int64_t i = 0; i < n_columns; i++) {
+    if (column_index[i] < 0) {
+      ArrowErrorSet(&private_data->error, "column_index[%ld] is < 0", (long)i);
+      return EINVAL;
+    }
+  }
+
+  private_data->column_index = (int*)ArrowMalloc(n_columns * sizeof(int));
+  if (private_data->column_index == NULL && n_columns > 0) {
+    return ENOMEM;
+  }
+
+  memcpy(private_data->column_index, column_index, n_columns * sizeof(int));
+  private_data->n_columns = n_columns;
+  return 0;
+}
+
+int ArrowSQLite3ResultSetColumnNames(struct ArrowSQLite3Result* result,
+                                     const char** column_names, int64_t n_columns,
+                                     int exclude) {
+  struct ArrowSQLite3ResultPrivate* private_data =
+      (struct ArrowSQLite3ResultPrivate*)result->private_data;
+
+  if (private_data->columns != NULL || private_data->column_index != NULL ||
+      private_data->column_names != NULL) {
+    ArrowErrorSet(&private_data->error, "columns have already been set or resolved");
+    return EINVAL;
+  }
+
+  private_data->column_names = (char**)ArrowMalloc(n_columns * sizeof(char*));
+  if (private_data->column_names == NULL && n_columns > 0) {
+    return ENOMEM;
+  }
+
+  private_data->n_column_names = n_columns;
+  private_data->exclude_column_names = exclude;
+  for (int64_t i = 0; i < n_columns; i++) {
+    private_data->column_names[i] = NULL;
+  }
+
+  for (int64_t i = 0; i < n_columns; i++) {
+    size_t name_size = strlen(column_names[i]) + 1;
+    private_data->column_names[i] = (char*)ArrowMalloc(name_size);
+    if (private_data->column_names[i] == NULL) {
+      ArrowSQLite3FreeColumnNames(private_data);
+      return ENOMEM;
+    }
+
+    memcpy(private_data->column_names[i], column_names[i], name_size);
+  }
+
+  return 0;
+}
+
+int ArrowSQLite3ResultSetColumnHandler(struct ArrowSQLite3Result* result,
+                                       const char* column_name,
+                                       struct ArrowSQLite3ColumnHandler* handler) {
+  struct ArrowSQLite3ResultPrivate* private_data =
+      (struct ArrowSQLite3ResultPrivate*)result->private_data;
+
+  if (private_data->columns != NULL) {
+    ArrowErrorSet(&private_data->error, "columns have already been resolved");
+    return EINVAL;
+  }
+
+  struct ArrowSQLite3NamedHandler* handlers =
+      (struct ArrowSQLite3NamedHandler*)ArrowRealloc(
+          private_data->handlers,
+          (private_data->n_handlers + 1) * sizeof(struct ArrowSQLite3NamedHandler));
+  if (handlers == NULL) {
+    return ENOMEM;
+  }
+
+  private_data->handlers = handlers;
+
+  size_t name_size = strlen(column_name) + 1;
+  char* name = (char*)ArrowMalloc(name_size);
+  if (name == NULL) {
+    return ENOMEM;
+  }
+
+  memcpy(name, column_name, name_size);
+  handlers[private_data->n_handlers].column_name = name;
+  memcpy(&handlers[private_data->n_handlers].handler, handler,
+         sizeof(struct ArrowSQLite3ColumnHandler));
+  handler->release = NULL;
+  private_data->n_handlers++;
+  return 0;
+}
+
+int ArrowSQLite3ResultSetRowFilter(struct ArrowSQLite3Result* result,
+                                   struct ArrowSQLite3RowFilter* filter) {
+  struct ArrowSQLite3ResultPrivate* private_data =
+      (struct ArrowSQLite3ResultPrivate*)result->private_data;
+
+  if (private_data->filter.release != NULL) {
+    private_data->filter.release(&private_data->filter);
+  }
+
+  memcpy(&private_data->filter, filter, sizeof(struct ArrowSQLite3RowFilter));
+  filter->release = NULL;
+  return 0;
+}
+
+static struct ArrowSQLite3ColumnHandler* ArrowSQLite3FindHandler(
+    struct ArrowSQLite3ResultPrivate* private_data, const char* column_name) {
+  for (int64_t i = 0; i < private_data->n_handlers; i++) {
+    if (sqlite3_stricmp(private_data->handlers[i].column_name, column_name) == 0) {
+      return &private_data->handlers[i].handler;
+    }
+  }
+
+  return NULL;
+}
+
 int ArrowSQLite3ResultFinishSchema(struct ArrowSQLite3Result* result,
                                    struct ArrowSchema* schema_out) {
   if (result->schema.release == NULL) {
@@ -89,6 +457,22 @@ int ArrowSQLite3ResultFinishArray(struct ArrowSQLite3Result* result,
 
   struct ArrowSQLite3ResultPrivate* private =
       (struct ArrowSQLite3ResultPrivate*)result->private_data;
+
+  // Keep track of the average value size of variable-length columns so that the
+  // data buffers of the next array can be reserved up front
+  if (private->columns != NULL) {
+    for (int64_t i = 0; i < result->array.n_children; i++) {
+      struct ArrowArray* child = result->array.children[i];
+      struct ArrowArrayPrivateData* child_private =
+          (struct ArrowArrayPrivateData*)child->private_data;
+      if (child_private->layout.buffer_type[1] == NANOARROW_BUFFER_TYPE_DATA_OFFSET &&
+          child->length > 0) {
+        private->columns[i].avg_value_bytes =
+            ArrowArrayBuffer(child, 2)->size_bytes / child->length;
+      }
+    }
+  }
+
   NANOARROW_RETURN_NOT_OK(ArrowArrayFinishBuilding(&result->array, &private->error));
 
   memcpy(array_out, &result->array, sizeof(struct ArrowArray));
@@ -96,27 +480,148 @@ int ArrowSQLite3ResultFinishArray(struct ArrowSQLite3Result* result,
   return 0;
 }
 
+struct ArrowSQLite3DeclaredTypeMapping {
+  const char* declared_type;
+  enum ArrowType type;
+};
+
+// GeoPackage core data types (including geometry types, which are stored as
+// GeoPackage geometry blobs)
+static const struct ArrowSQLite3DeclaredTypeMapping kArrowSQLite3DeclaredTypes[] = {
+    {"BOOLEAN", NANOARROW_TYPE_BOOL},
+    {"TINYINT", NANOARROW_TYPE_INT8},
+    {"SMALLINT", NANOARROW_TYPE_INT16},
+    {"MEDIUMINT", NANOARROW_TYPE_INT32},
+    {"INT", NANOARROW_TYPE_INT64},
+    {"INTEGER", NANOARROW_TYPE_INT64},
+    {"FLOAT", NANOARROW_TYPE_FLOAT},
+    {"DOUBLE", NANOARROW_TYPE_DOUBLE},
+    {"REAL", NANOARROW_TYPE_DOUBLE},
+    {"TEXT", NANOARROW_TYPE_STRING},
+    {"BLOB", NANOARROW_TYPE_BINARY},
+    {"DATE", NANOARROW_TYPE_STRING},
+    {"DATETIME", NANOARROW_TYPE_STRING},
+    {"GEOMETRY", NANOARROW_TYPE_BINARY},
+    {"POINT", NANOARROW_TYPE_BINARY},
+    {"LINESTRING", NANOARROW_TYPE_BINARY},
+    {"POLYGON", NANOARROW_TYPE_BINARY},
+    {"MULTIPOINT", NANOARROW_TYPE_BINARY},
+    {"MULTILINESTRING", NANOARROW_TYPE_BINARY},
+    {"MULTIPOLYGON", NANOARROW_TYPE_BINARY},
+    {"GEOMETRYCOLLECTION", NANOARROW_TYPE_BINARY},
+    {"CIRCULARSTRING", NANOARROW_TYPE_BINARY},
+    {"COMPOUNDCURVE", NANOARROW_TYPE_BINARY},
+    {"CURVEPOLYGON", NANOARROW_TYPE_BINARY},
+    {"MULTICURVE", NANOARROW_TYPE_BINARY},
+    {"MULTISURFACE", NANOARROW_TYPE_BINARY},
+    {"CURVE", NANOARROW_TYPE_BINARY},
+    {"SURFACE", NANOARROW_TYPE_BINARY}};
+
+// Returns the Arrow type for a declared column type or NANOARROW_TYPE_UNINITIALIZED
+// if the type of the column can't be known without looking at its values (e.g.,
+// expressions or columns with NUMERIC affinity). A maximum length (e.g.,
+// TEXT(32)) is ignored. Declared types that are not GeoPackage data types are
+// mapped using the SQLite type affinity rules.
+static enum ArrowType ArrowSQLite3DeclaredType(const char* declared_type) {
+  if (declared_type == NULL) {
+    return NANOARROW_TYPE_UNINITIALIZED;
+  }
+
+  char upper[64];
+  size_t n = 0;
+  for (const char* c = declared_type; *c != '\0' && n < (sizeof(upper) - 1); c++) {
+    upper[n++] = (char)toupper((unsigned char)*c);
+  }
+  upper[n] = '\0';
+
+  size_t name_size = strcspn(upper, "( ");
+  for (size_t i = 0; i < (sizeof(kArrowSQLite3DeclaredTypes) /
+                          sizeof(struct ArrowSQLite3DeclaredTypeMapping));
+       i++) {
+    const char* name = kArrowSQLite3DeclaredTypes[i].declared_type;
+    if (strlen(name) == name_size && strncmp(upper, name, name_size) == 0) {
+      return kArrowSQLite3DeclaredTypes[i].type;
+    }
+  }
+
+  // https://www.sqlite.org/datatype3.html#determination_of_column_affinity
+  if (strstr(upper, "INT") != NULL) {
+    return NANOARROW_TYPE_INT64;
+  } else if (strstr(upper, "CHAR") != NULL || strstr(upper, "CLOB") != NULL ||
+             strstr(upper, "TEXT") != NULL) {
+    return NANOARROW_TYPE_STRING;
+  } else if (strstr(upper, "BLOB") != NULL) {
+    return NANOARROW_TYPE_BINARY;
+  } else if (strstr(upper, "REAL") != NULL || strstr(upper, "FLOA") != NULL ||
+             strstr(upper, "DOUB") != NULL) {
+    return NANOARROW_TYPE_DOUBLE;
+  } else {
+    return NANOARROW_TYPE_UNINITIALIZED;
+  }
+}
+
+// Pseudo storage class for a column whose values have more than one (non-null)
+// storage class
+#define ARROW_SQLITE3_MIXED -1
+
+// The type ids of this union are the sqlite3 storage classes of each child such that
+// sqlite3_column_type() can be used as the type id (nulls are appended to the integer
+// child)
+#define ARROW_SQLITE3_UNION_FORMAT "+ud:1,2,3,4"
+
+static int ArrowSQLite3MixedSchema(struct ArrowSchema* schema_out) {
+  NANOARROW_RETURN_NOT_OK(ArrowSchemaInit(schema_out, NANOARROW_TYPE_UNINITIALIZED));
+  NANOARROW_RETURN_NOT_OK(ArrowSchemaSetFormat(schema_out, ARROW_SQLITE3_UNION_FORMAT));
+  NANOARROW_RETURN_NOT_OK(ArrowSchemaAllocateChildren(schema_out, 4));
+
+  NANOARROW_RETURN_NOT_OK(ArrowSchemaInit(schema_out->children[0], NANOARROW_TYPE_INT64));
+  NANOARROW_RETURN_NOT_OK(ArrowSchemaSetName(schema_out->children[0], "integer"));
+  NANOARROW_RETURN_NOT_OK(
+      ArrowSchemaInit(schema_out->children[1], NANOARROW_TYPE_DOUBLE));
+  NANOARROW_RETURN_NOT_OK(ArrowSchemaSetName(schema_out->children[1], "real"));
+  NANOARROW_RETURN_NOT_OK(
+      ArrowSchemaInit(schema_out->children[2], NANOARROW_TYPE_STRING));
+  NANOARROW_RETURN_NOT_OK(ArrowSchemaSetName(schema_out->children[2], "text"));
+  NANOARROW_RETURN_NOT_OK(
+      ArrowSchemaInit(schema_out->children[3], NANOARROW_TYPE_BINARY));
+  NANOARROW_RETURN_NOT_OK(ArrowSchemaSetName(schema_out->children[3], "blob"));
+
+  return NANOARROW_OK;
+}
+
 static int ArrowSQLite3ColumnSchema(const char* name, const char* declared_type,
-                                    int first_value_type,
+                                    int use_declared_type, int first_value_type,
                                     struct ArrowSchema* schema_out) {
   int result;
 
-  switch (first_value_type) {
-    case SQLITE_NULL:
-      result = ArrowSchemaInit(schema_out, NANOARROW_TYPE_NA);
-      break;
-    case SQLITE_INTEGER:
-      result = ArrowSchemaInit(schema_out, NANOARROW_TYPE_INT64);
-      break;
-    case SQLITE_FLOAT:
-      result = ArrowSchemaInit(schema_out, NANOARROW_TYPE_DOUBLE);
-      break;
-    case SQLITE_BLOB:
-      result = ArrowSchemaInit(schema_out, NANOARROW_TYPE_BINARY);
-      break;
-    default:
-      result = ArrowSchemaInit(schema_out, NANOARROW_TYPE_STRING);
-      break;
+  enum ArrowType type = NANOARROW_TYPE_UNINITIALIZED;
+  if (use_declared_type) {
+    type = ArrowSQLite3DeclaredType(declared_type);
+  }
+
+  if (type != NANOARROW_TYPE_UNINITIALIZED) {
+    result = ArrowSchemaInit(schema_out, type);
+  } else {
+    switch (first_value_type) {
+      case ARROW_SQLITE3_MIXED:
+        result = ArrowSQLite3MixedSchema(schema_out);
+        break;
+      case SQLITE_NULL:
+        result = ArrowSchemaInit(schema_out, NANOARROW_TYPE_NA);
+        break;
+      case SQLITE_INTEGER:
+        result = ArrowSchemaInit(schema_out, NANOARROW_TYPE_INT64);
+        break;
+      case SQLITE_FLOAT:
+        result = ArrowSchemaInit(schema_out, NANOARROW_TYPE_DOUBLE);
+        break;
+      case SQLITE_BLOB:
+        result = ArrowSchemaInit(schema_out, NANOARROW_TYPE_BINARY);
+        break;
+      default:
+        result = ArrowSchemaInit(schema_out, NANOARROW_TYPE_STRING);
+        break;
+    }
   }
 
   NANOARROW_RETURN_NOT_OK(result);
@@ -142,146 +647,1851 @@ static int ArrowSQLite3ColumnSchema(const char* name, const char* declared_type,
   return 0;
 }
 
-static int ArrowSQLite3GuessSchema(sqlite3_stmt* stmt, struct ArrowSchema* schema_out) {
-  NANOARROW_RETURN_NOT_OK(ArrowSchemaInit(schema_out, NANOARROW_TYPE_STRUCT));
+// Calculates the number of bits each row will add to the offset, data, and
+// validity buffers of the children of array. Bytes added to the data buffers of
+// variable-length children are tracked separately as values are appended.
+static int64_t ArrowSQLite3FixedRowBits(struct ArrowArray* array) {
+  int64_t row_bits = 0;
 
-  int n_col = sqlite3_column_count(stmt);
-  NANOARROW_RETURN_NOT_OK(ArrowSchemaAllocateChildren(schema_out, n_col));
+  for (int64_t i = 0; i < array->n_children; i++) {
+    struct ArrowArrayPrivateData* child_private =
+        (struct ArrowArrayPrivateData*)array->children[i]->private_data;
+
+    for (int j = 0; j < 3; j++) {
+      switch (child_private->layout.buffer_type[j]) {
+        case NANOARROW_BUFFER_TYPE_VALIDITY:
+          row_bits += 1;
+          break;
+        case NANOARROW_BUFFER_TYPE_DATA_OFFSET:
+          row_bits += child_private->layout.element_size_bits[j];
+          break;
+        case NANOARROW_BUFFER_TYPE_DATA:
+        case NANOARROW_BUFFER_TYPE_TYPE_ID:
+        case NANOARROW_BUFFER_TYPE_UNION_OFFSET:
+          row_bits += child_private->layout.element_size_bits[j];
+          break;
+        default:
+          break;
+      }
+    }
+  }
+
+  return row_bits;
+}
+
+static int ArrowSQLite3TypeRank(int value_type) {
+  switch (value_type) {
+    case SQLITE_INTEGER:
+      return 1;
+    case SQLITE_FLOAT:
+      return 2;
+    case SQLITE_TEXT:
+      return 3;
+    case SQLITE_BLOB:
+      return 4;
+    default:
+      return 0;
+  }
+}
 
-  for (int i = 0; i < n_col; i++) {
+// Returns the storage class that can represent values of both storage classes
+// (NULL < INTEGER < FLOAT < TEXT < BLOB)
+static int ArrowSQLite3WidenType(int current_type, int new_type) {
+  if (ArrowSQLite3TypeRank(new_type) > ArrowSQLite3TypeRank(current_type)) {
+    return new_type;
+  } else {
+    return current_type;
+  }
+}
+
+// Guess the schema from the storage classes in value_types or, if value_types is
+// NULL, from the storage classes of the current row of stmt. Columns with a handler
+// use the handler's schema and, if declared types are used, the declared type of
+// each column is used where possible.
+static int ArrowSQLite3GuessSchema(struct ArrowSQLite3ResultPrivate* private_data,
+                                   sqlite3_stmt* stmt, const int* value_types,
+                                   struct ArrowSchema* schema_out) {
+  int64_t n_columns = private_data->n_columns;
+  NANOARROW_RETURN_NOT_OK(ArrowSchemaInit(schema_out, NANOARROW_TYPE_STRUCT));
+  NANOARROW_RETURN_NOT_OK(ArrowSchemaAllocateChildren(schema_out, n_columns));
+
+  for (int64_t j = 0; j < n_columns; j++) {
+    int i = private_data->column_index[j];
     const char* name = sqlite3_column_name(stmt, i);
+
+    struct ArrowSQLite3ColumnHandler* handler =
+        ArrowSQLite3FindHandler(private_data, name);
+    if (handler != NULL) {
+      NANOARROW_RETURN_NOT_OK(
+          handler->init_schema(handler, name, schema_out->children[j]));
+      continue;
+    }
+
     const char* declared_type = sqlite3_column_decltype(stmt, i);
-    int first_value_type = sqlite3_column_type(stmt, i);
+    int first_value_type =
+        value_types == NULL ? sqlite3_column_type(stmt, i) : value_types[j];
     NANOARROW_RETURN_NOT_OK(ArrowSQLite3ColumnSchema(
-        name, declared_type, first_value_type, schema_out->children[i]));
+        name, declared_type, private_data->use_declared_types, first_value_type,
+        schema_out->children[j]));
   }
 
   return 0;
 }
 
-int ArrowSQLite3ResultStep(struct ArrowSQLite3Result* result, sqlite3_stmt* stmt) {
-  struct ArrowSQLite3ResultPrivate* private_data =
-      (struct ArrowSQLite3ResultPrivate*)result->private_data;
-  private_data->error.message[0] = '\0';
+// Returns non-zero if the type of every output column is known from its declared
+// type (or its handler) such that the schema does not depend on any values.
+static int ArrowSQLite3AllTypesDeclared(struct ArrowSQLite3ResultPrivate* private_data,
+                                        sqlite3_stmt* stmt) {
+  for (int64_t j = 0; j < private_data->n_columns; j++) {
+    int i = private_data->column_index[j];
+    if (ArrowSQLite3FindHandler(private_data, sqlite3_column_name(stmt, i)) != NULL) {
+      continue;
+    }
 
-  // Call sqlite3_step()
-  result->step_return_code = sqlite3_step(stmt);
-  if (result->step_return_code != SQLITE_ROW && result->step_return_code != SQLITE_DONE) {
-    return EIO;
+    const char* declared_type = sqlite3_column_decltype(stmt, i);
+    if (ArrowSQLite3DeclaredType(declared_type) == NANOARROW_TYPE_UNINITIALIZED) {
+      return 0;
+    }
   }
 
-  // Make sure we have a schema
-  if (result->schema.release == NULL) {
-    NANOARROW_RETURN_NOT_OK(ArrowSQLite3GuessSchema(stmt, &result->schema));
-  }
+  return 1;
+}
 
-  // Make sure we have an array
-  if (result->array.release == NULL) {
-    NANOARROW_RETURN_NOT_OK(
-        ArrowArrayInitFromSchema(&result->array, &result->schema, &private_data->error));
-    NANOARROW_RETURN_NOT_OK(ArrowArrayStartAppending(&result->array));
+static inline int ArrowSQLite3FinishValue(struct ArrowArray* array) {
+  struct ArrowBitmap* bitmap = ArrowArrayValidityBitmap(array);
+  if (bitmap->buffer.data != NULL) {
+    NANOARROW_RETURN_NOT_OK(ArrowBitmapAppend(bitmap, 1, 1));
   }
 
-  // Check the schema
-  int n_col = sqlite3_column_count(stmt);
-  if (n_col != result->schema.n_children) {
-    ArrowErrorSet(&private_data->error,
-                  "Expected result with %d column(s) but got result with %d column(s)",
-                  (int)result->schema.n_children, (int)n_col);
-    return EINVAL;
-  }
+  array->length++;
+  return NANOARROW_OK;
+}
+
+static int ArrowSQLite3AppendGeneric(struct ArrowSQLite3ResultPrivate* private_data,
+                                     struct ArrowSQLite3Column* column,
+                                     struct ArrowArray* array, sqlite3_stmt* stmt,
+                                     int i, int value_type) {
+  struct ArrowStringView string_view;
+  struct ArrowBufferView buffer_view;
+
+  switch (value_type) {
+    case SQLITE_NULL:
+      return ArrowArrayAppendNull(array, 1);
+
+    case SQLITE_INTEGER:
+      return ArrowArrayAppendInt(array, sqlite3_column_int64(stmt, i));
+
+    case SQLITE_FLOAT:
+      return ArrowArrayAppendDouble(array, sqlite3_column_double(stmt, i));
+
+    case SQLITE_BLOB:
+      buffer_view.data.data = sqlite3_column_blob(stmt, i);
+      buffer_view.n_bytes = sqlite3_column_bytes(stmt, i);
+      private_data->variable_bytes += buffer_view.n_bytes;
+      return ArrowArrayAppendBytes(array, buffer_view);
+
+    case SQLITE_TEXT:
+      string_view.data = (const char*)sqlite3_column_text(stmt, i);
+      string_view.n_bytes = sqlite3_column_bytes(stmt, i);
+      private_data->variable_bytes += string_view.n_bytes;
+      return ArrowArrayAppendString(array, string_view);
+
+    default:
+      return EIO;
+  }
+}
+
+static int ArrowSQLite3AppendNA(struct ArrowSQLite3ResultPrivate* private_data,
+                                struct ArrowSQLite3Column* column,
+                                struct ArrowArray* array, sqlite3_stmt* stmt, int i,
+                                int value_type) {
+  if (value_type != SQLITE_NULL) {
+    return EINVAL;
+  }
+
+  array->length++;
+  array->null_count++;
+  return NANOARROW_OK;
+}
+
+static int ArrowSQLite3AppendInt64(struct ArrowSQLite3ResultPrivate* private_data,
+                                   struct ArrowSQLite3Column* column,
+                                   struct ArrowArray* array, sqlite3_stmt* stmt, int i,
+                                   int value_type) {
+  switch (value_type) {
+    case SQLITE_INTEGER: {
+      int64_t value = sqlite3_column_int64(stmt, i);
+      NANOARROW_RETURN_NOT_OK(
+          ArrowBufferAppend(ArrowArrayBuffer(array, 1), &value, sizeof(int64_t)));
+      return ArrowSQLite3FinishValue(array);
+    }
+    case SQLITE_NULL:
+      return ArrowArrayAppendNull(array, 1);
+    default:
+      return EINVAL;
+  }
+}
+
+static int ArrowSQLite3AppendInt32(struct ArrowSQLite3ResultPrivate* private_data,
+                                   struct ArrowSQLite3Column* column,
+                                   struct ArrowArray* array, sqlite3_stmt* stmt, int i,
+                                   int value_type) {
+  switch (value_type) {
+    case SQLITE_INTEGER: {
+      int64_t value = sqlite3_column_int64(stmt, i);
+      _NANOARROW_CHECK_RANGE(value, INT32_MIN, INT32_MAX);
+      NANOARROW_RETURN_NOT_OK(ArrowBufferAppendInt32(ArrowArrayBuffer(array, 1), value));
+      return ArrowSQLite3FinishValue(array);
+    }
+    case SQLITE_NULL:
+      return ArrowArrayAppendNull(array, 1);
+    default:
+      return EINVAL;
+  }
+}
+
+static int ArrowSQLite3AppendInt16(struct ArrowSQLite3ResultPrivate* private_data,
+                                   struct ArrowSQLite3Column* column,
+                                   struct ArrowArray* array, sqlite3_stmt* stmt, int i,
+                                   int value_type) {
+  switch (value_type) {
+    case SQLITE_INTEGER: {
+      int64_t value = sqlite3_column_int64(stmt, i);
+      _NANOARROW_CHECK_RANGE(value, INT16_MIN, INT16_MAX);
+      NANOARROW_RETURN_NOT_OK(ArrowBufferAppendInt16(ArrowArrayBuffer(array, 1), value));
+      return ArrowSQLite3FinishValue(array);
+    }
+    case SQLITE_NULL:
+      return ArrowArrayAppendNull(array, 1);
+    default:
+      return EINVAL;
+  }
+}
+
+static int ArrowSQLite3AppendInt8(struct ArrowSQLite3ResultPrivate* private_data,
+                                  struct ArrowSQLite3Column* column,
+                                  struct ArrowArray* array, sqlite3_stmt* stmt, int i,
+                                  int value_type) {
+  switch (value_type) {
+    case SQLITE_INTEGER: {
+      int64_t value = sqlite3_column_int64(stmt, i);
+      _NANOARROW_CHECK_RANGE(value, INT8_MIN, INT8_MAX);
+      NANOARROW_RETURN_NOT_OK(ArrowBufferAppendInt8(ArrowArrayBuffer(array, 1), value));
+      return ArrowSQLite3FinishValue(array);
+    }
+    case SQLITE_NULL:
+      return ArrowArrayAppendNull(array, 1);
+    default:
+      return EINVAL;
+  }
+}
+
+static int ArrowSQLite3AppendBool(struct ArrowSQLite3ResultPrivate* private_data,
+                                  struct ArrowSQLite3Column* column,
+                                  struct ArrowArray* array, sqlite3_stmt* stmt, int i,
+                                  int value_type) {
+  switch (value_type) {
+    case SQLITE_INTEGER: {
+      int64_t value = sqlite3_column_int64(stmt, i);
+      NANOARROW_RETURN_NOT_OK(_ArrowArrayAppendBits(array, 1, value != 0, 1));
+      return ArrowSQLite3FinishValue(array);
+    }
+    case SQLITE_NULL:
+      return ArrowArrayAppendNull(array, 1);
+    default:
+      return EINVAL;
+  }
+}
+
+static int ArrowSQLite3AppendDouble(struct ArrowSQLite3ResultPrivate* private_data,
+                                    struct ArrowSQLite3Column* column,
+                                    struct ArrowArray* array, sqlite3_stmt* stmt, int i,
+                                    int value_type) {
+  double value;
+
+  switch (value_type) {
+    case SQLITE_INTEGER:
+      value = (double)sqlite3_column_int64(stmt, i);
+      break;
+    case SQLITE_FLOAT:
+      value = sqlite3_column_double(stmt, i);
+      break;
+    case SQLITE_NULL:
+      return ArrowArrayAppendNull(array, 1);
+    default:
+      return EINVAL;
+  }
+
+  NANOARROW_RETURN_NOT_OK(
+      ArrowBufferAppend(ArrowArrayBuffer(array, 1), &value, sizeof(double)));
+  return ArrowSQLite3FinishValue(array);
+}
+
+static int ArrowSQLite3AppendFloat(struct ArrowSQLite3ResultPrivate* private_data,
+                                   struct ArrowSQLite3Column* column,
+                                   struct ArrowArray* array, sqlite3_stmt* stmt, int i,
+                                   int value_type) {
+  double value;
+
+  switch (value_type) {
+    case SQLITE_INTEGER:
+      value = (double)sqlite3_column_int64(stmt, i);
+      break;
+    case SQLITE_FLOAT:
+      value = sqlite3_column_double(stmt, i);
+      // Infinity (which SQLite stores as a REAL) is a float too
+      if (isfinite(value)) {
+        _NANOARROW_CHECK_RANGE(value, -FLT_MAX, FLT_MAX);
+      }
+      break;
+    case SQLITE_NULL:
+      return ArrowArrayAppendNull(array, 1);
+    default:
+      return EINVAL;
+  }
+
+  NANOARROW_RETURN_NOT_OK(ArrowBufferAppendFloat(ArrowArrayBuffer(array, 1), value));
+  return ArrowSQLite3FinishValue(array);
+}
+
+// Numbers are only appended to string and binary columns (as text, using sqlite3's
+// conversion) if the column type was chosen to hold them: when types are widened or
+// guessed from several rows
+static inline int ArrowSQLite3NumbersAsText(
+    struct ArrowSQLite3ResultPrivate* private_data) {
+  return private_data->widen_types || private_data->guessed_from_rows;
+}
+
+static int ArrowSQLite3AppendUtf8(struct ArrowSQLite3ResultPrivate* private_data,
+                                  struct ArrowSQLite3Column* column,
+                                  struct ArrowArray* array, sqlite3_stmt* stmt, int i,
+                                  int value_type) {
+  switch (value_type) {
+    case SQLITE_INTEGER:
+    case SQLITE_FLOAT:
+      if (!ArrowSQLite3NumbersAsText(private_data)) {
+        return EINVAL;
+      }
+      break;
+    case SQLITE_TEXT:
+      break;
+    case SQLITE_NULL:
+      return ArrowArrayAppendNull(array, 1);
+    default:
+      return EINVAL;
+  }
+
+  const void* data = sqlite3_column_text(stmt, i);
+  int32_t n_bytes = sqlite3_column_bytes(stmt, i);
+  struct ArrowBuffer* offset_buffer = ArrowArrayBuffer(array, 1);
+  int32_t offset = ((int32_t*)offset_buffer->data)[array->length];
+  if (offset > (INT32_MAX - n_bytes)) {
+    return EINVAL;
+  }
+
+  offset += n_bytes;
+  NANOARROW_RETURN_NOT_OK(ArrowBufferAppend(offset_buffer, &offset, sizeof(int32_t)));
+  NANOARROW_RETURN_NOT_OK(ArrowBufferAppend(ArrowArrayBuffer(array, 2), data, n_bytes));
+  private_data->variable_bytes += n_bytes;
+  return ArrowSQLite3FinishValue(array);
+}
+
+static int ArrowSQLite3AppendLargeUtf8(struct ArrowSQLite3ResultPrivate* private_data,
+                                       struct ArrowSQLite3Column* column,
+                                       struct ArrowArray* array, sqlite3_stmt* stmt,
+                                       int i, int value_type) {
+  switch (value_type) {
+    case SQLITE_INTEGER:
+    case SQLITE_FLOAT:
+      if (!ArrowSQLite3NumbersAsText(private_data)) {
+        return EINVAL;
+      }
+      break;
+    case SQLITE_TEXT:
+      break;
+    case SQLITE_NULL:
+      return ArrowArrayAppendNull(array, 1);
+    default:
+      return EINVAL;
+  }
+
+  const void* data = sqlite3_column_text(stmt, i);
+  int64_t n_bytes = sqlite3_column_bytes(stmt, i);
+  struct ArrowBuffer* offset_buffer = ArrowArrayBuffer(array, 1);
+  int64_t offset = ((int64_t*)offset_buffer->data)[array->length] + n_bytes;
+  NANOARROW_RETURN_NOT_OK(ArrowBufferAppend(offset_buffer, &offset, sizeof(int64_t)));
+  NANOARROW_RETURN_NOT_OK(ArrowBufferAppend(ArrowArrayBuffer(array, 2), data, n_bytes));
+  private_data->variable_bytes += n_bytes;
+  return ArrowSQLite3FinishValue(array);
+}
+
+static int ArrowSQLite3AppendBinary(struct ArrowSQLite3ResultPrivate* private_data,
+                                    struct ArrowSQLite3Column* column,
+                                    struct ArrowArray* array, sqlite3_stmt* stmt, int i,
+                                    int value_type) {
+  switch (value_type) {
+    case SQLITE_INTEGER:
+    case SQLITE_FLOAT:
+      if (!ArrowSQLite3NumbersAsText(private_data)) {
+        return EINVAL;
+      }
+      break;
+    case SQLITE_BLOB:
+    case SQLITE_TEXT:
+      break;
+    case SQLITE_NULL:
+      return ArrowArrayAppendNull(array, 1);
+    default:
+      return EINVAL;
+  }
+
+  const void* data = sqlite3_column_blob(stmt, i);
+  int32_t n_bytes = sqlite3_column_bytes(stmt, i);
+  struct ArrowBuffer* offset_buffer = ArrowArrayBuffer(array, 1);
+  int32_t offset = ((int32_t*)offset_buffer->data)[array->length];
+  if (offset > (INT32_MAX - n_bytes)) {
+    return EINVAL;
+  }
+
+  offset += n_bytes;
+  NANOARROW_RETURN_NOT_OK(ArrowBufferAppend(offset_buffer, &offset, sizeof(int32_t)));
+  NANOARROW_RETURN_NOT_OK(ArrowBufferAppend(ArrowArrayBuffer(array, 2), data, n_bytes));
+  private_data->variable_bytes += n_bytes;
+  return ArrowSQLite3FinishValue(array);
+}
+
+static int ArrowSQLite3AppendLargeBinary(struct ArrowSQLite3ResultPrivate* private_data,
+                                         struct ArrowSQLite3Column* column,
+                                         struct ArrowArray* array, sqlite3_stmt* stmt,
+                                         int i, int value_type) {
+  switch (value_type) {
+    case SQLITE_INTEGER:
+    case SQLITE_FLOAT:
+      if (!ArrowSQLite3NumbersAsText(private_data)) {
+        return EINVAL;
+      }
+      break;
+    case SQLITE_BLOB:
+    case SQLITE_TEXT:
+      break;
+    case SQLITE_NULL:
+      return ArrowArrayAppendNull(array, 1);
+    default:
+      return EINVAL;
+  }
+
+  const void* data = sqlite3_column_blob(stmt, i);
+  int64_t n_bytes = sqlite3_column_bytes(stmt, i);
+  struct ArrowBuffer* offset_buffer = ArrowArrayBuffer(array, 1);
+  int64_t offset = ((int64_t*)offset_buffer->data)[array->length] + n_bytes;
+  NANOARROW_RETURN_NOT_OK(ArrowBufferAppend(offset_buffer, &offset, sizeof(int64_t)));
+  NANOARROW_RETURN_NOT_OK(ArrowBufferAppend(ArrowArrayBuffer(array, 2), data, n_bytes));
+  private_data->variable_bytes += n_bytes;
+  return ArrowSQLite3FinishValue(array);
+}
+
+// Appends to a dense union with the children of ArrowSQLite3MixedSchema() such that
+// each value keeps its storage class
+static int ArrowSQLite3AppendMixed(struct ArrowSQLite3ResultPrivate* private_data,
+                                   struct ArrowSQLite3Column* column,
+                                   struct ArrowArray* array, sqlite3_stmt* stmt, int i,
+                                   int value_type) {
+  int8_t type_id = value_type == SQLITE_NULL ? SQLITE_INTEGER : (int8_t)value_type;
+  struct ArrowArray* child = array->children[type_id - 1];
+  int32_t offset = (int32_t)child->length;
+
+  // Values of fixed-width children are not part of the fixed row size
+  switch (value_type) {
+    case SQLITE_NULL:
+    case SQLITE_INTEGER:
+      NANOARROW_RETURN_NOT_OK(
+          ArrowSQLite3AppendInt64(private_data, column, child, stmt, i, value_type));
+      private_data->variable_bytes += sizeof(int64_t);
+      break;
+    case SQLITE_FLOAT:
+      NANOARROW_RETURN_NOT_OK(
+          ArrowSQLite3AppendDouble(private_data, column, child, stmt, i, value_type));
+      private_data->variable_bytes += sizeof(double);
+      break;
+    case SQLITE_TEXT:
+      NANOARROW_RETURN_NOT_OK(
+          ArrowSQLite3AppendUtf8(private_data, column, child, stmt, i, value_type));
+      private_data->variable_bytes += sizeof(int32_t);
+      break;
+    case SQLITE_BLOB:
+      NANOARROW_RETURN_NOT_OK(
+          ArrowSQLite3AppendBinary(private_data, column, child, stmt, i, value_type));
+      private_data->variable_bytes += sizeof(int32_t);
+      break;
+    default:
+      return EINVAL;
+  }
+
+  NANOARROW_RETURN_NOT_OK(ArrowBufferAppendInt8(ArrowArrayBuffer(array, 0), type_id));
+  NANOARROW_RETURN_NOT_OK(ArrowBufferAppendInt32(ArrowArrayBuffer(array, 1), offset));
+  array->length++;
+  return NANOARROW_OK;
+}
+
+static int ArrowSQLite3AppendHandler(struct ArrowSQLite3ResultPrivate* private_data,
+                                     struct ArrowSQLite3Column* column,
+                                     struct ArrowArray* array, sqlite3_stmt* stmt, int i,
+                                     int value_type) {
+  return column->handler->append(column->handler, array, stmt, i, value_type,
+                                 &private_data->variable_bytes);
+}
 
-  // If there are no rows left, we're done!
-  if (result->step_return_code == SQLITE_DONE) {
+static int ArrowSQLite3IsMixed(struct ArrowArray* array, struct ArrowSchema* schema) {
+  if (strcmp(schema->format, ARROW_SQLITE3_UNION_FORMAT) != 0 ||
+      array->n_children != 4) {
     return 0;
   }
 
-  // Loop through columns and append to each child array
-  // Instead of using sqlite3_column_type(), we use the type most appropriate
-  // for the column type specified by schema so we can leverage sqlite3's facilities
-  // for type conversion.
-  struct ArrowStringView string_view;
-  struct ArrowBufferView buffer_view;
-  int result_code;
+  enum ArrowType child_types[] = {NANOARROW_TYPE_INT64, NANOARROW_TYPE_DOUBLE,
+                                  NANOARROW_TYPE_STRING, NANOARROW_TYPE_BINARY};
+  for (int64_t i = 0; i < 4; i++) {
+    struct ArrowArrayPrivateData* child_private =
+        (struct ArrowArrayPrivateData*)array->children[i]->private_data;
+    if (child_private->storage_type != child_types[i]) {
+      return 0;
+    }
+  }
 
-  for (int i = 0; i < n_col; i++) {
-    switch (sqlite3_column_type(stmt, i)) {
-      case SQLITE_NULL:
-        result_code = ArrowArrayAppendNull(result->array.children[i], 1);
-        break;
+  return 1;
+}
 
-      case SQLITE_INTEGER:
-        result_code =
-            ArrowArrayAppendInt(result->array.children[i], sqlite3_column_int64(stmt, i));
-        break;
+static ArrowSQLite3AppendFunc ArrowSQLite3ResolveAppender(struct ArrowArray* array,
+                                                          struct ArrowSchema* schema) {
+  struct ArrowArrayPrivateData* array_private =
+      (struct ArrowArrayPrivateData*)array->private_data;
 
-      case SQLITE_FLOAT:
-        result_code = ArrowArrayAppendDouble(result->array.children[i],
-                                             sqlite3_column_double(stmt, i));
-        break;
+  switch (array_private->storage_type) {
+    case NANOARROW_TYPE_NA:
+      return &ArrowSQLite3AppendNA;
+    case NANOARROW_TYPE_INT64:
+      return &ArrowSQLite3AppendInt64;
+    case NANOARROW_TYPE_INT32:
+      return &ArrowSQLite3AppendInt32;
+    case NANOARROW_TYPE_INT16:
+      return &ArrowSQLite3AppendInt16;
+    case NANOARROW_TYPE_INT8:
+      return &ArrowSQLite3AppendInt8;
+    case NANOARROW_TYPE_BOOL:
+      return &ArrowSQLite3AppendBool;
+    case NANOARROW_TYPE_DOUBLE:
+      return &ArrowSQLite3AppendDouble;
+    case NANOARROW_TYPE_FLOAT:
+      return &ArrowSQLite3AppendFloat;
+    case NANOARROW_TYPE_STRING:
+      return &ArrowSQLite3AppendUtf8;
+    case NANOARROW_TYPE_LARGE_STRING:
+      return &ArrowSQLite3AppendLargeUtf8;
+    case NANOARROW_TYPE_BINARY:
+      return &ArrowSQLite3AppendBinary;
+    case NANOARROW_TYPE_LARGE_BINARY:
+      return &ArrowSQLite3AppendLargeBinary;
+    case NANOARROW_TYPE_DENSE_UNION:
+      if (ArrowSQLite3IsMixed(array, schema)) {
+        return &ArrowSQLite3AppendMixed;
+      } else {
+        return &ArrowSQLite3AppendGeneric;
+      }
+    default:
+      return &ArrowSQLite3AppendGeneric;
+  }
+}
 
-      case SQLITE_BLOB:
-        buffer_view.n_bytes = sqlite3_column_bytes(stmt, i);
-        buffer_view.data.data = sqlite3_column_blob(stmt, i);
-        result_code = ArrowArrayAppendBytes(result->array.children[i], buffer_view);
-        break;
+static int ArrowSQLite3ResolveColumns(struct ArrowSQLite3ResultPrivate* private_data,
+                                      struct ArrowArray* array,
+                                      struct ArrowSchema* schema) {
+  private_data->columns = (struct ArrowSQLite3Column*)ArrowMalloc(
+      array->n_children * sizeof(struct ArrowSQLite3Column));
+  if (private_data->columns == NULL && array->n_children > 0) {
+    return ENOMEM;
+  }
 
-      case SQLITE_TEXT:
-        string_view.n_bytes = sqlite3_column_bytes(stmt, i);
-        string_view.data = (const char*)sqlite3_column_text(stmt, i);
-        result_code = ArrowArrayAppendString(result->array.children[i], string_view);
-        break;
+  for (int64_t i = 0; i < array->n_children; i++) {
+    struct ArrowSQLite3ColumnHandler* handler =
+        ArrowSQLite3FindHandler(private_data, schema->children[i]->name);
+    if (handler != NULL) {
+      private_data->columns[i].append = &ArrowSQLite3AppendHandler;
+    } else {
+      private_data->columns[i].append =
+          ArrowSQLite3ResolveAppender(array->children[i], schema->children[i]);
+    }
 
-      default:
-        result_code = EIO;
-        break;
+    private_data->columns[i].avg_value_bytes = 0;
+    private_data->columns[i].handler = handler;
+  }
+
+  return NANOARROW_OK;
+}
+
+// Reserve space for the expected number of rows in all columns of a newly
+// initialized array to avoid repeatedly growing each buffer while appending. With a
+// max_batch_bytes budget, no more is reserved than a batch can hold before it is full.
+static int ArrowSQLite3ResultReserve(struct ArrowSQLite3Result* result) {
+  struct ArrowSQLite3ResultPrivate* private_data =
+      (struct ArrowSQLite3ResultPrivate*)result->private_data;
+  int64_t n_rows = private_data->row_count_hint;
+  int64_t max_batch_bytes = private_data->max_batch_bytes;
+
+  if (max_batch_bytes > 0) {
+    int64_t row_bytes = (private_data->fixed_row_bits + 7) / 8;
+    for (int64_t i = 0; i < result->array.n_children; i++) {
+      row_bytes += private_data->columns[i].avg_value_bytes;
     }
 
-    if (result_code != NANOARROW_OK) {
-      // Set a decent error message
-      const char* sqlite_val_type_char;
-      switch (sqlite3_column_type(stmt, i)) {
-        case SQLITE_NULL:
-          sqlite_val_type_char = "SQLITE_NULL";
-          break;
-        case SQLITE_INTEGER:
-          sqlite_val_type_char = "SQLITE_INTEGER";
-          break;
-        case SQLITE_FLOAT:
-          sqlite_val_type_char = "SQLITE_FLOAT";
-          break;
-        case SQLITE_BLOB:
-          sqlite_val_type_char = "SQLITE_BLOB";
-          break;
-        case SQLITE_TEXT:
-          sqlite_val_type_char = "SQLITE_TEXT";
-          break;
-        default:
-          sqlite_val_type_char = "Unknown";
+    // The row that reaches the budget is part of the batch
+    if (row_bytes > 0 && n_rows > max_batch_bytes / row_bytes + 1) {
+      n_rows = max_batch_bytes / row_bytes + 1;
+    }
+  }
+
+  NANOARROW_RETURN_NOT_OK(ArrowArrayReserve(&result->array, n_rows));
+
+  for (int64_t i = 0; i < result->array.n_children; i++) {
+    int64_t data_bytes = private_data->columns[i].avg_value_bytes * n_rows;
+    if (max_batch_bytes > 0 && data_bytes > max_batch_bytes) {
+      data_bytes = max_batch_bytes;
+    }
+
+    if (data_bytes > 0) {
+      NANOARROW_RETURN_NOT_OK(
+          ArrowBufferReserve(ArrowArrayBuffer(result->array.children[i], 2), data_bytes));
+    }
+  }
+
+  return NANOARROW_OK;
+}
+
+static void ArrowSQLite3SetAppendError(struct ArrowSQLite3Result* result,
+                                       sqlite3_stmt* stmt, int64_t j, int i,
+                                       int value_type) {
+  struct ArrowSQLite3ResultPrivate* private_data =
+      (struct ArrowSQLite3ResultPrivate*)result->private_data;
+
+  const char* sqlite_val_type_char;
+  switch (value_type) {
+    case SQLITE_NULL:
+      sqlite_val_type_char = "SQLITE_NULL";
+      break;
+    case SQLITE_INTEGER:
+      sqlite_val_type_char = "SQLITE_INTEGER";
+      break;
+    case SQLITE_FLOAT:
+      sqlite_val_type_char = "SQLITE_FLOAT";
+      break;
+    case SQLITE_BLOB:
+      sqlite_val_type_char = "SQLITE_BLOB";
+      break;
+    case SQLITE_TEXT:
+      sqlite_val_type_char = "SQLITE_TEXT";
+      break;
+    default:
+      sqlite_val_type_char = "Unknown";
+      break;
+  }
+
+  const char* val_char = (const char*)sqlite3_column_text(stmt, i);
+  const char* dots = "";
+  int val_len = sqlite3_column_bytes(stmt, i);
+  if (val_len > 15) {
+    dots = "...";
+    val_len = 15;
+  }
+
+  ArrowErrorSet(&private_data->error,
+                "Row %ld, column %d ('%s'): \n  Can't append value '%.*s%s' (SQLite type "
+                "%s) to Arrow type with format '%s'",
+                (long)result->array.length, (int)j, result->schema.children[j]->name,
+                val_len, val_char, dots, sqlite_val_type_char,
+                result->schema.children[j]->format);
+}
+
+static int ArrowSQLite3ResolveColumnIndex(struct ArrowSQLite3ResultPrivate* private_data,
+                                          sqlite3_stmt* stmt) {
+  int n_col = sqlite3_column_count(stmt);
+
+  // Already resolved or explicitly set
+  if (private_data->column_index != NULL) {
+    for (int64_t j = 0; j < private_data->n_columns; j++) {
+      if (private_data->column_index[j] >= n_col) {
+        ArrowErrorSet(&private_data->error,
+                      "Column index %d is out of range for result with %d column(s)",
+                      private_data->column_index[j], n_col);
+        return EINVAL;
+      }
+    }
+
+    return NANOARROW_OK;
+  }
+
+  int64_t n_columns = n_col;
+  if (private_data->column_names != NULL && !private_data->exclude_column_names) {
+    n_columns = private_data->n_column_names;
+  }
+
+  private_data->column_index = (int*)ArrowMalloc(n_columns * sizeof(int));
+  if (private_data->column_index == NULL && n_columns > 0) {
+    return ENOMEM;
+  }
+
+  private_data->n_columns = 0;
+
+  if (private_data->column_names == NULL) {
+    for (int i = 0; i < n_col; i++) {
+      private_data->column_index[private_data->n_columns++] = i;
+    }
+  } else if (private_data->exclude_column_names) {
+    for (int i = 0; i < n_col; i++) {
+      int skip = 0;
+      for (int64_t k = 0; k < private_data->n_column_names; k++) {
+        if (sqlite3_stricmp(sqlite3_column_name(stmt, i),
+                            private_data->column_names[k]) == 0) {
+          skip = 1;
           break;
+        }
       }
 
-      const char* val_char = (const char*)sqlite3_column_text(stmt, i);
-      const char* dots = "";
-      int val_len = sqlite3_column_bytes(stmt, i);
-      if (val_len > 15) {
-        dots = "...";
-        val_len = 15;
+      if (!skip) {
+        private_data->column_index[private_data->n_columns++] = i;
+      }
+    }
+  } else {
+    for (int64_t k = 0; k < private_data->n_column_names; k++) {
+      int found = -1;
+      for (int i = 0; i < n_col; i++) {
+        if (sqlite3_stricmp(sqlite3_column_name(stmt, i),
+                            private_data->column_names[k]) == 0) {
+          found = i;
+          break;
+        }
       }
 
-      ArrowErrorSet(
-          &private_data->error,
-          "Row %ld, column %d ('%s'): \n  Can't append value '%.*s%s' (SQLite type "
-          "%s) to Arrow type with format '%s'",
-          result->array.length, i, result->schema.children[i]->name, val_len, val_char,
-          dots, sqlite_val_type_char, result->schema.children[i]->format);
+      if (found == -1) {
+        ArrowErrorSet(&private_data->error, "Column '%s' not found in result",
+                      private_data->column_names[k]);
+        return EINVAL;
+      }
 
-      // Attempt to leave the parent array in a consistent state with equal-length
-      // columns even if there was an error appending the value
-      ArrowArrayAppendNull(result->array.children[i], 1);
-      return result_code;
+      private_data->column_index[private_data->n_columns++] = found;
     }
   }
 
-  return ArrowArrayFinishElement(&result->array);
+  return NANOARROW_OK;
+}
+
+// Ensure that the result has a schema, an array, and appenders that are compatible
+// with the columns of stmt. stmt must have been stepped at least once. Newly
+// created arrays are reserved according to the row count hint.
+static int ArrowSQLite3ResultPrepare(struct ArrowSQLite3Result* result,
+                                     sqlite3_stmt* stmt) {
+  struct ArrowSQLite3ResultPrivate* private_data =
+      (struct ArrowSQLite3ResultPrivate*)result->private_data;
+
+  // Resolve the statement column for each output column
+  NANOARROW_RETURN_NOT_OK(ArrowSQLite3ResolveColumnIndex(private_data, stmt));
+
+  // Make sure we have a schema
+  if (result->schema.release == NULL) {
+    NANOARROW_RETURN_NOT_OK(
+        ArrowSQLite3GuessSchema(private_data, stmt, NULL, &result->schema));
+  }
+
+  // Make sure we have an array
+  int new_array = result->array.release == NULL;
+  if (new_array) {
+    NANOARROW_RETURN_NOT_OK(
+        ArrowArrayInitFromSchema(&result->array, &result->schema, &private_data->error));
+    NANOARROW_RETURN_NOT_OK(ArrowArrayStartAppending(&result->array));
+    private_data->fixed_row_bits = ArrowSQLite3FixedRowBits(&result->array);
+    private_data->variable_bytes = 0;
+  }
+
+  // Check the schema
+  if (private_data->n_columns != result->schema.n_children) {
+    ArrowErrorSet(&private_data->error,
+                  "Expected result with %d column(s) but got result with %d column(s)",
+                  (int)result->schema.n_children, (int)private_data->n_columns);
+    return EINVAL;
+  }
+
+  // Resolve the appender for each column once the output types are known
+  if (private_data->columns == NULL) {
+    NANOARROW_RETURN_NOT_OK(
+        ArrowSQLite3ResolveColumns(private_data, &result->array, &result->schema));
+  }
+
+  if (new_array && private_data->row_count_hint > 0) {
+    NANOARROW_RETURN_NOT_OK(ArrowSQLite3ResultReserve(result));
+  }
+
+  return NANOARROW_OK;
+}
+
+// Returns the type a column of type current_type must be widened to such that
+// a value with storage class value_type can be appended or
+// NANOARROW_TYPE_UNINITIALIZED if there is no such type.
+static enum ArrowType ArrowSQLite3WidenedType(enum ArrowType current_type,
+                                              int value_type) {
+  switch (current_type) {
+    case NANOARROW_TYPE_NA:
+      switch (value_type) {
+        case SQLITE_INTEGER:
+          return NANOARROW_TYPE_INT64;
+        case SQLITE_FLOAT:
+          return NANOARROW_TYPE_DOUBLE;
+        case SQLITE_TEXT:
+          return NANOARROW_TYPE_STRING;
+        case SQLITE_BLOB:
+          return NANOARROW_TYPE_BINARY;
+        default:
+          return NANOARROW_TYPE_UNINITIALIZED;
+      }
+    case NANOARROW_TYPE_BOOL:
+    case NANOARROW_TYPE_INT8:
+    case NANOARROW_TYPE_INT16:
+    case NANOARROW_TYPE_INT32:
+    case NANOARROW_TYPE_INT64:
+    case NANOARROW_TYPE_FLOAT:
+    case NANOARROW_TYPE_DOUBLE:
+      switch (value_type) {
+        case SQLITE_INTEGER:
+          return current_type == NANOARROW_TYPE_FLOAT ? NANOARROW_TYPE_DOUBLE
+                                                      : NANOARROW_TYPE_INT64;
+        case SQLITE_FLOAT:
+          return NANOARROW_TYPE_DOUBLE;
+        case SQLITE_TEXT:
+          return NANOARROW_TYPE_STRING;
+        case SQLITE_BLOB:
+          return NANOARROW_TYPE_BINARY;
+        default:
+          return NANOARROW_TYPE_UNINITIALIZED;
+      }
+    case NANOARROW_TYPE_STRING:
+      return value_type == SQLITE_BLOB ? NANOARROW_TYPE_BINARY
+                                       : NANOARROW_TYPE_UNINITIALIZED;
+    case NANOARROW_TYPE_LARGE_STRING:
+      return value_type == SQLITE_BLOB ? NANOARROW_TYPE_LARGE_BINARY
+                                       : NANOARROW_TYPE_UNINITIALIZED;
+    default:
+      return NANOARROW_TYPE_UNINITIALIZED;
+  }
+}
+
+// Append the k-th value of a (numeric, boolean, string, or null) array that is being
+// built to an array of a wider type. Numbers are converted to strings like SQLite
+// does and strings are copied as is.
+static int ArrowSQLite3AppendWidened(struct ArrowArray* array, int64_t k,
+                                     struct ArrowArray* out) {
+  struct ArrowArrayPrivateData* array_private =
+      (struct ArrowArrayPrivateData*)array->private_data;
+  struct ArrowArrayPrivateData* out_private =
+      (struct ArrowArrayPrivateData*)out->private_data;
+  enum ArrowType type = array_private->storage_type;
+
+  const uint8_t* validity = ArrowArrayValidityBitmap(array)->buffer.data;
+  if (type == NANOARROW_TYPE_NA || (validity != NULL && !ArrowBitGet(validity, k))) {
+    return ArrowArrayAppendNull(out, 1);
+  }
+
+  const void* data = ArrowArrayBuffer(array, 1)->data;
+  if (type == NANOARROW_TYPE_STRING || type == NANOARROW_TYPE_LARGE_STRING) {
+    int64_t start = type == NANOARROW_TYPE_STRING ? ((const int32_t*)data)[k]
+                                                  : ((const int64_t*)data)[k];
+    int64_t end = type == NANOARROW_TYPE_STRING ? ((const int32_t*)data)[k + 1]
+                                                : ((const int64_t*)data)[k + 1];
+    struct ArrowBufferView value;
+    value.data.as_uint8 = ArrowArrayBuffer(array, 2)->data + start;
+    value.n_bytes = end - start;
+    return ArrowArrayAppendBytes(out, value);
+  }
+
+  int is_double = 0;
+  int64_t int_value = 0;
+  double double_value = 0;
+
+  switch (type) {
+    case NANOARROW_TYPE_BOOL:
+      int_value = ArrowBitGet((const uint8_t*)data, k);
+      break;
+    case NANOARROW_TYPE_INT8:
+      int_value = ((const int8_t*)data)[k];
+      break;
+    case NANOARROW_TYPE_INT16:
+      int_value = ((const int16_t*)data)[k];
+      break;
+    case NANOARROW_TYPE_INT32:
+      int_value = ((const int32_t*)data)[k];
+      break;
+    case NANOARROW_TYPE_INT64:
+      int_value = ((const int64_t*)data)[k];
+      break;
+    case NANOARROW_TYPE_FLOAT:
+      is_double = 1;
+      double_value = ((const float*)data)[k];
+      break;
+    case NANOARROW_TYPE_DOUBLE:
+      is_double = 1;
+      double_value = ((const double*)data)[k];
+      break;
+    default:
+      return EINVAL;
+  }
+
+  switch (out_private->storage_type) {
+    case NANOARROW_TYPE_INT64:
+      return ArrowArrayAppendInt(out, int_value);
+    case NANOARROW_TYPE_DOUBLE:
+      return ArrowArrayAppendDouble(out, is_double ? double_value : (double)int_value);
+    case NANOARROW_TYPE_STRING:
+    case NANOARROW_TYPE_BINARY: {
+      char chars[64];
+      if (is_double) {
+        sqlite3_snprintf(sizeof(chars), chars, "%!.15g", double_value);
+      } else {
+        sqlite3_snprintf(sizeof(chars), chars, "%lld", (long long)int_value);
+      }
+
+      struct ArrowBufferView value;
+      value.data.data = chars;
+      value.n_bytes = (int64_t)strlen(chars);
+      return ArrowArrayAppendBytes(out, value);
+    }
+    default:
+      return EINVAL;
+  }
+}
+
+// Replace column j of the result with a column of a type that can also hold values
+// with storage class value_type, converting the values appended so far. The original
+// type is recorded in the nanoarrow_sqlite3.widened_from metadata key.
+static int ArrowSQLite3ResultWidenColumn(struct ArrowSQLite3Result* result, int64_t j,
+                                         int value_type) {
+  struct ArrowSQLite3ResultPrivate* private_data =
+      (struct ArrowSQLite3ResultPrivate*)result->private_data;
+  struct ArrowArray* child = result->array.children[j];
+  struct ArrowSchema* child_schema = result->schema.children[j];
+  struct ArrowArrayPrivateData* child_private =
+      (struct ArrowArrayPrivateData*)child->private_data;
+
+  enum ArrowType from_type = child_private->storage_type;
+  enum ArrowType type = ArrowSQLite3WidenedType(from_type, value_type);
+  if (type == NANOARROW_TYPE_UNINITIALIZED) {
+    return EINVAL;
+  }
+
+  // Consumers of a schema that was already exported would misinterpret the widened
+  // column
+  if (private_data->schema_exported) {
+    return ENOTSUP;
+  }
+
+  struct ArrowSchema widened_schema;
+  NANOARROW_RETURN_NOT_OK(ArrowSchemaInit(&widened_schema, type));
+  widened_schema.flags = child_schema->flags;
+
+  struct ArrowBuffer metadata;
+  int result_code = ArrowSchemaSetName(&widened_schema, child_schema->name);
+  if (result_code == NANOARROW_OK) {
+    result_code = ArrowMetadataBuilderInit(&metadata, child_schema->metadata);
+  }
+
+  if (result_code == NANOARROW_OK) {
+    struct ArrowStringView key = ArrowCharView("nanoarrow_sqlite3.widened_from");
+    if (!ArrowMetadataHasKey(child_schema->metadata, key)) {
+      result_code =
+          ArrowMetadataBuilderAppend(&metadata, key, ArrowCharView(child_schema->format));
+    }
+
+    if (result_code == NANOARROW_OK) {
+      result_code = ArrowSchemaSetMetadata(&widened_schema, (const char*)metadata.data);
+    }
+
+    ArrowBufferReset(&metadata);
+  }
+
+  if (result_code != NANOARROW_OK) {
+    widened_schema.release(&widened_schema);
+    return result_code;
+  }
+
+  struct ArrowArray widened;
+  result_code = ArrowArrayInitFromSchema(&widened, &widened_schema, &private_data->error);
+  if (result_code != NANOARROW_OK) {
+    widened_schema.release(&widened_schema);
+    return result_code;
+  }
+
+  result_code = ArrowArrayStartAppending(&widened);
+  for (int64_t k = 0; k < child->length && result_code == NANOARROW_OK; k++) {
+    result_code = ArrowSQLite3AppendWidened(child, k, &widened);
+  }
+
+  if (result_code != NANOARROW_OK) {
+    widened.release(&widened);
+    widened_schema.release(&widened_schema);
+    return result_code;
+  }
+
+  child->release(child);
+  memcpy(child, &widened, sizeof(struct ArrowArray));
+  child_schema->release(child_schema);
+  memcpy(child_schema, &widened_schema, sizeof(struct ArrowSchema));
+
+  private_data->columns[j].append = ArrowSQLite3ResolveAppender(child, child_schema);
+  private_data->columns[j].avg_value_bytes = 0;
+  private_data->fixed_row_bits = ArrowSQLite3FixedRowBits(&result->array);
+  // Values of a string column that is widened to binary were already counted
+  if ((type == NANOARROW_TYPE_STRING || type == NANOARROW_TYPE_BINARY) &&
+      from_type != NANOARROW_TYPE_STRING) {
+    private_data->variable_bytes += ArrowArrayBuffer(child, 2)->size_bytes;
+  }
+
+  return NANOARROW_OK;
+}
+
+// Append the current row of stmt to the result. ArrowSQLite3ResultPrepare() must
+// have been called for this statement.
+static inline int ArrowSQLite3ResultAppendRow(struct ArrowSQLite3Result* result,
+                                              sqlite3_stmt* stmt) {
+  struct ArrowSQLite3ResultPrivate* private_data =
+      (struct ArrowSQLite3ResultPrivate*)result->private_data;
+
+  int64_t n_col = result->array.n_children;
+  struct ArrowArray** children = result->array.children;
+  struct ArrowSQLite3Column* columns = private_data->columns;
+  const int* column_index = private_data->column_index;
+  int value_type;
+  int result_code;
+
+  // Columns that are not part of the projection are never read from the statement
+  for (int64_t j = 0; j < n_col; j++) {
+    int i = column_index[j];
+    value_type = sqlite3_column_type(stmt, i);
+    result_code =
+        columns[j].append(private_data, &columns[j], children[j], stmt, i, value_type);
+
+    if (result_code == EINVAL && private_data->widen_types) {
+      result_code = ArrowSQLite3ResultWidenColumn(result, j, value_type);
+      if (result_code == NANOARROW_OK) {
+        result_code = columns[j].append(private_data, &columns[j], children[j], stmt, i,
+                                        value_type);
+      }
+    }
+
+    if (result_code != NANOARROW_OK) {
+      ArrowSQLite3SetAppendError(result, stmt, j, i, value_type);
+      if (result_code == ENOTSUP) {
+        size_t n = strlen(private_data->error.message);
+        snprintf(private_data->error.message + n, sizeof(private_data->error.message) - n,
+                 " (can't widen a column after the schema was exported)");
+        result_code = EINVAL;
+      }
+
+      // Attempt to leave the parent array in a consistent state with equal-length
+      // columns even if there was an error appending the value
+      ArrowArrayAppendNull(children[j], 1);
+      return result_code;
+    }
+  }
+
+  return ArrowArrayFinishElement(&result->array);
+}
+
+// Step stmt to the next row that is kept by the row filter (if any)
+static inline int ArrowSQLite3ResultStepInternal(struct ArrowSQLite3Result* result,
+                                                 sqlite3_stmt* stmt) {
+  struct ArrowSQLite3ResultPrivate* private_data =
+      (struct ArrowSQLite3ResultPrivate*)result->private_data;
+  struct ArrowSQLite3RowFilter* filter = &private_data->filter;
+  int keep;
+
+  while (1) {
+    result->step_return_code = sqlite3_step(stmt);
+    if (result->step_return_code != SQLITE_ROW &&
+        result->step_return_code != SQLITE_DONE) {
+      ArrowErrorSet(&private_data->error, "<%s> %s",
+                    sqlite3_errstr(result->step_return_code),
+                    sqlite3_errmsg(sqlite3_db_handle(stmt)));
+      return EIO;
+    }
+
+    if (result->step_return_code == SQLITE_DONE || filter->filter == NULL) {
+      return NANOARROW_OK;
+    }
+
+    keep = 1;
+    NANOARROW_RETURN_NOT_OK(filter->filter(
+        filter, stmt, &keep, (struct ArrowSQLite3Error*)&private_data->error));
+    if (keep) {
+      return NANOARROW_OK;
+    }
+  }
+}
+
+// Set the schema from the declared types of stmt if declared types are used and the
+// type of every column is known from its declared type. This does not require stmt
+// to have been stepped.
+static int ArrowSQLite3ResultDeclareSchema(struct ArrowSQLite3Result* result,
+                                           sqlite3_stmt* stmt) {
+  struct ArrowSQLite3ResultPrivate* private_data =
+      (struct ArrowSQLite3ResultPrivate*)result->private_data;
+
+  if (!private_data->use_declared_types || result->schema.release != NULL) {
+    return NANOARROW_OK;
+  }
+
+  NANOARROW_RETURN_NOT_OK(ArrowSQLite3ResolveColumnIndex(private_data, stmt));
+  if (!ArrowSQLite3AllTypesDeclared(private_data, stmt)) {
+    return NANOARROW_OK;
+  }
+
+  return ArrowSQLite3GuessSchema(private_data, stmt, NULL, &result->schema);
+}
+
+// Step through up to guess_rows rows of stmt (which must be positioned on its first
+// row), keeping a copy of each value, and guess the schema from the widest storage
+// class seen in each column. The buffered rows are appended by
+// ArrowSQLite3ResultReplayRows() so that each query only has to be executed once.
+static int ArrowSQLite3ResultBufferRows(struct ArrowSQLite3Result* result,
+                                        sqlite3_stmt* stmt) {
+  struct ArrowSQLite3ResultPrivate* private_data =
+      (struct ArrowSQLite3ResultPrivate*)result->private_data;
+  struct ArrowSQLite3BufferedRows* buffered = &private_data->buffered;
+
+  NANOARROW_RETURN_NOT_OK(ArrowSQLite3ResolveColumnIndex(private_data, stmt));
+  const int* column_index = private_data->column_index;
+  int64_t n_columns = private_data->n_columns;
+
+  // Nothing to guess if the schema follows from the declared types
+  NANOARROW_RETURN_NOT_OK(ArrowSQLite3ResultDeclareSchema(result, stmt));
+  if (result->schema.release != NULL) {
+    return NANOARROW_OK;
+  }
+
+  int* value_types = (int*)ArrowMalloc(n_columns * sizeof(int));
+  if (value_types == NULL && n_columns > 0) {
+    return ENOMEM;
+  }
+
+  for (int64_t j = 0; j < n_columns; j++) {
+    value_types[j] = SQLITE_NULL;
+  }
+
+  int result_code = NANOARROW_OK;
+  while (result->step_return_code == SQLITE_ROW) {
+    result_code =
+        ArrowBufferReserve(&buffered->values, n_columns * sizeof(sqlite3_value*));
+    if (result_code != NANOARROW_OK) {
+      break;
+    }
+
+    for (int64_t j = 0; j < n_columns; j++) {
+      sqlite3_value* value =
+          sqlite3_value_dup(sqlite3_column_value(stmt, column_index[j]));
+      if (value == NULL) {
+        result_code = ENOMEM;
+        break;
+      }
+
+      ArrowBufferAppendUnsafe(&buffered->values, &value, sizeof(sqlite3_value*));
+      int value_type = sqlite3_value_type(value);
+      if (private_data->union_mixed_types && value_types[j] != SQLITE_NULL &&
+          value_type != SQLITE_NULL && value_type != value_types[j]) {
+        value_types[j] = ARROW_SQLITE3_MIXED;
+      } else if (value_types[j] != ARROW_SQLITE3_MIXED) {
+        value_types[j] = ArrowSQLite3WidenType(value_types[j], value_type);
+      }
+    }
+
+    if (result_code != NANOARROW_OK) {
+      break;
+    }
+
+    buffered->n_rows++;
+    if (buffered->n_rows >= private_data->guess_rows) {
+      break;
+    }
+
+    result_code = ArrowSQLite3ResultStepInternal(result, stmt);
+    if (result_code != NANOARROW_OK) {
+      break;
+    }
+  }
+
+  if (result_code == NANOARROW_OK) {
+    result_code =
+        ArrowSQLite3GuessSchema(private_data, stmt, value_types, &result->schema);
+    private_data->guessed_from_rows = 1;
+  }
+
+  ArrowFree(value_types);
+  NANOARROW_RETURN_NOT_OK(result_code);
+
+  // Prepare SELECT ?1, ?2, ... with one parameter for each column of stmt such that
+  // buffered values can be bound to the same column index that they came from
+  int n_col = sqlite3_column_count(stmt);
+  sqlite3_str* sql = sqlite3_str_new(sqlite3_db_handle(stmt));
+  sqlite3_str_appendall(sql, "SELECT ?1");
+  for (int i = 1; i < n_col; i++) {
+    sqlite3_str_appendf(sql, ", ?%d", i + 1);
+  }
+
+  char* sql_chars = sqlite3_str_finish(sql);
+  if (sql_chars == NULL) {
+    return ENOMEM;
+  }
+
+  result_code = sqlite3_prepare_v2(sqlite3_db_handle(stmt), sql_chars, -1,
+                                   &buffered->replay_stmt, NULL);
+  sqlite3_free(sql_chars);
+  if (result_code != SQLITE_OK) {
+    ArrowErrorSet(&private_data->error, "<%s> %s", sqlite3_errstr(result_code),
+                  sqlite3_errmsg(sqlite3_db_handle(stmt)));
+    return EIO;
+  }
+
+  buffered->step_return_code = result->step_return_code;
+  return NANOARROW_OK;
+}
+
+static int ArrowSQLite3ResultReplayRows(struct ArrowSQLite3Result* result,
+                                        int64_t max_rows, int64_t* rows_appended) {
+  struct ArrowSQLite3ResultPrivate* private_data =
+      (struct ArrowSQLite3ResultPrivate*)result->private_data;
+  struct ArrowSQLite3BufferedRows* buffered = &private_data->buffered;
+  sqlite3_stmt* replay_stmt = buffered->replay_stmt;
+  const int* column_index = private_data->column_index;
+  int64_t n_columns = private_data->n_columns;
+  sqlite3_value** values = (sqlite3_value**)buffered->values.data;
+
+  while (buffered->next_row < buffered->n_rows && *rows_appended < max_rows &&
+         !ArrowSQLite3ResultBatchFull(result)) {
+    sqlite3_reset(replay_stmt);
+    for (int64_t j = 0; j < n_columns; j++) {
+      sqlite3_bind_value(replay_stmt, column_index[j] + 1,
+                         values[buffered->next_row * n_columns + j]);
+    }
+
+    if (sqlite3_step(replay_stmt) != SQLITE_ROW) {
+      ArrowErrorSet(&private_data->error, "Failed to replay buffered row: %s",
+                    sqlite3_errmsg(sqlite3_db_handle(replay_stmt)));
+      return EIO;
+    }
+
+    NANOARROW_RETURN_NOT_OK(ArrowSQLite3ResultAppendRow(result, replay_stmt));
+    buffered->next_row++;
+    (*rows_appended)++;
+  }
+
+  return NANOARROW_OK;
+}
+
+int ArrowSQLite3ResultStepN(struct ArrowSQLite3Result* result, sqlite3_stmt* stmt,
+                            int64_t max_rows, int64_t* rows_appended) {
+  struct ArrowSQLite3ResultPrivate* private_data =
+      (struct ArrowSQLite3ResultPrivate*)result->private_data;
+  struct ArrowSQLite3BufferedRows* buffered = &private_data->buffered;
+  private_data->error.message[0] = '\0';
+  *rows_appended = 0;
+
+  if (max_rows <= 0) {
+    ArrowErrorSet(&private_data->error, "max_rows must be > 0");
+    return EINVAL;
+  }
+
+  // Step unless there are still buffered rows that need to be appended. If there
+  // is no schema yet, this may buffer more rows to guess it.
+  if (buffered->n_rows == 0) {
+    NANOARROW_RETURN_NOT_OK(ArrowSQLite3ResultStepInternal(result, stmt));
+    if (result->schema.release == NULL && private_data->guess_rows > 1 &&
+        result->step_return_code == SQLITE_ROW) {
+      NANOARROW_RETURN_NOT_OK(ArrowSQLite3ResultBufferRows(result, stmt));
+    }
+  }
+
+  NANOARROW_RETURN_NOT_OK(ArrowSQLite3ResultPrepare(result, stmt));
+
+  if (buffered->n_rows > 0) {
+    NANOARROW_RETURN_NOT_OK(
+        ArrowSQLite3ResultReplayRows(result, max_rows, rows_appended));
+    if (buffered->next_row < buffered->n_rows) {
+      result->step_return_code = SQLITE_ROW;
+      return NANOARROW_OK;
+    }
+
+    // All buffered rows were appended: stmt is either done or positioned on the
+    // last buffered row
+    result->step_return_code = buffered->step_return_code;
+    ArrowSQLite3FreeBufferedRows(buffered);
+    if (result->step_return_code == SQLITE_DONE || *rows_appended >= max_rows ||
+        ArrowSQLite3ResultBatchFull(result)) {
+      return NANOARROW_OK;
+    }
+
+    NANOARROW_RETURN_NOT_OK(ArrowSQLite3ResultStepInternal(result, stmt));
+  }
+
+  // Append rows until we've run out or we have appended enough. The last row
+  // stepped is always appended such that step_return_code == SQLITE_ROW means
+  // there may be more rows to come.
+  while (result->step_return_code == SQLITE_ROW) {
+    NANOARROW_RETURN_NOT_OK(ArrowSQLite3ResultAppendRow(result, stmt));
+    (*rows_appended)++;
+
+    if (*rows_appended >= max_rows || ArrowSQLite3ResultBatchFull(result)) {
+      break;
+    }
+
+    NANOARROW_RETURN_NOT_OK(ArrowSQLite3ResultStepInternal(result, stmt));
+  }
+
+  return NANOARROW_OK;
+}
+
+int ArrowSQLite3ResultStep(struct ArrowSQLite3Result* result, sqlite3_stmt* stmt) {
+  int64_t rows_appended;
+  return ArrowSQLite3ResultStepN(result, stmt, 1, &rows_appended);
+}
+
+struct ArrowSQLite3StreamPrivate {
+  struct ArrowSQLite3Result result;
+  sqlite3_stmt* stmt;
+  int64_t batch_rows;
+  int64_t row_count_hint;
+  int64_t rows_emitted;
+};
+
+// Before starting a new batch, set the expected number of rows for that batch from
+// the expected number of rows remaining (if known). Batches after the first one are
+// assumed to be full if the total number of rows is unknown.
+static void ArrowSQLite3StreamUpdateHint(struct ArrowSQLite3StreamPrivate* private_data) {
+  struct ArrowSQLite3ResultPrivate* result_private =
+      (struct ArrowSQLite3ResultPrivate*)private_data->result.private_data;
+  int64_t rows_remaining = private_data->row_count_hint - private_data->rows_emitted;
+
+  if (private_data->row_count_hint > 0 && rows_remaining > 0) {
+    result_private->row_count_hint = rows_remaining < private_data->batch_rows
+                                         ? rows_remaining
+                                         : private_data->batch_rows;
+  } else if (private_data->row_count_hint == 0 && private_data->rows_emitted > 0) {
+    result_private->row_count_hint = private_data->batch_rows;
+  } else {
+    result_private->row_count_hint = 0;
+  }
+}
+
+static int ArrowSQLite3StreamGetSchema(struct ArrowArrayStream* stream,
+                                       struct ArrowSchema* out) {
+  struct ArrowSQLite3StreamPrivate* private_data =
+      (struct ArrowSQLite3StreamPrivate*)stream->private_data;
+  struct ArrowSQLite3Result* result = &private_data->result;
+
+  // If we don't have a schema yet we need to step once to guess it (unless it can
+  // be built from declared types). The row that gets appended is kept and will be
+  // part of the first batch.
+  NANOARROW_RETURN_NOT_OK(ArrowSQLite3ResultDeclareSchema(result, private_data->stmt));
+  if (result->schema.release == NULL) {
+    ArrowSQLite3StreamUpdateHint(private_data);
+    NANOARROW_RETURN_NOT_OK(ArrowSQLite3ResultStep(result, private_data->stmt));
+  }
+
+  struct ArrowSQLite3ResultPrivate* result_private =
+      (struct ArrowSQLite3ResultPrivate*)result->private_data;
+  result_private->schema_exported = 1;
+  return ArrowSchemaDeepCopy(&result->schema, out);
+}
+
+static int ArrowSQLite3StreamGetNext(struct ArrowArrayStream* stream,
+                                     struct ArrowArray* out) {
+  struct ArrowSQLite3StreamPrivate* private_data =
+      (struct ArrowSQLite3StreamPrivate*)stream->private_data;
+  struct ArrowSQLite3Result* result = &private_data->result;
+
+  // A batch may have been started by get_schema(); otherwise, the array will be
+  // initialized from the (possibly guessed) schema on the first step
+  int64_t rows_appended;
+  if (result->array.release == NULL) {
+    if (result->step_return_code != SQLITE_DONE) {
+      ArrowSQLite3StreamUpdateHint(private_data);
+      NANOARROW_RETURN_NOT_OK(ArrowSQLite3ResultStepN(
+          result, private_data->stmt, private_data->batch_rows, &rows_appended));
+    }
+  } else if (result->step_return_code != SQLITE_DONE &&
+             result->array.length < private_data->batch_rows &&
+             !ArrowSQLite3ResultBatchFull(result)) {
+    NANOARROW_RETURN_NOT_OK(
+        ArrowSQLite3ResultStepN(result, private_data->stmt,
+                                private_data->batch_rows - result->array.length,
+                                &rows_appended));
+  }
+
+  // No rows left means the stream is finished
+  if (result->array.release == NULL || result->array.length == 0) {
+    if (result->array.release != NULL) {
+      result->array.release(&result->array);
+    }
+
+    out->release = NULL;
+    return NANOARROW_OK;
+  }
+
+  private_data->rows_emitted += result->array.length;
+  return ArrowSQLite3ResultFinishArray(result, out);
+}
+
+static const char* ArrowSQLite3StreamGetLastError(struct ArrowArrayStream* stream) {
+  struct ArrowSQLite3StreamPrivate* private_data =
+      (struct ArrowSQLite3StreamPrivate*)stream->private_data;
+  return ArrowSQLite3ResultError(&private_data->result);
+}
+
+static void ArrowSQLite3StreamRelease(struct ArrowArrayStream* stream) {
+  struct ArrowSQLite3StreamPrivate* private_data =
+      (struct ArrowSQLite3StreamPrivate*)stream->private_data;
+  ArrowSQLite3ResultReset(&private_data->result);
+  ArrowFree(private_data);
+  stream->release = NULL;
+}
+
+int ArrowSQLite3StreamInitFromResult(struct ArrowArrayStream* stream,
+                                     struct ArrowSQLite3Result* result,
+                                     sqlite3_stmt* stmt, int64_t batch_rows) {
+  if (stmt == NULL || batch_rows <= 0 || result->private_data == NULL ||
+      result->array.release != NULL) {
+    return EINVAL;
+  }
+
+  struct ArrowSQLite3StreamPrivate* private_data =
+      (struct ArrowSQLite3StreamPrivate*)ArrowMalloc(
+          sizeof(struct ArrowSQLite3StreamPrivate));
+  if (private_data == NULL) {
+    return ENOMEM;
+  }
+
+  // Move the result (and any options that were set on it) into the stream. The
+  // row count hint of the result is interpreted as the total number of rows.
+  memcpy(&private_data->result, result, sizeof(struct ArrowSQLite3Result));
+  private_data->row_count_hint =
+      ((struct ArrowSQLite3ResultPrivate*)result->private_data)->row_count_hint;
+  private_data->rows_emitted = 0;
+  result->schema.release = NULL;
+  result->private_data = NULL;
+
+  private_data->stmt = stmt;
+  private_data->batch_rows = batch_rows;
+
+  stream->get_schema = &ArrowSQLite3StreamGetSchema;
+  stream->get_next = &ArrowSQLite3StreamGetNext;
+  stream->get_last_error = &ArrowSQLite3StreamGetLastError;
+  stream->release = &ArrowSQLite3StreamRelease;
+  stream->private_data = private_data;
+  return NANOARROW_OK;
+}
+
+int ArrowSQLite3StreamInit(struct ArrowArrayStream* stream, sqlite3_stmt* stmt,
+                           int64_t batch_rows) {
+  struct ArrowSQLite3Result result;
+  NANOARROW_RETURN_NOT_OK(ArrowSQLite3ResultInit(&result));
+
+  int code = ArrowSQLite3StreamInitFromResult(stream, &result, stmt, batch_rows);
+  ArrowSQLite3ResultReset(&result);
+  return code;
+}
+
+int ArrowSQLite3QueryValue(sqlite3* con, const char* sql, const char* param,
+                           int64_t* int_out, double* double_out,
+                           struct ArrowSQLite3Error* error) {
+  struct ArrowError* arrow_error = (struct ArrowError*)error;
+
+  sqlite3_stmt* stmt;
+  int result = sqlite3_prepare_v2(con, sql, -1, &stmt, NULL);
+  if (result != SQLITE_OK) {
+    ArrowErrorSet(arrow_error, "<%s> %s", sqlite3_errstr(result), sqlite3_errmsg(con));
+    return EIO;
+  }
+
+  if (param != NULL) {
+    result = sqlite3_bind_text(stmt, 1, param, -1, SQLITE_STATIC);
+    if (result != SQLITE_OK) {
+      ArrowErrorSet(arrow_error, "<%s> %s", sqlite3_errstr(result), sqlite3_errmsg(con));
+      sqlite3_finalize(stmt);
+      return EIO;
+    }
+  }
+
+  int code = ENOENT;
+  result = sqlite3_step(stmt);
+  int n_col = sqlite3_column_count(stmt);
+  if (result == SQLITE_ROW) {
+    code = NANOARROW_OK;
+    for (int i = 0; i < n_col; i++) {
+      if (sqlite3_column_type(stmt, i) == SQLITE_NULL) {
+        code = ENOENT;
+      }
+    }
+
+    if (code == NANOARROW_OK && int_out != NULL) {
+      *int_out = sqlite3_column_int64(stmt, 0);
+    }
+
+    for (int i = 0; code == NANOARROW_OK && double_out != NULL && i < n_col; i++) {
+      double_out[i] = sqlite3_column_double(stmt, i);
+    }
+  } else if (result != SQLITE_DONE) {
+    ArrowErrorSet(arrow_error, "<%s> %s", sqlite3_errstr(result), sqlite3_errmsg(con));
+    code = EIO;
+  }
+
+  sqlite3_finalize(stmt);
+  return code;
+}
+
+int ArrowSQLite3EstimateRowCountSource(sqlite3* con, const char* table_name,
+                                       int64_t* row_count_out,
+                                       enum ArrowSQLite3RowCountSource* source_out) {
+  *source_out = ARROW_SQLITE3_ROW_COUNT_NONE;
+
+  // The GDAL/OGR feature count in a GeoPackage is maintained by triggers
+  int result = ArrowSQLite3QueryValue(
+      con,
+      "SELECT feature_count FROM gpkg_ogr_contents WHERE lower(table_name) = lower(?)",
+      table_name, row_count_out, NULL, NULL);
+  if (result == 0) {
+    *source_out = ARROW_SQLITE3_ROW_COUNT_OGR_CONTENTS;
+    return 0;
+  }
+
+  // Tables that have been ANALYZEd have their row count as the first integer of
+  // sqlite_stat1.stat. A partial index only counts the rows it covers, so take the
+  // largest count over the table's indexes.
+  result = ArrowSQLite3QueryValue(con,
+                                  "SELECT max(CAST(stat AS INTEGER)) FROM sqlite_stat1 "
+                                  "WHERE lower(tbl) = lower(?)",
+                                  table_name, row_count_out, NULL, NULL);
+  if (result == 0) {
+    *source_out = ARROW_SQLITE3_ROW_COUNT_SQLITE_STAT1;
+    return 0;
+  }
+
+  // For rowid tables, max(rowid) is a single b-tree lookup and is exact if rows
+  // have never been deleted
+  char* sql = sqlite3_mprintf("SELECT max(rowid) FROM \"%w\"", table_name);
+  if (sql == NULL) {
+    return ENOMEM;
+  }
+
+  result = ArrowSQLite3QueryValue(con, sql, NULL, row_count_out, NULL, NULL);
+  sqlite3_free(sql);
+  if (result == 0) {
+    *source_out = ARROW_SQLITE3_ROW_COUNT_MAX_ROWID;
+  }
+
+  return result;
+}
+
+int ArrowSQLite3EstimateRowCount(sqlite3* con, const char* table_name,
+                                 int64_t* row_count_out) {
+  enum ArrowSQLite3RowCountSource source;
+  return ArrowSQLite3EstimateRowCountSource(con, table_name, row_count_out, &source);
+}
+
+// Binders resolved once per column from the storage type of the input column. Each
+// binder binds element i of array_view to parameter param of stmt.
+typedef int (*ArrowSQLite3BindFunc)(sqlite3_stmt* stmt, int param,
+                                    struct ArrowArrayView* array_view, int64_t i);
+
+static int ArrowSQLite3BindNull(sqlite3_stmt* stmt, int param,
+                                struct ArrowArrayView* array_view, int64_t i) {
+  return sqlite3_bind_null(stmt, param);
+}
+
+static int ArrowSQLite3BindInt(sqlite3_stmt* stmt, int param,
+                               struct ArrowArrayView* array_view, int64_t i) {
+  return sqlite3_bind_int64(stmt, param, ArrowArrayViewGetIntUnsafe(array_view, i));
+}
+
+static int ArrowSQLite3BindUInt(sqlite3_stmt* stmt, int param,
+                                struct ArrowArrayView* array_view, int64_t i) {
+  // Like SQLite does for integer literals, values that don't fit in an int64 are
+  // stored as REAL
+  uint64_t value = ArrowArrayViewGetUIntUnsafe(array_view, i);
+  if (value > INT64_MAX) {
+    return sqlite3_bind_double(stmt, param, (double)value);
+  }
+
+  return sqlite3_bind_int64(stmt, param, (sqlite3_int64)value);
+}
+
+static int ArrowSQLite3BindDouble(sqlite3_stmt* stmt, int param,
+                                  struct ArrowArrayView* array_view, int64_t i) {
+  return sqlite3_bind_double(stmt, param, ArrowArrayViewGetDoubleUnsafe(array_view, i));
+}
+
+// Strings and blobs are bound without a copy since the array outlives the step
+static int ArrowSQLite3BindText(sqlite3_stmt* stmt, int param,
+                                struct ArrowArrayView* array_view, int64_t i) {
+  struct ArrowStringView value = ArrowArrayViewGetStringUnsafe(array_view, i);
+  return sqlite3_bind_text64(stmt, param, value.data, value.n_bytes, SQLITE_STATIC,
+                             SQLITE_UTF8);
+}
+
+static int ArrowSQLite3BindBlob(sqlite3_stmt* stmt, int param,
+                                struct ArrowArrayView* array_view, int64_t i) {
+  struct ArrowBufferView value = ArrowArrayViewGetBytesUnsafe(array_view, i);
+  return sqlite3_bind_blob64(stmt, param, value.data.data, value.n_bytes,
+                             SQLITE_STATIC);
+}
+
+static ArrowSQLite3BindFunc ArrowSQLite3ResolveBinder(enum ArrowType storage_type) {
+  switch (storage_type) {
+    case NANOARROW_TYPE_NA:
+      return &ArrowSQLite3BindNull;
+    case NANOARROW_TYPE_BOOL:
+    case NANOARROW_TYPE_INT8:
+    case NANOARROW_TYPE_UINT8:
+    case NANOARROW_TYPE_INT16:
+    case NANOARROW_TYPE_UINT16:
+    case NANOARROW_TYPE_INT32:
+    case NANOARROW_TYPE_UINT32:
+    case NANOARROW_TYPE_INT64:
+      return &ArrowSQLite3BindInt;
+    case NANOARROW_TYPE_UINT64:
+      return &ArrowSQLite3BindUInt;
+    case NANOARROW_TYPE_FLOAT:
+    case NANOARROW_TYPE_DOUBLE:
+      return &ArrowSQLite3BindDouble;
+    case NANOARROW_TYPE_STRING:
+    case NANOARROW_TYPE_LARGE_STRING:
+      return &ArrowSQLite3BindText;
+    case NANOARROW_TYPE_BINARY:
+    case NANOARROW_TYPE_LARGE_BINARY:
+    case NANOARROW_TYPE_FIXED_SIZE_BINARY:
+      return &ArrowSQLite3BindBlob;
+    default:
+      return NULL;
+  }
+}
+
+void ArrowSQLite3IngestOptionsInit(struct ArrowSQLite3IngestOptions* options) {
+  options->rows_per_transaction = 65536;
+}
+
+struct ArrowSQLite3Ingester {
+  sqlite3* con;
+  sqlite3_stmt* stmt;
+  struct ArrowSchema schema;
+  struct ArrowArrayView array_view;
+  ArrowSQLite3BindFunc* binders;
+  int64_t rows_per_transaction;
+  int64_t rows_in_transaction;
+  int own_transactions;
+  int in_transaction;
+  struct ArrowError* error;
+};
+
+static int ArrowSQLite3IngestExec(struct ArrowSQLite3Ingester* ingester,
+                                  const char* sql) {
+  int result = sqlite3_exec(ingester->con, sql, NULL, NULL, NULL);
+  if (result != SQLITE_OK) {
+    ArrowErrorSet(ingester->error, "<%s> %s", sqlite3_errstr(result),
+                  sqlite3_errmsg(ingester->con));
+    return EIO;
+  }
+
+  return NANOARROW_OK;
+}
+
+// Resolve a binder for each column of the stream and prepare the INSERT statement
+static int ArrowSQLite3IngestPrepare(struct ArrowSQLite3Ingester* ingester,
+                                     const char* table_name) {
+  struct ArrowSchema* schema = &ingester->schema;
+  if (strcmp(schema->format, "+s") != 0 || schema->n_children == 0) {
+    ArrowErrorSet(ingester->error, "Expected a stream of struct arrays with >= 1 column");
+    return EINVAL;
+  }
+
+  NANOARROW_RETURN_NOT_OK(
+      ArrowArrayViewInitFromSchema(&ingester->array_view, schema, ingester->error));
+
+  ingester->binders = (ArrowSQLite3BindFunc*)ArrowMalloc(
+      schema->n_children * sizeof(ArrowSQLite3BindFunc));
+  if (ingester->binders == NULL) {
+    return ENOMEM;
+  }
+
+  for (int64_t i = 0; i < schema->n_children; i++) {
+    ingester->binders[i] =
+        ArrowSQLite3ResolveBinder(ingester->array_view.children[i]->storage_type);
+    if (ingester->binders[i] == NULL) {
+      ArrowErrorSet(ingester->error, "Can't ingest column '%s' with format '%s'",
+                    schema->children[i]->name, schema->children[i]->format);
+      return ENOTSUP;
+    }
+  }
+
+  sqlite3_str* sql = sqlite3_str_new(ingester->con);
+  sqlite3_str_appendf(sql, "INSERT INTO \"%w\" (", table_name);
+  for (int64_t i = 0; i < schema->n_children; i++) {
+    const char* name = schema->children[i]->name == NULL ? "" : schema->children[i]->name;
+    sqlite3_str_appendf(sql, "%s\"%w\"", i > 0 ? ", " : "", name);
+  }
+
+  sqlite3_str_appendall(sql, ") VALUES (");
+  for (int64_t i = 0; i < schema->n_children; i++) {
+    sqlite3_str_appendf(sql, "%s?%d", i > 0 ? ", " : "", (int)i + 1);
+  }
+
+  sqlite3_str_appendall(sql, ")");
+  if (sqlite3_str_errcode(sql) != SQLITE_OK) {
+    sqlite3_free(sqlite3_str_finish(sql));
+    return ENOMEM;
+  }
+
+  char* sql_str = sqlite3_str_finish(sql);
+  int result = sqlite3_prepare_v2(ingester->con, sql_str, -1, &ingester->stmt, NULL);
+  sqlite3_free(sql_str);
+  if (result != SQLITE_OK) {
+    ArrowErrorSet(ingester->error, "<%s> %s", sqlite3_errstr(result),
+                  sqlite3_errmsg(ingester->con));
+    return EIO;
+  }
+
+  return NANOARROW_OK;
+}
+
+static int ArrowSQLite3IngestArray(struct ArrowSQLite3Ingester* ingester,
+                                   struct ArrowArray* array, int64_t* rows_inserted) {
+  NANOARROW_RETURN_NOT_OK(
+      ArrowArrayViewSetArray(&ingester->array_view, array, ingester->error));
+
+  sqlite3_stmt* stmt = ingester->stmt;
+  int64_t n_columns = ingester->array_view.n_children;
+  struct ArrowArrayView** columns = ingester->array_view.children;
+
+  for (int64_t i = 0; i < array->length; i++) {
+    if (ingester->own_transactions && !ingester->in_transaction) {
+      NANOARROW_RETURN_NOT_OK(ArrowSQLite3IngestExec(ingester, "BEGIN"));
+      ingester->in_transaction = 1;
+      ingester->rows_in_transaction = 0;
+    }
+
+    // Element views add the offset of the child array but not the one of the struct
+    int64_t row = array->offset + i;
+    int result = SQLITE_OK;
+    for (int64_t j = 0; j < n_columns && result == SQLITE_OK; j++) {
+      if (ArrowArrayViewIsNull(columns[j], row)) {
+        result = sqlite3_bind_null(stmt, (int)j + 1);
+      } else {
+        result = ingester->binders[j](stmt, (int)j + 1, columns[j], row);
+      }
+    }
+
+    if (result == SQLITE_OK) {
+      result = sqlite3_step(stmt);
+      sqlite3_reset(stmt);
+    }
+
+    if (result != SQLITE_OK && result != SQLITE_DONE) {
+      ArrowErrorSet(ingester->error, "<%s> %s", sqlite3_errstr(result),
+                    sqlite3_errmsg(ingester->con));
+      return EIO;
+    }
+
+    (*rows_inserted)++;
+    ingester->rows_in_transaction++;
+    if (ingester->in_transaction &&
+        ingester->rows_in_transaction == ingester->rows_per_transaction) {
+      NANOARROW_RETURN_NOT_OK(ArrowSQLite3IngestExec(ingester, "COMMIT"));
+      ingester->in_transaction = 0;
+    }
+  }
+
+  return NANOARROW_OK;
+}
+
+const char* ArrowSQLite3StreamError(struct ArrowArrayStream* stream, int code) {
+  const char* message = stream->get_last_error(stream);
+  return message != NULL ? message : strerror(code);
+}
+
+int ArrowSQLite3Ingest(sqlite3* con, const char* table_name,
+                       struct ArrowArrayStream* stream,
+                       const struct ArrowSQLite3IngestOptions* options,
+                       int64_t* rows_inserted, struct ArrowSQLite3Error* error) {
+  struct ArrowSQLite3IngestOptions default_options;
+  if (options == NULL) {
+    ArrowSQLite3IngestOptionsInit(&default_options);
+    options = &default_options;
+  }
+
+  struct ArrowError* arrow_error = (struct ArrowError*)error;
+  if (options->rows_per_transaction < 0) {
+    ArrowErrorSet(arrow_error, "rows_per_transaction must be >= 0");
+    return EINVAL;
+  }
+
+  int64_t rows_inserted_local = 0;
+  if (rows_inserted == NULL) {
+    rows_inserted = &rows_inserted_local;
+  }
+
+  *rows_inserted = 0;
+
+  struct ArrowSQLite3Ingester ingester;
+  memset(&ingester, 0, sizeof(struct ArrowSQLite3Ingester));
+  ingester.con = con;
+  ingester.rows_per_transaction = options->rows_per_transaction;
+  ingester.error = arrow_error;
+  ArrowArrayViewInit(&ingester.array_view, NANOARROW_TYPE_UNINITIALIZED);
+
+  // Transactions are only managed here if the caller isn't in one
+  ingester.own_transactions = sqlite3_get_autocommit(con);
+
+  int result = stream->get_schema(stream, &ingester.schema);
+  if (result != NANOARROW_OK) {
+    ArrowErrorSet(arrow_error, "get_schema() failed: %s",
+                  ArrowSQLite3StreamError(stream, result));
+  } else {
+    result = ArrowSQLite3IngestPrepare(&ingester, table_name);
+  }
+
+  struct ArrowArray array;
+  while (result == NANOARROW_OK) {
+    result = stream->get_next(stream, &array);
+    if (result != NANOARROW_OK) {
+      ArrowErrorSet(arrow_error, "get_next() failed: %s",
+                    ArrowSQLite3StreamError(stream, result));
+      break;
+    }
+
+    if (array.release == NULL) {
+      break;
+    }
+
+    result = ArrowSQLite3IngestArray(&ingester, &array, rows_inserted);
+    array.release(&array);
+  }
+
+  // On error, rows of the transaction in progress are rolled back (rows of
+  // transactions that were already committed are not)
+  if (ingester.in_transaction) {
+    if (result == NANOARROW_OK) {
+      result = ArrowSQLite3IngestExec(&ingester, "COMMIT");
+    } else {
+      sqlite3_exec(con, "ROLLBACK", NULL, NULL, NULL);
+      *rows_inserted -= ingester.rows_in_transaction;
+    }
+  }
+
+  sqlite3_finalize(ingester.stmt);
+  ArrowFree(ingester.binders);
+  ArrowArrayViewReset(&ingester.array_view);
+  if (ingester.schema.release != NULL) {
+    ingester.schema.release(&ingester.schema);
+  }
+
+  return result;
 }
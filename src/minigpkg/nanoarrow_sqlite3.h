@@ -102,6 +102,45 @@ struct ArrowArrayStream {
 #endif  // ARROW_C_STREAM_INTERFACE
 #endif  // ARROW_FLAG_DICTIONARY_ORDERED
 
+// Error detail for functions that do not operate on an ArrowSQLite3Result. This has
+// the same layout as the nanoarrow ArrowError.
+struct ArrowSQLite3Error {
+  char message[1024];
+};
+
+// A column handler appends the values of one column to an array of a type that it
+// chooses (e.g., to decode values instead of copying them into a binary column).
+struct ArrowSQLite3ColumnHandler {
+  // Initialize schema_out for a column named name when the schema is guessed
+  int (*init_schema)(struct ArrowSQLite3ColumnHandler* handler, const char* name,
+                     struct ArrowSchema* schema_out);
+
+  // Append the value of column i of the current row of stmt (with storage class
+  // value_type) to array and add the number of bytes appended to variable-length
+  // buffers to *variable_bytes. Returns EINVAL if the value can't be appended.
+  int (*append)(struct ArrowSQLite3ColumnHandler* handler, struct ArrowArray* array,
+                sqlite3_stmt* stmt, int i, int value_type, int64_t* variable_bytes);
+
+  // Release the resources held by private_data
+  void (*release)(struct ArrowSQLite3ColumnHandler* handler);
+
+  void* private_data;
+};
+
+// A row filter decides which rows of a statement are appended to a result (e.g., to
+// drop rows that can't be excluded using SQL).
+struct ArrowSQLite3RowFilter {
+  // Set *keep_out to zero to skip the current row of stmt. Returns an errno code
+  // (and sets error) if the row can't be evaluated.
+  int (*filter)(struct ArrowSQLite3RowFilter* filter, sqlite3_stmt* stmt,
+                int* keep_out, struct ArrowSQLite3Error* error);
+
+  // Release the resources held by private_data
+  void (*release)(struct ArrowSQLite3RowFilter* filter);
+
+  void* private_data;
+};
+
 struct ArrowSQLite3Result {
   int step_return_code;
   struct ArrowArray array;
@@ -118,6 +157,76 @@ const char* ArrowSQLite3ResultError(struct ArrowSQLite3Result* result);
 int ArrowSQLite3ResultSetSchema(struct ArrowSQLite3Result* result,
                                 struct ArrowSchema* schema);
 
+// Set the number of buffer bytes (data, offsets, and validity across all columns)
+// after which ArrowSQLite3ResultBatchFull() returns true. Use 0 for no limit.
+int ArrowSQLite3ResultSetMaxBatchBytes(struct ArrowSQLite3Result* result,
+                                       int64_t max_batch_bytes);
+
+// Set the number of rows expected in the array so that all buffers can be reserved
+// before the first row is appended. Use 0 if unknown.
+int ArrowSQLite3ResultSetRowCountHint(struct ArrowSQLite3Result* result,
+                                      int64_t row_count_hint);
+
+int64_t ArrowSQLite3ResultBatchBytes(struct ArrowSQLite3Result* result);
+
+int ArrowSQLite3ResultBatchFull(struct ArrowSQLite3Result* result);
+
+// Guess the schema (if one was not set) from the first guess_rows rows instead of
+// only the first row. The rows are buffered and appended after the schema is
+// guessed so that the statement only has to be executed once.
+int ArrowSQLite3ResultSetGuessRows(struct ArrowSQLite3Result* result,
+                                   int64_t guess_rows);
+
+// Use the declared type of each column (e.g., SMALLINT or MULTIPOLYGON) to choose
+// its Arrow type when guessing the schema. GeoPackage data types map to the
+// corresponding Arrow type (geometry types to binary, DATE and DATETIME to string)
+// and other declared types use the SQLite type affinity rules. Columns without a
+// declared type or with NUMERIC affinity are guessed from their values.
+int ArrowSQLite3ResultSetDeclaredTypes(struct ArrowSQLite3Result* result,
+                                       int use_declared_types);
+
+// Instead of failing when a value can't be appended to a column (e.g., a REAL in
+// an int64 column), replace the column with a wider one (null to any type,
+// integers to int64 or double, float to double, numbers to string, and numbers or
+// strings to binary when a blob is met) by converting the values appended so far. The original format is recorded in the
+// nanoarrow_sqlite3.widened_from metadata key. Columns of a stream can't be widened
+// after its schema was requested.
+int ArrowSQLite3ResultSetWidenTypes(struct ArrowSQLite3Result* result,
+                                    int widen_types);
+
+// When guessing the schema from more than one row, use a dense union for columns
+// whose values have more than one storage class instead of the widest one. The
+// union has the format "+ud:1,2,3,4" (i.e., the type ids are the SQLITE_INTEGER,
+// SQLITE_FLOAT, SQLITE_TEXT, and SQLITE_BLOB storage classes) with int64, double,
+// string, and binary children and values are appended without conversion. Nulls
+// are appended to the int64 child. A column of an explicit schema with this
+// union type is appended the same way.
+int ArrowSQLite3ResultSetUnionMixedTypes(struct ArrowSQLite3Result* result,
+                                          int union_mixed_types);
+
+// Only read the statement columns in column_index (in that order) into the result.
+// Values of other columns are never requested from sqlite3.
+int ArrowSQLite3ResultSetColumns(struct ArrowSQLite3Result* result,
+                                 const int* column_index, int64_t n_columns);
+
+// Like ArrowSQLite3ResultSetColumns() but using column names, which are resolved on
+// the first step. If exclude is non-zero, all columns except column_names are read.
+int ArrowSQLite3ResultSetColumnNames(struct ArrowSQLite3Result* result,
+                                     const char** column_names, int64_t n_columns,
+                                     int exclude);
+
+// Use handler to append values of the output column named column_name. The result
+// takes ownership of handler.
+int ArrowSQLite3ResultSetColumnHandler(struct ArrowSQLite3Result* result,
+                                       const char* column_name,
+                                       struct ArrowSQLite3ColumnHandler* handler);
+
+// Only append rows of the statement that are kept by filter. Skipped rows are not
+// used to guess the schema. The result takes ownership of filter (replacing any
+// filter that was previously set).
+int ArrowSQLite3ResultSetRowFilter(struct ArrowSQLite3Result* result,
+                                   struct ArrowSQLite3RowFilter* filter);
+
 int ArrowSQLite3ResultFinishSchema(struct ArrowSQLite3Result* result,
                                    struct ArrowSchema* schema_out);
 
@@ -126,6 +235,82 @@ int ArrowSQLite3ResultFinishArray(struct ArrowSQLite3Result* result,
 
 int ArrowSQLite3ResultStep(struct ArrowSQLite3Result* result, sqlite3_stmt* stmt);
 
+// Step stmt and append rows until max_rows rows have been appended, there are no
+// more rows (i.e., step_return_code is SQLITE_DONE), the maximum number of bytes
+// per batch has been reached, or an error occurs.
+int ArrowSQLite3ResultStepN(struct ArrowSQLite3Result* result, sqlite3_stmt* stmt,
+                            int64_t max_rows, int64_t* rows_appended);
+
+// Initialize an ArrowArrayStream whose get_next() returns record batches of at
+// most batch_rows rows from stmt. The schema is guessed from the first row. The
+// stream does not take ownership of stmt, which must outlive the stream.
+int ArrowSQLite3StreamInit(struct ArrowArrayStream* stream, sqlite3_stmt* stmt,
+                           int64_t batch_rows);
+
+// Like ArrowSQLite3StreamInit() but moves a result on which options (e.g., an
+// explicit schema or a maximum number of bytes per batch) have been set into
+// the stream. Batches end after batch_rows rows or when the result is full. A row
+// count hint set on the result is used as the total number of rows in the stream.
+int ArrowSQLite3StreamInitFromResult(struct ArrowArrayStream* stream,
+                                     struct ArrowSQLite3Result* result,
+                                     sqlite3_stmt* stmt, int64_t batch_rows);
+
+// Estimate the number of rows in table_name without scanning it using (in order)
+// gpkg_ogr_contents.feature_count, sqlite_stat1, or max(rowid). Returns ENOENT
+// if none of these are available.
+int ArrowSQLite3EstimateRowCount(sqlite3* con, const char* table_name,
+                                 int64_t* row_count_out);
+
+// The source of a row count estimated by ArrowSQLite3EstimateRowCountSource()
+enum ArrowSQLite3RowCountSource {
+  ARROW_SQLITE3_ROW_COUNT_NONE = 0,
+  // gpkg_ogr_contents.feature_count (exact)
+  ARROW_SQLITE3_ROW_COUNT_OGR_CONTENTS = 1,
+  // The row count in sqlite_stat1 (from the last ANALYZE)
+  ARROW_SQLITE3_ROW_COUNT_SQLITE_STAT1 = 2,
+  // The largest rowid of the table (an upper bound if rows were deleted)
+  ARROW_SQLITE3_ROW_COUNT_MAX_ROWID = 3
+};
+
+// Like ArrowSQLite3EstimateRowCount() but also sets source_out to the source of the
+// estimate (or ARROW_SQLITE3_ROW_COUNT_NONE if there is none). Table names are
+// matched case-insensitively, as SQLite matches identifiers.
+int ArrowSQLite3EstimateRowCountSource(sqlite3* con, const char* table_name,
+                                       int64_t* row_count_out,
+                                       enum ArrowSQLite3RowCountSource* source_out);
+
+// Query a single row of numbers: the first column as an integer into *int_out and
+// every column as a double into double_out (either may be NULL). param (if not NULL)
+// is bound as text to the first parameter. Returns ENOENT if there is no row or a
+// value is NULL and EIO if the query can't be prepared or fails.
+int ArrowSQLite3QueryValue(sqlite3* con, const char* sql, const char* param,
+                           int64_t* int_out, double* double_out,
+                           struct ArrowSQLite3Error* error);
+
+// The last error of a stream that failed with code (get_last_error() may return NULL)
+const char* ArrowSQLite3StreamError(struct ArrowArrayStream* stream, int code);
+
+struct ArrowSQLite3IngestOptions {
+  // The number of rows inserted per transaction or 0 to insert all rows in a single
+  // transaction. Ignored if con is already in a transaction, in which case the caller
+  // commits.
+  int64_t rows_per_transaction;
+};
+
+// Initialize options with their defaults
+void ArrowSQLite3IngestOptionsInit(struct ArrowSQLite3IngestOptions* options);
+
+// Insert the rows of stream into the existing table table_name (columns are matched by
+// name) using a single prepared INSERT. Integers, floating point numbers, strings, and
+// binary values are inserted as INTEGER, REAL, TEXT, and BLOB. options may be NULL to
+// use the defaults. If an error occurs, the rows of a transaction started here are
+// rolled back and not counted in *rows_inserted (if not NULL). The stream is not
+// released.
+int ArrowSQLite3Ingest(sqlite3* con, const char* table_name,
+                       struct ArrowArrayStream* stream,
+                       const struct ArrowSQLite3IngestOptions* options,
+                       int64_t* rows_inserted, struct ArrowSQLite3Error* error);
+
 #ifdef __cplusplus
 }
 #endif
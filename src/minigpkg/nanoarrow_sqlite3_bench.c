@@ -93,11 +93,13 @@ int main(int argc, char* argv[]) {
     struct ArrowSQLite3Result arrow_result;
     ArrowSQLite3ResultInit(&arrow_result);
     int64_t row_id = 0;
+    int64_t rows_appended;
 
     printf("Building Arrow result for query %s\n", argv[i]);
     start = clock();
     do {
-      result = ArrowSQLite3ResultStep(&arrow_result, stmt);
+      result = ArrowSQLite3ResultStepN(&arrow_result, stmt, 65536, &rows_appended);
+      row_id += rows_appended;
       if (result != 0) {
         printf("<ArrowSQLite3ResultError on row %ld> %s\n", (long)row_id,
                ArrowSQLite3ResultError(&arrow_result));
@@ -106,8 +108,6 @@ int main(int argc, char* argv[]) {
         ArrowSQLite3ResultReset(&arrow_result);
         return 1;
       }
-      
-      row_id++;
     } while (arrow_result.step_return_code == SQLITE_ROW);
 
     result = ArrowSQLite3ResultFinishArray(&arrow_result, &array);
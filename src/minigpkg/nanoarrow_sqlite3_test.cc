@@ -1,8 +1,14 @@
 
+#include <cmath>
 #include <stdexcept>
+#include <string>
+#include <vector>
 
 #include <arrow/array.h>
+#include <arrow/builder.h>
 #include <arrow/c/bridge.h>
+#include <arrow/record_batch.h>
+#include <arrow/util/key_value_metadata.h>
 #include <gtest/gtest.h>
 #include <sqlite3.h>
 
@@ -241,6 +247,90 @@ TEST(SQLite3Test, SQLite3ResultFromEmpty) {
   ArrowSQLite3ResultReset(&result);
 }
 
+TEST(SQLite3Test, SQLite3ResultDeclaredTypes) {
+  ConnectionHolder con;
+  con.open_memory();
+  con.exec(
+      "CREATE TABLE typed (b BOOLEAN, i8 TINYINT, i16 SMALLINT, i32 MEDIUMINT, "
+      "i64 INTEGER, f FLOAT, d DOUBLE, r REAL, t TEXT(16), blb BLOB(4), dt DATE, "
+      "dtm DATETIME, geom MULTIPOLYGON, vc VARCHAR(8), n NUMERIC)");
+
+  StmtHolder stmt;
+  stmt.prepare(con.ptr, "SELECT *, 1 + 1 AS expr FROM typed WHERE 0");
+
+  struct ArrowSQLite3Result result;
+  ASSERT_EQ(ArrowSQLite3ResultInit(&result), 0);
+  ASSERT_EQ(ArrowSQLite3ResultSetDeclaredTypes(&result, 1), 0);
+
+  do {
+    EXPECT_EQ(ArrowSQLite3ResultStep(&result, stmt.ptr), 0);
+  } while (result.step_return_code == SQLITE_ROW);
+
+  struct ArrowArray array;
+  struct ArrowSchema schema;
+  EXPECT_EQ(ArrowSQLite3ResultFinishArray(&result, &array), 0);
+  EXPECT_EQ(ArrowSQLite3ResultFinishSchema(&result, &schema), 0);
+
+  auto maybe_array = ImportArray(&array, &schema);
+  ASSERT_ARROW_OK(maybe_array.status());
+  EXPECT_TRUE(maybe_array.ValueUnsafe()->type()->Equals(struct_(
+      {field("b", boolean()), field("i8", int8()), field("i16", int16()),
+       field("i32", int32()), field("i64", int64()), field("f", float32()),
+       field("d", float64()), field("r", float64()), field("t", utf8()),
+       field("blb", binary()), field("dt", utf8()), field("dtm", utf8()),
+       field("geom", binary()), field("vc", utf8()), field("n", null()),
+       field("expr", null())})));
+
+  ArrowSQLite3ResultReset(&result);
+}
+
+TEST(SQLite3Test, SQLite3StreamDeclaredTypes) {
+  ConnectionHolder con;
+  con.open_memory();
+  con.exec("CREATE TABLE typed (flag BOOLEAN, small SMALLINT, name TEXT)");
+  con.exec(
+      "INSERT INTO typed VALUES (1, 300, 'one'), (0, NULL, 'two'), (NULL, -2, NULL)");
+
+  StmtHolder stmt;
+  stmt.prepare(con.ptr, "SELECT * FROM typed");
+
+  struct ArrowSQLite3Result result;
+  ASSERT_EQ(ArrowSQLite3ResultInit(&result), 0);
+  ASSERT_EQ(ArrowSQLite3ResultSetDeclaredTypes(&result, 1), 0);
+  ASSERT_EQ(ArrowSQLite3ResultSetGuessRows(&result, 1000), 0);
+
+  struct ArrowArrayStream stream;
+  ASSERT_EQ(ArrowSQLite3StreamInitFromResult(&stream, &result, stmt.ptr, 2), 0);
+  ArrowSQLite3ResultReset(&result);
+
+  // The schema is known without stepping the statement
+  struct ArrowSchema schema;
+  ASSERT_EQ(stream.get_schema(&stream, &schema), 0);
+  schema.release(&schema);
+  EXPECT_FALSE(sqlite3_stmt_busy(stmt.ptr));
+
+  auto maybe_reader = ImportRecordBatchReader(&stream);
+  ASSERT_ARROW_OK(maybe_reader.status());
+  auto reader = maybe_reader.ValueUnsafe();
+  EXPECT_TRUE(reader->schema()->Equals(arrow::schema(
+      {field("flag", boolean()), field("small", int16()), field("name", utf8())})));
+
+  auto maybe_batches = reader->ToRecordBatches();
+  ASSERT_ARROW_OK(maybe_batches.status());
+  auto batches = maybe_batches.ValueUnsafe();
+  ASSERT_EQ(batches.size(), 2);
+  ASSERT_ARROW_OK(batches[0]->ValidateFull());
+  ASSERT_ARROW_OK(batches[1]->ValidateFull());
+
+  auto flag = std::dynamic_pointer_cast<BooleanArray>(batches[0]->column(0));
+  EXPECT_TRUE(flag->Value(0));
+  EXPECT_FALSE(flag->Value(1));
+
+  auto small = std::dynamic_pointer_cast<Int16Array>(batches[1]->column(1));
+  EXPECT_EQ(small->Value(0), -2);
+  EXPECT_TRUE(batches[1]->column(0)->IsNull(0));
+}
+
 TEST(SQLite3Test, SQLite3ResultAppendError) {
   ConnectionHolder con;
   con.open_memory();
@@ -263,4 +353,899 @@ TEST(SQLite3Test, SQLite3ResultAppendError) {
                "type SQLITE_TEXT) to Arrow type with format 'i'");
 
   ArrowSQLite3ResultReset(&result);
+
+  // Numbers and blobs aren't appended to string columns of an explicit schema
+  for (const char* value : {"1", "2.5", "X'01'"}) {
+    for (const auto& type : {utf8(), large_utf8()}) {
+      StmtHolder value_stmt;
+      value_stmt.prepare(con.ptr, std::string("SELECT ") + value + " AS v");
+      ASSERT_EQ(ArrowSQLite3ResultInit(&result), 0);
+      ASSERT_ARROW_OK(ExportSchema(*arrow::schema({field("v", type)}), &schema_in));
+      ASSERT_EQ(ArrowSQLite3ResultSetSchema(&result, &schema_in), 0);
+      EXPECT_EQ(ArrowSQLite3ResultStep(&result, value_stmt.ptr), EINVAL) << value;
+      ArrowSQLite3ResultReset(&result);
+    }
+  }
+}
+
+TEST(SQLite3Test, SQLite3ResultWidenTypes) {
+  ConnectionHolder con;
+  con.open_memory();
+  con.exec("CREATE TABLE mixed (a, b, c, d)");
+  con.exec(
+      "INSERT INTO mixed VALUES (1, NULL, 1, 'p'), (3000000000, 2, 2, 'q'), "
+      "(2.5, 3, X'0102', NULL), ('x', 1.5, 'y', X'03')");
+
+  StmtHolder stmt;
+  stmt.prepare(con.ptr, "SELECT * FROM mixed");
+
+  struct ArrowSQLite3Result result;
+  ASSERT_EQ(ArrowSQLite3ResultInit(&result), 0);
+  ASSERT_EQ(ArrowSQLite3ResultSetWidenTypes(&result, 1), 0);
+
+  auto explicit_schema = arrow::schema({field("a", int32()), field("b", int16()),
+                                        field("c", int32()), field("d", utf8())});
+  struct ArrowSchema schema_in;
+  ASSERT_ARROW_OK(ExportSchema(*explicit_schema, &schema_in));
+  ASSERT_EQ(ArrowSQLite3ResultSetSchema(&result, &schema_in), 0);
+
+  int64_t rows_appended;
+  ASSERT_EQ(ArrowSQLite3ResultStepN(&result, stmt.ptr, 1024, &rows_appended), 0)
+      << ArrowSQLite3ResultError(&result);
+  EXPECT_EQ(rows_appended, 4);
+
+  struct ArrowArray array;
+  struct ArrowSchema schema;
+  EXPECT_EQ(ArrowSQLite3ResultFinishArray(&result, &array), 0);
+  EXPECT_EQ(ArrowSQLite3ResultFinishSchema(&result, &schema), 0);
+
+  auto maybe_array = ImportArray(&array, &schema);
+  ASSERT_ARROW_OK(maybe_array.status());
+  auto arr = std::dynamic_pointer_cast<StructArray>(maybe_array.ValueUnsafe());
+  ASSERT_ARROW_OK(arr->ValidateFull());
+
+  auto type = std::dynamic_pointer_cast<arrow::StructType>(arr->type());
+  EXPECT_TRUE(type->field(0)->type()->Equals(utf8()));
+  EXPECT_EQ(type->field(0)->metadata()->Get("nanoarrow_sqlite3.widened_from").ValueOr(""),
+            "i");
+  EXPECT_TRUE(type->field(1)->type()->Equals(float64()));
+  EXPECT_EQ(type->field(1)->metadata()->Get("nanoarrow_sqlite3.widened_from").ValueOr(""),
+            "s");
+
+  // a was widened to double before it was widened to string
+  auto a = std::dynamic_pointer_cast<StringArray>(arr->field(0));
+  EXPECT_EQ(a->Value(0), "1.0");
+  EXPECT_EQ(a->Value(1), "3000000000.0");
+  EXPECT_EQ(a->Value(2), "2.5");
+  EXPECT_EQ(a->Value(3), "x");
+
+  auto b = std::dynamic_pointer_cast<DoubleArray>(arr->field(1));
+  EXPECT_TRUE(b->IsNull(0));
+  EXPECT_EQ(b->Value(1), 2);
+  EXPECT_EQ(b->Value(2), 3);
+  EXPECT_EQ(b->Value(3), 1.5);
+
+  // Columns that meet a blob are widened to binary, like guessed columns are
+  EXPECT_TRUE(type->field(2)->type()->Equals(binary()));
+  auto c = std::dynamic_pointer_cast<BinaryArray>(arr->field(2));
+  EXPECT_EQ(c->GetString(0), "1");
+  EXPECT_EQ(c->GetString(1), "2");
+  EXPECT_EQ(c->GetString(2), std::string("\x01\x02"));
+  EXPECT_EQ(c->GetString(3), "y");
+
+  EXPECT_TRUE(type->field(3)->type()->Equals(binary()));
+  EXPECT_EQ(type->field(3)->metadata()->Get("nanoarrow_sqlite3.widened_from").ValueOr(""),
+            "u");
+  auto d = std::dynamic_pointer_cast<BinaryArray>(arr->field(3));
+  EXPECT_EQ(d->GetString(0), "p");
+  EXPECT_EQ(d->GetString(1), "q");
+  EXPECT_TRUE(d->IsNull(2));
+  EXPECT_EQ(d->GetString(3), std::string("\x03"));
+
+  ArrowSQLite3ResultReset(&result);
+}
+
+TEST(SQLite3Test, SQLite3StreamWidenTypes) {
+  ConnectionHolder con;
+  con.open_memory();
+  con.add_crossfit_table();
+
+  StmtHolder stmt;
+  stmt.prepare(con.ptr, "SELECT exercise FROM crossfit");
+
+  struct ArrowSQLite3Result result;
+  ASSERT_EQ(ArrowSQLite3ResultInit(&result), 0);
+  ASSERT_EQ(ArrowSQLite3ResultSetWidenTypes(&result, 1), 0);
+
+  auto explicit_schema = arrow::schema({field("exercise", int32())});
+  struct ArrowSchema schema_in;
+  ASSERT_ARROW_OK(ExportSchema(*explicit_schema, &schema_in));
+  ASSERT_EQ(ArrowSQLite3ResultSetSchema(&result, &schema_in), 0);
+
+  struct ArrowArrayStream stream;
+  ASSERT_EQ(ArrowSQLite3StreamInitFromResult(&stream, &result, stmt.ptr, 2), 0);
+  ArrowSQLite3ResultReset(&result);
+
+  struct ArrowSchema schema;
+  ASSERT_EQ(stream.get_schema(&stream, &schema), 0);
+  schema.release(&schema);
+
+  struct ArrowArray array;
+  EXPECT_EQ(stream.get_next(&stream, &array), EINVAL);
+  EXPECT_STREQ(stream.get_last_error(&stream),
+               "Row 0, column 0 ('exercise'): \n  Can't append value 'Push Ups' (SQLite "
+               "type SQLITE_TEXT) to Arrow type with format 'i' (can't widen a column "
+               "after the schema was exported)");
+
+  stream.release(&stream);
+}
+
+TEST(SQLite3Test, SQLite3ResultUnionMixedTypes) {
+  ConnectionHolder con;
+  con.open_memory();
+  con.exec("CREATE TABLE mixed (id, v)");
+  con.exec(
+      "INSERT INTO mixed VALUES (1, 1), (2, 2.5), (3, 'three'), (NULL, NULL), (5, "
+      "X'0102')");
+
+  StmtHolder stmt;
+  stmt.prepare(con.ptr, "SELECT * FROM mixed");
+
+  struct ArrowSQLite3Result result;
+  ASSERT_EQ(ArrowSQLite3ResultInit(&result), 0);
+  ASSERT_EQ(ArrowSQLite3ResultSetUnionMixedTypes(&result, 1), 0);
+  ASSERT_EQ(ArrowSQLite3ResultSetGuessRows(&result, 3), 0);
+
+  int64_t rows_appended;
+  ASSERT_EQ(ArrowSQLite3ResultStepN(&result, stmt.ptr, 1024, &rows_appended), 0)
+      << ArrowSQLite3ResultError(&result);
+  EXPECT_EQ(rows_appended, 5);
+
+  struct ArrowArray array;
+  struct ArrowSchema schema;
+  EXPECT_EQ(ArrowSQLite3ResultFinishArray(&result, &array), 0);
+  EXPECT_EQ(ArrowSQLite3ResultFinishSchema(&result, &schema), 0);
+
+  auto maybe_array = ImportArray(&array, &schema);
+  ASSERT_ARROW_OK(maybe_array.status());
+  auto arr = std::dynamic_pointer_cast<StructArray>(maybe_array.ValueUnsafe());
+  ASSERT_ARROW_OK(arr->ValidateFull());
+
+  auto mixed_type = dense_union(
+      {field("integer", int64()), field("real", float64()), field("text", utf8()),
+       field("blob", binary())},
+      {SQLITE_INTEGER, SQLITE_FLOAT, SQLITE_TEXT, SQLITE_BLOB});
+  EXPECT_TRUE(
+      arr->type()->Equals(struct_({field("id", int64()), field("v", mixed_type)})));
+
+  auto v = std::dynamic_pointer_cast<DenseUnionArray>(arr->field(1));
+  EXPECT_EQ(v->type_code(0), SQLITE_INTEGER);
+  EXPECT_EQ(v->type_code(1), SQLITE_FLOAT);
+  EXPECT_EQ(v->type_code(2), SQLITE_TEXT);
+  EXPECT_EQ(v->type_code(3), SQLITE_INTEGER);
+  EXPECT_EQ(v->type_code(4), SQLITE_BLOB);
+  EXPECT_TRUE(v->IsNull(3));
+
+  auto real = std::dynamic_pointer_cast<DoubleArray>(v->field(1));
+  EXPECT_EQ(real->Value(v->value_offset(1)), 2.5);
+  auto text = std::dynamic_pointer_cast<StringArray>(v->field(2));
+  EXPECT_EQ(text->Value(v->value_offset(2)), "three");
+
+  ArrowSQLite3ResultReset(&result);
+}
+
+TEST(SQLite3Test, SQLite3StreamBatches) {
+  ConnectionHolder con;
+  con.open_memory();
+  con.add_crossfit_table();
+
+  StmtHolder stmt;
+  stmt.prepare(con.ptr, "SELECT * from crossfit");
+
+  struct ArrowArrayStream stream;
+  EXPECT_EQ(ArrowSQLite3StreamInit(&stream, stmt.ptr, 0), EINVAL);
+  ASSERT_EQ(ArrowSQLite3StreamInit(&stream, stmt.ptr, 2), 0);
+
+  auto maybe_reader = ImportRecordBatchReader(&stream);
+  ASSERT_ARROW_OK(maybe_reader.status());
+  auto reader = maybe_reader.ValueUnsafe();
+
+  EXPECT_TRUE(reader->schema()->Equals(
+      arrow::schema({field("exercise", utf8()), field("difficulty_level", int64())})));
+
+  auto maybe_batches = reader->ToRecordBatches();
+  ASSERT_ARROW_OK(maybe_batches.status());
+  auto batches = maybe_batches.ValueUnsafe();
+  ASSERT_EQ(batches.size(), 3);
+  EXPECT_EQ(batches[0]->num_rows(), 2);
+  EXPECT_EQ(batches[1]->num_rows(), 2);
+  EXPECT_EQ(batches[2]->num_rows(), 1);
+
+  auto col1 = std::dynamic_pointer_cast<StringArray>(batches[1]->column(0));
+  EXPECT_EQ(col1->Value(0), "Push Jerk");
+  EXPECT_EQ(col1->Value(1), "Bar Muscle Up");
+
+  auto col2 = std::dynamic_pointer_cast<Int64Array>(batches[2]->column(1));
+  EXPECT_TRUE(col2->IsNull(0));
+}
+
+TEST(SQLite3Test, SQLite3StreamFromEmpty) {
+  ConnectionHolder con;
+  con.open_memory();
+  con.add_crossfit_table();
+
+  StmtHolder stmt;
+  stmt.prepare(con.ptr, "SELECT * from crossfit WHERE 0");
+
+  struct ArrowArrayStream stream;
+  ASSERT_EQ(ArrowSQLite3StreamInit(&stream, stmt.ptr, 1024), 0);
+
+  auto maybe_reader = ImportRecordBatchReader(&stream);
+  ASSERT_ARROW_OK(maybe_reader.status());
+  auto maybe_batches = maybe_reader.ValueUnsafe()->ToRecordBatches();
+  ASSERT_ARROW_OK(maybe_batches.status());
+  EXPECT_EQ(maybe_batches.ValueUnsafe().size(), 0);
+}
+
+TEST(SQLite3Test, SQLite3StreamMaxBatchBytes) {
+  ConnectionHolder con;
+  con.open_memory();
+  con.add_crossfit_table();
+
+  StmtHolder stmt;
+  stmt.prepare(con.ptr, "SELECT * from crossfit");
+
+  struct ArrowSQLite3Result result;
+  ASSERT_EQ(ArrowSQLite3ResultInit(&result), 0);
+  EXPECT_EQ(ArrowSQLite3ResultSetMaxBatchBytes(&result, -1), EINVAL);
+  ASSERT_EQ(ArrowSQLite3ResultSetMaxBatchBytes(&result, 40), 0);
+
+  struct ArrowArrayStream stream;
+  ASSERT_EQ(ArrowSQLite3StreamInitFromResult(&stream, &result, stmt.ptr, 1024), 0);
+  ArrowSQLite3ResultReset(&result);
+
+  auto maybe_reader = ImportRecordBatchReader(&stream);
+  ASSERT_ARROW_OK(maybe_reader.status());
+  auto maybe_batches = maybe_reader.ValueUnsafe()->ToRecordBatches();
+  ASSERT_ARROW_OK(maybe_batches.status());
+  auto batches = maybe_batches.ValueUnsafe();
+
+  // Each row is ~12 bytes of offsets/data/validity plus the string data
+  ASSERT_EQ(batches.size(), 3);
+  EXPECT_EQ(batches[0]->num_rows(), 2);
+  EXPECT_EQ(batches[1]->num_rows(), 2);
+  EXPECT_EQ(batches[2]->num_rows(), 1);
+}
+
+TEST(SQLite3Test, SQLite3StreamMaxBatchBytesLargeValues) {
+  ConnectionHolder con;
+  con.open_memory();
+  con.exec("CREATE TABLE blobs (i INTEGER, b BLOB)");
+  con.exec(
+      "WITH RECURSIVE s(i) AS (SELECT 0 UNION ALL SELECT i + 1 FROM s WHERE i < 99) "
+      "INSERT INTO blobs SELECT i, zeroblob(65536) FROM s");
+
+  StmtHolder stmt;
+  stmt.prepare(con.ptr, "SELECT * from blobs");
+
+  // Batches after the first are expected to be full, which must not reserve
+  // batch_rows times the size of a blob
+  struct ArrowSQLite3Result result;
+  ASSERT_EQ(ArrowSQLite3ResultInit(&result), 0);
+  ASSERT_EQ(ArrowSQLite3ResultSetMaxBatchBytes(&result, 4 * 65536), 0);
+
+  struct ArrowArrayStream stream;
+  int64_t batch_rows = int64_t(1) << 40;
+  ASSERT_EQ(ArrowSQLite3StreamInitFromResult(&stream, &result, stmt.ptr, batch_rows), 0);
+  ArrowSQLite3ResultReset(&result);
+
+  auto batches = ImportRecordBatchReader(&stream).ValueOrDie()->ToRecordBatches();
+  ASSERT_ARROW_OK(batches.status());
+  ASSERT_EQ(batches.ValueUnsafe().size(), 25);
+  for (const auto& batch : batches.ValueUnsafe()) {
+    EXPECT_EQ(batch->num_rows(), 4);
+    auto b = std::dynamic_pointer_cast<BinaryArray>(batch->column(1));
+    EXPECT_LE(b->value_data()->capacity(), 4 * 65536 + 64);
+  }
+}
+
+TEST(SQLite3Test, SQLite3ResultBatchBytes) {
+  ConnectionHolder con;
+  con.open_memory();
+  con.add_crossfit_table();
+
+  StmtHolder stmt;
+  stmt.prepare(con.ptr, "SELECT difficulty_level from crossfit");
+
+  struct ArrowSQLite3Result result;
+  ASSERT_EQ(ArrowSQLite3ResultInit(&result), 0);
+  ASSERT_EQ(ArrowSQLite3ResultSetMaxBatchBytes(&result, 18), 0);
+  EXPECT_EQ(ArrowSQLite3ResultBatchBytes(&result), 0);
+
+  ASSERT_EQ(ArrowSQLite3ResultStep(&result, stmt.ptr), 0);
+  EXPECT_EQ(ArrowSQLite3ResultBatchBytes(&result), 9);
+  EXPECT_FALSE(ArrowSQLite3ResultBatchFull(&result));
+
+  ASSERT_EQ(ArrowSQLite3ResultStep(&result, stmt.ptr), 0);
+  EXPECT_EQ(ArrowSQLite3ResultBatchBytes(&result), 17);
+  EXPECT_FALSE(ArrowSQLite3ResultBatchFull(&result));
+
+  ASSERT_EQ(ArrowSQLite3ResultStep(&result, stmt.ptr), 0);
+  EXPECT_EQ(ArrowSQLite3ResultBatchBytes(&result), 25);
+  EXPECT_TRUE(ArrowSQLite3ResultBatchFull(&result));
+
+  ArrowSQLite3ResultReset(&result);
+}
+
+TEST(SQLite3Test, SQLite3ResultNarrowTypes) {
+  ConnectionHolder con;
+  con.open_memory();
+  con.exec("CREATE TABLE narrow (a INTEGER, b REAL, c INTEGER)");
+  con.exec(
+      "INSERT INTO narrow VALUES (-3, -1.5, 1), (NULL, 0.0, 2), (100, 2.25, NULL), "
+      "(0, -9e999, 3)");
+
+  StmtHolder stmt;
+  stmt.prepare(con.ptr, "SELECT a, a, b, b, c, c from narrow");
+
+  struct ArrowSQLite3Result result;
+  ASSERT_EQ(ArrowSQLite3ResultInit(&result), 0);
+
+  auto explicit_schema =
+      arrow::schema({field("a8", int8()), field("a32", int32()), field("b32", float32()),
+                     field("b64", float64()), field("c64", float64()),
+                     field("c_bool", boolean())});
+  struct ArrowSchema schema_in;
+  ASSERT_ARROW_OK(ExportSchema(*explicit_schema, &schema_in));
+  ASSERT_EQ(ArrowSQLite3ResultSetSchema(&result, &schema_in), 0);
+
+  do {
+    ASSERT_EQ(ArrowSQLite3ResultStep(&result, stmt.ptr), 0);
+  } while (result.step_return_code == SQLITE_ROW);
+
+  struct ArrowArray array;
+  struct ArrowSchema schema;
+  EXPECT_EQ(ArrowSQLite3ResultFinishArray(&result, &array), 0);
+  EXPECT_EQ(ArrowSQLite3ResultFinishSchema(&result, &schema), 0);
+
+  auto maybe_array = ImportArray(&array, &schema);
+  ASSERT_ARROW_OK(maybe_array.status());
+  auto arr = std::dynamic_pointer_cast<StructArray>(maybe_array.ValueUnsafe());
+  ASSERT_ARROW_OK(arr->ValidateFull());
+
+  auto a8 = std::dynamic_pointer_cast<Int8Array>(arr->field(0));
+  EXPECT_EQ(a8->Value(0), -3);
+  EXPECT_TRUE(a8->IsNull(1));
+  EXPECT_EQ(a8->Value(2), 100);
+
+  auto b32 = std::dynamic_pointer_cast<FloatArray>(arr->field(2));
+  EXPECT_EQ(b32->Value(0), -1.5);
+  EXPECT_EQ(b32->Value(1), 0);
+  EXPECT_EQ(b32->Value(2), 2.25);
+  EXPECT_EQ(b32->Value(3), -INFINITY);
+
+  auto c64 = std::dynamic_pointer_cast<DoubleArray>(arr->field(4));
+  EXPECT_EQ(c64->Value(0), 1);
+  EXPECT_EQ(c64->Value(1), 2);
+  EXPECT_TRUE(c64->IsNull(2));
+
+  // Any non-zero integer is true
+  auto c_bool = std::dynamic_pointer_cast<BooleanArray>(arr->field(5));
+  EXPECT_TRUE(c_bool->Value(0));
+  EXPECT_TRUE(c_bool->Value(1));
+  EXPECT_TRUE(c_bool->IsNull(2));
+  EXPECT_TRUE(c_bool->Value(3));
+
+  ArrowSQLite3ResultReset(&result);
+}
+
+TEST(SQLite3Test, SQLite3ResultOutOfRange) {
+  ConnectionHolder con;
+  con.open_memory();
+  con.add_crossfit_table();
+
+  StmtHolder stmt;
+  stmt.prepare(con.ptr, "SELECT difficulty_level * 20 from crossfit");
+
+  struct ArrowSQLite3Result result;
+  ASSERT_EQ(ArrowSQLite3ResultInit(&result), 0);
+
+  auto explicit_schema = arrow::schema({field("level", int8())});
+  struct ArrowSchema schema_in;
+  ASSERT_ARROW_OK(ExportSchema(*explicit_schema, &schema_in));
+  ASSERT_EQ(ArrowSQLite3ResultSetSchema(&result, &schema_in), 0);
+
+  EXPECT_EQ(ArrowSQLite3ResultStep(&result, stmt.ptr), 0);
+  EXPECT_EQ(ArrowSQLite3ResultStep(&result, stmt.ptr), 0);
+  EXPECT_EQ(ArrowSQLite3ResultStep(&result, stmt.ptr), EINVAL);
+  EXPECT_STREQ(ArrowSQLite3ResultError(&result),
+               "Row 2, column 0 ('level'): \n  Can't append value '140' (SQLite "
+               "type SQLITE_INTEGER) to Arrow type with format 'c'");
+
+  ArrowSQLite3ResultReset(&result);
+}
+
+TEST(SQLite3Test, SQLite3ResultStepN) {
+  ConnectionHolder con;
+  con.open_memory();
+  con.add_crossfit_table();
+
+  StmtHolder stmt;
+  stmt.prepare(con.ptr, "SELECT * from crossfit");
+
+  struct ArrowSQLite3Result result;
+  ASSERT_EQ(ArrowSQLite3ResultInit(&result), 0);
+
+  int64_t rows_appended = -1;
+  EXPECT_EQ(ArrowSQLite3ResultStepN(&result, stmt.ptr, 0, &rows_appended), EINVAL);
+  EXPECT_STREQ(ArrowSQLite3ResultError(&result), "max_rows must be > 0");
+  EXPECT_EQ(rows_appended, 0);
+
+  ASSERT_EQ(ArrowSQLite3ResultStepN(&result, stmt.ptr, 3, &rows_appended), 0);
+  EXPECT_EQ(rows_appended, 3);
+  EXPECT_EQ(result.step_return_code, SQLITE_ROW);
+  EXPECT_EQ(result.array.length, 3);
+
+  ASSERT_EQ(ArrowSQLite3ResultStepN(&result, stmt.ptr, 3, &rows_appended), 0);
+  EXPECT_EQ(rows_appended, 2);
+  EXPECT_EQ(result.step_return_code, SQLITE_DONE);
+  EXPECT_EQ(result.array.length, 5);
+
+  struct ArrowArray array;
+  struct ArrowSchema schema;
+  EXPECT_EQ(ArrowSQLite3ResultFinishArray(&result, &array), 0);
+  EXPECT_EQ(ArrowSQLite3ResultFinishSchema(&result, &schema), 0);
+
+  auto maybe_array = ImportArray(&array, &schema);
+  ASSERT_ARROW_OK(maybe_array.status());
+  auto arr = std::dynamic_pointer_cast<StructArray>(maybe_array.ValueUnsafe());
+  auto col1 = std::dynamic_pointer_cast<StringArray>(arr->field(0));
+  EXPECT_EQ(col1->Value(3), "Bar Muscle Up");
+  EXPECT_EQ(col1->Value(4), "Unknown");
+
+  ArrowSQLite3ResultReset(&result);
+}
+
+TEST(SQLite3Test, SQLite3StreamRowCountHint) {
+  ConnectionHolder con;
+  con.open_memory();
+  con.add_crossfit_table();
+
+  StmtHolder stmt;
+  stmt.prepare(con.ptr, "SELECT * from crossfit");
+
+  struct ArrowSQLite3Result result;
+  ASSERT_EQ(ArrowSQLite3ResultInit(&result), 0);
+  EXPECT_EQ(ArrowSQLite3ResultSetRowCountHint(&result, -1), EINVAL);
+  ASSERT_EQ(ArrowSQLite3ResultSetRowCountHint(&result, 3), 0);
+
+  struct ArrowArrayStream stream;
+  ASSERT_EQ(ArrowSQLite3StreamInitFromResult(&stream, &result, stmt.ptr, 2), 0);
+  ArrowSQLite3ResultReset(&result);
+
+  auto maybe_reader = ImportRecordBatchReader(&stream);
+  ASSERT_ARROW_OK(maybe_reader.status());
+  auto maybe_batches = maybe_reader.ValueUnsafe()->ToRecordBatches();
+  ASSERT_ARROW_OK(maybe_batches.status());
+  auto batches = maybe_batches.ValueUnsafe();
+
+  // The hint is an underestimate, which should not affect the result
+  ASSERT_EQ(batches.size(), 3);
+  for (const auto& batch : batches) {
+    ASSERT_ARROW_OK(batch->ValidateFull());
+  }
+
+  auto col1 = std::dynamic_pointer_cast<StringArray>(batches[1]->column(0));
+  EXPECT_EQ(col1->Value(0), "Push Jerk");
+  EXPECT_EQ(col1->Value(1), "Bar Muscle Up");
+}
+
+TEST(SQLite3Test, SQLite3EstimateRowCount) {
+  ConnectionHolder con;
+  con.open_memory();
+  con.add_crossfit_table();
+
+  int64_t row_count = -1;
+  EXPECT_EQ(ArrowSQLite3EstimateRowCount(con.ptr, "not_a_table", &row_count), EIO);
+
+  // From max(rowid)
+  EXPECT_EQ(ArrowSQLite3EstimateRowCount(con.ptr, "crossfit", &row_count), 0);
+  EXPECT_EQ(row_count, 5);
+
+  // From sqlite_stat1, where a partial index only counts the rows it covers
+  con.exec("CREATE INDEX crossfit_level ON crossfit (difficulty_level)");
+  con.exec(
+      "CREATE INDEX a_crossfit_hard ON crossfit (exercise) WHERE difficulty_level > 6");
+  con.exec("DELETE FROM crossfit WHERE exercise = 'Push Ups'");
+  con.exec("ANALYZE");
+  EXPECT_EQ(ArrowSQLite3EstimateRowCount(con.ptr, "crossfit", &row_count), 0);
+  EXPECT_EQ(row_count, 4);
+
+  // From gpkg_ogr_contents
+  con.exec("CREATE TABLE gpkg_ogr_contents (table_name TEXT, feature_count INTEGER)");
+  con.exec("INSERT INTO gpkg_ogr_contents VALUES ('crossfit', 1234)");
+  EXPECT_EQ(ArrowSQLite3EstimateRowCount(con.ptr, "crossfit", &row_count), 0);
+  EXPECT_EQ(row_count, 1234);
+
+  // Each source is reported and table names are matched case-insensitively
+  enum ArrowSQLite3RowCountSource source;
+  EXPECT_EQ(ArrowSQLite3EstimateRowCountSource(con.ptr, "CrossFit", &row_count, &source),
+            0);
+  EXPECT_EQ(row_count, 1234);
+  EXPECT_EQ(source, ARROW_SQLITE3_ROW_COUNT_OGR_CONTENTS);
+
+  con.exec("DELETE FROM gpkg_ogr_contents");
+  EXPECT_EQ(ArrowSQLite3EstimateRowCountSource(con.ptr, "CrossFit", &row_count, &source),
+            0);
+  EXPECT_EQ(row_count, 4);
+  EXPECT_EQ(source, ARROW_SQLITE3_ROW_COUNT_SQLITE_STAT1);
+
+  con.exec("DELETE FROM sqlite_stat1");
+  EXPECT_EQ(ArrowSQLite3EstimateRowCountSource(con.ptr, "CrossFit", &row_count, &source),
+            0);
+  EXPECT_EQ(row_count, 5);
+  EXPECT_EQ(source, ARROW_SQLITE3_ROW_COUNT_MAX_ROWID);
+
+  EXPECT_EQ(
+      ArrowSQLite3EstimateRowCountSource(con.ptr, "not_a_table", &row_count, &source),
+      EIO);
+  EXPECT_EQ(source, ARROW_SQLITE3_ROW_COUNT_NONE);
+}
+
+TEST(SQLite3Test, SQLite3ResultColumns) {
+  ConnectionHolder con;
+  con.open_memory();
+  con.add_crossfit_table();
+
+  StmtHolder stmt;
+  stmt.prepare(con.ptr, "SELECT * from crossfit");
+
+  struct ArrowSQLite3Result result;
+  ASSERT_EQ(ArrowSQLite3ResultInit(&result), 0);
+
+  int column_index[] = {1};
+  ASSERT_EQ(ArrowSQLite3ResultSetColumns(&result, column_index, 1), 0);
+  EXPECT_EQ(ArrowSQLite3ResultSetColumns(&result, column_index, 1), EINVAL);
+  EXPECT_STREQ(ArrowSQLite3ResultError(&result),
+               "columns have already been set or resolved");
+
+  do {
+    ASSERT_EQ(ArrowSQLite3ResultStep(&result, stmt.ptr), 0);
+  } while (result.step_return_code == SQLITE_ROW);
+
+  struct ArrowArray array;
+  struct ArrowSchema schema;
+  EXPECT_EQ(ArrowSQLite3ResultFinishArray(&result, &array), 0);
+  EXPECT_EQ(ArrowSQLite3ResultFinishSchema(&result, &schema), 0);
+
+  auto maybe_array = ImportArray(&array, &schema);
+  ASSERT_ARROW_OK(maybe_array.status());
+  EXPECT_TRUE(maybe_array.ValueUnsafe()->type()->Equals(
+      struct_({field("difficulty_level", int64())})));
+
+  ArrowSQLite3ResultReset(&result);
+}
+
+TEST(SQLite3Test, SQLite3ResultColumnNames) {
+  ConnectionHolder con;
+  con.open_memory();
+  con.add_crossfit_table();
+
+  StmtHolder stmt;
+  stmt.prepare(con.ptr,
+               "SELECT exercise, difficulty_level, exercise AS e2 from crossfit");
+
+  // Include
+  struct ArrowSQLite3Result result;
+  ASSERT_EQ(ArrowSQLite3ResultInit(&result), 0);
+  const char* names[] = {"E2", "difficulty_level"};
+  ASSERT_EQ(ArrowSQLite3ResultSetColumnNames(&result, names, 2, 0), 0);
+  ASSERT_EQ(ArrowSQLite3ResultStep(&result, stmt.ptr), 0);
+  EXPECT_EQ(result.schema.n_children, 2);
+  EXPECT_STREQ(result.schema.children[0]->name, "e2");
+  EXPECT_STREQ(result.schema.children[1]->name, "difficulty_level");
+  ArrowSQLite3ResultReset(&result);
+
+  // Exclude
+  sqlite3_reset(stmt.ptr);
+  ASSERT_EQ(ArrowSQLite3ResultInit(&result), 0);
+  ASSERT_EQ(ArrowSQLite3ResultSetColumnNames(&result, names, 2, 1), 0);
+  ASSERT_EQ(ArrowSQLite3ResultStep(&result, stmt.ptr), 0);
+  EXPECT_EQ(result.schema.n_children, 1);
+  EXPECT_STREQ(result.schema.children[0]->name, "exercise");
+  ArrowSQLite3ResultReset(&result);
+
+  // Not found
+  sqlite3_reset(stmt.ptr);
+  ASSERT_EQ(ArrowSQLite3ResultInit(&result), 0);
+  const char* bad_names[] = {"not_a_column"};
+  ASSERT_EQ(ArrowSQLite3ResultSetColumnNames(&result, bad_names, 1, 0), 0);
+  EXPECT_EQ(ArrowSQLite3ResultStep(&result, stmt.ptr), EINVAL);
+  EXPECT_STREQ(ArrowSQLite3ResultError(&result),
+               "Column 'not_a_column' not found in result");
+  ArrowSQLite3ResultReset(&result);
+}
+
+TEST(SQLite3Test, SQLite3ResultGuessRows) {
+  ConnectionHolder con;
+  con.open_memory();
+  con.exec("CREATE TABLE mixed (a, b, c, d, e)");
+  con.exec(
+      "INSERT INTO mixed VALUES (NULL, 1, 1, NULL, 1), (1, 2.5, 'two', NULL, X'0102'), "
+      "(2, 3, 3, NULL, 2.5), (3, 4, 4.5, NULL, NULL)");
+
+  StmtHolder stmt;
+  stmt.prepare(con.ptr, "SELECT * FROM mixed");
+
+  struct ArrowSQLite3Result result;
+  ASSERT_EQ(ArrowSQLite3ResultInit(&result), 0);
+  EXPECT_EQ(ArrowSQLite3ResultSetGuessRows(&result, 0), EINVAL);
+  ASSERT_EQ(ArrowSQLite3ResultSetGuessRows(&result, 3), 0);
+
+  int64_t rows_appended;
+  ASSERT_EQ(ArrowSQLite3ResultStepN(&result, stmt.ptr, 1024, &rows_appended), 0);
+  EXPECT_EQ(rows_appended, 4);
+  EXPECT_EQ(result.step_return_code, SQLITE_DONE);
+
+  struct ArrowArray array;
+  struct ArrowSchema schema;
+  EXPECT_EQ(ArrowSQLite3ResultFinishArray(&result, &array), 0);
+  EXPECT_EQ(ArrowSQLite3ResultFinishSchema(&result, &schema), 0);
+
+  auto maybe_array = ImportArray(&array, &schema);
+  ASSERT_ARROW_OK(maybe_array.status());
+  EXPECT_TRUE(maybe_array.ValueUnsafe()->type()->Equals(
+      struct_({field("a", int64()), field("b", float64()), field("c", utf8()),
+               field("d", null()), field("e", binary())})));
+
+  auto arr = std::dynamic_pointer_cast<StructArray>(maybe_array.ValueUnsafe());
+  ASSERT_ARROW_OK(arr->ValidateFull());
+
+  auto a = std::dynamic_pointer_cast<Int64Array>(arr->field(0));
+  EXPECT_TRUE(a->IsNull(0));
+  EXPECT_EQ(a->Value(3), 3);
+
+  auto b = std::dynamic_pointer_cast<DoubleArray>(arr->field(1));
+  EXPECT_EQ(b->Value(0), 1);
+  EXPECT_EQ(b->Value(1), 2.5);
+  EXPECT_EQ(b->Value(3), 4);
+
+  auto c = std::dynamic_pointer_cast<StringArray>(arr->field(2));
+  EXPECT_EQ(c->Value(0), "1");
+  EXPECT_EQ(c->Value(1), "two");
+  EXPECT_EQ(c->Value(3), "4.5");
+
+  // Numbers in a column widened to binary are their text
+  auto e = std::dynamic_pointer_cast<BinaryArray>(arr->field(4));
+  EXPECT_EQ(e->GetString(0), "1");
+  EXPECT_EQ(e->GetString(1), std::string("\x01\x02", 2));
+  EXPECT_EQ(e->GetString(2), "2.5");
+  EXPECT_TRUE(e->IsNull(3));
+
+  ArrowSQLite3ResultReset(&result);
+}
+
+TEST(SQLite3Test, SQLite3StreamGuessRows) {
+  ConnectionHolder con;
+  con.open_memory();
+  con.add_crossfit_table();
+  con.exec("INSERT INTO crossfit VALUES ('Burpees', 2.5)");
+
+  StmtHolder stmt;
+  stmt.prepare(con.ptr, "SELECT * FROM crossfit");
+
+  struct ArrowSQLite3Result result;
+  ASSERT_EQ(ArrowSQLite3ResultInit(&result), 0);
+  ASSERT_EQ(ArrowSQLite3ResultSetGuessRows(&result, 1000), 0);
+  const char* names[] = {"difficulty_level"};
+  ASSERT_EQ(ArrowSQLite3ResultSetColumnNames(&result, names, 1, 0), 0);
+
+  struct ArrowArrayStream stream;
+  ASSERT_EQ(ArrowSQLite3StreamInitFromResult(&stream, &result, stmt.ptr, 4), 0);
+  ArrowSQLite3ResultReset(&result);
+
+  auto maybe_reader = ImportRecordBatchReader(&stream);
+  ASSERT_ARROW_OK(maybe_reader.status());
+  auto reader = maybe_reader.ValueUnsafe();
+  EXPECT_TRUE(
+      reader->schema()->Equals(arrow::schema({field("difficulty_level", float64())})));
+
+  auto maybe_batches = reader->ToRecordBatches();
+  ASSERT_ARROW_OK(maybe_batches.status());
+  auto batches = maybe_batches.ValueUnsafe();
+  ASSERT_EQ(batches.size(), 2);
+  EXPECT_EQ(batches[0]->num_rows(), 4);
+  EXPECT_EQ(batches[1]->num_rows(), 2);
+
+  auto level = std::dynamic_pointer_cast<DoubleArray>(batches[1]->column(0));
+  EXPECT_TRUE(level->IsNull(0));
+  EXPECT_EQ(level->Value(1), 2.5);
+}
+
+static int keep_even(struct ArrowSQLite3RowFilter* filter, sqlite3_stmt* stmt,
+                     int* keep_out, struct ArrowSQLite3Error* error) {
+  int64_t value = sqlite3_column_int64(stmt, 0);
+  if (value < 0) {
+    snprintf(error->message, sizeof(error->message), "negative value");
+    return EINVAL;
+  }
+
+  *keep_out = value % 2 == 0;
+  (*reinterpret_cast<int*>(filter->private_data))++;
+  return 0;
+}
+
+static void release_keep_even(struct ArrowSQLite3RowFilter* filter) {
+  filter->release = nullptr;
+}
+
+TEST(SQLite3Test, SQLite3ResultRowFilter) {
+  ConnectionHolder con;
+  con.open_memory();
+  con.exec("CREATE TABLE numbers (a, b)");
+  con.exec("INSERT INTO numbers VALUES (1, 'one'), (2, 2), (3, 3), (4, 4), (5, 5)");
+
+  StmtHolder stmt;
+  stmt.prepare(con.ptr, "SELECT * FROM numbers");
+
+  int n_filtered = 0;
+  struct ArrowSQLite3RowFilter filter;
+  filter.filter = &keep_even;
+  filter.release = &release_keep_even;
+  filter.private_data = &n_filtered;
+
+  struct ArrowSQLite3Result result;
+  ASSERT_EQ(ArrowSQLite3ResultInit(&result), 0);
+  ASSERT_EQ(ArrowSQLite3ResultSetRowFilter(&result, &filter), 0);
+  EXPECT_EQ(filter.release, nullptr);
+  ASSERT_EQ(ArrowSQLite3ResultSetGuessRows(&result, 10), 0);
+
+  int64_t rows_appended;
+  ASSERT_EQ(ArrowSQLite3ResultStepN(&result, stmt.ptr, 1024, &rows_appended), 0)
+      << ArrowSQLite3ResultError(&result);
+  EXPECT_EQ(rows_appended, 2);
+  EXPECT_EQ(n_filtered, 5);
+
+  struct ArrowArray array;
+  struct ArrowSchema schema;
+  EXPECT_EQ(ArrowSQLite3ResultFinishArray(&result, &array), 0);
+  EXPECT_EQ(ArrowSQLite3ResultFinishSchema(&result, &schema), 0);
+  ArrowSQLite3ResultReset(&result);
+
+  // The skipped text value is not used to guess the type of b
+  auto maybe_array = ImportArray(&array, &schema);
+  ASSERT_ARROW_OK(maybe_array.status());
+  EXPECT_TRUE(maybe_array.ValueUnsafe()->type()->Equals(
+      struct_({field("a", int64()), field("b", int64())})));
+
+  auto arr = std::dynamic_pointer_cast<StructArray>(maybe_array.ValueUnsafe());
+  auto a = std::dynamic_pointer_cast<Int64Array>(arr->field(0));
+  EXPECT_EQ(a->Value(0), 2);
+  EXPECT_EQ(a->Value(1), 4);
+
+  // Errors from the filter are propagated
+  con.exec("INSERT INTO numbers VALUES (-1, NULL)");
+  StmtHolder negative_stmt;
+  negative_stmt.prepare(con.ptr, "SELECT * FROM numbers WHERE a < 0");
+  ASSERT_EQ(ArrowSQLite3ResultInit(&result), 0);
+  filter.filter = &keep_even;
+  filter.release = &release_keep_even;
+  ASSERT_EQ(ArrowSQLite3ResultSetRowFilter(&result, &filter), 0);
+  EXPECT_EQ(ArrowSQLite3ResultStep(&result, negative_stmt.ptr), EINVAL);
+  EXPECT_STREQ(ArrowSQLite3ResultError(&result), "negative value");
+  ArrowSQLite3ResultReset(&result);
+}
+
+TEST(SQLite3Test, SQLite3Ingest) {
+  ConnectionHolder con;
+  con.open_memory();
+  con.exec("CREATE TABLE ingested (i INTEGER, u INTEGER, d REAL, s TEXT, b BLOB)");
+
+  Int32Builder i_builder;
+  UInt64Builder u_builder;
+  DoubleBuilder d_builder;
+  StringBuilder s_builder;
+  BinaryBuilder b_builder;
+  ASSERT_ARROW_OK(i_builder.AppendValues({1, 2, 3}));
+  ASSERT_ARROW_OK(i_builder.AppendNull());
+  ASSERT_ARROW_OK(u_builder.AppendValues({1, 2, 3, UINT64_MAX}));
+  ASSERT_ARROW_OK(d_builder.AppendValues({0.5, 1.5, 2.5, 3.5}));
+  ASSERT_ARROW_OK(s_builder.AppendValues({"one", "two", "three"}));
+  ASSERT_ARROW_OK(s_builder.AppendNull());
+  ASSERT_ARROW_OK(b_builder.AppendValues({"\x01", "\x02", "\x03", "\x04"}));
+
+  auto schema = arrow::schema({field("i", int32()), field("u", uint64()),
+                               field("d", float64()), field("s", utf8()),
+                               field("b", binary())});
+  auto batch = RecordBatch::Make(
+      schema, 4,
+      {i_builder.Finish().ValueOrDie(), u_builder.Finish().ValueOrDie(),
+       d_builder.Finish().ValueOrDie(), s_builder.Finish().ValueOrDie(),
+       b_builder.Finish().ValueOrDie()});
+
+  // The second batch is a slice so that its columns have an offset
+  auto reader =
+      RecordBatchReader::Make({batch->Slice(0, 3), batch->Slice(1, 3)}).ValueOrDie();
+  struct ArrowArrayStream stream;
+  ASSERT_ARROW_OK(ExportRecordBatchReader(reader, &stream));
+
+  struct ArrowSQLite3IngestOptions options;
+  ArrowSQLite3IngestOptionsInit(&options);
+  EXPECT_EQ(options.rows_per_transaction, 65536);
+  options.rows_per_transaction = 2;
+
+  int64_t rows_inserted;
+  struct ArrowSQLite3Error error;
+  ASSERT_EQ(ArrowSQLite3Ingest(con.ptr, "ingested", &stream, &options, &rows_inserted,
+                               &error),
+            0)
+      << error.message;
+  stream.release(&stream);
+  EXPECT_EQ(rows_inserted, 6);
+  EXPECT_TRUE(sqlite3_get_autocommit(con.ptr));
+
+  sqlite3_stmt* stmt;
+  ASSERT_EQ(sqlite3_prepare_v2(con.ptr,
+                               "SELECT i, u, d, s, hex(b), typeof(u) FROM ingested "
+                               "ORDER BY rowid",
+                               -1, &stmt, nullptr),
+            SQLITE_OK);
+  std::vector<std::string> rows;
+  while (sqlite3_step(stmt) == SQLITE_ROW) {
+    std::string row;
+    for (int i = 0; i < 6; i++) {
+      const unsigned char* value = sqlite3_column_text(stmt, i);
+      row += value == nullptr ? "NULL" : reinterpret_cast<const char*>(value);
+      row += i < 5 ? "|" : "";
+    }
+
+    rows.push_back(row);
+  }
+
+  sqlite3_finalize(stmt);
+  std::vector<std::string> expected = {"1|1|0.5|one|01|integer",
+                                       "2|2|1.5|two|02|integer",
+                                       "3|3|2.5|three|03|integer",
+                                       "2|2|1.5|two|02|integer",
+                                       "3|3|2.5|three|03|integer",
+                                       "NULL|1.84467440737096e+19|3.5|NULL|04|real"};
+  EXPECT_EQ(rows, expected);
+
+  // Errors roll back the transaction in progress
+  con.exec("DELETE FROM ingested");
+  con.exec("CREATE UNIQUE INDEX ingested_i ON ingested (i)");
+  reader = RecordBatchReader::Make({batch, batch}).ValueOrDie();
+  ASSERT_ARROW_OK(ExportRecordBatchReader(reader, &stream));
+  options.rows_per_transaction = 0;
+  EXPECT_EQ(ArrowSQLite3Ingest(con.ptr, "ingested", &stream, &options, &rows_inserted,
+                               &error),
+            EIO);
+  stream.release(&stream);
+  EXPECT_EQ(rows_inserted, 0);
+  EXPECT_TRUE(sqlite3_get_autocommit(con.ptr));
+  EXPECT_EQ(std::string(error.message).find("<constraint failed>"), 0);
+
+  // Nested columns can't be bound
+  auto list_batch = RecordBatch::Make(
+      arrow::schema({field("l", list(int32()))}), 0,
+      {MakeArrayOfNull(list(int32()), 0).ValueOrDie()});
+  reader = RecordBatchReader::Make({list_batch}).ValueOrDie();
+  ASSERT_ARROW_OK(ExportRecordBatchReader(reader, &stream));
+  EXPECT_EQ(ArrowSQLite3Ingest(con.ptr, "ingested", &stream, nullptr, nullptr, &error),
+            ENOTSUP);
+  stream.release(&stream);
+  EXPECT_STREQ(error.message, "Can't ingest column 'l' with format '+l'");
+
+  // A stream without an error message
+  struct ArrowArrayStream failing;
+  failing.get_schema = [](struct ArrowArrayStream*, struct ArrowSchema*) { return EIO; };
+  failing.get_last_error = [](struct ArrowArrayStream*) -> const char* {
+    return nullptr;
+  };
+  failing.release = [](struct ArrowArrayStream* stream) { stream->release = nullptr; };
+  EXPECT_EQ(ArrowSQLite3Ingest(con.ptr, "ingested", &failing, nullptr, nullptr, &error),
+            EIO);
+  failing.release(&failing);
+  EXPECT_EQ(std::string(error.message),
+            std::string("get_schema() failed: ") + strerror(EIO));
 }